@@ -48,10 +48,14 @@ function [txNL23W, info] = EBT(species, tT, tJX, x_0, V_X, h, t_max, numPar)
 %    	- DOPRI5: an explicit Runge-Kutta method of order (4)5 due to Dormand & Prince with step size control and dense output.
 %   	- DOPRI8: an explicit Runge-Kutta method of order 8(5,3) due to Dormand & Prince with step size control and dense output.
 %   	- RADAU5: an implicit Runge-Kutta method of order 5 with step size  control and dense output.
+%   	- CVODE: the variable-order Adams methods (order 1 to 12) of CVODE with step size control and dense output.
+%   	- CVBDF: the variable-order BDF methods (order 1 to 5) of CVODE for stiff problems.
 %
-%     The DOPRI5, DOPRI8 and RADAU5 methods can detect and locate discontinuities or events. 
+%     The DOPRI5, DOPRI8, RADAU5, CVODE and CVBDF methods can detect and locate discontinuities or events. 
 %     These events are signalled by the routine	EventLocation() in the program definition file. 
 %     Integration will be carried out exactly up to the moment that the event takes place and will be restarted subsequently.
+%     The implicit methods RADAU5 and CVBDF use the analytic Jacobian() in the program definition file (std model),
+%       or else Jacobian blocks by automatic differentiation (fns/ebtad.cpp, requires g++).
 %     Default: DOPRI5
 %
 % Output:
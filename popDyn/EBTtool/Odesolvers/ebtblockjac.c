@@ -0,0 +1,555 @@
+/***
+   NAME
+     ebtblockjac
+   DESCRIPTION
+     This file contains the routines to compute, factorize and solve with
+     a Jacobian matrix that exploits the structure of the system of ODEs in
+     the Escalator Boxcar Train program. It is included by the implicit
+     integration methods (RADAU5 and CVBDF) when BLOCK_JACOBIAN equals 1 and
+     relies on their own implementations of the routines dec() and sol()
+     and, for RADAU5 only, of decc() and solc().
+
+     In physiologically structured population models the cohorts in general
+     only interact through the environmental variables and the boundary
+     cohorts. The state variables are therefore divided into a border,
+     consisting of the environmental variables and all boundary cohorts, and
+     a set of blocks of size COHORT_SIZE, one for each internal cohort. The
+     Jacobian then has the arrowhead structure
+
+			| A  B |
+		J =	|      |
+			| C  D |
+
+     with A the (small) dense matrix of the border with respect to itself,
+     B the derivatives of the border with respect to the cohort states, C
+     the derivatives of the cohort states with respect to the border and D a
+     block-diagonal matrix with blocks of size COHORT_SIZE.
+
+     The columns of A and C require one evaluation of Gradient() per border
+     variable. The diagonal blocks in D could be computed simultaneously by
+     perturbing the same component in all cohorts at once (column
+     compression), but every row of B depends on all cohorts and such
+     compressed evaluations can not separate their contributions. When the
+     Jacobian is approximated by finite differences the cohort states are
+     therefore perturbed one at a time, which yields the columns of D and B
+     together. This takes one evaluation of Gradient() per state variable,
+     as for the dense Jacobian, but the factorization and the solution of
+     the linear systems remain cheap (see below).
+
+     The linear systems (fac*I - J) x = r are solved with the Schur
+     complement of the border:
+
+		S = (fac*I - A) - B (fac*I - D)^(-1) C
+
+     which only requires the factorization of the separate diagonal blocks
+     and of S. The costs of the factorization and the solution and the
+     memory requirements hence scale linearly with the number of cohorts,
+     instead of cubically and quadratically, respectively, for the dense
+     Jacobian.
+
+     If the problem file supplies the routine Jacobian() (JACOBIAN equals 1)
+     the diagonal blocks and the derivatives of the environmental variables
+     with respect to the individual cohort states (the corresponding rows of
+     B) are computed analytically, which yields the exact iteration matrix
+     apart from the dependence of the boundary cohorts on the internal
+     cohorts. Only the border columns are then approximated by finite
+     differences.
+
+     If JACOBIAN equals 2 the diagonal blocks and the same rows of B are
+     computed by automatic differentiation of the routine Gradient() (see
+     fns/ebtad.cpp), with one evaluation per cohort.
+
+     The calling routine describes the layout of the state vector by setting
+     the indices of the border variables in BJbidx[] and the index of the
+     first variable of every cohort block in BJblk[], after calling
+     BlockJacSetup(). The first ENVIRON_DIM border variables should be the
+     environmental variables.
+
+   Last modification: Oct 17, 2026
+***/
+#ifndef EBTBLOCKJAC
+#define EBTBLOCKJAC
+#endif
+
+
+/*==========================================================================*/
+/*
+ * Definitions of static variables, restricted to this file.
+ */
+
+static EBTSTATE int	BJnb = 0, BJnblk = 0, BJnp = 0;	/* Border, blocks, rows     */
+static EBTSTATE long	BJAllocated = 0L, BJBorderAllocated = 0L;
+
+static EBTSTATE int	*BJbidx = NULL, *BJblk  = NULL;	/* Layout of state vector   */
+
+static EBTSTATE double	*BJA    = NULL, *BJB    = NULL;	/* Jacobian blocks	    */
+static EBTSTATE double	*BJC    = NULL, *BJD    = NULL;
+
+static EBTSTATE double	*BJF1   = NULL, *BJX1   = NULL;	/* Real factorization	    */
+static EBTSTATE double	*BJS1   = NULL;
+static EBTSTATE int	*BJip1  = NULL, *BJipS1 = NULL;
+
+static EBTSTATE double	*BJF2R  = NULL, *BJF2I  = NULL;	/* Complex factorization    */
+static EBTSTATE double	*BJX2R  = NULL, *BJX2I  = NULL;
+static EBTSTATE double	*BJS2R  = NULL, *BJS2I  = NULL;
+static EBTSTATE int	*BJip2  = NULL, *BJipS2 = NULL;
+
+static EBTSTATE double	*BJtmp  = NULL, *BJtmpi = NULL;	/* Work space		    */
+static EBTSTATE double	*BJdedx = NULL;
+
+
+/*==========================================================================*/
+/*
+ * Prototypes of the linear algebra routines in the including file.
+ */
+
+static int 	dec(int dimM, double *M, int *perm, int *sign);
+static void 	sol(int dimM, double *M, double *V, int *perm);
+#if (TIME_METHOD == RADAU5)
+static int 	decc(int dimM, double *MR, double *MI, int *perm, int *sign);
+static void 	solc(int dimM, double *MR, double *MI, double *VR, double *VI,
+		     int *perm);
+#endif
+
+
+/*==========================================================================*/
+/*
+ * Start of function implementations.
+ */
+/*==========================================================================*/
+
+static void	BlockJacSetup(int nb, int nblk)
+
+  /*
+   * BlockJacSetup - Allocates the memory for the structured Jacobian with
+   *		     nb border variables and nblk cohort blocks. The routine
+   *		     is called at the beginning of every cohort cycle, after
+   *		     which the calling routine sets up BJbidx[] and BJblk[].
+   */
+
+{
+  int			newborder;
+  long			np, nbmax;
+
+  BJnb   = nb;
+  BJnblk = nblk;
+  BJnp   = nblk*COHORT_SIZE;
+
+  if (!BJdedx)
+    {
+      BJdedx = (double *)Myalloc((void *)BJdedx,
+				 (size_t)imax(ENVIRON_DIM*COHORT_SIZE, 1),
+				 sizeof(double));
+      if (!BJdedx) ErrorAbort(MAFO);
+    }
+
+  nbmax = imax(nb, COHORT_SIZE);
+  newborder = !(nbmax < BJBorderAllocated);
+  if (newborder)
+    {
+      BJBorderAllocated = MemBlocks(nbmax);
+      BJbidx = (int *)   Myalloc((void *)BJbidx, (size_t)BJBorderAllocated,
+				 sizeof(int));
+      BJA    = (double *)Myalloc((void *)BJA,
+				 (size_t)(BJBorderAllocated*BJBorderAllocated),
+				 sizeof(double));
+      BJS1   = (double *)Myalloc((void *)BJS1,
+				 (size_t)(BJBorderAllocated*BJBorderAllocated),
+				 sizeof(double));
+      BJS2R  = (double *)Myalloc((void *)BJS2R,
+				 (size_t)(BJBorderAllocated*BJBorderAllocated),
+				 sizeof(double));
+      BJS2I  = (double *)Myalloc((void *)BJS2I,
+				 (size_t)(BJBorderAllocated*BJBorderAllocated),
+				 sizeof(double));
+      BJipS1 = (int *)   Myalloc((void *)BJipS1, (size_t)BJBorderAllocated,
+				 sizeof(int));
+      BJipS2 = (int *)   Myalloc((void *)BJipS2, (size_t)BJBorderAllocated,
+				 sizeof(int));
+      BJtmp  = (double *)Myalloc((void *)BJtmp, (size_t)BJBorderAllocated,
+				 sizeof(double));
+      BJtmpi = (double *)Myalloc((void *)BJtmpi, (size_t)BJBorderAllocated,
+				 sizeof(double));
+      if (!(BJbidx && BJA && BJS1 && BJS2R && BJS2I && BJipS1 && BJipS2 &&
+	    BJtmp && BJtmpi))
+	ErrorAbort(MAFO);
+    }
+
+  np = imax(BJnp, 1);
+  if (newborder || !(np < BJAllocated))
+    {
+      if (!(np < BJAllocated)) BJAllocated = MemBlocks(np);
+      BJblk  = (int *)   Myalloc((void *)BJblk, (size_t)BJAllocated,
+				 sizeof(int));
+      BJB    = (double *)Myalloc((void *)BJB,
+				 (size_t)(BJAllocated*BJBorderAllocated),
+				 sizeof(double));
+      BJC    = (double *)Myalloc((void *)BJC,
+				 (size_t)(BJAllocated*BJBorderAllocated),
+				 sizeof(double));
+      BJD    = (double *)Myalloc((void *)BJD,
+				 (size_t)(BJAllocated*COHORT_SIZE),
+				 sizeof(double));
+      BJF1   = (double *)Myalloc((void *)BJF1,
+				 (size_t)(BJAllocated*COHORT_SIZE),
+				 sizeof(double));
+      BJX1   = (double *)Myalloc((void *)BJX1,
+				 (size_t)(BJAllocated*BJBorderAllocated),
+				 sizeof(double));
+      BJip1  = (int *)   Myalloc((void *)BJip1, (size_t)BJAllocated,
+				 sizeof(int));
+      BJF2R  = (double *)Myalloc((void *)BJF2R,
+				 (size_t)(BJAllocated*COHORT_SIZE),
+				 sizeof(double));
+      BJF2I  = (double *)Myalloc((void *)BJF2I,
+				 (size_t)(BJAllocated*COHORT_SIZE),
+				 sizeof(double));
+      BJX2R  = (double *)Myalloc((void *)BJX2R,
+				 (size_t)(BJAllocated*BJBorderAllocated),
+				 sizeof(double));
+      BJX2I  = (double *)Myalloc((void *)BJX2I,
+				 (size_t)(BJAllocated*BJBorderAllocated),
+				 sizeof(double));
+      BJip2  = (int *)   Myalloc((void *)BJip2, (size_t)BJAllocated,
+				 sizeof(int));
+      if (!(BJblk && BJB && BJC && BJD && BJF1 && BJX1 && BJip1 && BJF2R &&
+	    BJF2I && BJX2R && BJX2I && BJip2))
+	ErrorAbort(MAFO);
+    }
+
+  return;
+}
+
+
+
+
+/*==========================================================================*/
+
+static void	BlockJacobian(double *yy, double *f0, double *fpert,
+			      void (*deriv)(double *),
+			      void (*cohjac)(int, double *, double *))
+
+  /*
+   * BlockJacobian - Computes the structured Jacobian by finite differences.
+   *		     On entry yy[] contains the current state and f0[] its
+   *		     derivatives. The routine deriv() evaluates the
+   *		     derivatives in yy[] and stores them in its argument.
+   *		     The state yy[] is perturbed in place and restored on exit.
+   *		     If cohjac() is not NULL it is used to compute the
+   *		     diagonal block of cohort b and the derivatives of the
+   *		     environmental variables with respect to its state.
+   *		     Otherwise the cohort states are perturbed one at a time
+   *		     (see DESCRIPTION).
+   */
+
+{
+  register int		b, c, i, k;
+  int			ind;
+  double		ysafe, delt;
+
+  if (cohjac)					/* Analytical blocks	    */
+    {
+      (void)memset((DEF_TYPE *)BJB, 0, (size_t)(BJnb*BJnp*sizeof(double)));
+      (void)memset((DEF_TYPE *)BJD, 0,
+		   (size_t)(BJnp*COHORT_SIZE*sizeof(double)));
+      for (b = 0; b < BJnblk; b++)
+	{
+	  (void)memset((DEF_TYPE *)BJdedx, 0,
+		       (size_t)(ENVIRON_DIM*COHORT_SIZE*sizeof(double)));
+	  cohjac(b, BJD+b*COHORT_SIZE*COHORT_SIZE, BJdedx);
+	  for (i = 0; i < ENVIRON_DIM; i++)
+	    for (k = 0; k < COHORT_SIZE; k++)
+	      BJB[i*BJnp+b*COHORT_SIZE+k] = BJdedx[i*COHORT_SIZE+k];
+	}
+    }
+  else
+    {
+      for (b = 0; b < BJnblk; b++)		/* Perturb component k of   */
+	for (k = 0; k < COHORT_SIZE; k++)	/* cohort b: column of D    */
+	  {					/* and B		    */
+	    ind     = BJblk[b] + k;
+	    ysafe   = yy[ind];
+	    delt    = sqrt(UROUND * max(JACSTEP, fabs(ysafe)));
+	    yy[ind] = ysafe + delt;
+	    deriv(fpert);
+	    for (i = 0; i < COHORT_SIZE; i++)
+	      BJD[(b*COHORT_SIZE+i)*COHORT_SIZE+k] =
+		(fpert[BJblk[b]+i] - f0[BJblk[b]+i]) / delt;
+	    for (i = 0; i < BJnb; i++)
+	      BJB[i*BJnp+b*COHORT_SIZE+k] =
+		(fpert[BJbidx[i]] - f0[BJbidx[i]]) / delt;
+	    yy[ind] = ysafe;
+	  }
+    }
+
+  for (c = 0; c < BJnb; c++)			/* Border columns	    */
+    {
+      ind     = BJbidx[c];
+      ysafe   = yy[ind];
+      delt    = sqrt(UROUND * max(JACSTEP, fabs(ysafe)));
+      yy[ind] = ysafe + delt;
+      deriv(fpert);
+      for (i = 0; i < BJnb; i++)
+	BJA[i*BJnb+c] = (fpert[BJbidx[i]] - f0[BJbidx[i]]) / delt;
+      for (b = 0; b < BJnblk; b++)
+	for (i = 0; i < COHORT_SIZE; i++)
+	  BJC[(b*COHORT_SIZE+i)*BJnb+c] =
+	    (fpert[BJblk[b]+i] - f0[BJblk[b]+i]) / delt;
+      yy[ind] = ysafe;
+    }
+
+  return;
+}
+
+
+
+
+/*==========================================================================*/
+
+static int	BlockDec(double fac, int *daes)
+
+  /*
+   * BlockDec - Factorizes the real matrix fac*I - J. If daes is not NULL,
+   *	        fac is not added to the diagonal for the algebraic equations
+   *	        flagged in daes[]. Returns 1 if the matrix is singular.
+   */
+
+{
+  register int		b, c, i, k;
+  int			sign, ind;
+  double		*F, *X, sum;
+
+  for (b = 0; b < BJnblk; b++)			/* Diagonal blocks	    */
+    {
+      ind = BJblk[b];
+      F   = BJF1 + b*COHORT_SIZE*COHORT_SIZE;
+      for (i = 0; i < COHORT_SIZE*COHORT_SIZE; i++)
+	F[i] = -BJD[b*COHORT_SIZE*COHORT_SIZE+i];
+      for (i = 0; i < COHORT_SIZE; i++)
+	if (!(daes && daes[ind+i])) F[i*COHORT_SIZE+i] += fac;
+      if (dec(COHORT_SIZE, F, BJip1+b*COHORT_SIZE, &sign)) return 1;
+
+      X = BJX1 + b*COHORT_SIZE*BJnb;		/* X = (fac*I - D)^-1 (-C)  */
+      for (c = 0; c < BJnb; c++)
+	{
+	  for (i = 0; i < COHORT_SIZE; i++)
+	    BJtmp[i] = -BJC[(b*COHORT_SIZE+i)*BJnb+c];
+	  sol(COHORT_SIZE, F, BJtmp, BJip1+b*COHORT_SIZE);
+	  for (i = 0; i < COHORT_SIZE; i++) X[i*BJnb+c] = BJtmp[i];
+	}
+    }
+
+  for (i = 0; i < BJnb*BJnb; i++) BJS1[i] = -BJA[i];
+  for (i = 0; i < BJnb; i++)
+    if (!(daes && daes[BJbidx[i]])) BJS1[i*BJnb+i] += fac;
+
+  for (i = 0; i < BJnb; i++)			/* S = (fac*I-A) - (-B) X   */
+    for (c = 0; c < BJnb; c++)
+      {
+	for (k = 0, sum = 0.0; k < BJnp; k++)
+	  sum += BJB[i*BJnp+k]*BJX1[k*BJnb+c];
+	BJS1[i*BJnb+c] += sum;
+      }
+
+  return dec(BJnb, BJS1, BJipS1, &sign);
+}
+
+
+
+
+/*==========================================================================*/
+
+static void	BlockSol(double *V)
+
+  /*
+   * BlockSol - Solves (fac*I - J) x = V, using the factorization computed
+   *	        by BlockDec(). On exit V contains the solution.
+   */
+
+{
+  register int		b, c, i, k;
+  int			ind;
+  double		*X, sum;
+
+  for (b = 0; b < BJnblk; b++)			/* t = (fac*I - D)^-1 V_p   */
+    sol(COHORT_SIZE, BJF1+b*COHORT_SIZE*COHORT_SIZE, V+BJblk[b],
+	BJip1+b*COHORT_SIZE);
+
+  for (i = 0; i < BJnb; i++) BJtmp[i] = V[BJbidx[i]];
+  for (i = 0; i < BJnb; i++)			/* V_b - (-B) t		    */
+    {
+      for (b = 0, sum = 0.0; b < BJnblk; b++)
+	for (k = 0; k < COHORT_SIZE; k++)
+	  sum += BJB[i*BJnp+b*COHORT_SIZE+k]*V[BJblk[b]+k];
+      BJtmp[i] += sum;
+    }
+  sol(BJnb, BJS1, BJtmp, BJipS1);		/* Border solution	    */
+  for (i = 0; i < BJnb; i++) V[BJbidx[i]] = BJtmp[i];
+
+  for (b = 0; b < BJnblk; b++)			/* x_p = t - X x_b	    */
+    {
+      ind = BJblk[b];
+      X   = BJX1 + b*COHORT_SIZE*BJnb;
+      for (i = 0; i < COHORT_SIZE; i++)
+	{
+	  for (c = 0, sum = 0.0; c < BJnb; c++) sum += X[i*BJnb+c]*BJtmp[c];
+	  V[ind+i] -= sum;
+	}
+    }
+
+  return;
+}
+
+
+
+
+#if (TIME_METHOD == RADAU5)
+/*==========================================================================*/
+
+static int	BlockDecc(double alphn, double betan, int *daes)
+
+  /*
+   * BlockDecc - Factorizes the complex matrix (alphn + i betan)*I - J. If
+   *	         daes is not NULL, the shift is not added to the diagonal for
+   *	         the algebraic equations flagged in daes[]. Returns 1 if the
+   *	         matrix is singular.
+   */
+
+{
+  register int		b, c, i, k;
+  int			sign, ind;
+  double		*FR, *FI, *XR, *XI, sumr, sumi;
+
+  for (b = 0; b < BJnblk; b++)			/* Diagonal blocks	    */
+    {
+      ind = BJblk[b];
+      FR  = BJF2R + b*COHORT_SIZE*COHORT_SIZE;
+      FI  = BJF2I + b*COHORT_SIZE*COHORT_SIZE;
+      for (i = 0; i < COHORT_SIZE*COHORT_SIZE; i++)
+	{
+	  FR[i] = -BJD[b*COHORT_SIZE*COHORT_SIZE+i];
+	  FI[i] = 0.0;
+	}
+      for (i = 0; i < COHORT_SIZE; i++)
+	if (!(daes && daes[ind+i]))
+	  {
+	    FR[i*COHORT_SIZE+i] += alphn;
+	    FI[i*COHORT_SIZE+i] += betan;
+	  }
+      if (decc(COHORT_SIZE, FR, FI, BJip2+b*COHORT_SIZE, &sign)) return 1;
+
+      XR = BJX2R + b*COHORT_SIZE*BJnb;
+      XI = BJX2I + b*COHORT_SIZE*BJnb;
+      for (c = 0; c < BJnb; c++)
+	{
+	  for (i = 0; i < COHORT_SIZE; i++)
+	    {
+	      BJtmp[i]  = -BJC[(b*COHORT_SIZE+i)*BJnb+c];
+	      BJtmpi[i] = 0.0;
+	    }
+	  solc(COHORT_SIZE, FR, FI, BJtmp, BJtmpi, BJip2+b*COHORT_SIZE);
+	  for (i = 0; i < COHORT_SIZE; i++)
+	    {
+	      XR[i*BJnb+c] = BJtmp[i];
+	      XI[i*BJnb+c] = BJtmpi[i];
+	    }
+	}
+    }
+
+  for (i = 0; i < BJnb*BJnb; i++)
+    {
+      BJS2R[i] = -BJA[i];
+      BJS2I[i] = 0.0;
+    }
+  for (i = 0; i < BJnb; i++)
+    if (!(daes && daes[BJbidx[i]]))
+      {
+	BJS2R[i*BJnb+i] += alphn;
+	BJS2I[i*BJnb+i] += betan;
+      }
+
+  for (i = 0; i < BJnb; i++)
+    for (c = 0; c < BJnb; c++)
+      {
+	for (k = 0, sumr = sumi = 0.0; k < BJnp; k++)
+	  {
+	    sumr += BJB[i*BJnp+k]*BJX2R[k*BJnb+c];
+	    sumi += BJB[i*BJnp+k]*BJX2I[k*BJnb+c];
+	  }
+	BJS2R[i*BJnb+c] += sumr;
+	BJS2I[i*BJnb+c] += sumi;
+      }
+
+  return decc(BJnb, BJS2R, BJS2I, BJipS2, &sign);
+}
+
+
+
+
+/*==========================================================================*/
+
+static void	BlockSolc(double *VR, double *VI)
+
+  /*
+   * BlockSolc - Solves ((alphn + i betan)*I - J) x = V, using the
+   *	         factorization computed by BlockDecc(). On exit VR and VI
+   *	         contain the real and imaginary part of the solution.
+   */
+
+{
+  register int		b, c, i, k;
+  int			ind;
+  double		*XR, *XI, sumr, sumi;
+
+  for (b = 0; b < BJnblk; b++)
+    solc(COHORT_SIZE, BJF2R+b*COHORT_SIZE*COHORT_SIZE,
+	 BJF2I+b*COHORT_SIZE*COHORT_SIZE, VR+BJblk[b], VI+BJblk[b],
+	 BJip2+b*COHORT_SIZE);
+
+  for (i = 0; i < BJnb; i++)
+    {
+      BJtmp[i]  = VR[BJbidx[i]];
+      BJtmpi[i] = VI[BJbidx[i]];
+    }
+  for (i = 0; i < BJnb; i++)
+    {
+      for (b = 0, sumr = sumi = 0.0; b < BJnblk; b++)
+	for (k = 0; k < COHORT_SIZE; k++)
+	  {
+	    sumr += BJB[i*BJnp+b*COHORT_SIZE+k]*VR[BJblk[b]+k];
+	    sumi += BJB[i*BJnp+b*COHORT_SIZE+k]*VI[BJblk[b]+k];
+	  }
+      BJtmp[i]  += sumr;
+      BJtmpi[i] += sumi;
+    }
+  solc(BJnb, BJS2R, BJS2I, BJtmp, BJtmpi, BJipS2);
+  for (i = 0; i < BJnb; i++)
+    {
+      VR[BJbidx[i]] = BJtmp[i];
+      VI[BJbidx[i]] = BJtmpi[i];
+    }
+
+  for (b = 0; b < BJnblk; b++)
+    {
+      ind = BJblk[b];
+      XR  = BJX2R + b*COHORT_SIZE*BJnb;
+      XI  = BJX2I + b*COHORT_SIZE*BJnb;
+      for (i = 0; i < COHORT_SIZE; i++)
+	{
+	  for (c = 0, sumr = sumi = 0.0; c < BJnb; c++)
+	    {
+	      sumr += XR[i*BJnb+c]*BJtmp[c] - XI[i*BJnb+c]*BJtmpi[c];
+	      sumi += XR[i*BJnb+c]*BJtmpi[c] + XI[i*BJnb+c]*BJtmp[c];
+	    }
+	  VR[ind+i] -= sumr;
+	  VI[ind+i] -= sumi;
+	}
+    }
+
+  return;
+}
+
+
+
+/*==========================================================================*/
+#endif // (TIME_METHOD == RADAU5)
@@ -0,0 +1,1959 @@
+/***
+   NAME
+     ebtcvode
+   DESCRIPTION
+     This file contains the specification of variable-order, variable-step
+     linear multistep methods with error control and dense output for the
+     actual time integration of the ODEs in the Escalator Boxcar Train
+     program. Dependent on the value of TIME_METHOD the file implements:
+
+	CVODE : Adams-Moulton methods of order 1 to 12, with fixed-point
+		(functional) iteration of the corrector. Suited for non-stiff
+		problems.
+	CVBDF : Backward differentiation formulas of order 1 to 5, with a
+		modified Newton iteration of the corrector, using a dense
+		difference-quotient approximation of the Jacobian. Suited for
+		stiff problems.
+
+     The solution history is kept in Nordsieck form. Step size and order
+     selection, the coefficients for variable step sizes and the convergence
+     and error tests follow the CVODE package, described in:
+
+		S.D. Cohen & A.C. Hindmarsh (1996), CVODE, a stiff/nonstiff ODE
+		solver in C. Computers in Physics 10: 138-143.
+
+		A.C. Hindmarsh et al. (2005), SUNDIALS: Suite of nonlinear and
+		differential/algebraic equation solvers. ACM Transactions on
+		Mathematical Software 31: 363-396.
+
+     The code does not depend on the SUNDIALS libraries. The Nordsieck array
+     defines an interpolating polynomial over the last step, which is used for
+     event location and intermediate output in the same way as the continuous
+     output of the DOPRI5 and RADAU5 methods. As the system of ODEs changes at
+     every cohort closure, the integration restarts at order 1 at the
+     beginning of every cohort cycle. For the same reason the method is
+     restarted after every located event, as the derivatives are usually
+     discontinuous at events.
+
+     The Newton iteration of the corrector may fail to converge on a step
+     across a discontinuity in the derivatives, such as a maturation
+     threshold. Like every other convergence failure, the step is then
+     rejected. If the predicted state crosses an event, the step size is
+     reduced to end just beyond the earliest crossing, such that the event
+     is stepped over with a short step and located as usual.
+
+     CVBDF only pays off for stiff problems. On non-stiff problems it needs
+     far more time than DOPRI5 for the same results, as every step solves
+     the corrector equation and the Jacobian is re-evaluated at every cohort
+     cycle. For the standard DEB model (deb/EBTstd.c) it takes minutes where
+     DOPRI5 takes seconds.
+
+   Last modification: Oct 17, 2026
+***/
+#ifndef EBTCVODE
+#define EBTCVODE
+#endif
+
+#if ((TIME_METHOD == CVBDF) && (BLOCK_JACOBIAN != 1))
+#warning CVBDF with a dense finite-difference Jacobian is very slow for cohort systems, use BLOCK_JACOBIAN or JACOBIAN
+#endif
+
+
+
+/*==========================================================================*/
+/*
+ * Defining all constants that are local to this specific file.
+ */
+/*==========================================================================*/
+/*
+ * Return codes
+ */
+#define SUCCESS		0
+#define CONV_FAIL	10201
+#define TRY_AGAIN	10202
+
+#define FIRST_CALL	10211
+#define PREV_CONV_FAIL	10212
+#define PREV_ERR_FAIL	10213
+
+#define NO_FAILURES	10221
+#define FAIL_BAD_J	10222
+#define FAIL_OTHER	10223
+
+/*
+ * Constants in method
+ */
+#if (TIME_METHOD == CVBDF)
+#define QMAX		5		/* Maximum order of the BDF method	    */
+#else
+#define QMAX		12		/* Maximum order of the Adams method	    */
+#endif
+#define L_MAX		(QMAX+1)	/* Number of columns of Nordsieck array	    */
+
+#define NLSCOEF		0.1		/* Coefficient in convergence test	    */
+#define MAXCOR		3		/* Maximum number of corrector iterations   */
+#define CRDOWN		0.3		/* Decay constant of the convergence rate   */
+#define RDIV		2.0		/* Declare divergence if ratio del/delp >   */
+#define DGMAX		0.3		/* Update iteration matrix if gamma changes */
+#define MSBP		20		/* Max. steps between matrix updates	    */
+#define MSBJ		50		/* Max. steps between Jacobian evaluations  */
+#define MXNEF1		3		/* Error test failures before order change  */
+#define SMALL_NEF	2		/* Error test failures limiting increase    */
+#define SMALL_NST	10		/* Number of steps with larger increases    */
+#define LONG_WAIT	10		/* Steps before order change after restart  */
+
+#define ETAMX1		10000.0		/* Max. step size increase after 1st step   */
+#define ETAMX2		10.0		/* Max. increase during first SMALL_NST     */
+#define ETAMX3		10.0		/* Max. increase in later steps		    */
+#define ETAMXF		0.2		/* Max. increase after SMALL_NEF failures   */
+#define ETAMIN		0.1		/* Min. decrease after error test failure   */
+#define ETACF		0.25		/* Decrease after convergence failure	    */
+#define THRESH		1.5		/* Only change step size if increase > 1.5  */
+#define BIAS1		6.0		/* Safety factors in step size selection    */
+#define BIAS2		6.0		/* for order q-1, q and q+1		    */
+#define BIAS3		10.0
+#define ADDON		1.0E-6
+
+#define UROUND		1.0E-16		/* Smallest value satisfying 1.0+UROUND>1.0 */
+#define JACSTEP		1.0E-5		/* Step size for Jacobian computation	    */
+#define ABS_ERR		1.0E-13
+
+
+
+/*==========================================================================*/
+/*
+ * The error messages that occur in the routines in the present file.
+ */
+
+#define MAFO "Memory allocation failure in ODE integration routine!"
+#define REC  "Too many recursions in integration to find suitable stepsize!"
+#define SSS  "Step size in integration routine too small!"
+#define ZBB  "Root is not bracketed in ZBRENT!"
+#define ZBM  "Maximum number of iterations exceeded in ZBRENT!"
+
+
+/*==========================================================================*/
+/*
+ * Definitions of static variables, restricted to this file.
+ */
+
+static EBTSTATE int	recur_no;
+static EBTSTATE long	ODEAllocated = 0L, SystemSize;
+
+static EBTSTATE double	*zn[L_MAX];			/* Nordsieck array	    */
+static EBTSTATE double	*yy1    = NULL, *yco    = NULL, *ewt    = NULL;
+static EBTSTATE double	*acor   = NULL, *tempv  = NULL, *ftemp  = NULL;
+#if (TIME_METHOD == CVBDF)
+#if (BLOCK_JACOBIAN == 1)
+#include "ebtblockjac.c"
+#else
+static EBTSTATE long	JacobianSize;
+static EBTSTATE double	*Jac    = NULL, *Mat    = NULL;
+static EBTSTATE int	*ipiv   = NULL;
+
+static int 		dec(int, double *, int *, int *);
+static void 		sol(int, double *, double *, int *);
+#endif
+#endif
+
+#if (POPULATION_NR > 0)
+static EBTSTATE population	u_pop[POPULATION_NR], 	   u_ofs[POPULATION_NR];
+static EBTSTATE population	c_pop[POPULATION_NR],	   c_ofs[POPULATION_NR];
+static EBTSTATE population	u_popgradf[POPULATION_NR], u_ofsgradf[POPULATION_NR];
+static EBTSTATE population	u_popgradt[POPULATION_NR], u_ofsgradt[POPULATION_NR];
+static EBTSTATE int	table_size[POPULATION_NR];
+#else
+static EBTSTATE population	*bpoints = NULL;
+static EBTSTATE population	*u_pop = NULL, 	    *u_ofs = NULL;
+static EBTSTATE population	*c_pop = NULL,	    *c_ofs = NULL;
+static EBTSTATE population	*u_popgradf = NULL, *u_ofsgradf = NULL;
+static EBTSTATE population	*u_popgradt = NULL, *u_ofsgradt = NULL;
+#endif // (POPULATION_NR > 0)
+
+static EBTSTATE int	q, qprime, qwait, L;		/* Order and its control    */
+static EBTSTATE double	h, hprime, hscale, eta, etamax;	/* Step size and control    */
+static EBTSTATE double	l[L_MAX], tq[6], tau[L_MAX+1];	/* Method coefficients	    */
+static EBTSTATE double	rl1, gam, gamp, gamrat;
+static EBTSTATE double	crate, acnrm, saved_tq5;
+static EBTSTATE long	nst = 0L, nstlp = 0L;		/* Steps in current cycle   */
+static EBTSTATE int	nflag;				/* Outcome of last attempt  */
+static EBTSTATE int	restart = 0;			/* Restart after event	    */
+static EBTSTATE long	nfcn = 0L, nsetups = 0L, netf = 0L, ncfn = 0L;
+#if (TIME_METHOD == CVBDF)
+static EBTSTATE long	nstlj = 0L, nje = 0L;
+static EBTSTATE int	jcur = 0;
+#endif
+#if (EVENT_NR > 0)
+static EBTSTATE double	oldELvalue[EVENT_NR] = {0.0},
+			newELvalue[EVENT_NR] = {0.0};
+static EBTSTATE int	located[EVENT_NR] = {0};
+#endif
+
+
+/*==========================================================================*/
+/*
+ * Start of function implementations.
+ */
+/*==========================================================================*/
+
+static void	RestartMethod(void)
+
+  /*
+   * RestartMethod - Discards the solution history, such that the next step
+   *		     restarts the method at order 1. The first column of the
+   *		     Nordsieck array is only known once the first step size
+   *		     has been selected.
+   */
+
+{
+  register int		i;
+
+  nst = nstlp = 0L;
+#if (TIME_METHOD == CVBDF)
+  nstlj = 0L;
+  jcur  = 0;
+#endif
+  q = qprime = 1;
+  L = 2;
+  qwait = L;
+  etamax = ETAMX1;
+  saved_tq5 = 0.0;
+  for (i=0; i<=L_MAX; i++) tau[i] = 0.0;
+  for (i=0; i<6; i++) tq[i] = 0.0;
+  restart = 0;
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+
+void	PrepareCycle()
+
+  /*
+   * PrepareCycle - This routine is called at the beginning of a cohort
+   *		    cycle, when the size of the system of ODEs is fixed and
+   *		    will not change until the end of the cohort cycle has
+   *		    been reached. The different memory copies of the data
+   *		    to be integrated and the pointers into the data heap
+   *		    can hence safely be set up. The Nordsieck array is
+   *		    reinitialized, such that integration restarts at order 1.
+   */
+
+{
+  register int		i;
+
+  SystemSize = ENVIRON_DIM;
+#if (POPULATION_NR > 0)
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      table_size[i] = CohortNo[i]+BpointNo[i];
+      SystemSize   += table_size[i]*COHORT_SIZE;
+    }
+#endif // (POPULATION_NR > 0)
+
+  if (!(SystemSize < ODEAllocated) || MemExcess(SystemSize, ODEAllocated))
+    {
+      ODEAllocated = MemBlocks(SystemSize);
+      for (i=0; i<L_MAX; i++)
+	{
+	  zn[i] = (double *)Myalloc((void *)zn[i], (size_t)ODEAllocated,
+				    sizeof(double));
+	  if (!zn[i]) ErrorAbort(MAFO);
+	}
+      yy1   = (double *)Myalloc((void *)yy1, (size_t)ODEAllocated,
+				sizeof(double));
+      yco   = (double *)Myalloc((void *)yco, (size_t)ODEAllocated,
+				sizeof(double));
+      ewt   = (double *)Myalloc((void *)ewt, (size_t)ODEAllocated,
+				sizeof(double));
+      acor  = (double *)Myalloc((void *)acor, (size_t)ODEAllocated,
+				sizeof(double));
+      tempv = (double *)Myalloc((void *)tempv, (size_t)ODEAllocated,
+				sizeof(double));
+      ftemp = (double *)Myalloc((void *)ftemp, (size_t)ODEAllocated,
+				sizeof(double));
+      if(!(yy1 && yco && ewt && acor && tempv && ftemp))
+	ErrorAbort(MAFO);
+#if ((TIME_METHOD == CVBDF) && (BLOCK_JACOBIAN != 1))
+      Jac   = (double *)Myalloc((void *)Jac, (size_t)(ODEAllocated*ODEAllocated),
+				sizeof(double));
+      Mat   = (double *)Myalloc((void *)Mat, (size_t)(ODEAllocated*ODEAllocated),
+				sizeof(double));
+      ipiv  = (int *)   Myalloc((void *)ipiv, (size_t)ODEAllocated,
+				sizeof(int));
+      if(!(Jac && Mat && ipiv)) ErrorAbort(MAFO);
+#endif
+    }
+#if ((TIME_METHOD == CVBDF) && (BLOCK_JACOBIAN != 1))
+  JacobianSize = SystemSize*SystemSize;
+#endif
+
+  (void)memcpy((DEF_TYPE *)zn[0],		/* Copy environment vars.   */
+	       (DEF_TYPE *)env,
+	       ENVIRON_DIM*sizeof(double));
+
+#if (POPULATION_NR > 0)
+  int			len;
+
+  len = ENVIRON_DIM;
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      (void)memcpy((DEF_TYPE *)(zn[0]+len),	/* Copy all populations     */
+		   (DEF_TYPE *)pop[i],
+		   (table_size[i]*COHORT_SIZE)*sizeof(double));
+      u_pop[i] = (population)(yy1+len);
+      u_ofs[i] = (population)(yy1+len+CohortNo[i]*COHORT_SIZE);
+      c_pop[i] = (population)(yco+len);
+      c_ofs[i] = (population)(yco+len+CohortNo[i]*COHORT_SIZE);
+      u_popgradf[i] = (population)(ftemp+len);
+      u_ofsgradf[i] = (population)(ftemp+len+CohortNo[i]*COHORT_SIZE);
+      u_popgradt[i] = (population)(tempv+len);
+      u_ofsgradt[i] = (population)(tempv+len+CohortNo[i]*COHORT_SIZE);
+      len += (table_size[i]*COHORT_SIZE);
+    }
+#endif // (POPULATION_NR > 0)
+
+#if ((TIME_METHOD == CVBDF) && (BLOCK_JACOBIAN == 1))
+  int			nb, nblk, k, org;
+
+  /*
+   * The environmental variables and the boundary cohorts make up the border
+   * of the structured Jacobian, the internal cohorts its diagonal blocks.
+   */
+  nb   = ENVIRON_DIM;
+  nblk = 0;
+#if (POPULATION_NR > 0)
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      nb   += BpointNo[i]*COHORT_SIZE;
+      nblk += CohortNo[i];
+    }
+#endif // (POPULATION_NR > 0)
+  BlockJacSetup(nb, nblk);
+
+  for (nb=0; nb<ENVIRON_DIM; nb++) BJbidx[nb] = nb;
+  nblk = 0;
+#if (POPULATION_NR > 0)
+  org  = ENVIRON_DIM;
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      for (k=0; k<CohortNo[i]; k++, nblk++, org += COHORT_SIZE)
+	BJblk[nblk] = org;
+      for (k=0; k<BpointNo[i]*COHORT_SIZE; k++, nb++, org++)
+	BJbidx[nb] = org;
+    }
+#endif // (POPULATION_NR > 0)
+#endif
+
+  RestartMethod();
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+
+static double	wrmsnorm(double *v)
+
+  /*
+   * wrmsnorm - Returns the weighted root-mean-square norm of the vector v,
+   *		using the error weights in ewt[]. The first element (time)
+   *		is excluded, as in the RADAU5 method.
+   */
+
+{
+  register int		i;
+  double		sum = 0.0, prod;
+
+  for (i = 1; i < SystemSize; i++)
+    {
+      prod = v[i]*ewt[i];
+      sum += prod*prod;
+    }
+
+  return sqrt(sum/(double)(max(SystemSize-1, 1)));
+}
+
+
+
+
+/*==============================================================================*/
+
+static void	SetErrorWeights(void)
+
+{
+  register int		i;
+
+  for (i = 0; i < SystemSize; i++)
+    ewt[i] = 1.0/(ABS_ERR + accuracy * fabs(zn[0][i]));
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+
+static void	EvalGradient(double *yin, double *ydot, population *dpop,
+			     population *dofs)
+
+  /*
+   * EvalGradient - Computes the derivatives at state yin. As the population
+   *		    pointers u_pop[] and u_ofs[] point into yy1[], the state
+   *		    is first copied there if required.
+   */
+
+{
+  if (yin != yy1)
+    (void)memcpy((DEF_TYPE *)yy1, (DEF_TYPE *)yin, SystemSize*sizeof(double));
+  Gradient(yy1, u_pop, u_ofs, ydot, dpop, dofs, bpoints);
+  nfcn++;
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+
+static double	InitialStep(double hmax)
+
+  /*
+   * InitialStep - Estimates a suitable initial step size for a method of
+   *		   order 1, following the procedure of Hairer, Norsett &
+   *		   Wanner (1993, section II.4). On exit ftemp[] contains the
+   *		   derivatives in the initial state.
+   */
+
+{
+  register int		i;
+  double		d0, d1, d2, h0, h1;
+
+  EvalGradient(zn[0], ftemp, u_popgradf, u_ofsgradf);
+
+  d0 = wrmsnorm(zn[0]);
+  d1 = wrmsnorm(ftemp);
+  if ((d0 < 1.0E-5) || (d1 < 1.0E-5)) h0 = 1.0E-6;
+  else h0 = 0.01*(d0/d1);
+  h0 = min(h0, hmax);
+
+  for (i = 0; i < SystemSize; i++) yco[i] = zn[0][i] + h0*ftemp[i];
+  EvalGradient(yco, tempv, u_popgradt, u_ofsgradt);
+
+  for (i = 0; i < SystemSize; i++) tempv[i] = (tempv[i] - ftemp[i])/h0;
+  d2 = wrmsnorm(tempv);
+
+  if (max(d1, d2) <= 1.0E-15) h1 = max(1.0E-6, h0*1.0E-3);
+  else h1 = sqrt(0.01/max(d1, d2));
+
+  return max(SMALLEST_STEP, min(min(100.0*h0, h1), hmax));
+}
+
+
+
+
+/*==============================================================================*/
+#if (TIME_METHOD == CVODE)
+
+static double	AltSum(int iend, double *a, int k)
+
+  /*
+   * AltSum - Returns the alternating sum of a[i]/(i+k) for i = 0, ..., iend.
+   */
+
+{
+  register int		i;
+  int			sign = 1;
+  double		sum = 0.0;
+
+  if (iend < 0) return 0.0;
+
+  for (i = 0; i <= iend; i++)
+    {
+      sum += sign*(a[i]/(i+k));
+      sign = -sign;
+    }
+
+  return sum;
+}
+#endif // (TIME_METHOD == CVODE)
+
+
+
+
+/*==============================================================================*/
+#if (TIME_METHOD == CVBDF)
+
+static void	SetCoefficients(void)
+
+  /*
+   * SetCoefficients - Computes the coefficients l[] of the BDF method of
+   *		       order q for the current step size history and the
+   *		       test quantities tq[] for the error and convergence
+   *		       tests.
+   */
+
+{
+  register int		i, j;
+  double		alpha0, alpha0_hat, xi_inv, xistar_inv, hsum;
+  double		A1, A2, A3, A4, A5, A6, C, Cpinv, Cppinv;
+
+  l[0] = l[1] = xi_inv = xistar_inv = 1.0;
+  for (i = 2; i <= q; i++) l[i] = 0.0;
+  alpha0 = alpha0_hat = -1.0;
+  hsum = h;
+  if (q > 1)
+    {
+      for (j = 2; j < q; j++)
+	{
+	  hsum   += tau[j-1];
+	  xi_inv  = h/hsum;
+	  alpha0 -= 1.0/j;
+	  for (i = j; i >= 1; i--) l[i] += l[i-1]*xi_inv;
+	}
+      alpha0    -= 1.0/q;
+      xistar_inv = -l[1] - alpha0;
+      hsum      += tau[q-1];
+      xi_inv     = h/hsum;
+      alpha0_hat = -l[1] - xi_inv;
+      for (i = q; i >= 1; i--) l[i] += l[i-1]*xistar_inv;
+    }
+
+  A1 = 1.0 - alpha0_hat + alpha0;
+  A2 = 1.0 + q*A1;
+  tq[2] = fabs(A1/(alpha0*A2));
+  tq[5] = fabs(A2*xistar_inv/(l[q]*xi_inv));
+  if (qwait == 1)
+    {
+      if (q > 1)
+	{
+	  C     = xistar_inv/l[q];
+	  A3    = alpha0 + 1.0/q;
+	  A4    = alpha0_hat + xi_inv;
+	  Cpinv = (1.0 - A4 + A3)/A3;
+	  tq[1] = fabs(C*Cpinv);
+	}
+      else tq[1] = 1.0;
+      hsum  += tau[q];
+      xi_inv = h/hsum;
+      A5     = alpha0 - (1.0/(q+1));
+      A6     = alpha0_hat - xi_inv;
+      Cppinv = (1.0 - A6 + A5)/A2;
+      tq[3]  = fabs(Cppinv/(xi_inv*(q+2)*A5));
+    }
+  tq[4] = NLSCOEF/tq[2];
+
+  return;
+}
+
+#else
+
+static void	SetCoefficients(void)
+
+  /*
+   * SetCoefficients - Computes the coefficients l[] of the Adams-Moulton
+   *		       method of order q for the current step size history
+   *		       and the test quantities tq[] for the error and
+   *		       convergence tests.
+   */
+
+{
+  register int		i, j;
+  double		m[L_MAX+1], M0, M1, M2, M0_inv;
+  double		hsum, xi, xi_inv, sum;
+
+  if (q == 1)
+    {
+      l[0] = l[1] = tq[1] = tq[5] = 1.0;
+      tq[2] = 0.5;
+      tq[3] = 1.0/12.0;
+      tq[4] = NLSCOEF/tq[2];
+      return;
+    }
+
+  hsum = h;
+  m[0] = 1.0;
+  for (i = 1; i <= q; i++) m[i] = 0.0;
+  for (j = 1; j < q; j++)
+    {
+      if ((j == q-1) && (qwait == 1))
+	{
+	  sum = AltSum(q-2, m, 2);
+	  tq[1] = q*sum/m[q-2];
+	}
+      xi_inv = h/hsum;
+      for (i = j; i >= 1; i--) m[i] += m[i-1]*xi_inv;
+      hsum += tau[j];
+    }
+
+  M0 = AltSum(q-1, m, 1);
+  M1 = AltSum(q-1, m, 2);
+  M0_inv = 1.0/M0;
+
+  l[0] = 1.0;
+  for (i = 1; i <= q; i++) l[i] = M0_inv*(m[i-1]/i);
+  xi = hsum/h;
+  xi_inv = 1.0/xi;
+
+  tq[2] = M1*M0_inv/xi;
+  tq[5] = xi/l[q];
+
+  if (qwait == 1)
+    {
+      for (i = q; i >= 1; i--) m[i] += m[i-1]*xi_inv;
+      M2 = AltSum(q, m, 2);
+      tq[3] = M2*M0_inv/L;
+    }
+  tq[4] = NLSCOEF/tq[2];
+
+  return;
+}
+#endif // (TIME_METHOD == CVBDF)
+
+
+
+
+/*==============================================================================*/
+
+static void	AdjustOrder(int deltaq)
+
+  /*
+   * AdjustOrder - Adjusts the Nordsieck array when the order of the method
+   *		   is increased or decreased by 1. It is called before q is
+   *		   changed.
+   */
+
+{
+  register int		i, j, k;
+  double		hsum, xi;
+
+  if ((q == 2) && (deltaq != 1)) return;
+
+#if (TIME_METHOD == CVBDF)
+  double		alpha0, alpha1, prod, xiold, A1;
+
+  for (i = 0; i < L_MAX; i++) l[i] = 0.0;
+  if (deltaq == 1)
+    {
+      l[2] = alpha1 = prod = xiold = 1.0;
+      alpha0 = -1.0;
+      hsum = hscale;
+      for (j = 1; j < q; j++)
+	{
+	  hsum   += tau[j+1];
+	  xi      = hsum/hscale;
+	  prod   *= xi;
+	  alpha0 -= 1.0/(j+1);
+	  alpha1 += 1.0/xi;
+	  for (i = j+2; i >= 2; i--) l[i] = l[i]*xiold + l[i-1];
+	  xiold = xi;
+	}
+      A1 = (-alpha0 - alpha1)/prod;
+      /* The local error of the last step was saved in zn[QMAX]	    */
+      for (k = 0; k < SystemSize; k++) zn[L][k] = A1*zn[QMAX][k];
+      for (j = 2; j <= q; j++)
+	for (k = 0; k < SystemSize; k++) zn[j][k] += l[j]*zn[L][k];
+    }
+  else
+    {
+      l[2] = 1.0;
+      hsum = 0.0;
+      for (j = 1; j <= q-2; j++)
+	{
+	  hsum += tau[j];
+	  xi    = hsum/hscale;
+	  for (i = j+2; i >= 2; i--) l[i] = l[i]*xi + l[i-1];
+	}
+      for (j = 2; j < q; j++)
+	for (k = 0; k < SystemSize; k++) zn[j][k] -= l[j]*zn[q][k];
+    }
+#else
+  if (deltaq == 1)
+    {
+      (void)memset((DEF_TYPE *)zn[L], 0, SystemSize*sizeof(double));
+      return;
+    }
+
+  for (i = 0; i < L_MAX; i++) l[i] = 0.0;
+  l[1] = 1.0;
+  hsum = 0.0;
+  for (j = 1; j <= q-2; j++)
+    {
+      hsum += tau[j];
+      xi    = hsum/hscale;
+      for (i = j+1; i >= 1; i--) l[i] = l[i]*xi + l[i-1];
+    }
+  for (j = 1; j <= q-2; j++) l[j+1] = q*(l[j]/(j+1));
+  for (j = 2; j < q; j++)
+    for (k = 0; k < SystemSize; k++) zn[j][k] -= l[j]*zn[q][k];
+#endif // (TIME_METHOD == CVBDF)
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+
+static void	Rescale(void)
+
+  /*
+   * Rescale - Rescales the Nordsieck array for the step size h = hscale*eta.
+   */
+
+{
+  register int		j, k;
+  double		factor;
+
+  factor = eta;
+  for (j = 1; j <= q; j++)
+    {
+      for (k = 0; k < SystemSize; k++) zn[j][k] *= factor;
+      factor *= eta;
+    }
+  h      = hscale*eta;
+  hscale = h;
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+
+static void	Predict(void)
+
+  /*
+   * Predict - Computes the predicted Nordsieck array at the end of the step
+   *	       by applying the Pascal triangle matrix.
+   */
+
+{
+  register int		j, k, i;
+
+  for (k = 1; k <= q; k++)
+    for (j = q; j >= k; j--)
+      for (i = 0; i < SystemSize; i++) zn[j-1][i] += zn[j][i];
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+
+static void	Restore(void)
+
+  /*
+   * Restore - Restores the Nordsieck array to its state at the beginning of
+   *	       the step after a failed step attempt.
+   */
+
+{
+  register int		j, k, i;
+
+  for (k = 1; k <= q; k++)
+    for (j = q; j >= k; j--)
+      for (i = 0; i < SystemSize; i++) zn[j-1][i] -= zn[j][i];
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+#if (TIME_METHOD == CVBDF)
+#if (BLOCK_JACOBIAN == 1)
+
+static void	BlockDeriv(double *ydot)
+
+  /*
+   * BlockDeriv - Computes the derivatives in the (perturbed) state yy1[],
+   *		  as required for the computation of the structured
+   *		  Jacobian. The argument should equal tempv[].
+   */
+
+{
+  EvalGradient(yy1, ydot, u_popgradt, u_ofsgradt);
+
+  return;
+}
+
+
+
+#if (JACOBIAN > 0)
+static void	CohortJac(int b, double *dfdx, double *dedx)
+
+  /*
+   * CohortJac - Computes the diagonal block of the Jacobian for the internal
+   *		 cohort with block index b in the state yy1[] with the
+   *		 routine Jacobian() from the problem file, or by automatic
+   *		 differentiation of Gradient() (see fns/ebtad.cpp).
+   */
+
+{
+#if (POPULATION_NR > 0)
+  int			p = 0;
+
+  while (b >= CohortNo[p]) b -= CohortNo[p++];
+#if (JACOBIAN == 2)
+  ADJacobian(yy1, u_pop, u_ofs, bpoints, p, b, dfdx, dedx);
+#else
+  Jacobian(yy1, u_pop, u_ofs, bpoints, p, b, dfdx, dedx);
+#endif
+#endif // (POPULATION_NR > 0)
+
+  return;
+}
+#endif // (JACOBIAN > 0)
+#endif // (BLOCK_JACOBIAN == 1)
+
+
+
+static int	SetupMatrix(int convfail)
+
+  /*
+   * SetupMatrix - Computes the iteration matrix M = I - gamma*J and its LU
+   *		   decomposition. The Jacobian J is recomputed by
+   *		   difference quotients if it is likely to be out of date,
+   *		   otherwise the saved Jacobian is reused. On entry ftemp[]
+   *		   contains the derivatives in the predicted state zn[0].
+   */
+
+{
+#if (BLOCK_JACOBIAN != 1)
+  register int		i, j;
+  int			sign;
+  double		ysafe, delt;
+#endif
+  double		dgamma;
+
+  dgamma = fabs((gam/gamp) - 1.0);
+  if ((nst == 0) || (nst > (nstlj + MSBJ)) ||
+      ((convfail == FAIL_BAD_J) && (dgamma < DGMAX)) ||
+      (convfail == FAIL_OTHER))
+    {
+      (void)memcpy((DEF_TYPE *)yy1, (DEF_TYPE *)zn[0],
+		   SystemSize*sizeof(double));
+#if (BLOCK_JACOBIAN == 1)
+#if (JACOBIAN > 0)
+      BlockJacobian(yy1, ftemp, tempv, BlockDeriv, CohortJac);
+#else
+      BlockJacobian(yy1, ftemp, tempv, BlockDeriv, NULL);
+#endif
+#else
+      for (i = 0; i < SystemSize; i++)
+	{
+	  ysafe  = yy1[i];
+	  delt   = sqrt(UROUND * max(JACSTEP, fabs(ysafe)));
+	  yy1[i] = ysafe + delt;
+	  EvalGradient(yy1, tempv, u_popgradt, u_ofsgradt);
+	  for (j = 0; j < SystemSize; j++)
+	    Jac[j*SystemSize+i] = (tempv[j] - ftemp[j]) / delt;
+	  yy1[i] = ysafe;
+	}
+#endif
+      nje++;
+      nstlj = nst;
+      jcur = 1;
+    }
+  else jcur = 0;
+
+  nsetups++;
+
+#if (BLOCK_JACOBIAN == 1)
+  return BlockDec(1.0/gam, NULL);		/* Factorize I/gamma - J    */
+#else
+  for (i = 0; i < JacobianSize; i++) Mat[i] = -gam*Jac[i];
+  for (i = 0; i < SystemSize; i++) Mat[i*SystemSize+i] += 1.0;
+
+  return dec(SystemSize, Mat, ipiv, &sign);
+#endif
+}
+#endif // (TIME_METHOD == CVBDF)
+
+
+
+
+/*==============================================================================*/
+
+static int	Corrector(void)
+
+  /*
+   * Corrector - Solves the corrector equation for the correction acor[] to
+   *		 the predicted state zn[0]. For the BDF method a modified
+   *		 Newton iteration is used, for the Adams method a functional
+   *		 iteration. On successful return acnrm holds the norm of the
+   *		 correction and yy1[] the corrected state. nflag tells
+   *		 whether the step is attempted for the first time or after a
+   *		 convergence or error test failure.
+   */
+
+{
+  register int		i;
+  int			m;
+  double		del, delp = 0.0, dcon;
+
+#if (TIME_METHOD == CVBDF)
+  int			convfail, callSetup;
+
+  convfail  = ((nflag == FIRST_CALL) || (nflag == PREV_ERR_FAIL)) ?
+    NO_FAILURES : FAIL_OTHER;
+  callSetup = ((nflag == PREV_CONV_FAIL) || (nflag == PREV_ERR_FAIL) ||
+	       (nst == 0) || (nst >= (nstlp + MSBP)) ||
+	       (fabs(gamrat-1.0) > DGMAX));
+
+  while (1)
+    {
+      rk_level = 1;
+      EvalGradient(zn[0], ftemp, u_popgradf, u_ofsgradf);
+      if (callSetup)
+	{
+	  if (SetupMatrix(convfail)) return CONV_FAIL;
+	  callSetup = 0;
+	  gamrat = crate = 1.0;
+	  gamp = gam;
+	  nstlp  = nst;
+	}
+
+      (void)memset((DEF_TYPE *)acor, 0, SystemSize*sizeof(double));
+      (void)memcpy((DEF_TYPE *)yy1, (DEF_TYPE *)zn[0],
+		   SystemSize*sizeof(double));
+
+      for (m = 0; ; )
+	{
+	  for (i = 0; i < SystemSize; i++)
+	    tempv[i] = gam*ftemp[i] - rl1*zn[1][i] - acor[i];
+#if (BLOCK_JACOBIAN == 1)
+	  for (i = 0; i < SystemSize; i++) tempv[i] /= gam;
+	  BlockSol(tempv);
+#else
+	  sol(SystemSize, Mat, tempv, ipiv);
+#endif
+	  if (gamrat != 1.0)
+	    for (i = 0; i < SystemSize; i++) tempv[i] *= 2.0/(1.0 + gamrat);
+
+	  del = wrmsnorm(tempv);
+	  for (i = 0; i < SystemSize; i++)
+	    {
+	      acor[i] += tempv[i];
+	      yy1[i]   = zn[0][i] + acor[i];
+	    }
+
+	  if (m > 0) crate = max(CRDOWN*crate, del/delp);
+	  dcon = del*min(1.0, crate)/tq[4];
+	  if (dcon <= 1.0)
+	    {
+	      acnrm = (m == 0) ? del : wrmsnorm(acor);
+	      jcur = 0;
+	      return SUCCESS;
+	    }
+
+	  m++;
+	  if ((m == MAXCOR) || ((m >= 2) && (del > RDIV*delp))) break;
+
+	  delp = del;
+	  EvalGradient(yy1, ftemp, u_popgradf, u_ofsgradf);
+	}
+
+      if (jcur) return CONV_FAIL;
+      callSetup = 1;				/* Retry with new Jacobian  */
+      convfail  = FAIL_BAD_J;
+    }
+#else
+  crate = 1.0;
+  rk_level = 1;
+  EvalGradient(zn[0], tempv, u_popgradt, u_ofsgradt);
+  (void)memset((DEF_TYPE *)acor, 0, SystemSize*sizeof(double));
+
+  for (m = 0; ; )
+    {
+      for (i = 0; i < SystemSize; i++)
+	{
+	  tempv[i] = rl1*(h*tempv[i] - zn[1][i]);	/* New correction   */
+	  yy1[i]   = zn[0][i] + tempv[i];
+	  acor[i]  = tempv[i] - acor[i];		/* and its update   */
+	}
+      del = wrmsnorm(acor);
+      (void)memcpy((DEF_TYPE *)acor, (DEF_TYPE *)tempv,
+		   SystemSize*sizeof(double));
+
+      if (m > 0) crate = max(CRDOWN*crate, del/delp);
+      dcon = del*min(1.0, crate)/tq[4];
+      if (dcon <= 1.0)
+	{
+	  acnrm = (m == 0) ? del : wrmsnorm(acor);
+	  return SUCCESS;
+	}
+
+      m++;
+      if ((m == MAXCOR) || ((m >= 2) && (del > RDIV*delp))) return CONV_FAIL;
+
+      delp = del;
+      EvalGradient(yy1, tempv, u_popgradt, u_ofsgradt);
+    }
+#endif // (TIME_METHOD == CVBDF)
+
+  return CONV_FAIL;
+}
+
+
+
+
+/*==============================================================================*/
+
+static void	CompleteStep(void)
+
+  /*
+   * CompleteStep - Updates the step size history and applies the correction
+   *		    to all columns of the Nordsieck array.
+   */
+
+{
+  register int		i, j;
+
+  nst++;
+  for (i = q; i >= 2; i--) tau[i] = tau[i-1];
+  if ((q == 1) && (nst > 1)) tau[2] = tau[1];
+  tau[1] = h;
+
+  for (j = 0; j <= q; j++)
+    for (i = 0; i < SystemSize; i++) zn[j][i] += l[j]*acor[i];
+
+  qwait--;
+  if ((qwait == 1) && (q != QMAX))
+    {						/* Save the local error for */
+      (void)memcpy((DEF_TYPE *)zn[QMAX],	/* a possible order increase*/
+		   (DEF_TYPE *)acor, SystemSize*sizeof(double));
+      saved_tq5 = tq[5];
+    }
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+
+static void	PrepareNextStep(double dsm)
+
+  /*
+   * PrepareNextStep - Selects the step size hprime and the order qprime for
+   *		       the next step, by comparing the step size ratios that
+   *		       are possible with order q-1, q and q+1.
+   */
+
+{
+  register int		i;
+  double		etaq, etaqm1 = 0.0, etaqp1 = 0.0, etam, ddn, dup, cquot;
+
+  if (etamax == 1.0)
+    {
+      qwait  = imax(qwait, 2);
+      qprime = q;
+      hprime = h;
+      eta    = 1.0;
+      return;
+    }
+
+  etaq = 1.0/(pow(BIAS2*dsm, 1.0/L) + ADDON);
+  qprime = q;
+  if (qwait != 0) eta = etaq;
+  else
+    {
+      qwait = 2;
+      if (q > 1)
+	{
+	  ddn    = wrmsnorm(zn[q])*tq[1];
+	  etaqm1 = 1.0/(pow(BIAS1*ddn, 1.0/q) + ADDON);
+	}
+      if ((q != QMAX) && (saved_tq5 != 0.0))
+	{
+	  cquot = (tq[5]/saved_tq5)*pow(h/tau[2], (double)L);
+	  for (i = 0; i < SystemSize; i++)
+	    tempv[i] = acor[i] - cquot*zn[QMAX][i];
+	  dup    = wrmsnorm(tempv)*tq[3];
+	  etaqp1 = 1.0/(pow(BIAS3*dup, 1.0/(L+1)) + ADDON);
+	}
+
+      etam = max(etaqm1, max(etaq, etaqp1));
+      if (etam < THRESH)
+	eta = 1.0;
+      else if (etam == etaq)
+	eta = etaq;
+      else if (etam == etaqm1)
+	{
+	  eta = etaqm1;
+	  qprime = q - 1;
+	}
+      else
+	{
+	  eta = etaqp1;
+	  qprime = q + 1;
+#if (TIME_METHOD == CVBDF)
+	  (void)memcpy((DEF_TYPE *)zn[QMAX], (DEF_TYPE *)acor,
+		       SystemSize*sizeof(double));
+#endif
+	}
+    }
+
+  if (eta < THRESH)
+    {
+      eta    = 1.0;
+      qprime = q;
+      hprime = h;
+    }
+  else
+    {
+      eta    = min(eta, etamax);
+      hprime = h*eta;
+    }
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+
+static void	DenseOutput(double S, double *yout)
+
+  /*
+   * DenseOutput - Evaluates the interpolating polynomial defined by the
+   *		   Nordsieck array at time t + S*h, with -1 <= S <= 0.
+   */
+
+{
+  register int		i, j;
+
+  (void)memcpy((DEF_TYPE *)yout, (DEF_TYPE *)zn[q], SystemSize*sizeof(double));
+  for (j = q-1; j >= 0; j--)
+    for (i = 0; i < SystemSize; i++) yout[i] = yout[i]*S + zn[j][i];
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+#if (TIME_METHOD == CVBDF)
+
+static int 	dec(int dimM, double *M, int *perm, int *sign)
+
+  /**
+     NAME:
+	dec
+     NOTES:
+	MATRIX TRIANGULARIZATION BY GAUSSIAN ELIMINATION.
+
+	INPUT..
+		dimM = DIMENSION OF MATRIX.
+		M    = MATRIX TO BE TRIANGULARIZED.
+	OUTPUT..
+		M(I,J),  I.LE.J = UPPER TRIANGULAR FACTOR, U .
+		M(I,J),  I.GT.J = MULTIPLIERS = LOWER TRIANGULAR FACTOR, I - L.
+		perm(K), K.LT.N = INDEX OF K-TH PIVOT ROW.
+		sign = (-1)**(NUMBER OF INTERCHANGES) OR O.
+	RETURNS..
+		RETURN = 0 IF MATRIX M IS NONSINGULAR, OR 1
+
+	USE  SOL  TO OBTAIN SOLUTION OF LINEAR SYSTEM.
+
+  REFERENCE..
+     C. B. MOLER, ALGORITHM 423, LINEAR EQUATION SOLVER,
+     C.A.C.M. 15 (1972), P. 274.
+
+**/
+
+{
+  register int		i, j, k, m;
+  int			nm1, kp1;
+  double		T;
+
+  *sign = 1;
+  nm1 = dimM - 1;
+  for (k = 0; k < nm1; k++)
+    {
+      kp1 = k + 1;
+      m = k;
+      for (i = kp1; i < dimM; i++)
+	if (fabs(M[i*dimM+k]) > fabs(M[m*dimM+k])) m = i;
+      perm[k] = m;
+      T = M[m*dimM+k];
+      if (m != k)
+	{
+	  *sign = -(*sign);
+	  M[m*dimM+k] = M[k*dimM+k];
+	  M[k*dimM+k] = T;
+	}
+      if (fabs(T) < UROUND)
+	{
+	  *sign = 0;
+	  return 1;
+	}
+
+      T = -1.0/T;
+      for (i = kp1; i < dimM; i++) M[i*dimM+k] *= T;
+
+      for (j = kp1; j < dimM; j++)
+	{
+	  T = M[m*dimM+j];
+	  M[m*dimM+j] = M[k*dimM+j];
+	  M[k*dimM+j] = T;
+	  if (fabs(T) < UROUND) continue;
+	  for (i = kp1; i < dimM; i++) M[i*dimM+j] += M[i*dimM+k]*T;
+	}
+    }
+
+  if (fabs(M[dimM*dimM-1]) < UROUND)
+    {
+      *sign = 0;
+      return 1;
+    }
+
+  return 0;
+} /* dec */
+
+
+
+
+/*==============================================================================*/
+
+static void 	sol(int dimM, double *M, double *V, int *perm)
+
+  /**
+     NAME:
+	sol
+     NOTES:
+	SOLUTION OF LINEAR SYSTEM, M*X = V.
+
+     INPUT..
+	dimM = ORDER OF MATRIX.
+	M    = TRIANGULARIZED MATRIX OBTAINED FROM DEC.
+	V    = RIGHT HAND SIDE VECTOR.
+	perm = PIVOT VECTOR OBTAINED FROM DEC.
+
+	DO NOT USE IF DEC HAS RETURNED A SINGULARITY
+
+     OUTPUT..
+	V    = SOLUTION VECTOR, X.
+**/
+
+{
+  register int		i, j, k, m;
+  int			kp1, km1, nm1;
+  double 		T;
+
+  nm1 = dimM - 1;
+  for (k = 0; k < nm1; k++)
+    {
+      kp1 = k + 1;
+      m = perm[k];
+      T = V[m];
+      V[m] = V[k];
+      V[k] = T;
+      for (i = kp1; i < dimM; i++) V[i] += M[i*dimM+k]*T;
+    }
+  for (j = 0; j < nm1; j++)
+    {
+      km1 = dimM - 1 - j;
+      k   = km1;
+      V[k] /= M[k*dimM+k];
+      T = -V[k];
+      for (i = 0; i < km1; i++) V[i] += M[i*dimM+k]*T;
+    }
+  *V /= *M;
+
+  return;
+} /* sol */
+#endif // (TIME_METHOD == CVBDF)
+
+
+
+
+/*==============================================================================*/
+#if (EVENT_NR > 0)
+
+static double 	delvalue(double theta, int eventindex)
+
+{
+  register int		i;
+  double   		result[EVENT_NR];
+
+  DenseOutput(theta, yco);
+
+  for (i=0; i<EVENT_NR; i++) result[i] = NO_EVENT;
+  EventLocation(yco, c_pop, c_ofs, bpoints, result);
+
+  return result[eventindex];
+}
+
+
+
+
+/*==============================================================================*/
+#define ITMAX		500
+#define EPS		1.0e-16
+
+static double	zbrent(double start, double olddel, double newdel, int eventindex)
+
+{
+  int			iter;
+  double		a, b, c = 0.0, d = 0.0, e = 0.0, min1, min2;
+  double		fa, fb, fc, p, q, r, s, tol1, xm;
+
+  a = start; fa=olddel;
+  b =  0.0; fb=newdel;
+
+  if (fb*fa > 0.0)
+    {
+      Warning(ZBB);
+      return 1.0;
+    }
+
+  fc = fb;
+  for (iter=0; iter<ITMAX; iter++)
+    {
+      if (fb*fc > 0.0)
+	{
+	  c = a; fc=fa;
+	  e = d = b-a;
+	}
+      if (fabs(fc) < fabs(fb))
+	{
+	  a = b; fa = fb;
+	  b = c; fb = fc;
+	  c = a; fc = fa;
+	}
+      tol1 = 2.0*EPS*fabs(b)+0.5*identical_zero;
+      xm = 0.5*(c-b);
+
+      if ((fabs(xm) <= tol1 && fb*fc <=0.0) || fb == 0.0) return b;
+
+      if (fabs(e) >= tol1 && fabs(fa) > fabs(fb))
+	{
+	  s = fb/fa;
+	  if (a == c)
+	    {
+	      p=2.0*xm*s;
+	      q=1.0-s;
+	    }
+	  else
+	    {
+	      q = fa/fc;
+	      r = fb/fc;
+	      p = s*(2.0*xm*q*(q-r)-(b-a)*(r-1.0));
+	      q = (q-1.0)*(r-1.0)*(s-1.0);
+	    }
+	  if (p > 0.0) q = -q;
+	  p = fabs(p);
+	  min1 = 3.0*xm*q-fabs(tol1*q);
+	  min2 = fabs(e*q);
+	  if (2.0*p < (min1 < min2 ? min1 : min2))
+	    {
+	      e = d;
+	      d = p/q;
+	    }
+	  else
+	    {
+	      d = xm;
+	      e = d;
+	    }
+	}
+      else
+	{
+	  d = xm;
+	  e = d;
+	}
+      a = b; fa = fb;
+      if (fabs(d) > tol1) b += d;
+      else b += (xm > 0.0 ? fabs(tol1) : -fabs(tol1));
+      fb = delvalue(b, eventindex);
+    }
+  Warning(ZBM);
+
+  return 1.0;
+}
+
+
+
+#undef ITMAX
+#undef EPS
+
+/*===========================================================================*/
+
+static void	ShiftToEvent(double S)
+
+  /*
+   * ShiftToEvent - Shifts the interpolating polynomial defined by the
+   *		    Nordsieck array to the time t + S*h of an event, with
+   *		    -1 <= S <= 0. The step size history is adjusted
+   *		    accordingly and no order change is allowed in the next
+   *		    step, as the saved local error refers to the complete
+   *		    step.
+   */
+
+{
+  register int		i, j, k;
+
+  for (i = 0; i < q; i++)
+    for (j = q-1; j >= i; j--)
+      for (k = 0; k < SystemSize; k++) zn[j][k] += S*zn[j+1][k];
+  tau[1] += S*h;
+  qprime = q;
+  qwait  = imax(qwait, 2);
+  (void)memcpy((DEF_TYPE *)yy1, (DEF_TYPE *)zn[0], SystemSize*sizeof(double));
+
+  return;
+}
+
+
+
+
+/*===========================================================================*/
+
+static void	EventFound(int index)
+
+  /*
+   * EventFound - Registers the event with the given index, after the state
+   *		  in yy1[] has been shifted to the time of the event.
+   */
+
+{
+  register int		i;
+  double		level;
+
+  located[index] = 1;
+  LocatedEvent = index;
+  restart = 1;					/* History invalid at event */
+
+  for (i=0; i<EVENT_NR; i++) newELvalue[i] = NO_EVENT;
+  EventLocation(yy1, u_pop, u_ofs, bpoints, newELvalue);
+
+  equal2zero = max(identical_zero,
+		   pow(10, ceil(log10(fabs(newELvalue[index]) + ABS_ERR))));
+
+  cohort_end = ForceCohortEnd(yy1, u_pop, u_ofs, bpoints);
+
+  if (EBTDEBUG(1))				/* Report performance if    */
+    {						/* required by user         */
+      if (EBTDEBUG(4))
+	{
+	  fprintf(dbgfil, "%-14s%3d: T = %15.8f     dt = %12.7E\n",
+		  "Step to event", index, env[0], tau[1]);
+	  fflush(dbgfil);
+	}
+
+      if (EBTDEBUG(2) ||
+	  (EBTDEBUG(1) && (fabs(newELvalue[index]) >= identical_zero)))
+	{
+	  if (cohort_end)
+	    (void)fprintf(dbgfil, "%-18s T = %15.8f",
+			  "Cohort closed:", yy1[0]);
+	  else
+	    (void)fprintf(dbgfil, "%-18s T = %15.8f",
+			  "Event located:", yy1[0]);
+	  (void)fprintf(dbgfil, "  Value = %12.7E", newELvalue[index]);
+	  if (fabs(newELvalue[index]) >= identical_zero)
+	    {
+	      (void)fprintf(dbgfil, " ");
+	      level = (ceil(log10(fabs(newELvalue[index])/identical_zero))-
+		       identical_zero);
+	      for (i=0; i<level; i++) (void)fprintf(dbgfil, "*");
+	    }
+	  (void)fprintf(dbgfil, "\n");
+	  (void)fflush(dbgfil);
+	}
+    }
+
+  return;
+}
+
+
+
+
+/*===========================================================================*/
+
+static void	LocateEvent(int *doloc, int *located)
+
+  /*
+   * LocateEvent - This routine is called to locate the events that are
+   *		   triggered by the user-defined routine EventLocation()
+   *	           It is assumed that on entrance to this routine, the array
+   *		   doloc[] flags which events to locate, i.e. for which
+   *		   event indicator oldELvalue[] and newELvalue[] have sound
+   *		   values, i.e. both non-zero and their product negative.
+   *		   The Nordsieck array is shifted to the time of the earliest
+   *		   event, from where the integration continues.
+   */
+
+{
+  register int		i;
+  int			index = -1;
+  double		start, stepfrac[EVENT_NR], smallest = 2.0;
+
+  start = -tau[1]/h;				/* Start of the last step   */
+  for (i=0; i<EVENT_NR; i++)
+    {
+      located[i] = 0;
+      if (doloc[i])
+	{
+	  stepfrac[i] = zbrent(start, oldELvalue[i], newELvalue[i], i);
+	  if ((stepfrac[i] > 0.0) || (stepfrac[i] < start))
+	    {
+	      if (EBTDEBUG(1))
+		{
+		  (void)fprintf(dbgfil, "Problem locating event %d at T = %15.8f",
+				i, zn[0][0]);
+		  (void)fprintf(dbgfil,	"  Start = %12.7E", oldELvalue[i]);
+		  (void)fprintf(dbgfil,	"  Stop = %12.7E", newELvalue[i]);
+		  (void)fprintf(dbgfil,	"  dt = %12.7E\n", tau[1]);
+		  fflush(dbgfil);
+		}
+	    }
+	  else if (stepfrac[i] < smallest)
+	    {
+	      smallest = stepfrac[i];
+	      index = i;
+	    }
+	}
+    }
+
+  if (index < 0) return;			/* Keep the complete step   */
+
+  ShiftToEvent(stepfrac[index]);
+  EventFound(index);
+
+  return;
+} /* LocateEvent */
+
+
+
+
+/*===========================================================================*/
+
+static int	PredictedEvent(double *S)
+
+  /*
+   * PredictedEvent - This routine is called when the corrector iteration
+   *		      fails to converge, which happens on steps across a
+   *		      discontinuity in the derivatives, such as a maturity
+   *		      threshold. If the predicted state crosses one of the
+   *		      event surfaces, the routine locates the earliest
+   *		      crossing on the predictor polynomial and returns its
+   *		      index, together with a step fraction S that is just
+   *		      beyond the event. The rejected step is then retried
+   *		      with a step size that ends at this point. Otherwise the
+   *		      routine returns -1.
+   */
+
+{
+  register int		i;
+  int			index = -1;
+  double		predELvalue[EVENT_NR], stepfrac, val;
+
+  *S = 1.0;
+  (void)memcpy((DEF_TYPE *)yco, (DEF_TYPE *)zn[0], SystemSize*sizeof(double));
+  for (i=0; i<EVENT_NR; i++) predELvalue[i] = NO_EVENT;
+  EventLocation(yco, c_pop, c_ofs, bpoints, predELvalue);
+
+  for (i=0; i<EVENT_NR; i++)
+    {
+      if (!(((oldELvalue[i] < 0.0) && (predELvalue[i] >= 0.0)) ||
+	    ((oldELvalue[i] > 0.0) && (predELvalue[i] <= 0.0))))
+	continue;
+
+      stepfrac = zbrent(-1.0, oldELvalue[i], predELvalue[i], i);
+      if ((stepfrac > 0.0) || (stepfrac < -1.0)) continue;
+
+      val = delvalue(stepfrac, i);		/* Make sure the event is   */
+      if (((oldELvalue[i] < 0.0) && (val < 0.0)) ||	/* really crossed   */
+	  ((oldELvalue[i] > 0.0) && (val > 0.0)))
+	stepfrac = min(stepfrac + identical_zero, 0.0);
+
+      if (stepfrac < *S)
+	{
+	  *S = stepfrac;
+	  index = i;
+	}
+    }
+
+  if ((index >= 0) && ((1.0 + *S)*h < SMALLEST_STEP)) index = -1;
+
+  return index;
+} /* PredictedEvent */
+#endif /* EVENT_NR > 0 */
+
+
+
+/*==============================================================================*/
+
+static void	  IntermediateState(double S)
+
+  /*
+   * IntermediateState - Routine computes the state of the system at an
+   *			 intermediate time point by interpolation.
+   *			 Values are stored in basic data copy for further use
+   *			 in output routines.
+   */
+
+{
+  register int		i;
+
+  DenseOutput(S, yco);
+
+  (void)memcpy((DEF_TYPE *)env, (DEF_TYPE *)yco, ENVIRON_DIM*sizeof(double));
+
+#if (POPULATION_NR > 0)
+  register int		j, k;
+  int			len;
+
+  len = ENVIRON_DIM;
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      (void)memcpy((DEF_TYPE *)pop[i], (DEF_TYPE *)(yco+len),
+		   (table_size[i]*COHORT_SIZE)*sizeof(double));
+      len += (table_size[i]*COHORT_SIZE);
+    }
+
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      for(j=0; j<BpointNo[i]; j++)
+	{
+	  if(ofs[i][j][number] > 0)
+	    {
+	      for(k=1; k<COHORT_SIZE; k++)
+		ofs[i][j][k] /= ofs[i][j][number];
+	    }
+	  for(k=1; k<COHORT_SIZE; k++)
+	    ofs[i][j][k] += bpoints[i][j][k];
+	}
+    }
+#endif // (POPULATION_NR > 0)
+
+  return;
+}
+
+
+
+
+/*==============================================================================*/
+
+double	  IntegrationStep(double del_tim, double del_max, int recurs)
+
+  /*
+   * IntegrationStep - Performs an integration step with adaptable step size
+   *                   and order, but maximum step size "del_max". Step size
+   *                   and order selection as implemented in CVODE.
+   */
+
+{
+  register int		i;
+  double		del_h, dsm;
+  int			adjust = 1, intermediate = 0, nef = 0;
+#if (EVENT_NR > 0)
+  int			dolocation[EVENT_NR], events = 0;
+  double		S = 0.0;
+#endif
+
+  del_h = del_tim;				/* Adjust stepsize to hit   */
+  if(del_max < (2*del_tim))			/* cohort end, look ahead   */
+    {						/* two steps to avoid too   */
+      del_h = 0.5*del_max;			/* drastic step changes	    */
+      if(del_max < del_tim) del_h = del_max;
+      adjust = 0;
+    }
+  if(del_h < SMALLEST_STEP)
+    {
+#if (POPULATION_NR > 0)
+      TransBcohorts();
+#endif // (POPULATION_NR > 0)
+      ErrorExit(0, SSS);
+    }
+  recur_no = recurs;
+  LocatedEvent = -1;
+  if (restart) RestartMethod();
+
+  if (EBTDEBUG(4))
+    {
+      fprintf(dbgfil, "%-18s T = %15.8f     dt = %12.7E recurs = %2d\n",
+	      "Starting step:", env[0], del_h, recurs);
+      fflush(dbgfil);
+    }
+
+  initState = zn[0];
+  currentState = yy1;
+  currentDers[1] = ftemp;
+
+  SetErrorWeights();
+  if (!nst)					/* Start of cohort cycle:   */
+    {						/* first order method	    */
+      rk_level = 1;
+      del_h = min(del_h, InitialStep(del_h));
+      for (i = 0; i < SystemSize; i++) zn[1][i] = del_h*ftemp[i];
+      h = hscale = del_h;
+      gamp = h;
+    }
+  else
+    {
+      if (qprime != q)
+	{
+	  AdjustOrder(qprime-q);
+	  q = qprime;
+	  L = q+1;
+	  qwait = L;
+	}
+      eta = del_h/h;
+      if (eta != 1.0) Rescale();
+    }
+
+#if (EVENT_NR > 0)
+  (void)memcpy((DEF_TYPE *)yy1, (DEF_TYPE *)zn[0], SystemSize*sizeof(double));
+  for (i=0; i<EVENT_NR; i++) oldELvalue[i] = NO_EVENT;
+  EventLocation(yy1, u_pop, u_ofs, bpoints, oldELvalue);
+#endif
+
+  nflag = FIRST_CALL;
+  while (1)
+    {
+      Predict();
+      SetCoefficients();
+      rl1    = 1.0/l[1];
+      gam  = h*rl1;
+      gamrat = (nst > 0) ? gam/gamp : 1.0;
+
+      if (Corrector() != SUCCESS)		/* Convergence failure	    */
+	{
+	  eta = ETACF;
+#if (EVENT_NR > 0)
+	  if (PredictedEvent(&S) >= 0)		/* Retry up to just beyond  */
+	    eta = min(eta, 1.0 + S);		/* the event		    */
+#endif
+	  ncfn++;
+	  Restore();
+	  etamax = 1.0;
+	  nflag  = PREV_CONV_FAIL;
+	  if (EBTDEBUG(3))
+	    {
+	      fprintf(dbgfil, "%-18s T = %15.8f     dt = %12.7E recurs = %2d order = %2d\n",
+		      "No convergence:", env[0], h, recur_no, q);
+	      fflush(dbgfil);
+	    }
+	}
+      else
+	{
+	  dsm = acnrm*tq[2];
+	  if (dsm <= 1.0) break;		/* Step accepted	    */
+
+	  netf++; nef++;			/* Error test failure	    */
+	  Restore();
+	  etamax = 1.0;
+	  nflag  = PREV_ERR_FAIL;
+	  if (EBTDEBUG(3))
+	    {
+	      fprintf(dbgfil, "%-18s T = %15.8f     dt = %12.7E recurs = %2d order = %2d\n",
+		      "Step failed:", env[0], h, recur_no, q);
+	      fflush(dbgfil);
+	    }
+
+	  if (nef <= MXNEF1)
+	    {
+	      eta = 1.0/(pow(BIAS2*dsm, 1.0/L) + ADDON);
+	      eta = max(ETAMIN, eta);
+	      if (nef >= SMALL_NEF) eta = min(eta, ETAMXF);
+	    }
+	  else if (q > 1)			/* Reduce the order	    */
+	    {
+	      eta = ETAMIN;
+	      AdjustOrder(-1);
+	      L = q;
+	      q--;
+	      qwait = L;
+	    }
+	  else					/* Restart from derivative  */
+	    {
+	      eta    = 1.0;
+	      h     *= ETAMIN;
+	      hscale = h;
+	      qwait  = LONG_WAIT;
+	      EvalGradient(zn[0], tempv, u_popgradt, u_ofsgradt);
+	      for (i = 0; i < SystemSize; i++) zn[1][i] = h*tempv[i];
+	    }
+	}
+
+      recur_no++;
+      if (recur_no > 25)
+	{
+#if (POPULATION_NR > 0)
+	  TransBcohorts();
+#endif // (POPULATION_NR > 0)
+	  ErrorExit(0, REC);
+	}
+      if (eta != 1.0) Rescale();
+      if (h < SMALLEST_STEP)
+	{
+#if (POPULATION_NR > 0)
+	  TransBcohorts();
+#endif // (POPULATION_NR > 0)
+	  ErrorExit(0, SSS);
+	}
+    }
+  del_h = h;
+
+  CompleteStep();
+  PrepareNextStep(dsm);
+  etamax = (nst <= SMALL_NST) ? ETAMX2 : ETAMX3;
+  if (adjust)
+    {
+      step_size = min(hprime, cohort_limit);
+      step_size = min(step_size, LARGEST_STEP);
+    }
+
+  if (EBTDEBUG(4))
+    {
+      fprintf(dbgfil, "%-18s T = %15.8f     dt = %12.7E recurs = %2d order = %2d\n",
+	      "Step OK:", env[0], del_h, recur_no, q);
+      fprintf(dbgfil, "Nst:    %8ld    Nfcn:   %8ld    Nsetups: %6ld    Netf: %8ld    Ncfn: %8ld\n",
+	      nst, nfcn, nsetups, netf, ncfn);
+      fflush(dbgfil);
+    }
+
+  (void)memcpy((DEF_TYPE *)yy1, (DEF_TYPE *)zn[0], SystemSize*sizeof(double));
+
+  /*
+   * Location of events: If located in previous and no change in ELvalue do
+   * not locate.
+   * WARNING: The order of these statements seems odd but is OK! What is
+   * 	      checked is whether the newELvalue from before cohort closure
+   *	      equals the value computed at the beginning of this time
+   *	      integration step!
+   */
+#if (EVENT_NR > 0)
+  for(i=0; i<EVENT_NR; i++)
+    {
+      dolocation[i] = 1;
+      if (located[i] && isequal(oldELvalue[i], newELvalue[i]))
+	dolocation[i] = 0;
+    }
+
+  for (i=0; i<EVENT_NR; i++) newELvalue[i] = NO_EVENT;
+  EventLocation(yy1, u_pop, u_ofs, bpoints, newELvalue);
+
+  for(i=0, events=0; i<EVENT_NR; i++)
+    {
+      if (((oldELvalue[i] < 0.0) && (newELvalue[i] < 0.0)) ||
+	  ((oldELvalue[i] > 0.0) && (newELvalue[i] > 0.0)))
+	dolocation[i] = 0;
+      if (dolocation[i]) events++;
+    }
+  if (events) LocateEvent(dolocation, located);
+  else for(i=0; i<EVENT_NR; i++) located[i] = 0;
+#endif
+
+  intermediate = ((next_output < (yy1[0]-identical_zero)) ||
+		  ((state_out > 0.0) &&
+		   (next_state_output < (yy1[0]-identical_zero))));
+
+  if (intermediate)
+    {
+      /*
+       * Produce intermediate output and state output if requested
+       */
+#if (POPULATION_NR > 0)
+      for(i=0; i<POPULATION_NR; i++) CohortNo[i] += BpointNo[i];
+#endif // (POPULATION_NR > 0)
+      while (next_output < (yy1[0]-identical_zero))
+	{
+	  IntermediateState((next_output-yy1[0])/h);
+	  FileOut();
+	  next_output += delt_out;
+	}
+#if (POPULATION_NR > 0)
+      while ((state_out > 0.0) && (next_state_output < (yy1[0]-identical_zero)))
+	{
+	  IntermediateState((next_state_output-yy1[0])/h);
+	  FileState();
+	  next_state_output += state_out;
+	}
+      for(i=0; i<POPULATION_NR; i++) CohortNo[i] -= BpointNo[i];
+      for(i=0; i<POPULATION_NR; i++) cohort_no[i] = CohortNo[i];
+#endif // (POPULATION_NR > 0)
+    }
+
+  /*
+   * Update the basic data copy
+   */
+  (void)memcpy((DEF_TYPE *)env, (DEF_TYPE *)yy1, ENVIRON_DIM*sizeof(double));
+
+#if (POPULATION_NR > 0)
+  int			len;
+
+  len = ENVIRON_DIM;
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      (void)memcpy((DEF_TYPE *)pop[i], (DEF_TYPE *)(yy1+len),
+		   (table_size[i]*COHORT_SIZE)*sizeof(double));
+      len += (table_size[i]*COHORT_SIZE);
+    }
+#endif // (POPULATION_NR > 0)
+
+  return del_h;
+}
+
+
+
+/*==============================================================================*/
+
+int	  ExchangeSolver(double *data, int load)
+
+  /* 
+   * ExchangeSolver - Copies the state of the method that is carried over
+   *		      from one cohort cycle to the next to data[] (load = 0),
+   *		      or loads it from there (load = 1), when writing or
+   *		      reading a checkpoint. Returns the number of values, which
+   *		      is all that is computed when data equals NULL.
+   */
+
+{
+  int			n = 0;
+#if (EVENT_NR > 0)
+  register int		i;
+#endif
+
+  ExchangeVar(data, n, load, crate);
+  ExchangeVar(data, n, load, nfcn);
+  ExchangeVar(data, n, load, nsetups);
+  ExchangeVar(data, n, load, netf);
+  ExchangeVar(data, n, load, ncfn);
+#if (TIME_METHOD == CVBDF)
+  ExchangeVar(data, n, load, nje);
+#endif
+#if (EVENT_NR > 0)
+  for (i=0; i<EVENT_NR; i++)
+    {
+      ExchangeVar(data, n, load, oldELvalue[i]);
+      ExchangeVar(data, n, load, newELvalue[i]);
+      ExchangeVar(data, n, load, located[i]);
+    }
+#endif
+
+  return n;
+}
+
+
+
+/*==========================================================================*/
@@ -75,47 +75,49 @@ SAFETY   Safety factor in the step size prediction, default 0.9.
  * Definitions of static variables, restricted to this file.
  */
 
-static int		step_failed=0, recur_no;
-static int		nonsti = 0, iasti = 0;
-static double		hlamb = 0.0;
-static long		accepted_steps = 0L;
-static long		ODEAllocated = 0L, SystemSize;
-static double		*y  = NULL, *yy1 = NULL, *yco  = NULL, *ysti = NULL;
-static double		*k1 = NULL, *k2  = NULL, *k3   = NULL;
-static double		*k4 = NULL, *k5  = NULL, *k6   = NULL;
-static double		*rcont1 = NULL, *rcont2  = NULL, *rcont3 = NULL;
-static double		*rcont4 = NULL, *rcont5  = NULL;
+static EBTSTATE int	step_failed=0, recur_no;
+static EBTSTATE int	nonsti = 0, iasti = 0;
+static EBTSTATE double	hlamb = 0.0;
+static EBTSTATE long	accepted_steps = 0L;
+static EBTSTATE long	ODEAllocated = 0L, SystemSize;
+static EBTSTATE double	*y  = NULL, *yy1 = NULL, *yco  = NULL, *ysti = NULL;
+static EBTSTATE double	*k1 = NULL, *k2  = NULL, *k3   = NULL;
+static EBTSTATE double	*k4 = NULL, *k5  = NULL, *k6   = NULL;
+static EBTSTATE double	*rcont1 = NULL, *rcont2  = NULL, *rcont3 = NULL;
+static EBTSTATE double	*rcont4 = NULL, *rcont5  = NULL;
 #if (POPULATION_NR > 0)
-static int		table_size[POPULATION_NR];
-static population	u_pop[POPULATION_NR], 	   u_ofs[POPULATION_NR];
-static population	c_pop[POPULATION_NR],	   c_ofs[POPULATION_NR];
-static population	u_popgrad1[POPULATION_NR], u_ofsgrad1[POPULATION_NR];
-static population	u_popgrad2[POPULATION_NR], u_ofsgrad2[POPULATION_NR];
-static population	u_popgrad3[POPULATION_NR], u_ofsgrad3[POPULATION_NR];
-static population	u_popgrad4[POPULATION_NR], u_ofsgrad4[POPULATION_NR];
-static population	u_popgrad5[POPULATION_NR], u_ofsgrad5[POPULATION_NR];
-static population	u_popgrad6[POPULATION_NR], u_ofsgrad6[POPULATION_NR];
+static EBTSTATE int	table_size[POPULATION_NR];
+static EBTSTATE population	u_pop[POPULATION_NR], 	   u_ofs[POPULATION_NR];
+static EBTSTATE population	c_pop[POPULATION_NR],	   c_ofs[POPULATION_NR];
+static EBTSTATE population	u_popgrad1[POPULATION_NR], u_ofsgrad1[POPULATION_NR];
+static EBTSTATE population	u_popgrad2[POPULATION_NR], u_ofsgrad2[POPULATION_NR];
+static EBTSTATE population	u_popgrad3[POPULATION_NR], u_ofsgrad3[POPULATION_NR];
+static EBTSTATE population	u_popgrad4[POPULATION_NR], u_ofsgrad4[POPULATION_NR];
+static EBTSTATE population	u_popgrad5[POPULATION_NR], u_ofsgrad5[POPULATION_NR];
+static EBTSTATE population	u_popgrad6[POPULATION_NR], u_ofsgrad6[POPULATION_NR];
 #else
-static population	*bpoints = NULL;
-static population	*u_pop = NULL, 	    *u_ofs = NULL;
+static EBTSTATE population	*bpoints = NULL;
+static EBTSTATE population	*u_pop = NULL, 	    *u_ofs = NULL;
 #if (EVENT_NR > 0)
-static population	*c_pop = NULL,	    *c_ofs = NULL;
+static EBTSTATE population	*c_pop = NULL,	    *c_ofs = NULL;
 #endif
-static population	*u_popgrad1 = NULL, *u_ofsgrad1 = NULL;
-static population	*u_popgrad2 = NULL, *u_ofsgrad2 = NULL;
-static population	*u_popgrad3 = NULL, *u_ofsgrad3 = NULL;
-static population	*u_popgrad4 = NULL, *u_ofsgrad4 = NULL;
-static population	*u_popgrad5 = NULL, *u_ofsgrad5 = NULL;
-static population	*u_popgrad6 = NULL, *u_ofsgrad6 = NULL;
+static EBTSTATE population	*u_popgrad1 = NULL, *u_ofsgrad1 = NULL;
+static EBTSTATE population	*u_popgrad2 = NULL, *u_ofsgrad2 = NULL;
+static EBTSTATE population	*u_popgrad3 = NULL, *u_ofsgrad3 = NULL;
+static EBTSTATE population	*u_popgrad4 = NULL, *u_ofsgrad4 = NULL;
+static EBTSTATE population	*u_popgrad5 = NULL, *u_ofsgrad5 = NULL;
+static EBTSTATE population	*u_popgrad6 = NULL, *u_ofsgrad6 = NULL;
 #endif // (POPULATION_NR > 0)
 
-static double		facold = FACOLD;
+static EBTSTATE double	facold = FACOLD;
 #if (EVENT_NR > 0)
-static double		oldELvalue[EVENT_NR] = {0.0},
+static EBTSTATE double	oldELvalue[EVENT_NR] = {0.0},
 			newELvalue[EVENT_NR] = {0.0};
-static int		located[EVENT_NR] = {0};
+static EBTSTATE int	located[EVENT_NR] = {0};
 #endif
 
+#include "ebtrkstage.c"
+
 
 /*==========================================================================*/
 /*
@@ -146,7 +148,7 @@ void	PrepareCycle()
     }
 #endif // (POPULATION_NR > 0)
 
-  if (!(SystemSize < ODEAllocated))
+  if (!(SystemSize < ODEAllocated) || MemExcess(SystemSize, ODEAllocated))
     {
       ODEAllocated = MemBlocks(SystemSize);
       y    = (double *)Myalloc((void *)y, (size_t)ODEAllocated,
@@ -215,6 +217,7 @@ void	PrepareCycle()
       u_ofsgrad6[i] = (population)(k6+len+CohortNo[i]*COHORT_SIZE);
       len += (table_size[i]*COHORT_SIZE);
     }
+  AliasPopulations(y);				/* Populations live in y    */
 #endif // (POPULATION_NR > 0)
 
   return;
@@ -225,16 +228,20 @@ void	PrepareCycle()
 
 /*==============================================================================*/
 
-static void	dopri5(double dt)
+static double	dopri5(double dt, long *maxerri, double *maxsqr)
 
   /* 
    * dopri5 - Routine performs an integration step of the system using the
    *	      DOPRI5 integration method. The code is adapted from the original
-   *	      C source code by E. Hairer & G. Wanner.
+   *	      C source code by E. Hairer & G. Wanner. Returns the sum of
+   *	      squares of the scaled local errors and, if maxerri is not NULL,
+   *	      the index and value of the largest scaled error.
    */
 
 {
+#if (EVENT_NR > 0)
   register int		i;
+#endif
   static CONST double	
     a21=0.2, 		
     a31=3.0/40.0, 	a32=9.0/40.0,   
@@ -248,6 +255,7 @@ static void	dopri5(double dt)
     e1=71.0/57600.0, 				e3=-71.0/16695.0, 	
     e4=71.0/1920.0,	e5=-17253.0/339200.0, 	e6=22.0/525.0, 
     e7=-1.0/40.0;
+  rkterms		c, e;
 
   initState = y;
   currentState = yy1;
@@ -273,53 +281,53 @@ static void	dopri5(double dt)
 #endif
     }
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * a21 * k1[i];
+  c = (rkterms){1, {a21}, {k1}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 2;
   Gradient(yy1, u_pop, u_ofs, k2, u_popgrad2, u_ofsgrad2, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a31*k1[i] + a32*k2[i]);
+  c = (rkterms){2, {a31, a32}, {k1, k2}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 3;
   Gradient(yy1, u_pop, u_ofs, k3, u_popgrad3, u_ofsgrad3, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a41*k1[i] + a42*k2[i] + a43*k3[i]);
+  c = (rkterms){3, {a41, a42, a43}, {k1, k2, k3}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 4;
   Gradient(yy1, u_pop, u_ofs, k4, u_popgrad4, u_ofsgrad4, bpoints);
 
-  for (i = 0; i <SystemSize; i++)
-    yy1[i] = y[i] + dt * (a51*k1[i] + a52*k2[i] + a53*k3[i] + a54*k4[i]);
+  c = (rkterms){4, {a51, a52, a53, a54}, {k1, k2, k3, k4}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 5;
   Gradient(yy1, u_pop, u_ofs, k5, u_popgrad5, u_ofsgrad5, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a61*k1[i] + a62*k2[i] + a63*k3[i] +
-			  a64*k4[i] + a65*k5[i]);
+  c = (rkterms){5, {a61, a62, a63, a64, a65}, {k1, k2, k3, k4, k5}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
-  (void)memcpy((DEF_TYPE *)ysti, (DEF_TYPE *)yy1, SystemSize*sizeof(double));
+  if (EBTDEBUG(1) || AUTO_SWITCH)		/* Only for stiffness	    */
+    (void)memcpy((DEF_TYPE *)ysti, (DEF_TYPE *)yy1,	/* detection	    */
+		 SystemSize*sizeof(double));
 
   rk_level = 6;
   Gradient(yy1, u_pop, u_ofs, k6, u_popgrad6, u_ofsgrad6, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a71*k1[i] + a73*k3[i] + a74*k4[i] +
-			  a75*k5[i] + a76*k6[i]);
+  c = (rkterms){5, {a71, a73, a74, a75, a76}, {k1, k3, k4, k5, k6}};
+  RKStage(SystemSize, yy1, y, dt, &c);
+
   rk_level = 7;
   Gradient(yy1, u_pop, u_ofs, k2, u_popgrad2, u_ofsgrad2, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    rcont5[i] = dt * (d1*k1[i] + d3*k3[i] + d4*k4[i] +
-		      d5*k5[i] + d6*k6[i] + d7*k2[i]);
-
-  for (i = 0; i < SystemSize; i++)
-    k4[i] = dt * (e1*k1[i] + e3*k3[i] + e4*k4[i] + e5*k5[i] + e6*k6[i] + e7*k2[i]);
+						/* Dense output and error   */
+						/* estimate in one sweep    */
+  c = (rkterms){6, {d1, d3, d4, d5, d6, d7}, {k1, k3, k4, k5, k6, k2}};
+  e = (rkterms){6, {e1, e3, e4, e5, e6, e7}, {k1, k3, k4, k5, k6, k2}};
 
-  return;
+  return RKErrorRMS(SystemSize, rcont5, dt, &c, y, yy1, &e, ABS_ERR, accuracy,
+		    maxerri, maxsqr);
 } /* dopri5 */
 
 
@@ -511,7 +519,7 @@ static void	LocateEvent(double prev_dt, int *doloc, int *located)
 #else
       double		yd0, ydiff, bspl;
       
-      dopri5(new_dt);
+      (void)dopri5(new_dt, NULL, NULL);
       /*
        * Update variables for continuous output
        */
@@ -583,8 +591,8 @@ static void	  IntermediateState(double theta)
   /* 
    * IntermediateState - Routine computes the state of the system at an
    *			 intermediate time point by interpolation. 
-   *			 Values are stored in basic data copy for further use
-   *			 in output routines.
+   *			 Values are stored in yco, which pop[] points to
+   *			 for further use in output routines.
    */
   
 {
@@ -603,15 +611,8 @@ static void	  IntermediateState(double theta)
 
 #if (POPULATION_NR > 0)
   register int		j, k;
-  int			len;
 
-  len = ENVIRON_DIM;
-  for(i=0; i<POPULATION_NR; i++)
-    {
-      (void)memcpy((DEF_TYPE *)pop[i], (DEF_TYPE *)(yco+len),
-		   (table_size[i]*COHORT_SIZE)*sizeof(double));
-      len += (table_size[i]*COHORT_SIZE);
-    }
+  AliasPopulations(yco);			/* Until SwapState()        */
 
   for(i=0; i<POPULATION_NR; i++)
     {
@@ -634,6 +635,43 @@ static void	  IntermediateState(double theta)
 
 
 
+/*==============================================================================*/
+
+static void	  SwapState(void)
+
+  /* 
+   * SwapState - Routine makes the state at the end of the integration step
+   *		 the current state by swapping the pointers to the state
+   *		 vectors and points pop[] and the local pointers to them.
+   */
+
+{
+  double		*tmp;
+
+  tmp = y; y = yy1; yy1 = tmp;
+
+  (void)memcpy((DEF_TYPE *)env, (DEF_TYPE *)y, ENVIRON_DIM*sizeof(double));
+
+#if (POPULATION_NR > 0)
+  register int		i;
+  int			len;
+
+  len = ENVIRON_DIM;
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      u_pop[i] = (population)(yy1+len);
+      u_ofs[i] = (population)(yy1+len+(table_size[i]-BpointNo[i])*COHORT_SIZE);
+      len += (table_size[i]*COHORT_SIZE);
+    }
+  AliasPopulations(y);
+#endif // (POPULATION_NR > 0)
+
+  return;
+}
+
+
+
+
 /*==============================================================================*/
 
 double	  IntegrationStep(double del_tim, double del_max, int recurs)
@@ -647,11 +685,12 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
 {
   register int		i;
   double		del_h;
-  double		err, err0, sk, sqr, maxsqr;
+  double		err, err0, sqr, maxsqr = 0.0;
   double		fac, fac11, hnew;
   double		yd0, ydiff, bspl;
   double		stnum, stden;
-  int			adjust = 1, events = 0, intermediate = 0, maxerri;
+  int			adjust = 1, events = 0, intermediate = 0;
+  long			maxerri = 0;
 #if (EVENT_NR > 0)
   int			dolocation[EVENT_NR];
 #endif
@@ -680,28 +719,27 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
       fflush(dbgfil);
     }
 
-  dopri5(del_h);				/* Do an integration step   */
-
-  err = 0.0; maxsqr = 0.0; maxerri = 0;		/* error estimation         */
-  for (i = 0; i < SystemSize; i++)
-    {
-      sk   = ABS_ERR + accuracy * max (fabs(y[i]), fabs(yy1[i]));
-      sqr  = k4[i] / sk;
-      if (sqr > maxsqr)
-	{
-	  maxsqr  = sqr;
-	  maxerri = i;
-	}
-      err += sqr*sqr;
-    }
-  err0 = err;
+						/* Do an integration step   */
+  err  = dopri5(del_h, EBTDEBUG(3) ? &maxerri : NULL, &maxsqr);
+  err0 = err;					/* error estimation         */
   err = sqrt (err / (double)SystemSize);
 
+  /*
+   * The acceptance test and the step size control below are those of the
+   * original method: the RMS norm of the scaled local error against 1.0.
+   * Only the rounding of the norm differs, as RKErrorRMS() forms the error
+   * from the differences of the weights (e1...e7) in the same sweep as the
+   * dense output and sums its squares in RK_LANES partial sums. A step
+   * with an error norm within a few ulps of 1.0 can therefore be decided
+   * differently than before, after which the solution differs from that of
+   * older versions by amounts within the integration tolerance.
+   */
+
   if (err > 1.0)				/* Step rejected            */
     {
       if (EBTDEBUG(3))
 	{
-	  fprintf(dbgfil, "%-18s T = %15.8f     dt = %12.7E recurs = %2d Largest error contribution in ODE #%d (%.3f%%)\n",
+	  fprintf(dbgfil, "%-18s T = %15.8f     dt = %12.7E recurs = %2d Largest error contribution in ODE #%ld (%.3f%%)\n",
 		  "Step failed:", env[0], del_h, recur_no, maxerri, 100*maxsqr*maxsqr/err0);
 	  fflush(dbgfil);
 	}
@@ -752,7 +790,7 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
       step_failed=0;
       accepted_steps++;
       
-      if (EBTDEBUG(1))
+      if (EBTDEBUG(1) || AUTO_SWITCH)
 	{
 	  /*
 	   * Do some stiffness detection at regular intervals
@@ -775,9 +813,16 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
 		  nonsti = 0;
 		  iasti++;
 		  if (iasti == 15)
-		    (void)fprintf(dbgfil,
-				  "The problem is becoming stiff at T = %.4f\n",
-				  env[0]);
+		    {
+		      if (EBTDEBUG(1))
+			(void)fprintf(dbgfil,
+				      "The problem is becoming stiff at T = %.4f\n",
+				      env[0]);
+#if (AUTO_SWITCH == 1)
+		      NoteStiffness(1);		/* Switch to RADAU5 at the  */
+		      iasti = 0;		/* next cohort cycle        */
+#endif
+		    }
 		}
 	      else
 		{
@@ -867,29 +912,80 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
 #endif // (POPULATION_NR > 0)
 	}
 
-      /*
-       * Update the basic data copy, and the local copy 
-       */
-      (void)memcpy((DEF_TYPE *)env, (DEF_TYPE *)yy1, ENVIRON_DIM*sizeof(double));
+      SwapState();				/* Update basic data copy   */
+    }
 
-#if (POPULATION_NR > 0)
-      int		len;
+  return del_h;
+}
 
-      len = ENVIRON_DIM;
-      for(i=0; i<POPULATION_NR; i++)
-	{
-	  (void)memcpy((DEF_TYPE *)pop[i], (DEF_TYPE *)(yy1+len),
-		       (table_size[i]*COHORT_SIZE)*sizeof(double));
-	  len += (table_size[i]*COHORT_SIZE);
-	}
-#endif // (POPULATION_NR > 0)
 
-      (void)memcpy((DEF_TYPE *)y, (DEF_TYPE *)yy1, SystemSize*sizeof(double));
+
+#if ((AUTO_SWITCH == 1) && (EVENT_NR > 0))
+/*==============================================================================*/
+
+void	  ExchangeEvents(double *ELvalue, int *loc, int load)
+
+  /* 
+   * ExchangeEvents - Copies the values of the event indicators at the end of
+   *		      the last step and the flags of the located events to
+   *		      ELvalue[] and loc[] (load = 0), or loads them from there
+   *		      (load = 1), when switching integration methods at the
+   *		      end of a cohort cycle.
+   */
+
+{
+  if (load)
+    {
+      (void)memcpy((DEF_TYPE *)newELvalue, (DEF_TYPE *)ELvalue, EVENT_NR*sizeof(double));
+      (void)memcpy((DEF_TYPE *)located, (DEF_TYPE *)loc, EVENT_NR*sizeof(int));
+    }
+  else
+    {
+      (void)memcpy((DEF_TYPE *)ELvalue, (DEF_TYPE *)newELvalue, EVENT_NR*sizeof(double));
+      (void)memcpy((DEF_TYPE *)loc, (DEF_TYPE *)located, EVENT_NR*sizeof(int));
+    }
+
+  return;
+}
+#endif // ((AUTO_SWITCH == 1) && (EVENT_NR > 0))
+
+
+/*==============================================================================*/
+
+int	  ExchangeSolver(double *data, int load)
+
+  /* 
+   * ExchangeSolver - Copies the state of the method that is carried over
+   *		      from one cohort cycle to the next to data[] (load = 0),
+   *		      or loads it from there (load = 1), when writing or
+   *		      reading a checkpoint. Returns the number of values, which
+   *		      is all that is computed when data equals NULL.
+   */
+
+{
+  int			n = 0;
+#if (EVENT_NR > 0)
+  register int		i;
+#endif
+
+  ExchangeVar(data, n, load, facold);
+  ExchangeVar(data, n, load, nonsti);
+  ExchangeVar(data, n, load, iasti);
+  ExchangeVar(data, n, load, hlamb);
+  ExchangeVar(data, n, load, accepted_steps);
+#if (EVENT_NR > 0)
+  for (i=0; i<EVENT_NR; i++)
+    {
+      ExchangeVar(data, n, load, oldELvalue[i]);
+      ExchangeVar(data, n, load, newELvalue[i]);
+      ExchangeVar(data, n, load, located[i]);
     }
+#endif
 
-  return del_h;
+  return n;
 }
 
 
 
+
 /*==========================================================================*/
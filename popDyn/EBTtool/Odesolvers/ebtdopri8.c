@@ -74,57 +74,59 @@ SAFETY   Safety factor in the step size prediction, default 0.9.
  * Definitions of static variables, restricted to this file.
  */
 
-static int		step_failed=0, recur_no;
-static int		nonsti = 0, iasti = 0;
-static double		hlamb = 0.0;
-static long		accepted_steps = 0L;
-static long		ODEAllocated = 0L, SystemSize;
-static double		*y  = NULL, *yy1 = NULL, *yco  = NULL;
-static double		*k1 = NULL, *k2  = NULL, *k3   = NULL;
-static double		*k4 = NULL, *k5  = NULL, *k6   = NULL;
-static double		*k7 = NULL, *k8  = NULL, *k9   = NULL, *k10 = NULL;
-static double		*rcont1 = NULL, *rcont2  = NULL, *rcont3 = NULL;
-static double		*rcont4 = NULL, *rcont5  = NULL, *rcont6 = NULL;
-static double		*rcont7 = NULL, *rcont8  = NULL;
+static EBTSTATE int	step_failed=0, recur_no;
+static EBTSTATE int	nonsti = 0, iasti = 0;
+static EBTSTATE double	hlamb = 0.0;
+static EBTSTATE long	accepted_steps = 0L;
+static EBTSTATE long	ODEAllocated = 0L, SystemSize;
+static EBTSTATE double	*y  = NULL, *yy1 = NULL, *yco  = NULL;
+static EBTSTATE double	*k1 = NULL, *k2  = NULL, *k3   = NULL;
+static EBTSTATE double	*k4 = NULL, *k5  = NULL, *k6   = NULL;
+static EBTSTATE double	*k7 = NULL, *k8  = NULL, *k9   = NULL, *k10 = NULL;
+static EBTSTATE double	*rcont1 = NULL, *rcont2  = NULL, *rcont3 = NULL;
+static EBTSTATE double	*rcont4 = NULL, *rcont5  = NULL, *rcont6 = NULL;
+static EBTSTATE double	*rcont7 = NULL, *rcont8  = NULL;
 #if (POPULATION_NR > 0)
-static int		table_size[POPULATION_NR];
-static population	u_pop[POPULATION_NR], 	    u_ofs[POPULATION_NR];
-static population	c_pop[POPULATION_NR],	    c_ofs[POPULATION_NR];
-static population	u_popgrad1[POPULATION_NR],  u_ofsgrad1[POPULATION_NR];
-static population	u_popgrad2[POPULATION_NR],  u_ofsgrad2[POPULATION_NR];
-static population	u_popgrad3[POPULATION_NR],  u_ofsgrad3[POPULATION_NR];
-static population	u_popgrad4[POPULATION_NR],  u_ofsgrad4[POPULATION_NR];
-static population	u_popgrad5[POPULATION_NR],  u_ofsgrad5[POPULATION_NR];
-static population	u_popgrad6[POPULATION_NR],  u_ofsgrad6[POPULATION_NR];
-static population	u_popgrad7[POPULATION_NR],  u_ofsgrad7[POPULATION_NR];
-static population	u_popgrad8[POPULATION_NR],  u_ofsgrad8[POPULATION_NR];
-static population	u_popgrad9[POPULATION_NR],  u_ofsgrad9[POPULATION_NR];
-static population	u_popgrad10[POPULATION_NR], u_ofsgrad10[POPULATION_NR];
+static EBTSTATE int	table_size[POPULATION_NR];
+static EBTSTATE population	u_pop[POPULATION_NR], 	    u_ofs[POPULATION_NR];
+static EBTSTATE population	c_pop[POPULATION_NR],	    c_ofs[POPULATION_NR];
+static EBTSTATE population	u_popgrad1[POPULATION_NR],  u_ofsgrad1[POPULATION_NR];
+static EBTSTATE population	u_popgrad2[POPULATION_NR],  u_ofsgrad2[POPULATION_NR];
+static EBTSTATE population	u_popgrad3[POPULATION_NR],  u_ofsgrad3[POPULATION_NR];
+static EBTSTATE population	u_popgrad4[POPULATION_NR],  u_ofsgrad4[POPULATION_NR];
+static EBTSTATE population	u_popgrad5[POPULATION_NR],  u_ofsgrad5[POPULATION_NR];
+static EBTSTATE population	u_popgrad6[POPULATION_NR],  u_ofsgrad6[POPULATION_NR];
+static EBTSTATE population	u_popgrad7[POPULATION_NR],  u_ofsgrad7[POPULATION_NR];
+static EBTSTATE population	u_popgrad8[POPULATION_NR],  u_ofsgrad8[POPULATION_NR];
+static EBTSTATE population	u_popgrad9[POPULATION_NR],  u_ofsgrad9[POPULATION_NR];
+static EBTSTATE population	u_popgrad10[POPULATION_NR], u_ofsgrad10[POPULATION_NR];
 #else
-static population	*bpoints = NULL;
-static population	*u_pop = NULL, 	     *u_ofs = NULL;
+static EBTSTATE population	*bpoints = NULL;
+static EBTSTATE population	*u_pop = NULL, 	     *u_ofs = NULL;
 #if (EVENT_NR > 0)
-static population	*c_pop = NULL,	     *c_ofs = NULL;
+static EBTSTATE population	*c_pop = NULL,	     *c_ofs = NULL;
 #endif // (EVENT_NR > 0)
-static population	*u_popgrad1 = NULL,  *u_ofsgrad1 = NULL;
-static population	*u_popgrad2 = NULL,  *u_ofsgrad2 = NULL;
-static population	*u_popgrad3 = NULL,  *u_ofsgrad3 = NULL;
-static population	*u_popgrad4 = NULL,  *u_ofsgrad4 = NULL;
-static population	*u_popgrad5 = NULL,  *u_ofsgrad5 = NULL;
-static population	*u_popgrad6 = NULL,  *u_ofsgrad6 = NULL;
-static population	*u_popgrad7 = NULL,  *u_ofsgrad7 = NULL;
-static population	*u_popgrad8 = NULL,  *u_ofsgrad8 = NULL;
-static population	*u_popgrad9 = NULL,  *u_ofsgrad9 = NULL;
-static population	*u_popgrad10 = NULL, *u_ofsgrad10 = NULL;
+static EBTSTATE population	*u_popgrad1 = NULL,  *u_ofsgrad1 = NULL;
+static EBTSTATE population	*u_popgrad2 = NULL,  *u_ofsgrad2 = NULL;
+static EBTSTATE population	*u_popgrad3 = NULL,  *u_ofsgrad3 = NULL;
+static EBTSTATE population	*u_popgrad4 = NULL,  *u_ofsgrad4 = NULL;
+static EBTSTATE population	*u_popgrad5 = NULL,  *u_ofsgrad5 = NULL;
+static EBTSTATE population	*u_popgrad6 = NULL,  *u_ofsgrad6 = NULL;
+static EBTSTATE population	*u_popgrad7 = NULL,  *u_ofsgrad7 = NULL;
+static EBTSTATE population	*u_popgrad8 = NULL,  *u_ofsgrad8 = NULL;
+static EBTSTATE population	*u_popgrad9 = NULL,  *u_ofsgrad9 = NULL;
+static EBTSTATE population	*u_popgrad10 = NULL, *u_ofsgrad10 = NULL;
 #endif // (POPULATION_NR > 0)
 
-static double		facold = FACOLD;
+static EBTSTATE double	facold = FACOLD;
 #if (EVENT_NR > 0)
-static double		oldELvalue[EVENT_NR] = {0.0},
+static EBTSTATE double	oldELvalue[EVENT_NR] = {0.0},
 			newELvalue[EVENT_NR] = {0.0};
-static int		located[EVENT_NR] = {0};
+static EBTSTATE int	located[EVENT_NR] = {0};
 #endif
 
+#include "ebtrkstage.c"
+
 static CONST double	c2    =  0.526001519587677318785587544488E-01,
 			c3    =  0.789002279381515978178381316732E-01,
 			c4    =  0.118350341907227396726757197510E+00,
@@ -316,7 +318,7 @@ void	PrepareCycle()
     }
 #endif // (POPULATION_NR > 0)
 
-  if (!(SystemSize < ODEAllocated))
+  if (!(SystemSize < ODEAllocated) || MemExcess(SystemSize, ODEAllocated))
     {
       ODEAllocated = MemBlocks(SystemSize);
       y    = (double *)Myalloc((void *)y, (size_t)ODEAllocated,
@@ -406,6 +408,7 @@ void	PrepareCycle()
       u_ofsgrad10[i] = (population)(k10+len+CohortNo[i]*COHORT_SIZE);
       len += (table_size[i]*COHORT_SIZE);
     }
+  AliasPopulations(y);				/* Populations live in y    */
 #endif // (POPULATION_NR > 0)
 
   return;
@@ -426,6 +429,7 @@ static void	dopri8(double dt)
 
 {
   register int		i;
+  rkterms		c;
 
   initState = y;
   currentState = yy1;
@@ -457,74 +461,76 @@ static void	dopri8(double dt)
 #endif
     }
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * a21 * k1[i];
+  c = (rkterms){1, {a21}, {k1}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 2;
   Gradient(yy1, u_pop, u_ofs, k2, u_popgrad2, u_ofsgrad2, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a31*k1[i] + a32*k2[i]);
+  c = (rkterms){2, {a31, a32}, {k1, k2}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 3;
   Gradient(yy1, u_pop, u_ofs, k3, u_popgrad3, u_ofsgrad3, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a41*k1[i] + a43*k3[i]);
+  c = (rkterms){2, {a41, a43}, {k1, k3}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 4;
   Gradient(yy1, u_pop, u_ofs, k4, u_popgrad4, u_ofsgrad4, bpoints);
 
-  for (i = 0; i <SystemSize; i++)
-    yy1[i] = y[i] + dt * (a51*k1[i] + a53*k3[i] + a54*k4[i]);
+  c = (rkterms){3, {a51, a53, a54}, {k1, k3, k4}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 5;
   Gradient(yy1, u_pop, u_ofs, k5, u_popgrad5, u_ofsgrad5, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a61*k1[i] + a64*k4[i] + a65*k5[i]);
+  c = (rkterms){3, {a61, a64, a65}, {k1, k4, k5}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 6;
   Gradient(yy1, u_pop, u_ofs, k6, u_popgrad6, u_ofsgrad6, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a71*k1[i] + a74*k4[i] + a75*k5[i] + a76*k6[i]);
+  c = (rkterms){4, {a71, a74, a75, a76}, {k1, k4, k5, k6}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 7;
   Gradient(yy1, u_pop, u_ofs, k7, u_popgrad7, u_ofsgrad7, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a81*k1[i] + a84*k4[i] + a85*k5[i] + a86*k6[i] +
-			  a87*k7[i]);
+  c = (rkterms){5, {a81, a84, a85, a86, a87}, {k1, k4, k5, k6, k7}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 8;
   Gradient(yy1, u_pop, u_ofs, k8, u_popgrad8, u_ofsgrad8, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a91*k1[i] + a94*k4[i] + a95*k5[i] + a96*k6[i] +
-			  a97*k7[i] + a98*k8[i]);
+  c = (rkterms){6,
+	{a91, a94, a95, a96, a97, a98},
+	{k1, k4, k5, k6, k7, k8}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 9;
   Gradient(yy1, u_pop, u_ofs, k9, u_popgrad9, u_ofsgrad9, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a101*k1[i] + a104*k4[i] + a105*k5[i] + a106*k6[i] +
-			  a107*k7[i] + a108*k8[i] + a109*k9[i]);
+  c = (rkterms){7,
+	{a101, a104, a105, a106, a107, a108, a109},
+	{k1, k4, k5, k6, k7, k8, k9}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 10;
   Gradient(yy1, u_pop, u_ofs, k10, u_popgrad10, u_ofsgrad10, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a111*k1[i] + a114*k4[i] + a115*k5[i] + a116*k6[i] +
-			  a117*k7[i] + a118*k8[i] + a119*k9[i] + a1110*k10[i]);
+  c = (rkterms){8,
+	{a111, a114, a115, a116, a117, a118, a119, a1110},
+	{k1, k4, k5, k6, k7, k8, k9, k10}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 11;
   Gradient(yy1, u_pop, u_ofs, k2, u_popgrad2, u_ofsgrad2, bpoints);
 
-  for (i = 0; i < SystemSize; i++)
-    yy1[i] = y[i] + dt * (a121*k1[i] + a124*k4[i] + a125*k5[i] + a126*k6[i] +
-			  a127*k7[i] + a128*k8[i] + a129*k9[i] +
-			  a1210*k10[i] + a1211*k2[i]);
+  c = (rkterms){9,
+	{a121, a124, a125, a126, a127, a128, a129, a1210, a1211},
+	{k1, k4, k5, k6, k7, k8, k9, k10, k2}};
+  RKStage(SystemSize, yy1, y, dt, &c);
 
   rk_level = 12;
   Gradient(yy1, u_pop, u_ofs, k3, u_popgrad3, u_ofsgrad3, bpoints);
@@ -789,8 +795,8 @@ static void	  IntermediateState(double theta)
   /* 
    * IntermediateState - Routine computes the state of the system at an
    *			 intermediate time point by interpolation. 
-   *			 Values are stored in basic data copy for further use
-   *			 in output routines.
+   *			 Values are stored in yco, which pop[] points to
+   *			 for further use in output routines.
    */
   
 {
@@ -813,15 +819,8 @@ static void	  IntermediateState(double theta)
 
 #if (POPULATION_NR > 0)
   register int		j, k;
-  int			len;
 
-  len = ENVIRON_DIM;
-  for(i=0; i<POPULATION_NR; i++)
-    {
-      (void)memcpy((DEF_TYPE *)pop[i], (DEF_TYPE *)(yco+len),
-		   (table_size[i]*COHORT_SIZE)*sizeof(double));
-      len += (table_size[i]*COHORT_SIZE);
-    }
+  AliasPopulations(yco);			/* Until SwapState()        */
 
   for(i=0; i<POPULATION_NR; i++)
     {
@@ -844,6 +843,43 @@ static void	  IntermediateState(double theta)
 
 
 
+/*==============================================================================*/
+
+static void	  SwapState(void)
+
+  /* 
+   * SwapState - Routine makes the state at the end of the integration step
+   *		 the current state by swapping the pointers to the state
+   *		 vectors and points pop[] and the local pointers to them.
+   */
+
+{
+  double		*tmp;
+
+  tmp = y; y = yy1; yy1 = tmp;
+
+  (void)memcpy((DEF_TYPE *)env, (DEF_TYPE *)y, ENVIRON_DIM*sizeof(double));
+
+#if (POPULATION_NR > 0)
+  register int		i;
+  int			len;
+
+  len = ENVIRON_DIM;
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      u_pop[i] = (population)(yy1+len);
+      u_ofs[i] = (population)(yy1+len+(table_size[i]-BpointNo[i])*COHORT_SIZE);
+      len += (table_size[i]*COHORT_SIZE);
+    }
+  AliasPopulations(y);
+#endif // (POPULATION_NR > 0)
+
+  return;
+}
+
+
+
+
 /*==============================================================================*/
 
 double	  IntegrationStep(double del_tim, double del_max, int recurs)
@@ -1126,26 +1162,47 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
 #endif // (POPULATION_NR > 0)
 	}
       
-      /*
-       * Update the basic data copy, and the local copy 
-       */
-      (void)memcpy((DEF_TYPE *)env, (DEF_TYPE *)yy1, ENVIRON_DIM*sizeof(double));
-#if (POPULATION_NR > 0)
-      int			len;
+      SwapState();				/* Update basic data copy   */
+    }
 
-      len = ENVIRON_DIM;
-      for(i=0; i<POPULATION_NR; i++)
-	{
-	  (void)memcpy((DEF_TYPE *)pop[i], (DEF_TYPE *)(yy1+len),
-		       (table_size[i]*COHORT_SIZE)*sizeof(double));
-	  len += (table_size[i]*COHORT_SIZE);
-	}
-#endif // (POPULATION_NR > 0)
+  return del_h;
+}
 
-      (void)memcpy((DEF_TYPE *)y, (DEF_TYPE *)yy1, SystemSize*sizeof(double));
+
+
+/*==============================================================================*/
+
+int	  ExchangeSolver(double *data, int load)
+
+  /* 
+   * ExchangeSolver - Copies the state of the method that is carried over
+   *		      from one cohort cycle to the next to data[] (load = 0),
+   *		      or loads it from there (load = 1), when writing or
+   *		      reading a checkpoint. Returns the number of values, which
+   *		      is all that is computed when data equals NULL.
+   */
+
+{
+  int			n = 0;
+#if (EVENT_NR > 0)
+  register int		i;
+#endif
+
+  ExchangeVar(data, n, load, facold);
+  ExchangeVar(data, n, load, nonsti);
+  ExchangeVar(data, n, load, iasti);
+  ExchangeVar(data, n, load, hlamb);
+  ExchangeVar(data, n, load, accepted_steps);
+#if (EVENT_NR > 0)
+  for (i=0; i<EVENT_NR; i++)
+    {
+      ExchangeVar(data, n, load, oldELvalue[i]);
+      ExchangeVar(data, n, load, newELvalue[i]);
+      ExchangeVar(data, n, load, located[i]);
     }
+#endif
 
-  return del_h;
+  return n;
 }
 
 
@@ -29,6 +29,11 @@
 #define RADAU_TEST	0
 #endif
 
+#if RADAU_TEST
+#undef  BLOCK_JACOBIAN
+#define BLOCK_JACOBIAN	0
+#endif
+
 
 /*==========================================================================*/
 /*
@@ -58,6 +63,8 @@
 #define JACSTEP 1.0E-5		/* Step size for Jacobian computation       */
 #define INIT_H	1.0E-2		/* Initial stepsize when restarting         */
 #define ABS_ERR	1.0E-13
+#define NONSTIFF 15		/* Successive non-stiff steps before switch */
+#define STIFFRST 6		/* Stiff steps that reset the count above   */
 
 
 
@@ -79,38 +86,42 @@
  * Definitions of static variables, restricted to this file.
  */
 
-static int		step_failed=0, recur_no;
-static long		ODEAllocated = 0L, SystemSize, JacobianSize;
+static EBTSTATE int	step_failed=0, recur_no;
+static EBTSTATE long	ODEAllocated = 0L, SystemSize;
 
-static double		*y      = NULL, *yy1    = NULL, *yy2    = NULL;
-static double		*Jac    = NULL, *scal   = NULL, *z0     = NULL;
-static double		*E1     = NULL, *E2R    = NULL, *E2I    = NULL;
-static double		*z1     = NULL, *z2     = NULL, *z3     = NULL;
-static double		*f1     = NULL, *f2     = NULL, *f3     = NULL;
-static double		*rcont1 = NULL, *rcont2 = NULL, *rcont3 = NULL;
-static int		*daes   = NULL, *ip1    = NULL, *ip2    = NULL;
+static EBTSTATE double	*y      = NULL, *yy1    = NULL, *yy2    = NULL;
+static EBTSTATE double	*scal   = NULL, *z0     = NULL;
+#if (BLOCK_JACOBIAN != 1)
+static EBTSTATE long	JacobianSize;
+static EBTSTATE double	*Jac    = NULL;
+static EBTSTATE double	*E1     = NULL, *E2R    = NULL, *E2I    = NULL;
+#endif
+static EBTSTATE double	*z1     = NULL, *z2     = NULL, *z3     = NULL;
+static EBTSTATE double	*f1     = NULL, *f2     = NULL, *f3     = NULL;
+static EBTSTATE double	*rcont1 = NULL, *rcont2 = NULL, *rcont3 = NULL;
+static EBTSTATE int	*daes   = NULL, *ip1    = NULL, *ip2    = NULL;
 
 #if (POPULATION_NR > 0)
-static population	u_pop1[POPULATION_NR], 	   u_ofs1[POPULATION_NR];
-static population	u_pop2[POPULATION_NR], 	   u_ofs2[POPULATION_NR];
+static EBTSTATE population	u_pop1[POPULATION_NR], 	   u_ofs1[POPULATION_NR];
+static EBTSTATE population	u_pop2[POPULATION_NR], 	   u_ofs2[POPULATION_NR];
 
-static population_index	i_pop1[POPULATION_NR], 	   i_ofs1[POPULATION_NR];
+static EBTSTATE population_index	i_pop1[POPULATION_NR], 	   i_ofs1[POPULATION_NR];
 
-static population	u_popgrad0[POPULATION_NR], u_ofsgrad0[POPULATION_NR];
-static population	u_popgrad1[POPULATION_NR], u_ofsgrad1[POPULATION_NR];
-static population	u_popgrad2[POPULATION_NR], u_ofsgrad2[POPULATION_NR];
-static population	u_popgrad3[POPULATION_NR], u_ofsgrad3[POPULATION_NR];
-static population	u_popgrad4[POPULATION_NR], u_ofsgrad4[POPULATION_NR];
+static EBTSTATE population	u_popgrad0[POPULATION_NR], u_ofsgrad0[POPULATION_NR];
+static EBTSTATE population	u_popgrad1[POPULATION_NR], u_ofsgrad1[POPULATION_NR];
+static EBTSTATE population	u_popgrad2[POPULATION_NR], u_ofsgrad2[POPULATION_NR];
+static EBTSTATE population	u_popgrad3[POPULATION_NR], u_ofsgrad3[POPULATION_NR];
+static EBTSTATE population	u_popgrad4[POPULATION_NR], u_ofsgrad4[POPULATION_NR];
 #else
-static population	*bpoints = NULL;
-static population	*u_pop1 = NULL,     *u_ofs1 = NULL;
-static population	*u_pop2 = NULL,     *u_ofs2 = NULL;
-
-static population	*u_popgrad0 = NULL, *u_ofsgrad0 = NULL;
-static population	*u_popgrad1 = NULL, *u_ofsgrad1 = NULL;
-static population	*u_popgrad2 = NULL, *u_ofsgrad2 = NULL;
-static population	*u_popgrad3 = NULL, *u_ofsgrad3 = NULL;
-static population	*u_popgrad4 = NULL, *u_ofsgrad4 = NULL;
+static EBTSTATE population	*bpoints = NULL;
+static EBTSTATE population	*u_pop1 = NULL,     *u_ofs1 = NULL;
+static EBTSTATE population	*u_pop2 = NULL,     *u_ofs2 = NULL;
+
+static EBTSTATE population	*u_popgrad0 = NULL, *u_ofsgrad0 = NULL;
+static EBTSTATE population	*u_popgrad1 = NULL, *u_ofsgrad1 = NULL;
+static EBTSTATE population	*u_popgrad2 = NULL, *u_ofsgrad2 = NULL;
+static EBTSTATE population	*u_popgrad3 = NULL, *u_ofsgrad3 = NULL;
+static EBTSTATE population	*u_popgrad4 = NULL, *u_ofsgrad4 = NULL;
 #endif // (POPULATION_NR > 0)
 
 static const double	_c1    =    .15505102572168219018,
@@ -142,17 +153,25 @@ static const double	_t11  =   .091232394870892942792,
 			_ti32 =  2.5719269498556054292,
 			_ti33 =  -.59603920482822492497;
 
-static int		start_new = 1, jac_new = 1, caljac = 0, dec_new = 1;
-static int		newt = 0;
-static int		nfcn = 0, njac = 0, ndec = 0, nsol = 0, nsing = 0;
-static int		naccpt = 0, nrejct = 0;
-static double		faccon, theta, hhfac, erracc, hacc;
-static double		dynold, thqold;
-static double		dtold = 0.0;
+static EBTSTATE int	start_new = 1, jac_new = 1, caljac = 0, dec_new = 1;
+static EBTSTATE int	newt = 0;
+static EBTSTATE int	nfcn = 0, njac = 0, ndec = 0, nsol = 0, nsing = 0;
+static EBTSTATE int	naccpt = 0, nrejct = 0;
+static EBTSTATE double	faccon, theta, hhfac, erracc, hacc;
+static EBTSTATE double	dynold, thqold;
+static EBTSTATE double	dtold = 0.0;
+#if (AUTO_SWITCH == 1)
+static EBTSTATE double	*ysti   = NULL, *fsti   = NULL;
+static EBTSTATE int	nonsti = 0, iasti = 0, sti_valid = 0;
+#endif
 #if (EVENT_NR > 0)
-static double		oldELvalue[EVENT_NR] = {0.0},
+static EBTSTATE double	oldELvalue[EVENT_NR] = {0.0},
 			newELvalue[EVENT_NR] = {0.0};
-static int		located[EVENT_NR] = {0};
+static EBTSTATE int	located[EVENT_NR] = {0};
+#endif
+
+#if (BLOCK_JACOBIAN == 1)
+#include "ebtblockjac.c"
 #endif
 
 
@@ -175,6 +194,9 @@ void	PrepareCycle()
 
 {
   int				org, len;
+#if (BLOCK_JACOBIAN == 1)
+  int				nb, nblk, k;
+#endif
 
   SystemSize    = ENVIRON_DIM;
 #if (POPULATION_NR > 0)
@@ -183,9 +205,11 @@ void	PrepareCycle()
   for(i=0; i<POPULATION_NR; i++)
     SystemSize   += (CohortNo[i]+BpointNo[i])*COHORT_SIZE;
 #endif // (POPULATION_NR > 0)
+#if (BLOCK_JACOBIAN != 1)
   JacobianSize = SystemSize*SystemSize;
+#endif
 
-  if (!(SystemSize < ODEAllocated))
+  if (!(SystemSize < ODEAllocated) || MemExcess(SystemSize, ODEAllocated))
     {
       ODEAllocated = MemBlocks(SystemSize);
       y    = (double *)Myalloc((void *)y, (size_t)ODEAllocated,
@@ -194,6 +218,7 @@ void	PrepareCycle()
 			       sizeof(double));
       yy2  = (double *)Myalloc((void *)yy2, (size_t)ODEAllocated,
 			       sizeof(double));
+#if (BLOCK_JACOBIAN != 1)
       Jac  = (double *)Myalloc((void *)Jac, (size_t)(ODEAllocated*ODEAllocated),
 			       sizeof(double));
       E1   = (double *)Myalloc((void *)E1, (size_t)(ODEAllocated*ODEAllocated),
@@ -202,6 +227,8 @@ void	PrepareCycle()
 			       sizeof(double));
       E2I  = (double *)Myalloc((void *)E2I, (size_t)(ODEAllocated*ODEAllocated),
 			       sizeof(double));
+      if(!(Jac && E1 && E2R && E2I)) ErrorAbort(MAFO);
+#endif
       scal = (double *)Myalloc((void *)scal, (size_t)ODEAllocated,
 			       sizeof(double));
       daes = (int *)   Myalloc((void *)daes, (size_t)ODEAllocated,
@@ -230,10 +257,17 @@ void	PrepareCycle()
 				  sizeof(double));
       rcont3  = (double *)Myalloc((void *)rcont3, (size_t)ODEAllocated,
 				  sizeof(double));
-      if(!(y && yy1 && yy2 && Jac && E1 && E2R && E2I && scal &&
+      if(!(y && yy1 && yy2 && scal &&
 	   daes && ip1 && ip2 && z0 && z1 && z2 && z3 && f1 && f2 && f3 &&
 	   rcont1 && rcont2 && rcont3))
 	ErrorAbort(MAFO);
+#if (AUTO_SWITCH == 1)
+      ysti = (double *)Myalloc((void *)ysti, (size_t)ODEAllocated,
+			       sizeof(double));
+      fsti = (double *)Myalloc((void *)fsti, (size_t)ODEAllocated,
+			       sizeof(double));
+      if(!(ysti && fsti)) ErrorAbort(MAFO);
+#endif
 #if RADAU_TEST
       start_new = 1;
       jac_new = 1;
@@ -244,6 +278,9 @@ void	PrepareCycle()
 #endif
     }
 
+#if (AUTO_SWITCH == 1)
+  sti_valid = 0;
+#endif
 #if (!RADAU_TEST)
   start_new = 1;
   jac_new = 1;
@@ -302,6 +339,25 @@ void	PrepareCycle()
 
   (void)memset((DEF_TYPE *)daes, 0, (size_t)(ODEAllocated*sizeof(int)));
 
+#if (BLOCK_JACOBIAN == 1)
+  /*
+   * The environmental variables and the boundary cohorts make up the border
+   * of the structured Jacobian, the internal cohorts its diagonal blocks.
+   */
+  nb   = ENVIRON_DIM;
+  nblk = 0;
+#if (POPULATION_NR > 0)
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      nb   += BpointNo[i]*COHORT_SIZE;
+      nblk += CohortNo[i];
+    }
+#endif // (POPULATION_NR > 0)
+  BlockJacSetup(nb, nblk);
+  for (k=0; k<nb; k++)   BJbidx[k] = k;
+  for (k=0; k<nblk; k++) BJblk[k]  = nb + k*COHORT_SIZE;
+#endif
+
   return;
 }
 
@@ -632,6 +688,124 @@ static void 	solc(int dimM, double *MR, double *MI, double *VR, double *VI,
 
 
 
+#if (BLOCK_JACOBIAN == 1)
+/*==========================================================================*/
+
+static void	RadauDeriv(double *ydot)
+
+  /*
+   * RadauDeriv - Computes the derivatives in the state yy1[], as required
+   *		  for the computation of the structured Jacobian. The
+   *		  argument should equal yy2[], into which the population
+   *		  pointers u_pop2[] and u_ofs2[] point.
+   */
+
+{
+  Gradient(yy1, u_pop1, u_ofs1, ydot, u_pop2, u_ofs2, bpoints);
+  nfcn++;
+
+  return;
+}
+
+
+
+#if (JACOBIAN > 0)
+/*==========================================================================*/
+
+static void	RadauCohortJac(int b, double *dfdx, double *dedx)
+
+  /*
+   * RadauCohortJac - Computes the diagonal block of the Jacobian for the
+   *		      internal cohort with block index b in the state yy1[]
+   *		      with the routine Jacobian() from the problem file, or
+   *		      by automatic differentiation (see fns/ebtad.cpp).
+   */
+
+{
+#if (POPULATION_NR > 0)
+  int				p = 0;
+
+  while (b >= CohortNo[p]) b -= CohortNo[p++];
+#if (JACOBIAN == 2)
+  ADJacobian(yy1, u_pop1, u_ofs1, bpoints, p, b, dfdx, dedx);
+#else
+  Jacobian(yy1, u_pop1, u_ofs1, bpoints, p, b, dfdx, dedx);
+#endif
+#endif // (POPULATION_NR > 0)
+
+  return;
+}
+#endif // (JACOBIAN > 0)
+#endif // (BLOCK_JACOBIAN == 1)
+
+
+
+
+
+#if (AUTO_SWITCH == 1)
+/*==============================================================================*/
+
+static void	NonStiffness(void)
+
+  /* 
+   * NonStiffness - Estimates the product of the step size and the dominant
+   *		    eigenvalue of the Jacobian from the derivatives z0[] at the
+   *		    start of the previous and the present step, in the same way
+   *		    as the stiffness detection of DOPRI5. If the product stays
+   *		    within the stability region of DOPRI5 during NONSTIFF
+   *		    steps, the integrator registry is notified. The estimate
+   *		    from successive steps is cruder than the stage difference
+   *		    used by DOPRI5, hence the count of non-stiff steps is
+   *		    only reset after STIFFRST stiff steps, which prevents
+   *		    the methods from switching back and forth.
+   */
+
+{
+  register int		i;
+  double		sqr, stnum = 0.0, stden = 0.0, hlamb;
+
+  if (sti_valid)
+    {
+      for (i = 0; i < SystemSize; i++)
+	{
+	  sqr    = z0[i] - fsti[i];
+	  stnum += sqr*sqr;
+	  sqr    = yy1[i] - ysti[i];
+	  stden += sqr*sqr;
+	}
+      if (stden > 0.0)
+	{
+	  hlamb = (yy1[0] - ysti[0]) * sqrt (stnum / stden);
+	  if (hlamb > 3.25)
+	    {
+	      iasti++;
+	      if (iasti == STIFFRST) nonsti = 0;
+	    }
+	  else
+	    {
+	      iasti = 0;
+	      nonsti++;
+	    }
+	  if (nonsti == NONSTIFF)
+	    {
+	      if (EBTDEBUG(1))
+		(void)fprintf(dbgfil,
+			      "The problem is becoming non-stiff at T = %.4f\n",
+			      env[0]);
+	      NoteStiffness(0);			/* Switch to DOPRI5 at the  */
+	      nonsti = iasti = 0;		/* next cohort cycle        */
+	    }
+	}
+    }
+  (void)memcpy((DEF_TYPE *)ysti, (DEF_TYPE *)yy1, SystemSize*sizeof(double));
+  (void)memcpy((DEF_TYPE *)fsti, (DEF_TYPE *)z0, SystemSize*sizeof(double));
+  sti_valid = 1;
+
+  return;
+}
+#endif // (AUTO_SWITCH == 1)
+
+
 
 
 /*==============================================================================*/
@@ -645,10 +819,14 @@ static int   rad_core(double dt, int jn, int dn)
    */
 
 {
-  register int		i, j;
-  int			error = 0, done = 0;
+  register int		i;
+  int			done = 0;
+#if (BLOCK_JACOBIAN != 1)
+  register int		j;
+  int			error = 0;
   int			signE1, signE2;
   double		ysafe, delt;
+#endif
   double		_hv1, _hv2, _hv3;
   double		fac1, alphn, betan;
   double		c1q, c2q, c3q = 1.0;
@@ -668,6 +846,9 @@ static int   rad_core(double dt, int jn, int dn)
 #if (EVENT_NR > 0)
       for (i=0; i<EVENT_NR; i++) oldELvalue[i] = NO_EVENT;
       EventLocation(yy1, u_pop1, u_ofs1, bpoints, oldELvalue);
+#endif
+#if (AUTO_SWITCH == 1)
+      NonStiffness();
 #endif
     }
 
@@ -682,6 +863,12 @@ static int   rad_core(double dt, int jn, int dn)
       Jac[6] = 0.0; 
       Jac[7] = (-2.0*yy1[1]*yy1[2]-1.0)/(1.0E-6);
       Jac[8] = (1.0-yy1[1]*yy1[1])/(1.0E-6);
+#elif (BLOCK_JACOBIAN == 1)
+#if (JACOBIAN > 0)
+      BlockJacobian(yy1, z0, yy2, RadauDeriv, RadauCohortJac);
+#else
+      BlockJacobian(yy1, z0, yy2, RadauDeriv, NULL);
+#endif
 #else
       for (i = 0; i < SystemSize; i++)
 	{
@@ -707,6 +894,11 @@ static int   rad_core(double dt, int jn, int dn)
 
   if (jn || dn)
     {
+#if (BLOCK_JACOBIAN == 1)
+      if (BlockDec(fac1, daes)) return SINGULARITY;
+      if (BlockDecc(alphn, betan, daes)) return SINGULARITY;
+      ndec++;
+#else
       for (i = 0; i < JacobianSize; i++) E1[i] = -Jac[i];
 
       (void)memcpy((DEF_TYPE *)E2R, (DEF_TYPE *)E1, JacobianSize*sizeof(double));
@@ -727,6 +919,7 @@ static int   rad_core(double dt, int jn, int dn)
       error = decc(SystemSize, E2R, E2I, ip2, &signE2);
       if (error) return SINGULARITY;
       ndec++;
+#endif
     }
   
   /*
@@ -817,8 +1010,13 @@ static int   rad_core(double dt, int jn, int dn)
 	  z3[i] += _hv3*alphn + _hv2*betan;
 	}
       
+#if (BLOCK_JACOBIAN == 1)
+      BlockSol(z1);
+      BlockSolc(z2, z3);
+#else
       sol(SystemSize,  E1, z1, ip1);
       solc(SystemSize, E2R, E2I, z2, z3, ip2);
+#endif
       nsol++;
 
       /*
@@ -979,7 +1177,11 @@ static double	estrad(double h)
 	f2[i]  = _hv1*z1[i] + _hv2*z2[i] + _hv3*z3[i];
       yy2[i] = f2[i] + z0[i];
     }
+#if (BLOCK_JACOBIAN == 1)
+  BlockSol(yy2);
+#else
   sol(SystemSize, E1, yy2, ip1);
+#endif
   
   for (i = 1, err = 0.0; i < SystemSize; i++)	/* Exclude the time here    */
     err += pow(yy2[i]/scal[i], 2.0);
@@ -991,7 +1193,11 @@ static double	estrad(double h)
       Gradient(yy2, u_pop2, u_ofs2, f1, u_popgrad4, u_ofsgrad4, bpoints);
       nfcn++;
       for (i = 0; i < SystemSize; i++) yy2[i] = f1[i] + f2[i];
+#if (BLOCK_JACOBIAN == 1)
+      BlockSol(yy2);
+#else
       sol(SystemSize, E1, yy2, ip1);
+#endif
 
       for (i = 0, err = 0.0; i < SystemSize; i++)
 	err += pow(yy2[i]/scal[i], 2.0);
@@ -1537,6 +1743,89 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
 
 
 
+#if ((AUTO_SWITCH == 1) && (EVENT_NR > 0))
+/*==============================================================================*/
+
+void	  ExchangeEvents(double *ELvalue, int *loc, int load)
+
+  /* 
+   * ExchangeEvents - Copies the values of the event indicators at the end of
+   *		      the last step and the flags of the located events to
+   *		      ELvalue[] and loc[] (load = 0), or loads them from there
+   *		      (load = 1), when switching integration methods at the
+   *		      end of a cohort cycle.
+   */
+
+{
+  if (load)
+    {
+      (void)memcpy((DEF_TYPE *)newELvalue, (DEF_TYPE *)ELvalue, EVENT_NR*sizeof(double));
+      (void)memcpy((DEF_TYPE *)located, (DEF_TYPE *)loc, EVENT_NR*sizeof(int));
+    }
+  else
+    {
+      (void)memcpy((DEF_TYPE *)ELvalue, (DEF_TYPE *)newELvalue, EVENT_NR*sizeof(double));
+      (void)memcpy((DEF_TYPE *)loc, (DEF_TYPE *)located, EVENT_NR*sizeof(int));
+    }
+
+  return;
+}
+#endif // ((AUTO_SWITCH == 1) && (EVENT_NR > 0))
+
+
+
+/*==============================================================================*/
+
+int	  ExchangeSolver(double *data, int load)
+
+  /* 
+   * ExchangeSolver - Copies the state of the method that is carried over
+   *		      from one cohort cycle to the next to data[] (load = 0),
+   *		      or loads it from there (load = 1), when writing or
+   *		      reading a checkpoint. Returns the number of values, which
+   *		      is all that is computed when data equals NULL.
+   */
+
+{
+  int			n = 0;
+#if (EVENT_NR > 0)
+  register int		i;
+#endif
+
+  ExchangeVar(data, n, load, faccon);
+  ExchangeVar(data, n, load, theta);
+  ExchangeVar(data, n, load, hhfac);
+  ExchangeVar(data, n, load, erracc);
+  ExchangeVar(data, n, load, hacc);
+  ExchangeVar(data, n, load, dynold);
+  ExchangeVar(data, n, load, thqold);
+  ExchangeVar(data, n, load, dtold);
+  ExchangeVar(data, n, load, newt);
+  ExchangeVar(data, n, load, nfcn);
+  ExchangeVar(data, n, load, njac);
+  ExchangeVar(data, n, load, ndec);
+  ExchangeVar(data, n, load, nsol);
+  ExchangeVar(data, n, load, nsing);
+  ExchangeVar(data, n, load, naccpt);
+  ExchangeVar(data, n, load, nrejct);
+#if (AUTO_SWITCH == 1)
+  ExchangeVar(data, n, load, nonsti);
+  ExchangeVar(data, n, load, iasti);
+#endif
+#if (EVENT_NR > 0)
+  for (i=0; i<EVENT_NR; i++)
+    {
+      ExchangeVar(data, n, load, oldELvalue[i]);
+      ExchangeVar(data, n, load, newELvalue[i]);
+      ExchangeVar(data, n, load, located[i]);
+    }
+#endif
+
+  return n;
+}
+
+
+
 
 /*==============================================================================*/
 
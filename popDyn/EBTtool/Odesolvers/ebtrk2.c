@@ -30,19 +30,19 @@
  * Definitions of static variables, restricted to this file.
  */
 
-static long		ODEAllocated = 0L, SystemSize;
-static double		*xin = NULL, *xtemp = NULL;
-static double		*der1 = NULL, *der2 = NULL;
+static EBTSTATE long	ODEAllocated = 0L, SystemSize;
+static EBTSTATE double	*xin = NULL, *xtemp = NULL;
+static EBTSTATE double	*der1 = NULL, *der2 = NULL;
 #if (POPULATION_NR > 0)
-static int		table_size[POPULATION_NR];
-static population	u_pop[POPULATION_NR], 	   u_ofs[POPULATION_NR];
-static population	u_popgrad1[POPULATION_NR], u_ofsgrad1[POPULATION_NR];
-static population	u_popgrad2[POPULATION_NR], u_ofsgrad2[POPULATION_NR];
+static EBTSTATE int	table_size[POPULATION_NR];
+static EBTSTATE population	u_pop[POPULATION_NR], 	   u_ofs[POPULATION_NR];
+static EBTSTATE population	u_popgrad1[POPULATION_NR], u_ofsgrad1[POPULATION_NR];
+static EBTSTATE population	u_popgrad2[POPULATION_NR], u_ofsgrad2[POPULATION_NR];
 #else
-static population	*bpoints = NULL;
-static population	*u_pop = NULL, 	    *u_ofs = NULL;
-static population	*u_popgrad1 = NULL, *u_ofsgrad1 = NULL;
-static population	*u_popgrad2 = NULL, *u_ofsgrad2 = NULL;
+static EBTSTATE population	*bpoints = NULL;
+static EBTSTATE population	*u_pop = NULL, 	    *u_ofs = NULL;
+static EBTSTATE population	*u_popgrad1 = NULL, *u_ofsgrad1 = NULL;
+static EBTSTATE population	*u_popgrad2 = NULL, *u_ofsgrad2 = NULL;
 #endif // (POPULATION_NR > 0)
 
 
@@ -75,7 +75,7 @@ void	PrepareCycle()
       SystemSize   += table_size[i]*COHORT_SIZE;
     }
 #endif
-  if (!(SystemSize < ODEAllocated))
+  if (!(SystemSize < ODEAllocated) || MemExcess(SystemSize, ODEAllocated))
     {
       ODEAllocated = MemBlocks(SystemSize);
       xin   = (double *)Myalloc((void *)xin, (size_t)ODEAllocated,
@@ -110,6 +110,45 @@ void	PrepareCycle()
       u_ofsgrad2[i] = (population)(der2+len+CohortNo[i]*COHORT_SIZE);
       len += (table_size[i]*COHORT_SIZE);
     }
+  AliasPopulations(xin);			/* Populations live in xin  */
+#endif // (POPULATION_NR > 0)
+
+  return;
+}
+
+
+
+
+/*==========================================================================*/
+
+static void	  SwapState(void)
+
+  /* 
+   * SwapState - Routine makes the state at the end of the integration step
+   *		 the current state by swapping the pointers to the state
+   *		 vectors and points pop[] and the local pointers to them.
+   */
+
+{
+  double		*tmp;
+
+  tmp = xin; xin = xtemp; xtemp = tmp;
+
+  (void)memcpy((DEF_TYPE *)env,			/* Copy environment vars.   */
+	       (DEF_TYPE *)xin,
+	       ENVIRON_DIM*sizeof(double));
+#if (POPULATION_NR > 0)
+  register int		i;
+  int			len;
+
+  len = ENVIRON_DIM;
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      u_pop[i] = (population)(xtemp+len);
+      u_ofs[i] = (population)(xtemp+len+(table_size[i]-BpointNo[i])*COHORT_SIZE);
+      len += (table_size[i]*COHORT_SIZE);
+    }
+  AliasPopulations(xin);
 #endif // (POPULATION_NR > 0)
 
   return;
@@ -155,24 +194,7 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
   for (i=0; i<SystemSize; i++)
     xtemp[i] = xin[i] + h4*(der1[i]+3.0*der2[i]);
 
-						/* Update basic data copy   */
-  (void)memcpy((DEF_TYPE *)env,			/* Copy environment vars.   */
-	       (DEF_TYPE *)xtemp,
-	       ENVIRON_DIM*sizeof(double));
-#if (POPULATION_NR > 0)
-  int			len;
-
-  len = ENVIRON_DIM;
-  for(i=0; i<POPULATION_NR; i++)
-    {
-      (void)memcpy((DEF_TYPE *)pop[i],		/* Copy populations         */
-		   (DEF_TYPE *)(xtemp+len),
-		   (table_size[i]*COHORT_SIZE)*sizeof(double));
-      len += (table_size[i]*COHORT_SIZE);
-    }
-#endif						/* Update local data copy   */
-  (void)memcpy((DEF_TYPE *)xin,(DEF_TYPE *)xtemp,
-	       SystemSize*sizeof(double));
+  SwapState();					/* Update basic data copy   */
 
   return del_h;
 }
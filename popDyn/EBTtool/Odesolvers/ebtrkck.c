@@ -45,32 +45,34 @@
  * Definitions of static variables, restricted to this file.
  */
 
-static int		step_failed=0, recur_no;
-static long		ODEAllocated = 0L, SystemSize;
-static double		abs_err;
-static double		*xin = NULL, *xtemp = NULL;
-static double		*der1 = NULL, *der2 = NULL, *der3 = NULL;
-static double		*der4 = NULL, *der5 = NULL, *der6 = NULL;
+static EBTSTATE int	step_failed=0, recur_no;
+static EBTSTATE long	ODEAllocated = 0L, SystemSize;
+static EBTSTATE double	abs_err;
+static EBTSTATE double	*xin = NULL, *xtemp = NULL;
+static EBTSTATE double	*der1 = NULL, *der2 = NULL, *der3 = NULL;
+static EBTSTATE double	*der4 = NULL, *der5 = NULL, *der6 = NULL;
 #if (POPULATION_NR > 0)
-static int		table_size[POPULATION_NR];
-static population	u_pop[POPULATION_NR], 	   u_ofs[POPULATION_NR];
-static population	u_popgrad1[POPULATION_NR], u_ofsgrad1[POPULATION_NR];
-static population	u_popgrad2[POPULATION_NR], u_ofsgrad2[POPULATION_NR];
-static population	u_popgrad3[POPULATION_NR], u_ofsgrad3[POPULATION_NR];
-static population	u_popgrad4[POPULATION_NR], u_ofsgrad4[POPULATION_NR];
-static population	u_popgrad5[POPULATION_NR], u_ofsgrad5[POPULATION_NR];
-static population	u_popgrad6[POPULATION_NR], u_ofsgrad6[POPULATION_NR];
+static EBTSTATE int	table_size[POPULATION_NR];
+static EBTSTATE population	u_pop[POPULATION_NR], 	   u_ofs[POPULATION_NR];
+static EBTSTATE population	u_popgrad1[POPULATION_NR], u_ofsgrad1[POPULATION_NR];
+static EBTSTATE population	u_popgrad2[POPULATION_NR], u_ofsgrad2[POPULATION_NR];
+static EBTSTATE population	u_popgrad3[POPULATION_NR], u_ofsgrad3[POPULATION_NR];
+static EBTSTATE population	u_popgrad4[POPULATION_NR], u_ofsgrad4[POPULATION_NR];
+static EBTSTATE population	u_popgrad5[POPULATION_NR], u_ofsgrad5[POPULATION_NR];
+static EBTSTATE population	u_popgrad6[POPULATION_NR], u_ofsgrad6[POPULATION_NR];
 #else
-static population	*bpoints = NULL;
-static population	*u_pop = NULL, 	    *u_ofs = NULL;
-static population	*u_popgrad1 = NULL, *u_ofsgrad1 = NULL;
-static population	*u_popgrad2 = NULL, *u_ofsgrad2 = NULL;
-static population	*u_popgrad3 = NULL, *u_ofsgrad3 = NULL;
-static population	*u_popgrad4 = NULL, *u_ofsgrad4 = NULL;
-static population	*u_popgrad5 = NULL, *u_ofsgrad5 = NULL;
-static population	*u_popgrad6 = NULL, *u_ofsgrad6 = NULL;
+static EBTSTATE population	*bpoints = NULL;
+static EBTSTATE population	*u_pop = NULL, 	    *u_ofs = NULL;
+static EBTSTATE population	*u_popgrad1 = NULL, *u_ofsgrad1 = NULL;
+static EBTSTATE population	*u_popgrad2 = NULL, *u_ofsgrad2 = NULL;
+static EBTSTATE population	*u_popgrad3 = NULL, *u_ofsgrad3 = NULL;
+static EBTSTATE population	*u_popgrad4 = NULL, *u_ofsgrad4 = NULL;
+static EBTSTATE population	*u_popgrad5 = NULL, *u_ofsgrad5 = NULL;
+static EBTSTATE population	*u_popgrad6 = NULL, *u_ofsgrad6 = NULL;
 #endif // (POPULATION_NR > 0)
 
+#include "ebtrkstage.c"
+
 
 
 /*==========================================================================*/
@@ -104,7 +106,7 @@ void	PrepareCycle()
     }
 #endif
 
-  if (!(SystemSize < ODEAllocated))
+  if (!(SystemSize < ODEAllocated) || MemExcess(SystemSize, ODEAllocated))
     {
       ODEAllocated = MemBlocks(SystemSize);
       xin   = (double *)Myalloc((void *)xin, (size_t)ODEAllocated,
@@ -157,6 +159,7 @@ void	PrepareCycle()
 
       len += (table_size[i]*COHORT_SIZE);
     }
+  AliasPopulations(xin);			/* Populations live in xin  */
 #endif
 
   return;
@@ -167,15 +170,54 @@ void	PrepareCycle()
 
 /*==========================================================================*/
 
-static void	rkck(double dt)
+static void	  SwapState(void)
 
   /* 
-   * rkck - Routine performs a Cash-Karp Runge-Kutta integration step of
-   *        the system and updates all the variables.
+   * SwapState - Routine makes the state at the end of the integration step
+   *		 the current state by swapping the pointers to the state
+   *		 vectors and points pop[] and the local pointers to them.
    */
 
 {
+  double		*tmp;
+
+  tmp = xin; xin = xtemp; xtemp = tmp;
+
+  (void)memcpy((DEF_TYPE *)env,			/* Copy environment vars.   */
+	       (DEF_TYPE *)xin,
+	       ENVIRON_DIM*sizeof(double));
+#if (POPULATION_NR > 0)
   register int		i;
+  int			len;
+
+  len = ENVIRON_DIM;
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      u_pop[i] = (population)(xtemp+len);
+      u_ofs[i] = (population)(xtemp+len+(table_size[i]-BpointNo[i])*COHORT_SIZE);
+      len += (table_size[i]*COHORT_SIZE);
+    }
+  AliasPopulations(xin);
+#endif // (POPULATION_NR > 0)
+
+  return;
+}
+
+
+
+
+/*==========================================================================*/
+
+static double	rkck(double dt, long *ierr)
+
+  /* 
+   * rkck - Routine performs a Cash-Karp Runge-Kutta integration step of
+   *        the system and updates all the variables. Returns the largest
+   *	    relative difference between the 4th and 5th order solutions
+   *	    and, if ierr is not NULL, its index in ierr.
+   */
+
+{
   static CONST double	b11=		     0.2;
   static CONST double	b21=	    3.0/    40.0,  b22=	       9.0/     40.0;
   static CONST double	b31=		     0.3,  b32= -		 0.9,
@@ -194,6 +236,8 @@ static void	rkck(double dt)
 			dc4 = 125.0/ 594.0 - 13525.0/55296.0,
 			dc5 =		   -   277.0/14336.0,
 			dc6 = 512.0/1771.0 - 0.25;
+  rkterms		c;
+  rkterms		e;
 
   initState = xin;
   currentState = xtemp;
@@ -215,48 +259,43 @@ static void	rkck(double dt)
       Gradient(xtemp, u_pop, u_ofs, der1, u_popgrad1, u_ofsgrad1, bpoints);
     }
 
-  for (i=0; i<SystemSize; i++)
-    xtemp[i] = xin[i] + dt*(b11*der1[i]);
+  c = (rkterms){1, {b11}, {der1}};
+  RKStage(SystemSize, xtemp, xin, dt, &c);
 
   rk_level = 2;
   Gradient(xtemp, u_pop, u_ofs, der2, u_popgrad2, u_ofsgrad2, bpoints);
 
-  for (i=0; i<SystemSize; i++)
-    xtemp[i] = xin[i] + dt*(b21*der1[i]+b22*der2[i]);
+  c = (rkterms){2, {b21, b22}, {der1, der2}};
+  RKStage(SystemSize, xtemp, xin, dt, &c);
 
   rk_level = 3;
   Gradient(xtemp, u_pop, u_ofs, der3, u_popgrad3, u_ofsgrad3, bpoints);
 
-  for (i=0; i<SystemSize; i++)
-    xtemp[i] = xin[i] + dt*(b31*der1[i]+b32*der2[i]+b33*der3[i]);
+  c = (rkterms){3, {b31, b32, b33}, {der1, der2, der3}};
+  RKStage(SystemSize, xtemp, xin, dt, &c);
 
   rk_level = 4;
   Gradient(xtemp, u_pop, u_ofs, der4, u_popgrad4, u_ofsgrad4, bpoints);
 
-  for (i=0; i<SystemSize; i++)
-    xtemp[i] = xin[i] +
-      dt*(b41*der1[i]+b42*der2[i]+b43*der3[i]+b44*der4[i]);
+  c = (rkterms){4, {b41, b42, b43, b44}, {der1, der2, der3, der4}};
+  RKStage(SystemSize, xtemp, xin, dt, &c);
 
   rk_level = 5;
   Gradient(xtemp, u_pop, u_ofs, der5, u_popgrad5, u_ofsgrad5, bpoints);
 
-  for (i=0; i<SystemSize; i++)
-    xtemp[i] = xin[i] +
-      dt*(b51*der1[i]+b52*der2[i]+b53*der3[i]+b54*der4[i]+b55*der5[i]);
+  c = (rkterms){5, {b51, b52, b53, b54, b55}, {der1, der2, der3, der4, der5}};
+  RKStage(SystemSize, xtemp, xin, dt, &c);
 
   rk_level = 6;
   Gradient(xtemp, u_pop, u_ofs, der6, u_popgrad6, u_ofsgrad6, bpoints);
 
-  for (i=0; i<SystemSize; i++)			/* Save 5th order values    */
-    xtemp[i] = xin[i] +
-      dt*(c1*der1[i]+c3*der3[i]+c4*der4[i]+c6*der6[i]);
-
-						/* Save differences with 4th*/
-  for (i=0; i<SystemSize; i++)			/* order values in der2     */
-    der2[i] =					/* (no longer needed)       */
-      dt*(dc1*der1[i]+dc3*der3[i]+dc4*der4[i]+dc5*der5[i]+dc6*der6[i]);
+						/* 5th order values and the */
+						/* difference with the 4th  */
+						/* order values in one sweep*/
+  c = (rkterms){4, {c1, c3, c4, c6}, {der1, der3, der4, der6}};
+  e = (rkterms){5, {dc1, dc3, dc4, dc5, dc6}, {der1, der3, der4, der5, der6}};
 
-  return;
+  return RKErrorMax(SystemSize, xtemp, xin, dt, &c, &e, abs_err, ierr);
 }
 
 
@@ -276,10 +315,9 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
    */
   
 {
-  register int		i, ierr = -1;
-  register double	*pin, *perr, *pout;
+  long			ierr = -1;
   double		del_h, ss;
-  double		errmax, err;
+  double		errmax;
   int			adjust = 1;
   
   del_h = del_tim;				/* Adjust stepsize to hit   */
@@ -298,24 +336,14 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
     }
   recur_no = recurs;
 
-  rkck(del_h);					/* Do an integration step   */
-
-  pin = xin; perr = der2; pout = xtemp; errmax=0.0;
+						/* Do an integration step   */
+  errmax  = rkck(del_h, EBTDEBUG(4) ? &ierr : NULL);
 
   // Determine relative error according to Watts & Shampine (see Forsythe)
-  for(i=0; i<SystemSize; i++)
-    {
-      err    = fabs(perr[i])/(fabs(pin[i])+fabs(pout[i])+abs_err);
-      if (EBTDEBUG(4))
-	{
-	  if (err > errmax) ierr = i;
-	}
-      errmax = max(err, errmax);
-    }
   errmax *= 2.0*del_h/accuracy;
   if (EBTDEBUG(4))
 	{
-	  fprintf(dbgfil, "Largest error %15.8E in component %2d\n", errmax, ierr);
+	  fprintf(dbgfil, "Largest error %15.8E in component %2ld\n", errmax, ierr);
 	  fflush(dbgfil);
 	}
 						/* If bigger than accuracy  */
@@ -354,24 +382,7 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
         }
       step_failed=0;
 
-						/* Update basic data copy   */
-      (void)memcpy((DEF_TYPE *)env,		/* Copy environment vars.   */
-                   (DEF_TYPE *)xtemp,
-		   ENVIRON_DIM*sizeof(double));
-
-#if (POPULATION_NR > 0)
-      int			len = ENVIRON_DIM;
-
-      for(i=0; i<POPULATION_NR; i++)
-	{
-	  (void)memcpy((DEF_TYPE *)pop[i],	/* Copy other populations   */
-		       (DEF_TYPE *)(xtemp+len),
-		       (table_size[i]*COHORT_SIZE)*sizeof(double));
-	  len += (table_size[i]*COHORT_SIZE);
-	}
-#endif						/* Update local data copy   */
-      (void)memcpy((DEF_TYPE *)xin,(DEF_TYPE *)xtemp,
-		   SystemSize*sizeof(double));
+      SwapState();				/* Update basic data copy   */
       if (EBTDEBUG(4))
 	{
 	  fprintf(dbgfil, "Step OK: T = %15.8f dt = %12.7E recurs = %2d\n",
@@ -45,32 +45,34 @@
  * Definitions of static variables, restricted to this file.
  */
 
-static int		step_failed=0, recur_no;
-static long		ODEAllocated = 0L, SystemSize;
-static double		abs_err;
-static double		*xin = NULL, *xtemp = NULL;
-static double		*der1 = NULL, *der2 = NULL, *der3 = NULL;
-static double		*der4 = NULL, *der5 = NULL, *der6 = NULL;
+static EBTSTATE int	step_failed=0, recur_no;
+static EBTSTATE long	ODEAllocated = 0L, SystemSize;
+static EBTSTATE double	abs_err;
+static EBTSTATE double	*xin = NULL, *xtemp = NULL;
+static EBTSTATE double	*der1 = NULL, *der2 = NULL, *der3 = NULL;
+static EBTSTATE double	*der4 = NULL, *der5 = NULL, *der6 = NULL;
 #if (POPULATION_NR > 0)
-static int		table_size[POPULATION_NR];
-static population	u_pop[POPULATION_NR], 	   u_ofs[POPULATION_NR];
-static population	u_popgrad1[POPULATION_NR], u_ofsgrad1[POPULATION_NR];
-static population	u_popgrad2[POPULATION_NR], u_ofsgrad2[POPULATION_NR];
-static population	u_popgrad3[POPULATION_NR], u_ofsgrad3[POPULATION_NR];
-static population	u_popgrad4[POPULATION_NR], u_ofsgrad4[POPULATION_NR];
-static population	u_popgrad5[POPULATION_NR], u_ofsgrad5[POPULATION_NR];
-static population	u_popgrad6[POPULATION_NR], u_ofsgrad6[POPULATION_NR];
+static EBTSTATE int	table_size[POPULATION_NR];
+static EBTSTATE population	u_pop[POPULATION_NR], 	   u_ofs[POPULATION_NR];
+static EBTSTATE population	u_popgrad1[POPULATION_NR], u_ofsgrad1[POPULATION_NR];
+static EBTSTATE population	u_popgrad2[POPULATION_NR], u_ofsgrad2[POPULATION_NR];
+static EBTSTATE population	u_popgrad3[POPULATION_NR], u_ofsgrad3[POPULATION_NR];
+static EBTSTATE population	u_popgrad4[POPULATION_NR], u_ofsgrad4[POPULATION_NR];
+static EBTSTATE population	u_popgrad5[POPULATION_NR], u_ofsgrad5[POPULATION_NR];
+static EBTSTATE population	u_popgrad6[POPULATION_NR], u_ofsgrad6[POPULATION_NR];
 #else
-static population	*bpoints = NULL;
-static population	*u_pop = NULL, 	    *u_ofs = NULL;
-static population	*u_popgrad1 = NULL, *u_ofsgrad1 = NULL;
-static population	*u_popgrad2 = NULL, *u_ofsgrad2 = NULL;
-static population	*u_popgrad3 = NULL, *u_ofsgrad3 = NULL;
-static population	*u_popgrad4 = NULL, *u_ofsgrad4 = NULL;
-static population	*u_popgrad5 = NULL, *u_ofsgrad5 = NULL;
-static population	*u_popgrad6 = NULL, *u_ofsgrad6 = NULL;
+static EBTSTATE population	*bpoints = NULL;
+static EBTSTATE population	*u_pop = NULL, 	    *u_ofs = NULL;
+static EBTSTATE population	*u_popgrad1 = NULL, *u_ofsgrad1 = NULL;
+static EBTSTATE population	*u_popgrad2 = NULL, *u_ofsgrad2 = NULL;
+static EBTSTATE population	*u_popgrad3 = NULL, *u_ofsgrad3 = NULL;
+static EBTSTATE population	*u_popgrad4 = NULL, *u_ofsgrad4 = NULL;
+static EBTSTATE population	*u_popgrad5 = NULL, *u_ofsgrad5 = NULL;
+static EBTSTATE population	*u_popgrad6 = NULL, *u_ofsgrad6 = NULL;
 #endif // (POPULATION_NR > 0)
 
+#include "ebtrkstage.c"
+
 
 
 /*==========================================================================*/
@@ -102,7 +104,7 @@ void	PrepareCycle()
       SystemSize   += table_size[i]*COHORT_SIZE;
     }
 #endif //(POPULATION_NR > 0)
-  if (!(SystemSize < ODEAllocated))
+  if (!(SystemSize < ODEAllocated) || MemExcess(SystemSize, ODEAllocated))
     {
       ODEAllocated = MemBlocks(SystemSize);
       xin   = (double *)Myalloc((void *)xin, (size_t)ODEAllocated,
@@ -153,6 +155,7 @@ void	PrepareCycle()
       u_ofsgrad6[i] = (population)(der6+len+CohortNo[i]*COHORT_SIZE);
       len += (table_size[i]*COHORT_SIZE);
     }
+  AliasPopulations(xin);			/* Populations live in xin  */
 #endif // (POPULATION_NR > 0)
 
   return;
@@ -163,15 +166,53 @@ void	PrepareCycle()
 
 /*==========================================================================*/
 
-static void	Fehlberg(double dt)
+static void	  SwapState(void)
 
   /* 
-   * Fehlberg - Routine performs a RKF45 integration step of the system and 
-   *            updates all the variables.
+   * SwapState - Routine makes the state at the end of the integration step
+   *		 the current state by swapping the pointers to the state
+   *		 vectors and points pop[] and the local pointers to them.
    */
 
 {
+  double		*tmp;
+
+  tmp = xin; xin = xtemp; xtemp = tmp;
+
+  (void)memcpy((DEF_TYPE *)env,			/* Copy environment vars.   */
+	       (DEF_TYPE *)xin,
+	       ENVIRON_DIM*sizeof(double));
+#if (POPULATION_NR > 0)
   register int		i;
+  int			len;
+
+  len = ENVIRON_DIM;
+  for(i=0; i<POPULATION_NR; i++)
+    {
+      u_pop[i] = (population)(xtemp+len);
+      u_ofs[i] = (population)(xtemp+len+(table_size[i]-BpointNo[i])*COHORT_SIZE);
+      len += (table_size[i]*COHORT_SIZE);
+    }
+  AliasPopulations(xin);
+#endif // (POPULATION_NR > 0)
+
+  return;
+}
+
+
+
+
+/*==========================================================================*/
+
+static double	Fehlberg(double dt)
+
+  /* 
+   * Fehlberg - Routine performs a RKF45 integration step of the system and 
+   *            updates all the variables. Returns the largest relative
+   *		difference between the 4th and 5th order solutions.
+   */
+
+{
   static CONST double	b11=  	    1.0/     4.0;
   static CONST double	b21=	    3.0/    32.0,  b22=	       9.0/     32.0;
   static CONST double	b31=	 1932.0/  2197.0,  b32= -   7200.0/   2197.0,
@@ -187,6 +228,8 @@ static void	Fehlberg(double dt)
   static CONST double	b71=   902880.0/7618050.0,
 			b73=  3953664.0/7618050.0, b74=  3855735.0/7618050.0,
 			b75= -1371249.0/7618050.0, b76=   277020.0/7618050.0;
+  rkterms		c;
+  rkterms		e;
 
   initState = xin;
   currentState   = xtemp;
@@ -208,48 +251,44 @@ static void	Fehlberg(double dt)
       Gradient(xtemp, u_pop, u_ofs, der1, u_popgrad1, u_ofsgrad1, bpoints);
     }
 
-  for (i=0; i<SystemSize; i++)
-    xtemp[i] = xin[i] + dt*(b11*der1[i]);
+  c = (rkterms){1, {b11}, {der1}};
+  RKStage(SystemSize, xtemp, xin, dt, &c);
 
   rk_level = 2;
   Gradient(xtemp, u_pop, u_ofs, der2, u_popgrad2, u_ofsgrad2, bpoints);
 
-  for (i=0; i<SystemSize; i++)
-    xtemp[i] = xin[i] + dt*(b21*der1[i]+b22*der2[i]);
+  c = (rkterms){2, {b21, b22}, {der1, der2}};
+  RKStage(SystemSize, xtemp, xin, dt, &c);
 
   rk_level = 3;
   Gradient(xtemp, u_pop, u_ofs, der3, u_popgrad3, u_ofsgrad3, bpoints);
 
-  for (i=0; i<SystemSize; i++)
-    xtemp[i] = xin[i] + dt*(b31*der1[i]+b32*der2[i]+b33*der3[i]);
+  c = (rkterms){3, {b31, b32, b33}, {der1, der2, der3}};
+  RKStage(SystemSize, xtemp, xin, dt, &c);
 
   rk_level = 4;
   Gradient(xtemp, u_pop, u_ofs, der4, u_popgrad4, u_ofsgrad4, bpoints);
 
-  for (i=0; i<SystemSize; i++)
-    xtemp[i] = xin[i] +
-      dt*(b41*der1[i]+b42*der2[i]+b43*der3[i]+b44*der4[i]);
+  c = (rkterms){4, {b41, b42, b43, b44}, {der1, der2, der3, der4}};
+  RKStage(SystemSize, xtemp, xin, dt, &c);
 
   rk_level = 5;
   Gradient(xtemp, u_pop, u_ofs, der5, u_popgrad5, u_ofsgrad5, bpoints);
 
-  for (i=0; i<SystemSize; i++)
-    xtemp[i] = xin[i] +
-      dt*(b51*der1[i]+b52*der2[i]+b53*der3[i]+b54*der4[i]+b55*der5[i]);
+  c = (rkterms){5, {b51, b52, b53, b54, b55}, {der1, der2, der3, der4, der5}};
+  RKStage(SystemSize, xtemp, xin, dt, &c);
 
   rk_level = 6;
   Gradient(xtemp, u_pop, u_ofs, der6, u_popgrad6, u_ofsgrad6, bpoints);
 
-  for (i=0; i<SystemSize; i++)			/* Save 5th order values    */
-    xtemp[i] = xin[i] +
-      dt*(b71*der1[i]+b73*der3[i]+b74*der4[i]+b75*der5[i]+b76*der6[i]);
+						/* 5th order values and the */
+						/* difference with the 4th  */
+						/* order values in one sweep*/
+  c = (rkterms){5, {b71, b73, b74, b75, b76}, {der1, der3, der4, der5, der6}};
+  e = (rkterms){5, {b61-b71, b63-b73, b64-b74, b65-b75, -b76},
+		   {der1, der3, der4, der5, der6}};
 
-						/* Save differences with 4th*/
-  for (i=0; i<SystemSize; i++)			/* order values in der2     */
-    der2[i] = xin[i] - xtemp[i] +		/* (no longer needed)       */
-      dt*(b61*der1[i]+b63*der3[i]+b64*der4[i]+b65*der5[i]);
-
-  return;
+  return RKErrorMax(SystemSize, xtemp, xin, dt, &c, &e, abs_err, NULL);
 }
 
 
@@ -269,8 +308,6 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
    */
   
 {
-  register int		i;
-  register double	*pin, *perr, *pout;
   double		del_h, ss;
   double		errmax;
   int			adjust = 1;
@@ -291,12 +328,8 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
     }
   recur_no = recurs;
 
-  Fehlberg(del_h);				/* Do an integration step   */
-
-  pin = xin; perr = der2; pout = xtemp; errmax=0.0;
-  for(i=0; i<SystemSize; i++)
-      errmax = max(fabs(perr[i])/(fabs(pin[i])+fabs(pout[i])+abs_err),
-		   errmax);			/* Determine relative error */
+  errmax  = Fehlberg(del_h);			/* Do an integration step   */
+						/* Determine relative error */
   errmax *= 2.0*del_h/accuracy;			/* according to Watts &	    */
 						/* Shampine (see Forsythe)  */
 
@@ -329,25 +362,7 @@ double	  IntegrationStep(double del_tim, double del_max, int recurs)
 	}
       step_failed=0;
 
-						/* Update basic data copy   */
-      (void)memcpy((DEF_TYPE *)env,		/* Copy environment vars.   */
-                   (DEF_TYPE *)xtemp,
-		   ENVIRON_DIM*sizeof(double));
-#if (POPULATION_NR > 0)
-      int			len, adjust = 1;
-
-      len = ENVIRON_DIM;
-      for(i=0; i<POPULATION_NR; i++)
-	{
-	  (void)memcpy((DEF_TYPE *)pop[i],	/* Copy all populations     */
-		       (DEF_TYPE *)(xtemp+len),
-		       (table_size[i]*COHORT_SIZE)*sizeof(double));
-	  len += (table_size[i]*COHORT_SIZE);
-	}
-#endif // (POPULATION_NR > 0)
-						/* Update local data copy   */
-      (void)memcpy((DEF_TYPE *)xin,(DEF_TYPE *)xtemp,
-		   SystemSize*sizeof(double));
+      SwapState();				/* Update basic data copy   */
 
     }
   
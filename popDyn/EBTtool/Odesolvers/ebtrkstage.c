@@ -0,0 +1,507 @@
+/***
+   NAME
+     ebtrkstage
+   DESCRIPTION
+     This file contains the stage combination kernels that are shared by the
+     explicit Runge-Kutta integration methods (RKF45, RKCK, DOPRI5 and
+     DOPRI8) of the Escalator Boxcar Train program. It is included by these
+     methods.
+
+     Every stage of an explicit Runge-Kutta method computes a linear
+     combination of the derivatives of the previous stages:
+
+		out[i] = base[i] + dt*(a[0]*k[0][i] + ... + a[m-1]*k[m-1][i])
+
+     With large numbers of cohorts these loops are limited by the memory
+     bandwidth rather than by the arithmetic. The kernels therefore process
+     the state vector in strips of RK_STRIP elements, small enough to stay
+     in the first level cache, such that every vector is read from memory
+     only once, irrespective of the number of terms. The final stage of the
+     step moreover computes the (dense output or solution) combination and
+     the error norm in the same sweep, without storing the error vector.
+
+     The loops over a strip are simple enough to be vectorized by the
+     compiler. When SIMD_DISPATCH is defined (see ebttune.h) the compiler
+     generates AVX-512, AVX2 and generic versions of the kernels and the
+     fastest version supported by the processor is selected at run time.
+     The sum of squares in RKErrorRMS() is accumulated in RK_LANES partial
+     sums, such that the result does not depend on the version used.
+
+     Large state vectors are processed in parallel (see ParallelForBlocks()
+     in ebtutils.c), in blocks of RK_PARSTRIPS strips. The error norms of
+     the blocks are combined in the order of the blocks, such that the
+     result does not depend on the number of threads.
+
+   Created: Oct 17, 2026
+***/
+
+#ifndef EBTRKSTAGE
+#define EBTRKSTAGE
+
+
+
+/*==========================================================================*/
+/*
+ * Defining all constants that are local to this specific file.
+ */
+/*==========================================================================*/
+
+#define RK_STRIP	256			/* Elements per cache strip */
+#define RK_LANES	8			/* Partial sums in norms    */
+#define RK_TERMS	12			/* Maximum number of terms  */
+#define RK_PARSTRIPS	16			/* Strips per parallel block*/
+
+#define MAFK "Memory allocation failure in Runge-Kutta stage kernels!"
+
+#ifndef SIMD_DISPATCH
+#define SIMD_DISPATCH
+#endif
+
+
+/*==========================================================================*/
+/*
+ * Type definition of a linear combination of stage derivatives.
+ */
+
+typedef struct
+{
+  int			m;			/* Number of terms	    */
+  double		a[RK_TERMS];		/* Coefficients		    */
+  double		*k[RK_TERMS];		/* Stage derivatives	    */
+} rkterms;
+
+
+/*
+ * Arguments and results of the parallel blocks of the kernels.
+ */
+
+typedef struct
+{
+  long			n;			/* Length of state vector   */
+  double		*out;			/* Combination		    */
+  CONST double		*base, *y0, *y1;	/* Base and solution vectors*/
+  double		dt, atol, rtol;		/* Step size, tolerances    */
+  CONST rkterms		*oc, *ec;		/* Combination and error    */
+  int			wantmax;		/* Largest error requested  */
+} rkjob;
+
+#if defined(EBTDOPRI5) || defined(EBTRKF45) || defined(EBTRKCK)
+static EBTSTATE double	*rkblkerr = NULL;	/* Error norms of blocks    */
+static EBTSTATE double	*rkblkmax = NULL;	/* Largest errors of blocks */
+static EBTSTATE long	*rkblkidx = NULL;	/* Index of largest errors  */
+static EBTSTATE long	rkblkalloc = 0L;
+#endif
+
+
+/*==========================================================================*/
+/*
+ * Start of function implementations.
+ */
+/*==========================================================================*/
+
+#if defined(EBTDOPRI5) || defined(EBTRKF45) || defined(EBTRKCK)
+static int	RKBlocks(long n)
+
+  /*
+   * RKBlocks - Returns the number of parallel blocks of a state vector of
+   *		length n and makes sure that the arrays with the results of
+   *		the blocks are large enough.
+   */
+
+{
+  long			nblk;
+
+  nblk = (n + RK_PARSTRIPS*RK_STRIP - 1)/(RK_PARSTRIPS*RK_STRIP);
+  if (nblk > rkblkalloc)
+    {
+      rkblkalloc = MemBlocks(nblk);
+      rkblkerr = (double *)Myalloc((void *)rkblkerr, (size_t)rkblkalloc,
+				   sizeof(double));
+      rkblkmax = (double *)Myalloc((void *)rkblkmax, (size_t)rkblkalloc,
+				   sizeof(double));
+      rkblkidx = (long *)Myalloc((void *)rkblkidx, (size_t)rkblkalloc,
+				 sizeof(long));
+      if (!(rkblkerr && rkblkmax && rkblkidx)) ErrorAbort(MAFK);
+    }
+
+  return (int)nblk;
+}
+#endif
+
+
+
+
+/*==========================================================================*/
+
+SIMD_DISPATCH
+static void	RKStageStrips(long s0, long n, double *RESTRICT out,
+			      CONST double *RESTRICT base, double dt,
+			      CONST rkterms *c)
+
+  /*
+   * RKStageStrips - Computes out[] = base[] + dt*(sum of terms in c) for
+   *		     the elements s0 to n of the state vector. If base
+   *		     equals NULL only the scaled sum is stored.
+   */
+
+{
+  register long		i;
+  long			s, len;
+  int			j;
+  double		aj;
+  CONST double		*RESTRICT kj;
+  double		*RESTRICT o;
+
+  for (s = s0; s < n; s += RK_STRIP)
+    {
+      len = ((n - s) < RK_STRIP) ? (n - s) : RK_STRIP;
+      o   = out + s;
+
+      aj = c->a[0]; kj = c->k[0] + s;
+      for (i = 0; i < len; i++) o[i] = aj*kj[i];
+      for (j = 1; j < c->m; j++)
+	{
+	  aj = c->a[j]; kj = c->k[j] + s;
+	  for (i = 0; i < len; i++) o[i] += aj*kj[i];
+	}
+
+      if (base)
+	{
+	  kj = base + s;
+	  for (i = 0; i < len; i++) o[i] = kj[i] + dt*o[i];
+	}
+      else
+	for (i = 0; i < len; i++) o[i] *= dt;
+    }
+
+  return;
+}
+
+
+
+static void	RKStageBlock(int lo, int hi, void *arg)
+
+{
+  rkjob			*job = (rkjob *)arg;
+  long			s1;
+
+  s1 = (long)hi*RK_STRIP;
+  RKStageStrips((long)lo*RK_STRIP, (s1 < job->n) ? s1 : job->n, job->out,
+		job->base, job->dt, job->oc);
+
+  return;
+}
+
+
+
+static void	RKStage(long n, double *out, CONST double *base, double dt,
+			CONST rkterms *c)
+
+  /*
+   * RKStage - Computes out[] = base[] + dt*(sum of terms in c) for the n
+   *	       elements of the state vector. If base equals NULL only the
+   *	       scaled sum is stored.
+   */
+
+{
+  rkjob			job;
+
+  job.n = n; job.out = out; job.base = base; job.dt = dt; job.oc = c;
+  ParallelForBlocks((int)((n + RK_STRIP - 1)/RK_STRIP), RK_PARSTRIPS,
+		    RKStageBlock, (void *)&job);
+
+  return;
+}
+
+
+
+
+/*==========================================================================*/
+#if defined(EBTDOPRI5)
+
+SIMD_DISPATCH
+static double	RKErrorRMSStrips(long s0, long n, double *RESTRICT out,
+				 double dt, CONST rkterms *oc,
+				 CONST double *RESTRICT y0,
+				 CONST double *RESTRICT y1, CONST rkterms *ec,
+				 double atol, double rtol, long *imax,
+				 double *qmax)
+
+  /*
+   * RKErrorRMSStrips - Computes out[] = dt*(sum of terms in oc) and, in the
+   *			same sweep, the local error vector err[] = dt*(sum
+   *			of terms in ec) for the elements s0 to n and returns
+   *			the sum of squares of the scaled errors
+   *
+   *			  err[i]/(atol + rtol*max(|y0[i]|, |y1[i]|))
+   *
+   *			If imax is not NULL the index and the value of the
+   *			largest scaled error are returned in imax and qmax.
+   */
+
+{
+  register long		i;
+  long			s, len;
+  int			j, l;
+  double		aj, sk, sqr;
+  double		err[RK_STRIP], acc[RK_LANES];
+  CONST double		*RESTRICT kj;
+  double		*RESTRICT o;
+
+  for (l = 0; l < RK_LANES; l++) acc[l] = 0.0;
+  if (imax) { *imax = 0; *qmax = 0.0; }
+
+  for (s = s0; s < n; s += RK_STRIP)
+    {
+      len = ((n - s) < RK_STRIP) ? (n - s) : RK_STRIP;
+      o   = out + s;
+
+      aj = oc->a[0]; kj = oc->k[0] + s;
+      for (i = 0; i < len; i++) o[i] = aj*kj[i];
+      aj = ec->a[0]; kj = ec->k[0] + s;
+      for (i = 0; i < len; i++) err[i] = aj*kj[i];
+      for (j = 1; j < oc->m; j++)
+	{
+	  aj = oc->a[j]; kj = oc->k[j] + s;
+	  for (i = 0; i < len; i++) o[i] += aj*kj[i];
+	}
+      for (j = 1; j < ec->m; j++)
+	{
+	  aj = ec->a[j]; kj = ec->k[j] + s;
+	  for (i = 0; i < len; i++) err[i] += aj*kj[i];
+	}
+
+      for (i = 0; i < len; i++)
+	{
+	  o[i]  *= dt;
+	  sk     = fabs(y0[s+i]);
+	  aj     = fabs(y1[s+i]);
+	  sk     = atol + rtol*((sk > aj) ? sk : aj);
+	  err[i] = dt*err[i]/sk;
+	}
+
+      if (imax)
+	{
+	  for (i = 0; i < len; i++)
+	    if (err[i] > *qmax) { *qmax = err[i]; *imax = s + i; }
+	}
+
+      for (i = 0; (i + RK_LANES) <= len; i += RK_LANES)
+	for (l = 0; l < RK_LANES; l++)
+	  {
+	    sqr     = err[i+l];
+	    acc[l] += sqr*sqr;
+	  }
+      for (l = 0; i < len; i++, l++)
+	{
+	  sqr     = err[i];
+	  acc[l] += sqr*sqr;
+	}
+    }
+
+  for (l = 1; l < RK_LANES; l++) acc[0] += acc[l];
+
+  return acc[0];
+}
+
+
+
+static void	RKErrorRMSBlock(int lo, int hi, void *arg)
+
+{
+  rkjob			*job = (rkjob *)arg;
+  long			s1;
+  int			b = lo/RK_PARSTRIPS;
+
+  s1 = (long)hi*RK_STRIP;
+  rkblkerr[b] = RKErrorRMSStrips((long)lo*RK_STRIP,
+				 (s1 < job->n) ? s1 : job->n, job->out,
+				 job->dt, job->oc, job->y0, job->y1, job->ec,
+				 job->atol, job->rtol,
+				 (job->wantmax ? rkblkidx + b : NULL),
+				 rkblkmax + b);
+
+  return;
+}
+
+
+
+static double	RKErrorRMS(long n, double *out, double dt, CONST rkterms *oc,
+			   CONST double *y0, CONST double *y1,
+			   CONST rkterms *ec, double atol, double rtol,
+			   long *imax, double *qmax)
+
+  /*
+   * RKErrorRMS - Computes out[] = dt*(sum of terms in oc) and, in the same
+   *		  sweep, the local error vector err[] = dt*(sum of terms in
+   *		  ec) and returns the sum of squares of the scaled errors
+   *		  (see RKErrorRMSStrips()). If imax is not NULL the index and
+   *		  the value of the largest scaled error are returned in imax
+   *		  and qmax.
+   */
+
+{
+  rkjob			job;
+  int			b, nblk;
+  double		sqr = 0.0;
+
+  nblk = RKBlocks(n);
+  job.n  = n;  job.out = out; job.dt = dt; job.oc = oc; job.ec = ec;
+  job.y0 = y0; job.y1 = y1; job.atol = atol; job.rtol = rtol;
+  job.wantmax = (imax != NULL);
+  ParallelForBlocks((int)((n + RK_STRIP - 1)/RK_STRIP), RK_PARSTRIPS,
+		    RKErrorRMSBlock, (void *)&job);
+
+  if (imax) { *imax = 0; *qmax = 0.0; }
+  for (b = 0; b < nblk; b++)
+    {
+      sqr += rkblkerr[b];
+      if (imax && (rkblkmax[b] > *qmax))
+	{
+	  *qmax = rkblkmax[b];
+	  *imax = rkblkidx[b];
+	}
+    }
+
+  return sqr;
+}
+#endif // defined(EBTDOPRI5)
+
+
+
+
+/*==========================================================================*/
+#if defined(EBTRKF45) || defined(EBTRKCK)
+
+SIMD_DISPATCH
+static double	RKErrorMaxStrips(long s0, long n, double *RESTRICT out,
+				 CONST double *RESTRICT base, double dt,
+				 CONST rkterms *oc, CONST rkterms *ec,
+				 double atol, long *imax)
+
+  /*
+   * RKErrorMaxStrips - Computes the solution out[] = base[] + dt*(sum of
+   *			terms in oc) and, in the same sweep, the local error
+   *			vector err[] = dt*(sum of terms in ec) for the
+   *			elements s0 to n and returns the largest relative
+   *			error (Watts & Shampine)
+   *
+   *			  |err[i]|/(|base[i]| + |out[i]| + atol)
+   *
+   *			If imax is not NULL the index of the largest
+   *			relative error is returned in imax.
+   */
+
+{
+  register long		i;
+  long			s, len;
+  int			j;
+  double		aj, emax = 0.0;
+  double		err[RK_STRIP];
+  CONST double		*RESTRICT kj;
+  CONST double		*RESTRICT b;
+  double		*RESTRICT o;
+
+  if (imax) *imax = -1;
+
+  for (s = s0; s < n; s += RK_STRIP)
+    {
+      len = ((n - s) < RK_STRIP) ? (n - s) : RK_STRIP;
+      o   = out + s;
+      b   = base + s;
+
+      aj = oc->a[0]; kj = oc->k[0] + s;
+      for (i = 0; i < len; i++) o[i] = aj*kj[i];
+      aj = ec->a[0]; kj = ec->k[0] + s;
+      for (i = 0; i < len; i++) err[i] = aj*kj[i];
+      for (j = 1; j < oc->m; j++)
+	{
+	  aj = oc->a[j]; kj = oc->k[j] + s;
+	  for (i = 0; i < len; i++) o[i] += aj*kj[i];
+	}
+      for (j = 1; j < ec->m; j++)
+	{
+	  aj = ec->a[j]; kj = ec->k[j] + s;
+	  for (i = 0; i < len; i++) err[i] += aj*kj[i];
+	}
+
+      for (i = 0; i < len; i++)
+	{
+	  o[i]   = b[i] + dt*o[i];
+	  err[i] = fabs(dt*err[i])/(fabs(b[i]) + fabs(o[i]) + atol);
+	}
+
+      if (imax)
+	{
+	  for (i = 0; i < len; i++)
+	    if (err[i] > emax) { emax = err[i]; *imax = s + i; }
+	}
+      else
+	{
+	  for (i = 0; i < len; i++)
+	    emax = (err[i] > emax) ? err[i] : emax;
+	}
+    }
+
+  return emax;
+}
+
+
+
+static void	RKErrorMaxBlock(int lo, int hi, void *arg)
+
+{
+  rkjob			*job = (rkjob *)arg;
+  long			s1;
+  int			b = lo/RK_PARSTRIPS;
+
+  s1 = (long)hi*RK_STRIP;
+  rkblkerr[b] = RKErrorMaxStrips((long)lo*RK_STRIP,
+				 (s1 < job->n) ? s1 : job->n, job->out,
+				 job->base, job->dt, job->oc, job->ec,
+				 job->atol, rkblkidx + b);
+
+  return;
+}
+
+
+
+static double	RKErrorMax(long n, double *out, CONST double *base, double dt,
+			   CONST rkterms *oc, CONST rkterms *ec, double atol,
+			   long *imax)
+
+  /*
+   * RKErrorMax - Computes the solution out[] = base[] + dt*(sum of terms in
+   *		  oc) and, in the same sweep, the local error vector err[] =
+   *		  dt*(sum of terms in ec) and returns the largest relative
+   *		  error (see RKErrorMaxStrips()). If imax is not NULL the
+   *		  index of the largest relative error is returned in imax.
+   */
+
+{
+  rkjob			job;
+  int			b, nblk;
+  double		emax = 0.0;
+
+  nblk = RKBlocks(n);
+  job.n  = n; job.out = out; job.base = base; job.dt = dt;
+  job.oc = oc; job.ec = ec; job.atol = atol;
+  ParallelForBlocks((int)((n + RK_STRIP - 1)/RK_STRIP), RK_PARSTRIPS,
+		    RKErrorMaxBlock, (void *)&job);
+
+  if (imax) *imax = -1;
+  for (b = 0; b < nblk; b++)
+    if (rkblkerr[b] > emax)
+      {
+	emax = rkblkerr[b];
+	if (imax) *imax = rkblkidx[b];
+      }
+
+  return emax;
+}
+#endif // defined(EBTRKF45) || defined(EBTRKCK)
+
+#endif // EBTRKSTAGE
+
+
+/*==========================================================================*/
@@ -12,6 +12,7 @@
 #include "escbox.h"
 #include "spline_TC.c"
 #include "spline_JX.c"
+#include "dormant_embryo.c"
 
 /*
  *==========================================================================
@@ -84,6 +85,13 @@
 
 void UserInit( int argc, char **argv, double *env, population *pop)
 {
+  LabelOutput(0, "Scaled food density");
+  LabelOutput(1, "Total number");
+  LabelOutput(2, "Total length");
+  LabelOutput(3, "Total squared length");
+  LabelOutput(4, "Total cubed length");
+  LabelOutput(5, "Total weight");
+
   return;
 }
 
@@ -223,6 +231,15 @@ void Gradient(double *env, population *pop, population *ofs, double *envgrad, po
   return;
 }
 
+/*==========================================================================*/
+
+/* Embryos are dormant, see dormant_embryo.c */
+
+int DormantCohort(double *env, population *pop, int p, int i, double horizon, double *rates)
+{
+  return DormantEmbryo(env, pop[p][i], a_b, h_B0b, horizon, rates);
+}
+
 /*
  *==========================================================================
  * SPECIFICATION OF BETWEEN COHORT CYCLE DYNAMICS
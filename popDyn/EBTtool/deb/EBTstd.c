@@ -12,6 +12,7 @@
 #include "escbox.h"
 #include "spline_TC.c"
 #include "spline_JX.c"
+#include "dormant_embryo.c"
 
 /*
  *==========================================================================
@@ -78,6 +79,13 @@
 
 void UserInit( int argc, char **argv, double *env, population *pop)
 {
+  LabelOutput(0, "Scaled food density");
+  LabelOutput(1, "Total number");
+  LabelOutput(2, "Total length");
+  LabelOutput(3, "Total squared length");
+  LabelOutput(4, "Total cubed length");
+  LabelOutput(5, "Total weight");
+
   return;
 }
 
@@ -136,78 +144,231 @@ void EventLocation(double *env, population *pop, population *ofs, population *bp
  *==========================================================================
  */
 
-void Gradient(double *env, population *pop, population *ofs, double *envgrad, population *popgrad, population *ofsgrad, population *bpoints)
+/* The i-states are accessed through COHORT_VAR() and BPOINT_VAR() (see escbox.h),
+   such that Gradient() is also valid if the program is compiled with COHORT_LAYOUT
+   equal to SOA, in which case the i-states are passed as contiguous columns */
+
+#define POP(p, i, k)      COHORT_VAR(pop, p, i, k)
+#define POPGRAD(p, i, k)  COHORT_VAR(popgrad, p, i, k)
+#define OFS(p, i, k)      BPOINT_VAR(ofs, p, i, k)
+#define OFSGRAD(p, i, k)  BPOINT_VAR(ofsgrad, p, i, k)
+
+/* The derivatives of the internal cohorts and their food uptake are computed in
+   parallel, in blocks of cohorts (see ParallelFor() and ParallelSum()). The
+   quantities shared by all cohorts are passed to the blocks in a stdrates record */
+
+typedef struct
 {
-  double sumL2, TC, kT_J, kT_JX, vT, pT_Am, p_A, p_J, p_C, p_R, h_thin, hT_X, hT_J, hT_a, JT_X_Am, r, f, e, hazard, E_H, L, L2, L3, kapG;
-  register int i;
+  population *pop, *popgrad;
+  double kT_J, vT, pT_Am, hT_a, f;
+} stdrates;
 
-  /* temp correction */
-  TC = spline_TC(time); 
-  kT_J = k_J * TC; kT_JX = k_JX * TC; vT = v * TC; pT_Am = TC * p_Am; JT_X_Am = TC * J_X_Am; aT_b = a_b/ TC;
-  hT_X = h_X * TC; hT_J = TC * h_J; hT_a = h_a * TC * TC; hT_Ab = h_Ab * TC; qT_b = q_b * TC * TC; 
-  
-  /* scaled functional response, food = scaled food density */
-  f = food/ (food + 1);  
+/*==========================================================================*/
 
-  /* The derivatives for the boundary cohort */
-  ofsgrad[0][0][number]    = - h_B0b * ofs[0][0][number];        /*   */
-  ofsgrad[0][0][age]       = 1.0;                                /* 0 */
-  ofsgrad[0][0][accel]     = 0.0;                                /* 1 */
-  ofsgrad[0][0][ageHaz]    = 0.0;                                /* 2 */
-  ofsgrad[0][0][length]    = 0.0;                                /* 3 */
-  ofsgrad[0][0][resDens]   = 0.0;                                /* 4 */
-  ofsgrad[0][0][maturity]  = 0.0;                                /* 5 */
-  ofsgrad[0][0][reprodBuf] = 0.0;                                /* 6 */
-  ofsgrad[0][0][weight]    = 0.0;                                /* 7 */
-          
-  /* The derivatives for all internal cohorts */
-  for(i=0; i<cohort_no[0]; i++) 
+static void CohortGradient(int lo, int hi, void *arg)
+{
+  stdrates *q = (stdrates *)arg;
+  population *pop = q->pop, *popgrad = q->popgrad;
+  double kT_J = q->kT_J, vT = q->vT, pT_Am = q->pT_Am, hT_a = q->hT_a, f = q->f;
+  double p_A, p_J, p_C, p_R, h_thin, r, e, hazard, E_H, L, L2, L3, kapG;
+  register int i;
+
+  for(i=lo; i<hi; i++) 
     { 
+      /* embryo's only age and suffer background mortality, since i-states other than age are already set at birth values */
+      if (POP(0, i, age) < aT_b)
+        {
+          POPGRAD(0, i, number)    = - h_B0b * POP(0, i, number); /* background hazard only */
+          POPGRAD(0, i, age)       = 1.;
+          POPGRAD(0, i, accel)     = 0.;
+          POPGRAD(0, i, ageHaz)    = 0.;
+          POPGRAD(0, i, length)    = 0.;
+          POPGRAD(0, i, resDens)   = 0.;
+          POPGRAD(0, i, maturity)  = 0.;
+          POPGRAD(0, i, reprodBuf) = 0.;
+          POPGRAD(0, i, weight)    = 0.;
+          continue;
+        }
+
       /* help quantities */
-      e = pop[0][i][resDens]/ E_m;                                /* -, scaled reserve density e = [E]/[E_m] */
-      L = pop[0][i][length]; L2 = L * L; L3 = L * L2;             /* cm, struc length */
-      E_H = pop[0][i][maturity];                                  /* J, maturity */
+      e = POP(0, i, resDens)/ E_m;                                /* -, scaled reserve density e = [E]/[E_m] */
+      L = POP(0, i, length); L2 = L * L; L3 = L * L2;             /* cm, struc length */
+      E_H = POP(0, i, maturity);                                  /* J, maturity */
       kapG = e>=L/L_m ? 1. : kap_G;                               /* kap_G if shrinking, else 1 */
       r = E_H<E_Hp ? vT * (e/ L - 1./ L_m)/ (e + kapG * g) : 0;   /* 1/d, spec growth rate of structure */
       p_J = kT_J * E_H;                                           /* J/d, maturity maintenance */
       p_C = L3 * e * E_m * (vT/ L - r);                           /* J/d, reserve mobilisation rate */
       p_R = (1.-kap)*p_C>p_J ? (1. - kap) * p_C - p_J : 0;        /* J/d, flux to maturation or reprod */
-      p_A = pT_Am * f * L2;                                       /* J/d, assimilation flux (overwritten for embryo's) */
+      p_A = pT_Am * f * L2;                                       /* J/d, assimilation flux */
       h_thin = thin==0. ? 0. : r * 2./3.;                         /* 1/d, thinning hazard */
-      hazard = E_H<E_Hp ? pop[0][i][ageHaz] + h_Bbp + h_thin :  pop[0][i][ageHaz] + h_Bpi + h_thin;
-      
-      popgrad[0][i][number]    = - hazard * pop[0][i][number];                                                                 /*   */
-      popgrad[0][i][age]       = 1.0;                                                                                          /* 0 */
-      popgrad[0][i][accel]     = (pop[0][i][accel] * s_G * L3/ L_m/ L_m/ L_m + hT_a) * e * (vT/ L - r) - r * pop[0][i][accel]; /* 1 */
-      popgrad[0][i][ageHaz]    = pop[0][i][accel] - r * pop[0][i][ageHaz];                                                     /* 2 */
-      popgrad[0][i][length]    = L * r/ 3.;                                                                                    /* 3 */
-      popgrad[0][i][resDens]   = p_A/ L3 - vT * e * E_m/ L; /* J/d.cm^3, change in reserve density [E] */                      /* 4 */
-      popgrad[0][i][maturity]  = E_H<E_Hp ? p_R : 0.;                                                                          /* 5 */
-      popgrad[0][i][reprodBuf] = E_H>=E_Hp ? p_R : 0.;                                                                         /* 6 */
-      popgrad[0][i][weight]    = 3. * L2 * popgrad[0][i][length] * (1. + ome * e) + L3 * ome * popgrad[0][i][resDens]/ E_m;    /* 7 */
+      hazard = E_H<E_Hp ? POP(0, i, ageHaz) + h_Bbp + h_thin :  POP(0, i, ageHaz) + h_Bpi + h_thin;
       
-      /* overwrite changes for embryo's since i-states other than age are already set at birth values */
-      if (pop[0][i][age] < aT_b)
-        {
-          popgrad[0][i][number]    = - h_B0b * pop[0][i][number]; /* background hazard only */
-          popgrad[0][i][accel]     = 0.;
-          popgrad[0][i][ageHaz]    = 0.;
-          popgrad[0][i][length]    = 0.;
-          popgrad[0][i][resDens]   = 0.;
-          popgrad[0][i][maturity]  = 0.;
-          popgrad[0][i][reprodBuf] = 0.;
-          popgrad[0][i][weight]    = 0.;
-        }
+      POPGRAD(0, i, number)    = - hazard * POP(0, i, number);                                                                 /*   */
+      POPGRAD(0, i, age)       = 1.0;                                                                                          /* 0 */
+      POPGRAD(0, i, accel)     = (POP(0, i, accel) * s_G * L3/ L_m/ L_m/ L_m + hT_a) * e * (vT/ L - r) - r * POP(0, i, accel); /* 1 */
+      POPGRAD(0, i, ageHaz)    = POP(0, i, accel) - r * POP(0, i, ageHaz);                                                     /* 2 */
+      POPGRAD(0, i, length)    = L * r/ 3.;                                                                                    /* 3 */
+      POPGRAD(0, i, resDens)   = p_A/ L3 - vT * e * E_m/ L; /* J/d.cm^3, change in reserve density [E] */                      /* 4 */
+      POPGRAD(0, i, maturity)  = E_H<E_Hp ? p_R : 0.;                                                                          /* 5 */
+      POPGRAD(0, i, reprodBuf) = E_H>=E_Hp ? p_R : 0.;                                                                         /* 6 */
+      POPGRAD(0, i, weight)    = 3. * L2 * POPGRAD(0, i, length) * (1. + ome * e) + L3 * ome * POPGRAD(0, i, resDens)/ E_m;    /* 7 */
     }
+
+  return;
+}
+
+/*==========================================================================*/
+
+static void CohortFeeding(int lo, int hi, void *arg, double *sumL2)
+{
+  population *pop = ((stdrates *)arg)->pop;
+  register int i;
+
+  for(i=lo; i<hi; i++) sumL2[0] += POP(0, i, age)>aT_b ? POP(0, i, number) * pow(POP(0, i, length), 2.0) : 0; 
+
+  return;
+}
+
+/*==========================================================================*/
+
+void Gradient(double *env, population *pop, population *ofs, double *envgrad, population *popgrad, population *ofsgrad, population *bpoints)
+{
+  double sumL2, TC, kT_JX, hT_X, hT_J, JT_X_Am;
+  stdrates q;
+
+  /* temp correction */
+  TC = spline_TC(time); 
+  q.kT_J = k_J * TC; kT_JX = k_JX * TC; q.vT = v * TC; q.pT_Am = TC * p_Am; JT_X_Am = TC * J_X_Am; aT_b = a_b/ TC;
+  hT_X = h_X * TC; hT_J = TC * h_J; q.hT_a = h_a * TC * TC; hT_Ab = h_Ab * TC; qT_b = q_b * TC * TC; 
+  
+  /* scaled functional response, food = scaled food density */
+  q.f = food/ (food + 1);  
+  q.pop = pop; q.popgrad = popgrad;
+
+  /* The derivatives for the boundary cohort */
+  OFSGRAD(0, 0, number)    = - h_B0b * OFS(0, 0, number);        /*   */
+  OFSGRAD(0, 0, age)       = 1.0;                                /* 0 */
+  OFSGRAD(0, 0, accel)     = 0.0;                                /* 1 */
+  OFSGRAD(0, 0, ageHaz)    = 0.0;                                /* 2 */
+  OFSGRAD(0, 0, length)    = 0.0;                                /* 3 */
+  OFSGRAD(0, 0, resDens)   = 0.0;                                /* 4 */
+  OFSGRAD(0, 0, maturity)  = 0.0;                                /* 5 */
+  OFSGRAD(0, 0, reprodBuf) = 0.0;                                /* 6 */
+  OFSGRAD(0, 0, weight)    = 0.0;                                /* 7 */
+          
+  /* The derivatives for all internal cohorts */
+  ParallelFor(cohort_no[0], CohortGradient, (void *)&q);
   
   /* The derivatives of environmental vars: time & scaled food density x=X/K*/
   envgrad[0] = 1.0; /* 1/d, change in time */
-  for(i=0, sumL2 = 0.; i<cohort_no[0]; i++) sumL2 += pop[0][i][age]>aT_b ? pop[0][i][number] * pow(pop[0][i][length], 2.0) : 0; 
-  envgrad[1] = spline_JX(time)/ V_X/ K - hT_X * food - JT_X_Am * f * sumL2/ V_X/ K; /* 1/d, change in scaled food density */
+  ParallelSum(cohort_no[0], 1, CohortFeeding, (void *)&q, &sumL2);
+  envgrad[1] = spline_JX(time)/ V_X/ K - hT_X * food - JT_X_Am * q.f * sumL2/ V_X/ K; /* 1/d, change in scaled food density */
     
   return;
 }
 
+#undef POP
+#undef POPGRAD
+#undef OFS
+#undef OFSGRAD
+
+/*==========================================================================*/
+
+/* Jacobian of the derivatives of internal cohort i with respect to its own i-states (dfdx)
+   and of the derivatives of the environmental variables with respect to these i-states (dedx),
+   used by the implicit integration methods (RADAU5, CVBDF) if JACOBIAN equals 1 */
+
+#define DFDX(a, b) dfdx[(a) * COHORT_SIZE + (b)]
+
+void Jacobian(double *env, population *pop, population *ofs, population *bpoints, int p, int i, double *dfdx, double *dedx)
+{
+  double TC, kT_J, vT, pT_Am, hT_a, JT_X_Am, f, e, n, q, h_A, L, L2, L3, E_H, kapG, S, X, Y, dLdt, dEdt, dth, hazard;
+  double r = 0., dr_de = 0., dr_dL = 0., p_C, dpC_de, dpC_dL, dpR_de = 0., dpR_dL = 0., dpR_dH = 0.;
+  int k;
+
+  /* temp correction */
+  TC = spline_TC(time);
+  kT_J = k_J * TC; vT = v * TC; pT_Am = TC * p_Am; JT_X_Am = TC * J_X_Am; hT_a = h_a * TC * TC;
+
+  f = food/ (food + 1);
+  n = pop[0][i][number]; q = pop[0][i][accel]; h_A = pop[0][i][ageHaz];
+
+  /* embryo's only experience background hazard */
+  if (pop[0][i][age] < aT_b)
+    {
+      DFDX(number, number) = - h_B0b;
+      return;
+    }
+
+  /* help quantities and their derivatives with respect to e and L */
+  e = pop[0][i][resDens]/ E_m;
+  L = pop[0][i][length]; L2 = L * L; L3 = L * L2;
+  E_H = pop[0][i][maturity];
+  kapG = e>=L/L_m ? 1. : kap_G;
+  if (E_H<E_Hp)
+    {
+      r = vT * (e/ L - 1./ L_m)/ (e + kapG * g);
+      dr_de = vT * (kapG * g/ L + 1./ L_m)/ pow(e + kapG * g, 2.0);
+      dr_dL = - vT * e/ L2/ (e + kapG * g);
+    }
+  p_C = L3 * e * E_m * (vT/ L - r);
+  dpC_de = E_m * (vT * L2 - L3 * r) - E_m * e * L3 * dr_de;
+  dpC_dL = E_m * e * (2. * vT * L - 3. * L2 * r - L3 * dr_dL);
+  if ((1.-kap)*p_C>kT_J * E_H)
+    {
+      dpR_de = (1. - kap) * dpC_de; dpR_dL = (1. - kap) * dpC_dL; dpR_dH = - kT_J;
+    }
+  dth = thin==0. ? 0. : 2./3.;
+  hazard = E_H<E_Hp ? h_A + h_Bbp + dth * r :  h_A + h_Bpi + dth * r;
+
+  DFDX(number, number)    = - hazard;
+  DFDX(number, ageHaz)    = - n;
+  DFDX(number, length)    = - n * dth * dr_dL;
+  DFDX(number, resDens)   = - n * dth * dr_de/ E_m;
+
+  S = s_G/ L_m/ L_m/ L_m; X = q * S * L3 + hT_a; Y = vT/ L - r;
+  DFDX(accel, accel)      = S * L3 * e * Y - r;
+  DFDX(accel, length)     = 3. * q * S * L2 * e * Y - X * e * (vT/ L2 + dr_dL) - q * dr_dL;
+  DFDX(accel, resDens)    = (X * (Y - e * dr_de) - q * dr_de)/ E_m;
+
+  DFDX(ageHaz, accel)     = 1.;
+  DFDX(ageHaz, ageHaz)    = - r;
+  DFDX(ageHaz, length)    = - h_A * dr_dL;
+  DFDX(ageHaz, resDens)   = - h_A * dr_de/ E_m;
+
+  DFDX(length, length)    = (r + L * dr_dL)/ 3.;
+  DFDX(length, resDens)   = L * dr_de/ 3./ E_m;
+
+  DFDX(resDens, length)   = (vT * e * E_m - pT_Am * f)/ L2;
+  DFDX(resDens, resDens)  = - vT/ L;
+
+  k = E_H<E_Hp ? maturity : reprodBuf;
+  DFDX(k, length)         = dpR_dL;
+  DFDX(k, resDens)        = dpR_de/ E_m;
+  DFDX(k, maturity)       = dpR_dH;
+
+  dLdt = L * r/ 3.; dEdt = pT_Am * f/ L - vT * e * E_m/ L;
+  DFDX(weight, length)    = 3. * L2 * (1. + ome * e) * DFDX(length, length) + L3 * ome * DFDX(resDens, length)/ E_m
+                            + 6. * L * dLdt * (1. + ome * e) + 3. * L2 * ome * dEdt/ E_m;
+  DFDX(weight, resDens)   = 3. * L2 * (1. + ome * e) * DFDX(length, resDens) + L3 * ome * DFDX(resDens, resDens)/ E_m
+                            + 3. * L2 * dLdt * ome/ E_m;
+
+  /* food consumption by post-embryo's */
+  dedx[1 * COHORT_SIZE + number] = - JT_X_Am * f * L2/ V_X/ K;
+  dedx[1 * COHORT_SIZE + length] = - 2. * JT_X_Am * f * n * L/ V_X/ K;
+
+  return;
+}
+
+/*==========================================================================*/
+
+/* Embryos are dormant, see dormant_embryo.c */
+
+int DormantCohort(double *env, population *pop, int p, int i, double horizon, double *rates)
+{
+  return DormantEmbryo(env, pop[p][i], a_b, h_B0b, horizon, rates);
+}
+
 /*
  *==========================================================================
  * SPECIFICATION OF BETWEEN COHORT CYCLE DYNAMICS
@@ -0,0 +1,25 @@
+/***
+  NAME
+    dormant_embryo.c
+    DormantCohort() of the DEB models, included by deb/EBT*.c
+***/
+
+/* Cohorts that remain embryos during the coming cohort cycle of at most horizon days only
+   age and suffer background mortality. If DORMANT_COHORTS equals 1 they are set aside during
+   the cycle and advanced with constant rates of change (relative for number).
+   The age at birth a_b is corrected for the highest temperature during the cycle, because
+   the parameter slot aT_b is only updated by Gradient() and the temperature may rise
+   within the cycle: an embryo that might be born before the end of the cycle is not dormant */
+
+static int DormantEmbryo(double *env, double *coh, double a_b, double h_B0b, double horizon, double *rates)
+{
+  register int k;
+
+  if (coh[i_state(0)] + horizon >= a_b/ spline_TC_max(env[0], env[0] + horizon)) return 0;
+
+  for (k=0; k<COHORT_SIZE; k++) rates[k] = 0.0;
+  rates[number]     = - h_B0b; /* 1/d, background hazard only */
+  rates[i_state(0)] = 1.0;     /* -, aging */
+
+  return 1;
+}
@@ -0,0 +1,470 @@
+/***
+  NAME
+    ebtad.cpp
+  PURPOSE
+    Automatic differentiation of the program definition file. The routines
+    of the program definition file are compiled a second time, in the
+    namespace ebtad, with the type double replaced by the dual number type
+    Dual<COHORT_SIZE> (see ebtdual.h). The routines ADJacobian() and
+    ADGradientSensitivity() use the resulting Gradient() to compute the
+    diagonal blocks of the Jacobian and the derivatives of the gradient with
+    respect to a parameter exactly, without finite differences.
+
+    ADJacobian() has the same interface as the routine Jacobian() in the
+    program definition file and is used by the implicit integration
+    methods (RADAU5 and CVBDF) if JACOBIAN equals 2.
+  NOTES
+    This file is compiled with a C++ compiler, using the same flags as the
+    program definition file and the additional definition of PROGRAMFILE:
+
+      g++ -I. -I./fns -DPROBLEMFILE="<deb/EBTstd.h>"
+          -DPROGRAMFILE="<deb/EBTstd.c>" -c fns/ebtad.cpp
+
+    and is linked with the other object files (and -lstdc++).
+
+    ADJacobian() evaluates Gradient() once for every requested cohort,
+    assigning direction k to i-state k of that cohort only. The same
+    evaluation yields the derivatives of the cohort and of the
+    environmental variables with respect to the i-state of the cohort.
+    Seeding all cohorts at once would yield all diagonal blocks in a
+    single evaluation, but the contributions of the individual cohorts to
+    the derivatives of the environmental variables can then not be
+    separated.
+
+    If COHORT_LAYOUT equals SOA the dual state is stored in the column
+    layout expected by Gradient() (see ADIDX()).
+
+    The dual copies of the global variables used by the program definition
+    file (cohort_no[], bpoint_no[], parameter[] and the like) are updated
+    before every evaluation. Routines from the EBT library that only make
+    sense during initialization or in between cohort cycles (AddCohorts(),
+    SievePop() and the like) can not be called from the differentiated
+    routines.
+  HISTORY
+    Oct 17, 2026 : Created.
+***/
+
+#include "ebttune.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#if HAS_FLOAT_H
+#include <float.h>
+#endif
+#if HAS_SIGNALS
+#include <signal.h>
+#endif
+#if defined(_GNU_SOURCE)
+#include <fenv.h>
+#endif
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+
+#include PROBLEMFILE
+
+#if !defined(PROGRAMFILE)
+#error You failed to specify the PROGRAMFILE constant, the program definition file to differentiate!
+#endif
+#if !defined(POPULATION_NR) || (POPULATION_NR == 0)
+#error Automatic differentiation requires at least one structured population!
+#endif
+#if defined(I_CONST_DIM) && (I_CONST_DIM > 0)
+#error Automatic differentiation does not support i-constants!
+#endif
+#ifndef REENTRANT
+#define REENTRANT		0
+#endif
+#if (ENSEMBLE == 1)
+#undef  REENTRANT
+#define REENTRANT		1
+#endif
+#if (REENTRANT == 1)
+#define EBTSTATE		THREAD_LOCAL		/* See escbox.h		    */
+#if !defined(THREAD_LOCAL)
+#error REENTRANT requires thread-local storage, define THREAD_LOCAL for this compiler
+#endif
+#else
+#define EBTSTATE
+#endif
+
+#include "ebtdual.h"
+
+#define AD_SIZE			(1+I_STATE_DIM)		/* Equals COHORT_SIZE	    */
+
+typedef Dual<AD_SIZE>		adouble;
+
+/*
+ * Offset of i-state k of cohort i in a block of n cohorts, which depends on
+ * the layout used in Gradient() (see COHORT_LAYOUT in escbox.h).
+ */
+#ifndef AOS
+#define AOS			0
+#define SOA			1
+#endif
+#ifndef COHORT_LAYOUT
+#define COHORT_LAYOUT		AOS
+#endif
+#ifndef PAR_BLOCK
+#define PAR_BLOCK		256
+#endif
+#if (COHORT_LAYOUT == SOA)
+#define ADIDX(i, k, n)		((k)*(n) + (i))
+#else
+#define ADIDX(i, k, n)		((i)*AD_SIZE + (k))
+#endif
+
+typedef double			c_cohort[AD_SIZE];
+typedef c_cohort		*c_population;
+
+
+/*==========================================================================*/
+/*
+ * The variables and routines of the EBT library (compiled as C).
+ */
+
+extern "C"
+{
+extern EBTSTATE int		cohort_no[POPULATION_NR];
+extern EBTSTATE int		bpoint_no[POPULATION_NR];
+extern EBTSTATE int		rk_level;
+extern EBTSTATE int		LocatedEvent;
+extern EBTSTATE double		cohort_limit;
+extern EBTSTATE double		next_output, next_state_output;
+#if PARAMETER_NR
+extern EBTSTATE double		parameter[PARAMETER_NR];
+#endif
+extern EBTSTATE const double	*forcing_table[];
+
+int				isequal(double, double);
+int				iszero(double);
+int				ismissing(double);
+void				ErrorAbort(const char *);
+void				ErrorExit(const int, const char *);
+void				Warning(const char *);
+void				ReportNote(const char *, ...);
+void				*Myalloc(void *, size_t, size_t);
+int				ForcingKnots(int);
+double				Forcing(int, double);
+double				ForcingMax(int, double, double);
+}
+
+
+/*==========================================================================*/
+/*
+ * Dual counterparts of the types, global variables and library routines
+ * that are accessible in the program definition file. The program
+ * definition file itself is included at the end of this file, such that
+ * its macro definitions can not interfere with the code below.
+ */
+
+namespace ebtad
+{
+typedef adouble			cohort[AD_SIZE];
+typedef cohort			*population;
+
+void				Gradient(adouble *, population *, population *, adouble *,
+					 population *, population *, population *);
+
+EBTSTATE adouble		cohort_limit;
+EBTSTATE adouble		next_output, next_state_output;
+EBTSTATE int			cohort_no[POPULATION_NR];
+EBTSTATE int			bpoint_no[POPULATION_NR];
+EBTSTATE int			rk_level;
+EBTSTATE int			ForcedCohortEnd;
+EBTSTATE int			ForcedRunEnd;
+EBTSTATE int			LocatedEvent;
+EBTSTATE int			parameter_nr = PARAMETER_NR;
+#if PARAMETER_NR
+EBTSTATE adouble		parameter[PARAMETER_NR];
+#endif
+#if (BIFURCATION == 1)
+EBTSTATE int			BifParIndex;
+EBTSTATE adouble		BifOutput;
+EBTSTATE adouble		BifStateOutput;
+EBTSTATE adouble		BifPeriod;
+#endif // (BIFURCATION == 1)
+
+#define NAD "Routine can not be called from a differentiated program definition file!"
+
+int				imin(int a, int b) { return (a < b) ? a : b; }
+int				imax(int a, int b) { return (a > b) ? a : b; }
+adouble				min(adouble a, adouble b) { return (a < b) ? a : b; }
+adouble				max(adouble a, adouble b) { return (a > b) ? a : b; }
+int				iszero(adouble a) { return ::iszero(a.v); }
+int				ismissing(adouble a) { return ::ismissing(a.v); }
+int				isequal(adouble a, adouble b) { return ::isequal(a.v, b.v); }
+void				ErrorAbort(const char *mes) { ::ErrorAbort(mes); }
+void				ErrorExit(const int exitcode, const char *mes) { ::ErrorExit(exitcode, mes); }
+void				Warning(const char *mes) { ::Warning(mes); }
+void				SetStepSize(adouble) { ::ErrorAbort(NAD); }
+void				SievePop(void) { ::ErrorAbort(NAD); }
+int				AddCohorts(population *, int, int) { ::ErrorAbort(NAD); return 0; }
+void				LabelState(int, const char *, ...) { return; }
+void				LabelOutput(int, const char *, ...) { return; }
+void				measureBifstats(adouble *, population *) { return; }
+int				ForcingKnots(int k) { return ::ForcingKnots(k); }
+
+// Linear interpolation of a forcing table, with the slope of the segment
+adouble				Forcing(int k, adouble t)
+{
+  const double			*tab;
+  double			slope = 0.0;
+  int				i, n;
+
+  n = ::ForcingKnots(k);
+  if (n > 1)
+    {
+      tab = forcing_table[k];
+      for (i=n-2; i>0; i--)
+	if (t.v - tab[2*i] >= 0) break;
+      slope = (tab[2*i+3] - tab[2*i+1])/(tab[2*i+2] - tab[2*i]);
+    }
+
+  return chain(t, ::Forcing(k, t.v), slope);
+}
+
+// Only used for decisions, such as the dormancy of embryos
+adouble				ForcingMax(int k, adouble t0, adouble t1)
+{
+  return ::ForcingMax(k, t0.v, t1.v);
+}
+
+// The parallel loops are executed serially, with the same blocks
+void				ParallelFor(int n, void (*body)(int, int, void *), void *arg)
+{
+  if (n > 0) (*body)(0, n, arg);
+}
+
+void				ParallelSum(int n, int m, void (*body)(int, int, void *, adouble *),
+					    void *arg, adouble *sums)
+{
+  adouble			*part = new adouble[(m > 0) ? m : 1];
+  int				lo, j;
+
+  for (j=0; j<m; j++) sums[j] = 0.0;
+  for (lo=0; lo<n; lo+=PAR_BLOCK)
+    {
+      for (j=0; j<m; j++) part[j] = 0.0;
+      (*body)(lo, (n-lo < PAR_BLOCK) ? n : lo+PAR_BLOCK, arg, part);
+      for (j=0; j<m; j++) sums[j] += part[j];
+    }
+  delete[] part;
+}
+
+void				ReportNote(const char *fmt, ...)
+{
+  char				buf[1024];
+  va_list			argpnt;
+
+  va_start(argpnt, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, argpnt);
+  va_end(argpnt);
+  ::ReportNote("%s", buf);
+
+  return;
+}
+} // namespace ebtad
+
+
+/*==========================================================================*/
+/*
+ * Definitions of static variables, restricted to this file.
+ */
+
+#define MAFO "Memory allocation failure in automatic differentiation!"
+
+static EBTSTATE long		ADAllocated = 0L;
+static EBTSTATE adouble		*ADstate = NULL, *ADgrad = NULL;
+static EBTSTATE adouble		ADenv[ENVIRON_DIM], ADenvgrad[ENVIRON_DIM];
+static EBTSTATE ebtad::population ADpop[POPULATION_NR],	  ADofs[POPULATION_NR];
+static EBTSTATE ebtad::population ADpopgrad[POPULATION_NR], ADofsgrad[POPULATION_NR];
+static EBTSTATE ebtad::population ADbpoints[POPULATION_NR];
+
+
+/*==========================================================================*/
+/*
+ * Start of function implementations.
+ */
+/*==========================================================================*/
+
+static void	LoadState(double *env, c_population *pop, c_population *ofs,
+			  c_population *bpoints)
+
+  /*
+   * LoadState - Copies the global variables and the current state to their
+   *		 dual counterparts, with all derivatives set to 0, and sets
+   *		 up the pointers to the dual populations.
+   */
+
+{
+  int				i, j, k, len, org;
+
+  ebtad::cohort_limit      = cohort_limit;
+  ebtad::next_output       = next_output;
+  ebtad::next_state_output = next_state_output;
+  ebtad::rk_level          = rk_level;
+  ebtad::LocatedEvent      = LocatedEvent;
+#if PARAMETER_NR
+  for (i=0; i<PARAMETER_NR; i++) ebtad::parameter[i] = parameter[i];
+#endif
+
+  len = 0;
+  for (i=0; i<POPULATION_NR; i++)
+    {
+      ebtad::cohort_no[i] = cohort_no[i];
+      ebtad::bpoint_no[i] = bpoint_no[i];
+      len += (2*cohort_no[i] + bpoint_no[i])*AD_SIZE;
+    }
+  if (!(len < ADAllocated))
+    {
+      ADAllocated = (((len/256)+1)*256);
+      ADstate = (adouble *)Myalloc((void *)ADstate, (size_t)ADAllocated,
+				   sizeof(adouble));
+      ADgrad  = (adouble *)Myalloc((void *)ADgrad, (size_t)ADAllocated,
+				   sizeof(adouble));
+      if (!(ADstate && ADgrad)) ErrorAbort(MAFO);
+    }
+
+  for (i=0; i<ENVIRON_DIM; i++) ADenv[i] = env[i];
+
+  org = 0;
+  for (i=0; i<POPULATION_NR; i++)
+    {
+      ADpop[i]     = (ebtad::population)(ADstate+org);
+      ADpopgrad[i] = (ebtad::population)(ADgrad+org);
+      for (j=0; j<cohort_no[i]; j++)
+	for (k=0; k<AD_SIZE; k++)
+	  ADstate[org+ADIDX(j, k, cohort_no[i])] = pop[i][j][k];
+      org += cohort_no[i]*AD_SIZE;
+
+      ADofs[i]     = (ebtad::population)(ADstate+org);
+      ADofsgrad[i] = (ebtad::population)(ADgrad+org);
+      for (j=0; j<bpoint_no[i]; j++)
+	for (k=0; k<AD_SIZE; k++)
+	  ADstate[org+ADIDX(j, k, bpoint_no[i])] = ofs[i][j][k];
+      org += bpoint_no[i]*AD_SIZE;
+
+      ADbpoints[i] = (ebtad::population)(ADstate+org);
+      for (j=0; j<bpoint_no[i]; j++)
+	for (k=0; k<AD_SIZE; k++)
+	  ADstate[org+ADIDX(j, k, bpoint_no[i])] = bpoints[i][j][k];
+      org += bpoint_no[i]*AD_SIZE;
+    }
+
+  return;
+}
+
+
+
+
+/*==========================================================================*/
+
+extern "C" void	ADJacobian(double *env, c_population *pop, c_population *ofs,
+			   c_population *bpoints, int p, int i, double *dfdx,
+			   double *dedx)
+
+  /*
+   * ADJacobian - Returns in dfdx[] the derivatives of the gradient of
+   *		  internal cohort i of population p with respect to its
+   *		  i-state and in dedx[] the derivatives of the gradient of
+   *		  the environmental variables with respect to this i-state.
+   *		  Every call evaluates Gradient() in the current state, such
+   *		  that the cohorts can be requested in any order (see NOTES).
+   */
+
+{
+  int				k, r;
+  adouble			*x, *dx;
+
+  LoadState(env, pop, ofs, bpoints);
+  x  = (adouble *)ADpop[p];
+  dx = (adouble *)ADpopgrad[p];
+  for (k=0; k<AD_SIZE; k++) x[ADIDX(i, k, cohort_no[p])].d[k] = 1.0;
+
+  ebtad::Gradient(ADenv, ADpop, ADofs, ADenvgrad, ADpopgrad, ADofsgrad,
+		  ADbpoints);
+
+  for (r=0; r<AD_SIZE; r++)
+    for (k=0; k<AD_SIZE; k++)
+      dfdx[r*AD_SIZE+k] = dx[ADIDX(i, r, cohort_no[p])].d[k];
+  for (r=0; r<ENVIRON_DIM; r++)
+    for (k=0; k<AD_SIZE; k++) dedx[r*AD_SIZE+k] = ADenvgrad[r].d[k];
+
+  return;
+}
+
+
+
+
+/*==========================================================================*/
+
+extern "C" void	ADGradientSensitivity(double *env, c_population *pop,
+				      c_population *ofs, c_population *bpoints,
+				      int k, double *denv, c_population *dpop,
+				      c_population *dofs)
+
+  /*
+   * ADGradientSensitivity - Returns the partial derivatives of the
+   *			     gradient (the right-hand side of the ODEs) of the
+   *			     environmental variables (denv[]), the internal
+   *			     cohorts (dpop[]) and the boundary cohorts
+   *			     (dofs[]) with respect to parameter[k], in the
+   *			     current state. The arrays have the same layout as
+   *			     the state itself. These are not the sensitivities
+   *			     of the state: the derivative s of the state with
+   *			     respect to parameter[k] follows from integrating
+   *			     s' = J s + (the returned derivatives), with J the
+   *			     Jacobian of the gradient.
+   */
+
+{
+  int				i, j, l, n;
+
+  if ((k < 0) || (k >= PARAMETER_NR)) return;
+
+  LoadState(env, pop, ofs, bpoints);
+#if PARAMETER_NR
+  ebtad::parameter[k].d[0] = 1.0;
+#endif
+
+  ebtad::Gradient(ADenv, ADpop, ADofs, ADenvgrad, ADpopgrad, ADofsgrad,
+		  ADbpoints);
+
+  for (j=0; j<ENVIRON_DIM; j++) denv[j] = ADenvgrad[j].d[0];
+  for (i=0; i<POPULATION_NR; i++)
+    {
+      n = cohort_no[i];
+      for (j=0; j<n; j++)
+	for (l=0; l<AD_SIZE; l++)
+	  dpop[i][j][l] = ((adouble *)ADpopgrad[i])[ADIDX(j, l, n)].d[0];
+      n = bpoint_no[i];
+      for (j=0; j<n; j++)
+	for (l=0; l<AD_SIZE; l++)
+	  dofs[i][j][l] = ((adouble *)ADofsgrad[i])[ADIDX(j, l, n)].d[0];
+    }
+
+  return;
+}
+
+
+/*==========================================================================*/
+/*
+ * The program definition file, compiled with dual numbers.
+ */
+
+namespace ebtad
+{
+#define register
+#define double			adouble
+#include PROGRAMFILE
+#undef  double
+#undef  register
+} // namespace ebtad
+
+
+/*==========================================================================*/
@@ -65,28 +65,28 @@
 #define NANO                      1.0E-9
 #endif
 
-static double                     stored[MAXFFT], wrapped[MAXFFT];
-static int                        indexStored;
-static double                     periodFFT;
+static EBTSTATE double            stored[MAXFFT], wrapped[MAXFFT];
+static EBTSTATE int               indexStored;
+static EBTSTATE double            periodFFT;
 
-static char                       fn[1024], currun[1024];
+static EBTSTATE char              fn[1024], currun[1024];
 
 #define Sigma(ss, n)              sqrt((ss)/((double)(n - 1)))
 
-static int                        Observation = 0;
+static EBTSTATE int               Observation = 0;
 
-static int                        PreventRecursion = 0;
+static EBTSTATE int               PreventRecursion = 0;
 
-static double                     delt_out_target;
-extern double                     delt_out;
+static EBTSTATE double            delt_out_target;
+extern EBTSTATE double            delt_out;
 
-static double                     BifOutputVar[OUTPUT_VAR_NR];
-static double                     AllAve[OUTPUT_VAR_NR];
-static double                     AllGAve[OUTPUT_VAR_NR];
-static double                     AllVar[OUTPUT_VAR_NR];
-static double                     AllMax[OUTPUT_VAR_NR];
-static double                     AllMin[OUTPUT_VAR_NR];
-static double                     AveCohno[POPULATION_NR];
+static EBTSTATE double            BifOutputVar[OUTPUT_VAR_NR];
+static EBTSTATE double            AllAve[OUTPUT_VAR_NR];
+static EBTSTATE double            AllGAve[OUTPUT_VAR_NR];
+static EBTSTATE double            AllVar[OUTPUT_VAR_NR];
+static EBTSTATE double            AllMax[OUTPUT_VAR_NR];
+static EBTSTATE double            AllMin[OUTPUT_VAR_NR];
+static EBTSTATE double            AveCohno[POPULATION_NR];
 
 static void                       initMeasureBifstats(char *rn);
 static void                       UpdateStats(double value, double *mean, double *gmean, double *sum_sq, int n);
@@ -94,11 +94,11 @@ static double                     dofft(double *source, double *tm, int obs);
 
 #if (ADJUST_COH_LIMIT == 1)
 #define COHORTLIMITS              13
-static double                     CohLimits[COHORTLIMITS] = {0.001, 0.002, 0.0025, 0.005,
+static EBTSTATE double            CohLimits[COHORTLIMITS] = {0.001, 0.002, 0.0025, 0.005,
                                                              0.01,  0.02,  0.025,  0.05,
                                                              0.1,   0.2,   0.25,   0.5,
                                                              1.0};
-static int                        CLindex = 0, minCLindex, maxCLindex;
+static EBTSTATE int               CLindex = 0, minCLindex, maxCLindex;
 static void                       setCohortLimit(double targetval);
 #endif
 
@@ -115,8 +115,8 @@ void  measureBifstats(double *env, population *pop)
 
 {
   int     i, nr;
-  static double   lastCallT = -HUGE_VAL;
-  static int    first = 1;
+  static EBTSTATE double   lastCallT = -HUGE_VAL;
+  static EBTSTATE int    first = 1;
 
   if (first) initMeasureBifstats(runname);
   first = 0;
@@ -637,8 +637,8 @@ static void fft(double *real_data, double *imag_data, int n_pts)
   int                             tstep;
   double                          tr, ti, arg;                                      // intermediate values in calcs.
   double                          c, s;                                             // cosine & sine components of Fourier trans.
-  static double                   *sintab = NULL;
-  static int                      last_n = 0;
+  static EBTSTATE double          *sintab = NULL;
+  static EBTSTATE int             last_n = 0;
 
   // nu ...... logarithm in base 2 of n_pts e.g. nu = 5 if n_pts = 32.
   n2 = n_pts;
@@ -20,6 +20,7 @@
 #include "ebtcohrt.h"
 #include "ebttint.h"
 #include "ebtutils.h"
+#include "ebtstop.h"
 
 /* Bas Kooijman 2020/04/02 */
 #include "ebttint.h"
@@ -36,6 +37,8 @@
 #define MAFC                      "Memory allocation failure for i-state variables!"
 #define MAFI                      "Memory allocation failure for cohort constants!"
 #define MAFT                      "Memory allocation failure while inserting boundary cohorts!"
+#define MAFD                      "Memory allocation failure for dormant cohorts!"
+#define MAFM                      "Memory allocation failure while merging cohorts!"
 
 
 /*==================================================================================================================================*/
@@ -44,10 +47,62 @@
  */
 
 #if (POPULATION_NR > 0)
-static population                 BPData = NULL;                                    // Pointer to bpoints data  
-static long                       BPAllocated = 0L;                                 // # of doubles allocated   
+static EBTSTATE population        BPData = NULL;                                    // Pointer to bpoints data  
+static EBTSTATE long              BPAllocated = 0L;                                 // # of doubles allocated   
 #endif // (POPULATION_NR > 0)
-static double                     maxss, minss;
+static EBTSTATE double            maxss, minss;
+
+#if (POPULATION_NR > 0)
+static EBTSTATE double            *AliasState = NULL;                               // State vector of integrator
+static EBTSTATE population        PopData[POPULATION_NR];                           // Own memory of populations
+static EBTSTATE int               AliasCohorts[POPULATION_NR];                      // Cohorts and boundary     
+static EBTSTATE int               AliasBpoints[POPULATION_NR];                      // cohorts in state vector  
+#endif // (POPULATION_NR > 0)
+
+#if ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+static EBTSTATE population        DormData[POPULATION_NR];                          // Dormant cohorts          
+static EBTSTATE population        DormRates[POPULATION_NR];                         // and their rates of change
+static EBTSTATE int               *DormIndex[POPULATION_NR];                        // Their positions in pop[] 
+static EBTSTATE int               DormNo[POPULATION_NR];                            // Number of dormant cohorts
+static EBTSTATE long              DormAllocated[POPULATION_NR];                     // # of cohorts allocated   
+#if (I_CONST_DIM > 0)
+static EBTSTATE popID             DormIDcard[POPULATION_NR];                        // Their i-constants        
+#endif
+static EBTSTATE double            DormStart;                                        // Start of dormancy        
+static EBTSTATE int               DormActive[POPULATION_NR];                        // Remaining internal cohorts
+static EBTSTATE population        ShowData[POPULATION_NR];                          // All cohorts for output   
+static EBTSTATE long              ShowAllocated[POPULATION_NR];                     // # of cohorts allocated   
+#if (I_CONST_DIM > 0)
+static EBTSTATE popID             ShowIDcard[POPULATION_NR];
+static EBTSTATE popID             HidePopIDcard[POPULATION_NR], HideOfsIDcard[POPULATION_NR];
+#endif
+static EBTSTATE population        HidePop[POPULATION_NR], HideOfs[POPULATION_NR];   // Pointers while shown     
+static EBTSTATE int               HideNo[POPULATION_NR];
+static EBTSTATE int               DormShown = 0;
+#endif // ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+
+#if ((POPULATION_NR > 0) && (COHORT_BUDGET == 1))
+static EBTSTATE int               *MrgPrev = NULL, *MrgNext = NULL;                 // Linked list of cohorts   
+static EBTSTATE int               *MrgHeap = NULL, *MrgHpos = NULL;                 // Heap of pairs, positions 
+static EBTSTATE double            *MrgCost = NULL;                                  // Cost of merging pairs    
+static EBTSTATE long              MrgAllocated = 0L;                                // # of cohorts allocated   
+#endif // ((POPULATION_NR > 0) && (COHORT_BUDGET == 1))
+
+#if (ADAPT_COH_LIMIT == 1)
+#ifndef BIRTH_VARIATION
+#define BIRTH_VARIATION           0.1                                               // Targeted relative change in birth rate per cycle
+#endif
+#ifndef COH_LIMIT_SAFETY
+#define COH_LIMIT_SAFETY          0.9                                               // Safety factor for the birth rate criterion
+#endif
+
+static EBTSTATE double            CycleStart;                                       // Start of cohort cycle    
+static EBTSTATE double            BirthRate[POPULATION_NR];                         // Averaged birth rates     
+static EBTSTATE double            PrevBirthRate[POPULATION_NR];                     // and before last update   
+static EBTSTATE int               BirthsMeasured = 0;                               // # of cycles measured     
+static EBTSTATE double            LimitBase = 0.0;                                  // Cohort limit from CVF    
+static EBTSTATE int               LimitExp, MinLimitExp, MaxLimitExp;               // Its current power of 2   
+#endif // (ADAPT_COH_LIMIT == 1)
 
 
 /*==================================================================================================================================*/
@@ -57,6 +112,25 @@ static double                     maxss, minss;
 /*==================================================================================================================================*/
 #if (POPULATION_NR > 0)
 
+static int CohortAbove(CONST double *a, CONST double *b)
+
+  /* 
+   * CohortAbove - Returns 1 if the cohort "a" lies above the cohort "b" in the ordering of the population, i.e. if the first 
+   *               i-state variable in which they differ is larger in "a", and 0 otherwise.
+   */
+
+{
+  register int                    i;
+
+  for (i = 1; i < COHORT_SIZE; i++)
+    if (a[i] != b[i]) return (a[i] > b[i]);
+
+  return 0;
+}
+
+
+/*==================================================================================================================================*/
+
 int   InsCohort(cohort newcoh,
 #if (I_CONST_DIM > 0)
                 cohortID id,
@@ -69,28 +143,38 @@ int   InsCohort(cohort newcoh,
    *              pointer "new" points to an array of i-state variables of
    *              length COHORT_SIZE, the pointer "id" points to an array
    *              of i-state constants of length I_CONST_DIM.
+   *              The new cohort is placed below all cohorts that lie above
+   *              it and above all other ones, including the ones equal to
+   *              it. The position is found by bisection, after checking
+   *              the common cases that it ends up at the bottom or the top.
    */
 
 {
-  register int                    found, equal;
-  register int                    i, pos;
+  register int                    lo, hi, mid, pos;
   cohort_pnt                      p;
 #if (I_CONST_DIM > 0)
   cohortID_pnt pid;
 #endif
-  // Top-down search for appropriate cohort place
-  p = pop[pop_nr];
-  for (pos = CohortNo[pop_nr] - 1, found = 0; pos >= 0; pos--)
-    {
-      for (i = 1, equal = 1; (i < COHORT_SIZE) && equal; i++)
+  p  = pop[pop_nr];
+  hi = CohortNo[pop_nr];
+  if ((!hi) || CohortAbove(p[hi - 1], newcoh))                                       // Append at the bottom
+    pos = hi;
+  else if (!CohortAbove(p[0], newcoh))                                               // or place at the top
+    pos = 0;
+  else
+    {                                                                                // p[lo-1] lies above, p[hi] does not
+      lo = 1;
+      hi--;
+      while (lo < hi)
         {
-          equal = (p[pos][i] == newcoh[i]);
-          found = (p[pos][i] > newcoh[i]);
+          mid = lo + (hi - lo)/2;
+          if (CohortAbove(p[mid], newcoh)) lo = mid + 1;
+          else hi = mid;
         }
-      if (found) break;
+      pos = lo;
     }
 
-  pos++;                                                                             // Shift all entries lying above position upwards
+  // Shift all entries lying above position upwards
   p = pop[pop_nr] + pos;
   if (pos < CohortNo[pop_nr]) (void)memmove(*(p + 1), *p, (CohortNo[pop_nr] - pos)*COHORT_SIZE*sizeof(double));
   // Place new cohort
@@ -107,6 +191,80 @@ int   InsCohort(cohort newcoh,
 }
 
 
+/*==================================================================================================================================*/
+
+static EBTSTATE population        SortPop;                                          // Population being sorted  
+
+static int CompareCohorts(CONST void *a, CONST void *b)
+
+  /* 
+   * CompareCohorts - Comparison routine for qsort() in SortCohorts(). Cohorts that lie above others come first, equal cohorts in 
+   *                  reverse order of their index.
+   */
+
+{
+  register int                    ia = *(CONST int *)a, ib = *(CONST int *)b;
+
+  if (CohortAbove(SortPop[ia], SortPop[ib])) return -1;
+  if (CohortAbove(SortPop[ib], SortPop[ia])) return 1;
+
+  return (ib - ia);
+}
+
+
+/*==================================================================================================================================*/
+
+void SortCohorts(int pop_nr)
+
+  /* 
+   * SortCohorts - Routine sorts all cohorts of the population with number "pop_nr" in a single pass. If only the cohorts appended 
+   *               since the population was last ordered are out of place, the result equals inserting them one by one with 
+   *               InsCohort(), but takes O(n log(n)) instead of O(n^2) operations.
+   */
+
+{
+  register int                    i, n;
+  int                             *order;
+  double                          *tmp;
+#if (I_CONST_DIM > 0)
+  double                          *tmpid;
+#endif
+
+  n = CohortNo[pop_nr];
+  if (n < 2) return;
+
+  order = (int *)Myalloc(NULL, (size_t)n, sizeof(int));
+  tmp   = (double *)Myalloc(NULL, (size_t)(n*COHORT_SIZE), sizeof(double));
+  if (!(order && tmp)) ErrorAbort(MAFC);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+
+  for (i = 0; i < n; i++) order[i] = i;
+  SortPop = pop[pop_nr];
+  qsort((DEF_TYPE *)order, (size_t)n, sizeof(int), CompareCohorts);
+
+  for (i = 0; i < n; i++)
+    (void)memcpy((DEF_TYPE *)(tmp + i*COHORT_SIZE), (DEF_TYPE *)pop[pop_nr][order[i]], COHORT_SIZE*sizeof(double));
+  (void)memcpy((DEF_TYPE *)pop[pop_nr][0], (DEF_TYPE *)tmp, n*COHORT_SIZE*sizeof(double));
+  Myfree(tmp);
+#if (I_CONST_DIM > 0)
+  tmpid = (double *)Myalloc(NULL, (size_t)(n*I_CONST_DIM), sizeof(double));
+  if (!tmpid) ErrorAbort(MAFI);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+  for (i = 0; i < n; i++)
+    (void)memcpy((DEF_TYPE *)(tmpid + i*I_CONST_DIM), (DEF_TYPE *)popIDcard[pop_nr][order[i]], I_CONST_DIM*sizeof(double));
+  (void)memcpy((DEF_TYPE *)popIDcard[pop_nr][0], (DEF_TYPE *)tmpid, n*I_CONST_DIM*sizeof(double));
+  Myfree(tmpid);
+#endif
+  Myfree(order);
+
+  return;
+}
+
+
 /*==================================================================================================================================*/
 
 static void CreateBcohorts()
@@ -236,11 +394,11 @@ static void InsertBcohorts()
 {
   register int                    i;
   register int                    j;
-  static cohort_pnt               p = NULL;
+  static EBTSTATE cohort_pnt      p = NULL;
 #if (I_CONST_DIM > 0)
-  static cohortID_pnt             pid = NULL;
+  static EBTSTATE cohortID_pnt    pid = NULL;
 #endif
-  static int                      max_bcohorts = -1;
+  static EBTSTATE int             max_bcohorts = -1;
   int                             cbc;
 
   for (i = 0, cbc = 0; i < POPULATION_NR; i++) cbc = imax(cbc, BpointNo[i]);
@@ -289,13 +447,269 @@ static void InsertBcohorts()
 }
 
 
+/*==================================================================================================================================*/
+/*
+ * During a cohort cycle the explicit integration methods let pop[] and ofs[] point into their own state vector, such that an 
+ * accepted integration step only has to swap the pointers to their state vectors instead of copying the entire state. The state 
+ * vector starts with the environment, followed by the cohorts and boundary cohorts of every population. The environment itself 
+ * is still copied, as env[] is an array. At the end of the cycle the populations are copied back into their own memory once.
+ */
+
+void AliasPopulations(double *state)
+
+  /* 
+   * AliasPopulations - Routine points pop[] and ofs[] to the populations in the state vector "state". The first call in a cohort 
+   *                    cycle stores the pointers to the memory of the populations and the size of the populations, such that 
+   *                    the routine can be called while CohortNo[] temporarily includes the boundary cohorts.
+   */
+
+{
+  register int                    i;
+  long                            len;
+
+  if (!AliasState)
+    {
+      for (i = 0; i < POPULATION_NR; i++)
+        {
+          PopData[i]      = pop[i];
+          AliasCohorts[i] = CohortNo[i];
+          AliasBpoints[i] = BpointNo[i];
+        }
+    }
+  AliasState = state;
+
+  for (i = 0, len = ENVIRON_DIM; i < POPULATION_NR; i++)
+    {
+      pop[i] = (population)(state + len);
+      if (AliasBpoints[i]) ofs[i] = pop[i] + AliasCohorts[i];
+      len += (AliasCohorts[i] + AliasBpoints[i])*COHORT_SIZE;
+    }
+
+  return;
+}
+
+
+/*==================================================================================================================================*/
+
+void ReleasePopulations()
+
+  /* 
+   * ReleasePopulations - Routine copies the populations from the state vector that pop[] points into back into their own memory 
+   *                      and restores the pointers pop[] and ofs[]. Nothing is done if pop[] points to its own memory already.
+   */
+
+{
+  register int                    i;
+
+  if (!AliasState) return;
+
+  for (i = 0; i < POPULATION_NR; i++)
+    {
+      (void)memcpy((DEF_TYPE *)PopData[i], (DEF_TYPE *)pop[i], (AliasCohorts[i] + AliasBpoints[i])*COHORT_SIZE*sizeof(double));
+      pop[i] = PopData[i];
+      if (AliasBpoints[i]) ofs[i] = pop[i] + AliasCohorts[i];
+    }
+  AliasState = NULL;
+
+  return;
+}
+
+
+#if (COHORT_BUDGET == 1)
+/*==================================================================================================================================*/
+/*
+ * The routines below merge cohorts when a population exceeds its maximum number of cohorts max_cohorts[]. Candidates are the pairs 
+ * of neighbouring cohorts in the ordered population, with as cost of merging the increase in the weighted sum of squared deviations 
+ * of the i-states from their cohort means (Ward's criterion), the deviations scaled by the cohort tolerances. The pairs are kept in 
+ * a binary heap, ordered on their cost, and indexed by their first cohort.
+ */
+
+static double MergeCost(int pop_nr, int a, int b)
+
+  /* 
+   * MergeCost - Returns the cost of merging cohorts "a" and "b" of population "pop_nr".
+   */
+
+{
+  register int                    k;
+  register cohort_pnt             p = pop[pop_nr];
+  double                          diff, scale, sum = 0.0;
+
+  if (!((p[a][0] + p[b][0]) > 0.0)) return 0.0;                                     // Empty cohorts merge for free
+  for (k = 1; k < COHORT_SIZE; k++)
+    {
+      diff  = p[a][k] - p[b][k];
+      scale = max(abs_tols[pop_nr][k], rel_tols[pop_nr][k]*fabs(p[a][k] + p[b][k])/2.0);
+      if (scale <= 0.0) scale = fabs(p[a][k] + p[b][k])/2.0 + 1.0E-15;
+      sum  += (diff/scale)*(diff/scale);
+    }
+
+  return sum*p[a][0]*p[b][0]/(p[a][0] + p[b][0]);
+}
+
+
+/*==================================================================================================================================*/
+
+static void HeapMove(int pos, int n)
+
+  /* 
+   * HeapMove - Restores the heap order of the n pairs in MrgHeap[] after the cost of the pair at position "pos" has changed.
+   */
+
+{
+  register int                    a, c;
+
+  a = MrgHeap[pos];
+  while ((pos > 0) && (MrgCost[a] < MrgCost[MrgHeap[(pos - 1)/2]]))
+    {
+      MrgHeap[pos] = MrgHeap[(pos - 1)/2];
+      MrgHpos[MrgHeap[pos]] = pos;
+      pos = (pos - 1)/2;
+    }
+  while ((c = 2*pos + 1) < n)
+    {
+      if (((c + 1) < n) && (MrgCost[MrgHeap[c + 1]] < MrgCost[MrgHeap[c]])) c++;
+      if (!(MrgCost[MrgHeap[c]] < MrgCost[a])) break;
+      MrgHeap[pos] = MrgHeap[c];
+      MrgHpos[MrgHeap[pos]] = pos;
+      pos = c;
+    }
+  MrgHeap[pos] = a;
+  MrgHpos[a]   = pos;
+
+  return;
+}
+
+
+/*==================================================================================================================================*/
+
+static void HeapRemove(int a, int *n)
+
+  /* 
+   * HeapRemove - Removes the pair with first cohort "a" from the heap of "n" pairs.
+   */
+
+{
+  register int                    pos = MrgHpos[a];
+
+  (*n)--;
+  MrgHpos[a] = -1;
+  if (pos == *n) return;
+  MrgHeap[pos] = MrgHeap[*n];
+  MrgHpos[MrgHeap[pos]] = pos;
+  HeapMove(pos, *n);
+
+  return;
+}
+
+
+/*==================================================================================================================================*/
+
+static void MergeCohorts(int pop_nr)
+
+  /* 
+   * MergeCohorts - Routine merges the pairs of neighbouring cohorts with the lowest cost in population "pop_nr", until its number 
+   *                of cohorts equals max_cohorts[pop_nr]. The merged cohort gets the sum of the numbers and the weighted means of 
+   *                the i-states and i-constants, such that the total number and the first moments of the population are conserved.
+   */
+
+{
+  register int                    j, k, a, b;
+  register cohort_pnt             p = pop[pop_nr];
+#if (I_CONST_DIM > 0)
+  register cohortID_pnt           pid = popIDcard[pop_nr];
+#endif
+  int                             n, hn;
+  double                          w;
+
+  n = CohortNo[pop_nr];
+  if (n > MrgAllocated)
+    {
+      MrgAllocated = MemBlocks(n);
+      MrgPrev = (int *)Myalloc((void *)MrgPrev, (size_t)MrgAllocated, sizeof(int));
+      MrgNext = (int *)Myalloc((void *)MrgNext, (size_t)MrgAllocated, sizeof(int));
+      MrgHeap = (int *)Myalloc((void *)MrgHeap, (size_t)MrgAllocated, sizeof(int));
+      MrgHpos = (int *)Myalloc((void *)MrgHpos, (size_t)MrgAllocated, sizeof(int));
+      MrgCost = (double *)Myalloc((void *)MrgCost, (size_t)MrgAllocated, sizeof(double));
+      if (!(MrgPrev && MrgNext && MrgHeap && MrgHpos && MrgCost)) ErrorAbort(MAFM);
+#ifdef MODULE
+      if (error_code & FATAL_ERROR) return;
+#endif
+    }
+
+  for (j = 0, hn = 0; j < n; j++)
+    {
+      MrgPrev[j] = j - 1;
+      MrgNext[j] = ((j + 1) < n) ? (j + 1) : -1;
+      MrgHpos[j] = -1;
+      if (MrgNext[j] < 0) continue;
+      MrgCost[j]  = MergeCost(pop_nr, j, j + 1);
+      MrgHeap[hn] = j;
+      MrgHpos[j]  = hn;
+      hn++;
+    }
+  for (j = hn/2 - 1; j >= 0; j--) HeapMove(j, hn);
+
+  for (; n > max_cohorts[pop_nr]; n--)
+    {
+      a = MrgHeap[0];                                                               // Merge the cheapest pair into "a"
+      b = MrgNext[a];
+      if ((p[a][0] + p[b][0]) > 0.0)
+        {                                                                           // Weighted means, written such that equal
+          w = p[b][0]/(p[a][0] + p[b][0]);                                          // i-states stay exactly the same
+          for (k = 1; k < COHORT_SIZE; k++) p[a][k] += w*(p[b][k] - p[a][k]);
+#if (I_CONST_DIM > 0)
+          for (k = 0; k < I_CONST_DIM; k++) pid[a][k] += w*(pid[b][k] - pid[a][k]);
+#endif
+        }
+      p[a][0] += p[b][0];
+      p[b][0]  = -1.0E-15;
+
+      MrgNext[a] = MrgNext[b];                                                      // Unlink "b" and update the costs
+      if (MrgNext[b] >= 0) MrgPrev[MrgNext[b]] = a;
+      if (MrgHpos[b] >= 0) HeapRemove(b, &hn);
+      if (MrgNext[a] >= 0)
+        {
+          MrgCost[a] = MergeCost(pop_nr, a, MrgNext[a]);
+          HeapMove(MrgHpos[a], hn);
+        }
+      else
+        HeapRemove(a, &hn);
+      if (MrgPrev[a] >= 0)
+        {
+          MrgCost[MrgPrev[a]] = MergeCost(pop_nr, MrgPrev[a], a);
+          HeapMove(MrgHpos[MrgPrev[a]], hn);
+        }
+    }
+
+  // Remove the merged cohorts, keeping the order
+  for (j = 0, a = 0; j < CohortNo[pop_nr]; j++)
+    {
+      if (p[j][0] < 0.0) continue;
+      if (a < j)
+        {
+          (void)memcpy((DEF_TYPE *)p[a], (DEF_TYPE *)p[j], COHORT_SIZE*sizeof(double));
+#if (I_CONST_DIM > 0)
+          (void)memcpy((DEF_TYPE *)pid[a], (DEF_TYPE *)pid[j], I_CONST_DIM*sizeof(double));
+#endif
+        }
+      a++;
+    }
+  CohortNo[pop_nr] = a;
+
+  return;
+}
+#endif // (COHORT_BUDGET == 1)
+
+
 /*==================================================================================================================================*/
 
 void SievePop()
 
   /* 
    * SievePop - Routine that scans all the cohorts, removing the ones that are below the minimum size and conjugating cohorts that 
-   *            have become too similar.
+   *            have become too similar. With COHORT_BUDGET equal to 1 it subsequently merges cohorts in populations that exceed
+   *            their maximum number of cohorts. Finally the memory of populations that use less than a quarter of it is shrunk.
    */
 
 {
@@ -307,6 +721,7 @@ void SievePop()
 #endif
   double                          diff, comp;
   int                             equal;
+  long                            mem_req;
 
   for (i = 0; i < POPULATION_NR; i++)
     {                                                                               // Join similar cohorts
@@ -369,6 +784,32 @@ void SievePop()
             }
         }
       CohortNo[i] = ind1;
+
+#if (COHORT_BUDGET == 1)
+      // Merge cohorts if the population exceeds its maximum number
+      if ((max_cohorts[i] > 0) && (CohortNo[i] > max_cohorts[i])) MergeCohorts(i);
+#endif
+
+      // Shrink the memory of populations that have lost most of their cohorts
+      mem_req = CohortNo[i]*COHORT_SIZE;
+      if (MemExcess(mem_req, DataMemAllocated[i]))
+        {
+          DataMemAllocated[i] = MemBlocks(mem_req);
+          pop[i]              = (population)Myalloc((void *)pop[i], (size_t)DataMemAllocated[i], sizeof(double));
+          if (!(pop[i])) ErrorAbort(MAFC);
+        }
+#if (I_CONST_DIM > 0)
+      mem_req = CohortNo[i]*I_CONST_DIM;
+      if (MemExcess(mem_req, IDMemAllocated[i]))
+        {
+          IDMemAllocated[i] = MemBlocks(mem_req);
+          popIDcard[i]      = (popID)Myalloc((void *)popIDcard[i], (size_t)IDMemAllocated[i], sizeof(double));
+          if (!(popIDcard[i])) ErrorAbort(MAFI);
+        }
+#endif
+#ifdef MODULE
+      if (error_code & FATAL_ERROR) return;
+#endif // MODULE
     }
 
   for (i = 0; i < POPULATION_NR; i++) cohort_no[i] = CohortNo[i];
@@ -377,8 +818,481 @@ void SievePop()
 }
 
 
+/*==================================================================================================================================*/
+#if (DORMANT_COHORTS == 1)
+
+static void ParkDormant(double horizon)
+
+  /* 
+   * ParkDormant - Routine removes the internal cohorts that the user declares dormant for the coming cohort cycle of at most 
+   *               "horizon" time units (see DormantCohort()) from the populations, such that they are skipped by Gradient() and 
+   *               the integration method. The dormant cohorts are stored together with their rates of change and their positions 
+   *               in the population.
+   */
+
+{
+  register int                    i, j, n;
+  register cohort_pnt             p;
+#if (I_CONST_DIM > 0)
+  register cohortID_pnt           pid;
+#endif
+
+  DormStart = env[0];
+  for (i = 0; i < POPULATION_NR; i++)
+    {
+      DormNo[i] = 0;
+      if (!CohortNo[i]) continue;
+
+      if (CohortNo[i] > DormAllocated[i])                                           // Create memory for dormant cohorts if necessary
+        {
+          DormAllocated[i] = MemBlocks(CohortNo[i]);
+          DormData[i]      = (population)Myalloc((void *)DormData[i], (size_t)(DormAllocated[i]*COHORT_SIZE), sizeof(double));
+          DormRates[i]     = (population)Myalloc((void *)DormRates[i], (size_t)(DormAllocated[i]*COHORT_SIZE), sizeof(double));
+          DormIndex[i]     = (int *)Myalloc((void *)DormIndex[i], (size_t)DormAllocated[i], sizeof(int));
+          if (!(DormData[i] && DormRates[i] && DormIndex[i])) ErrorAbort(MAFD);
+#if (I_CONST_DIM > 0)
+          DormIDcard[i]    = (popID)Myalloc((void *)DormIDcard[i], (size_t)(DormAllocated[i]*I_CONST_DIM), sizeof(double));
+          if (!(DormIDcard[i])) ErrorAbort(MAFD);
+#endif
+#ifdef MODULE
+          if (error_code & FATAL_ERROR) return;
+#endif // MODULE
+        }
+
+      p = pop[i];
+#if (I_CONST_DIM > 0)
+      pid = popIDcard[i];
+#endif
+      for (j = 0, n = 0; j < CohortNo[i]; j++)                                      // Move dormant cohorts out, compact the others
+        {
+          if (DormantCohort(env, pop, i, j, horizon, DormRates[i][DormNo[i]]))
+            {
+              (void)memcpy((DEF_TYPE *)DormData[i][DormNo[i]], (DEF_TYPE *)p[j], COHORT_SIZE*sizeof(double));
+#if (I_CONST_DIM > 0)
+              (void)memcpy((DEF_TYPE *)DormIDcard[i][DormNo[i]], (DEF_TYPE *)pid[j], I_CONST_DIM*sizeof(double));
+#endif
+              DormIndex[i][DormNo[i]++] = j;
+            }
+          else
+            {
+              if (n < j)
+                {
+                  (void)memcpy((DEF_TYPE *)p[n], (DEF_TYPE *)p[j], COHORT_SIZE*sizeof(double));
+#if (I_CONST_DIM > 0)
+                  (void)memcpy((DEF_TYPE *)pid[n], (DEF_TYPE *)pid[j], I_CONST_DIM*sizeof(double));
+#endif
+                }
+              n++;
+            }
+        }
+      if (!DormNo[i]) continue;
+
+      if (BpointNo[i])                                                              // Move boundary cohorts down
+        {
+          (void)memmove((DEF_TYPE *)p[n], (DEF_TYPE *)p[CohortNo[i]], BpointNo[i]*COHORT_SIZE*sizeof(double));
+          ofs[i] = pop[i] + n;
+#if (I_CONST_DIM > 0)
+          (void)memmove((DEF_TYPE *)pid[n], (DEF_TYPE *)pid[CohortNo[i]], BpointNo[i]*I_CONST_DIM*sizeof(double));
+          ofsIDcard[i] = popIDcard[i] + n;
+#endif
+        }
+      CohortNo[i]   = n;
+      cohort_no[i]  = n;
+      DormActive[i] = n;
+    }
+
+  return;
+}
+
+
+/*==================================================================================================================================*/
+
+static void AdvanceDormant(cohort dst, cohort src, cohort rates, double dt)
+
+  /* 
+   * AdvanceDormant - Routine advances the dormant cohort "src" over a time "dt" with its constant rates of change and stores the 
+   *                  result in "dst". The number of individuals decreases exponentially, the i-state variables change linearly.
+   */
+
+{
+  register int                    k;
+
+  dst[number] = src[number]*exp(rates[number]*dt);
+  for (k = 1; k < COHORT_SIZE; k++) dst[k] = src[k] + rates[k]*dt;
+
+  return;
+}
+
+
+/*==================================================================================================================================*/
+
+void WakeDormant()
+
+  /* 
+   * WakeDormant - Routine advances the dormant cohorts to the current time, using their constant rates of change, and returns 
+   *               them to their original positions in the populations. The number of individuals decreases exponentially, the 
+   *               i-state variables change linearly.
+   */
+
+{
+  register int                    i, j, a, d;
+  register cohort_pnt             p;
+#if (I_CONST_DIM > 0)
+  register cohortID_pnt           pid;
+#endif
+  double                          dt;
+  int                             total;
+
+  HideDormant();
+  dt = env[0] - DormStart;
+  for (i = 0; i < POPULATION_NR; i++)
+    {
+      if (!DormNo[i]) continue;
+
+      for (j = 0; j < DormNo[i]; j++) AdvanceDormant(DormData[i][j], DormData[i][j], DormRates[i][j], dt);
+
+      p     = pop[i];
+      total = CohortNo[i] + DormNo[i];
+#if (I_CONST_DIM > 0)
+      pid   = popIDcard[i];
+#endif
+      if (BpointNo[i])                                                              // Move boundary cohorts up again
+        {
+          (void)memmove((DEF_TYPE *)p[total], (DEF_TYPE *)p[CohortNo[i]], BpointNo[i]*COHORT_SIZE*sizeof(double));
+          ofs[i] = pop[i] + total;
+#if (I_CONST_DIM > 0)
+          (void)memmove((DEF_TYPE *)pid[total], (DEF_TYPE *)pid[CohortNo[i]], BpointNo[i]*I_CONST_DIM*sizeof(double));
+          ofsIDcard[i] = popIDcard[i] + total;
+#endif
+        }
+
+      for (j = total - 1, a = CohortNo[i] - 1, d = DormNo[i] - 1; j > a; j--)       // Merge from the top down
+        {
+          if ((d >= 0) && (DormIndex[i][d] == j))
+            {
+              (void)memcpy((DEF_TYPE *)p[j], (DEF_TYPE *)DormData[i][d], COHORT_SIZE*sizeof(double));
+#if (I_CONST_DIM > 0)
+              (void)memcpy((DEF_TYPE *)pid[j], (DEF_TYPE *)DormIDcard[i][d], I_CONST_DIM*sizeof(double));
+#endif
+              d--;
+            }
+          else
+            {
+              (void)memcpy((DEF_TYPE *)p[j], (DEF_TYPE *)p[a], COHORT_SIZE*sizeof(double));
+#if (I_CONST_DIM > 0)
+              (void)memcpy((DEF_TYPE *)pid[j], (DEF_TYPE *)pid[a], I_CONST_DIM*sizeof(double));
+#endif
+              a--;
+            }
+        }
+      CohortNo[i]  = total;
+      cohort_no[i] = total;
+      DormNo[i]    = 0;
+    }
+
+  return;
+}
+
+
+/*==================================================================================================================================*/
+
+void ShowDormant()
+
+  /* 
+   * ShowDormant - Routine makes the dormant cohorts, advanced to the current time, temporarily part of the populations, such that 
+   *               output produced during a cohort cycle covers all cohorts. The populations are composed in their own memory from 
+   *               the remaining cohorts, which pop[] may point to in the state vector of the integrator, the advanced dormant 
+   *               cohorts at their original positions and the boundary cohorts, if CohortNo[] includes them at this time. 
+   *               HideDormant() restores the populations.
+   */
+
+{
+  register int                    i, j, a, d, total;
+  double                          dt;
+
+  if (DormShown) return;
+
+  dt = env[0] - DormStart;
+  for (i = 0; i < POPULATION_NR; i++)
+    {
+      if (!DormNo[i]) continue;
+
+      total = CohortNo[i] + DormNo[i];
+      if (total > ShowAllocated[i])                                                 // Create memory if necessary
+        {
+          ShowAllocated[i] = MemBlocks(total);
+          ShowData[i]      = (population)Myalloc((void *)ShowData[i], (size_t)(ShowAllocated[i]*COHORT_SIZE), sizeof(double));
+          if (!ShowData[i]) ErrorAbort(MAFD);
+#if (I_CONST_DIM > 0)
+          ShowIDcard[i]    = (popID)Myalloc((void *)ShowIDcard[i], (size_t)(ShowAllocated[i]*I_CONST_DIM), sizeof(double));
+          if (!ShowIDcard[i]) ErrorAbort(MAFD);
+#endif
+#ifdef MODULE
+          if (error_code & FATAL_ERROR) return;
+#endif // MODULE
+        }
+
+      for (j = 0, a = 0, d = 0; j < DormActive[i] + DormNo[i]; j++)                  // Merge from the bottom up
+        {
+          if ((d < DormNo[i]) && (DormIndex[i][d] == j))
+            {
+              AdvanceDormant(ShowData[i][j], DormData[i][d], DormRates[i][d], dt);
+#if (I_CONST_DIM > 0)
+              (void)memcpy((DEF_TYPE *)ShowIDcard[i][j], (DEF_TYPE *)DormIDcard[i][d], I_CONST_DIM*sizeof(double));
+#endif
+              d++;
+            }
+          else
+            {
+              (void)memcpy((DEF_TYPE *)ShowData[i][j], (DEF_TYPE *)pop[i][a], COHORT_SIZE*sizeof(double));
+#if (I_CONST_DIM > 0)
+              (void)memcpy((DEF_TYPE *)ShowIDcard[i][j], (DEF_TYPE *)popIDcard[i][a], I_CONST_DIM*sizeof(double));
+#endif
+              a++;
+            }
+        }
+      if (CohortNo[i] > DormActive[i])                                              // Boundary cohorts included
+        {
+          (void)memcpy((DEF_TYPE *)ShowData[i][j], (DEF_TYPE *)pop[i][a], (CohortNo[i] - a)*COHORT_SIZE*sizeof(double));
+#if (I_CONST_DIM > 0)
+          (void)memcpy((DEF_TYPE *)ShowIDcard[i][j], (DEF_TYPE *)popIDcard[i][a], (CohortNo[i] - a)*I_CONST_DIM*sizeof(double));
+#endif
+        }
+
+      HidePop[i]   = pop[i];
+      HideOfs[i]   = ofs[i];
+      HideNo[i]    = CohortNo[i];
+      pop[i]       = ShowData[i];
+      if (BpointNo[i]) ofs[i] = pop[i] + DormActive[i] + DormNo[i];
+      CohortNo[i]  = total;
+      cohort_no[i] = total;
+#if (I_CONST_DIM > 0)
+      HidePopIDcard[i] = popIDcard[i];
+      HideOfsIDcard[i] = ofsIDcard[i];
+      popIDcard[i]     = ShowIDcard[i];
+      if (BpointNo[i]) ofsIDcard[i] = popIDcard[i] + DormActive[i] + DormNo[i];
+#endif
+    }
+  DormShown = 1;
+
+  return;
+}
+
+
+/*==================================================================================================================================*/
+
+void HideDormant()
+
+  /* 
+   * HideDormant - Routine undoes ShowDormant(). Changes made to the populations in the meantime are discarded.
+   */
+
+{
+  register int                    i;
+
+  if (!DormShown) return;
+
+  for (i = 0; i < POPULATION_NR; i++)
+    {
+      if (!DormNo[i]) continue;
+
+      pop[i]       = HidePop[i];
+      ofs[i]       = HideOfs[i];
+      CohortNo[i]  = HideNo[i];
+      cohort_no[i] = HideNo[i];
+#if (I_CONST_DIM > 0)
+      popIDcard[i] = HidePopIDcard[i];
+      ofsIDcard[i] = HideOfsIDcard[i];
+#endif
+    }
+  DormShown = 0;
+
+  return;
+}
+
+#endif // (DORMANT_COHORTS == 1)
 #endif // (POPULATION_NR > 0)
 
+#if (ADAPT_COH_LIMIT == 1)
+/*==================================================================================================================================*/
+/*
+ * The routines below adapt the cohort limit at the end of every cohort cycle. The cohort limit is kept at the value from the CVF 
+ * file times a power of 2 between min_coh_limit and max_coh_limit, so that cycles keep ending at multiples of the cohort limit, 
+ * as with a fixed cohort limit, unless the run ends before (see SetCycleEnd()). Cycles are shortened when the birth rate changes 
+ * quickly, as during a reproductive pulse, and lengthened when it hardly changes. Cycles are not shortened when the largest 
+ * integration step spanned more than half of the last cycle, as shorter cycles would only truncate the integration steps. 
+ * Irrespective of the birth rate, cycles are lengthened as long as the populations on average contain more than target_cohorts 
+ * cohorts.
+ */
+
+static void MeasureBirths()
+
+  /* 
+   * MeasureBirths - Routine updates the rates at which individuals are born into the boundary cohorts of each population, 
+   *                 including the ones added by InstantDynamics(), and keeps the rates before the update. The rates are 
+   *                 averaged exponentially over a time scale equal to the cohort limit from the CVF file, such that 
+   *                 short cycles do not mistake the randomness of individual reproduction events for a reproductive pulse.
+   */
+
+{
+  register int                    i, j;
+  double                          born, len;
+
+  len = env[0] - CycleStart;
+  if (len < SMALLEST_STEP) return;
+
+  if (LimitBase <= 0.0)                                                             // Determine the admissible powers of 2
+    {
+      LimitBase   = cohort_limit;
+      LimitExp    = 0;
+      MinLimitExp = (int)ceil(log2(min_coh_limit/LimitBase) - 1.0E-9);
+      MaxLimitExp = (int)floor(log2(max_coh_limit/LimitBase) + 1.0E-9);
+    }
+
+  for (i = 0; i < POPULATION_NR; i++)
+    {
+      born = 0.0;
+      if (ofs[i])
+        for (j = 0; j < BpointNo[i]; j++) born += max(ofs[i][j][number], 0.0);
+
+      PrevBirthRate[i] = BirthRate[i];
+      if (BirthsMeasured)
+        BirthRate[i] += (1.0 - exp(-len/LimitBase))*(born/len - BirthRate[i]);
+      else
+        BirthRate[i]  = born/len;
+    }
+  BirthsMeasured++;
+
+  return;
+}
+
+
+/*==================================================================================================================================*/
+
+static void SetCycleEnd()
+
+  /* 
+   * SetCycleEnd - Routine sets the end of the next cohort cycle at the next multiple of the cohort limit, but not beyond the end 
+   *               of the run, as the run only ends between cohort cycles. Neither does a cycle run past the next time of 
+   *               (state) output, if output is not more frequent than cohort cycles of the length in the CVF file. More frequent 
+   *               output is interpolated within a cycle, as with a fixed cohort limit.
+   */
+
+{
+  double                          base;
+
+  next_cohort_end = (floor((env[0] + SMALLEST_STEP)/cohort_limit) + 1)*cohort_limit;
+  base            = (LimitBase > 0.0) ? LimitBase : cohort_limit;
+
+  if ((max_time - env[0]) >= SMALLEST_STEP) next_cohort_end = min(next_cohort_end, max_time);
+  if ((delt_out >= base) && ((next_output - env[0]) >= SMALLEST_STEP))
+    next_cohort_end = min(next_cohort_end, next_output);
+  if ((state_out >= base) && ((next_state_output - env[0]) >= SMALLEST_STEP))
+    next_cohort_end = min(next_cohort_end, next_state_output);
+
+  return;
+}
+
+
+/*==================================================================================================================================*/
+
+static void AdaptCohortLimit()
+
+  /* 
+   * AdaptCohortLimit - Routine adapts the cohort limit on the basis of the changes in birth rate, the step sizes of the integrator 
+   *                    and the number of cohorts and sets the end of the next cohort cycle. The cohort limit is doubled at most 
+   *                    once per cycle, but can be halved several times in a row.
+   */
+
+{
+  register int                    i;
+  double                          len, factor, change, cohorts;
+
+  if (LimitBase <= 0.0)                                                             // No birth rates measured yet
+    {
+      SetCycleEnd();
+      return;
+    }
+
+  factor = 2.0;
+
+  if (BirthsMeasured > 1)                                                           // Relative change in birth rates
+    {
+      for (i = 0; i < POPULATION_NR; i++)
+        {
+          change = max(BirthRate[i], PrevBirthRate[i]);
+          if (change <= 0.0) continue;
+
+          change = fabs(BirthRate[i] - PrevBirthRate[i])/change;
+          if (change > 0.0) factor = min(factor, COH_LIMIT_SAFETY*BIRTH_VARIATION/change);
+        }
+    }
+  len = env[0] - CycleStart;                                                        // No shorter cycles if integration steps
+  if ((factor < 1.0) && (maxss > 0.5*len)) factor = 1.0;                            // already span half the cycle
+
+  if (target_cohorts > 0.0)                                                         // Longer cycles if too many cohorts
+    {
+      for (i = 0, cohorts = 0.0; i < POPULATION_NR; i++) cohorts += CohortNo[i];
+      cohorts /= POPULATION_NR;
+      if (cohorts > target_cohorts) factor = max(factor, cohorts/target_cohorts);
+    }
+
+  if (factor >= 2.0)
+    LimitExp++;
+  else if (factor < 1.0)
+    LimitExp -= (int)ceil(-log2(factor));
+  LimitExp = imin(imax(LimitExp, MinLimitExp), MaxLimitExp);
+
+  if (MinLimitExp <= MaxLimitExp) cohort_limit = ldexp(LimitBase, LimitExp);
+
+  SetCycleEnd();
+
+  if (EBTDEBUG(2))
+    {
+      (void)fprintf(dbgfil, "Cohort limit: T = %15.8f   factor: %12.7E  limit: %12.7E\n", env[0], factor, cohort_limit);
+      (void)fflush(dbgfil);
+    }
+
+  return;
+}
+
+#endif // (ADAPT_COH_LIMIT == 1)
+
+/*==================================================================================================================================*/
+
+int ExchangeCycleState(double *data, int load)
+
+  /* 
+   * ExchangeCycleState - Routine copies the state of the cohort administration that is carried over from one cohort cycle to 
+   *                      the next to data[] (load = 0), or loads it from there (load = 1), when writing or reading a 
+   *                      checkpoint. Returns the number of values, which is all that is computed when data equals NULL.
+   */
+
+{
+  int                             n = 0;
+
+#if (ADAPT_COH_LIMIT == 1)
+  register int                    i;
+
+  for (i = 0; i < POPULATION_NR; i++)
+    {
+      ExchangeVar(data, n, load, BirthRate[i]);
+      ExchangeVar(data, n, load, PrevBirthRate[i]);
+    }
+  ExchangeVar(data, n, load, BirthsMeasured);
+  ExchangeVar(data, n, load, LimitBase);
+  ExchangeVar(data, n, load, LimitExp);
+  ExchangeVar(data, n, load, MinLimitExp);
+  ExchangeVar(data, n, load, MaxLimitExp);
+#else
+  (void)data;                                                                       // Nothing carried over
+  (void)load;
+#endif // (ADAPT_COH_LIMIT == 1)
+
+  return n;
+}
+
+
 /*==================================================================================================================================*/
 
 void CohortCycle(double next)
@@ -448,6 +1362,13 @@ void CohortCycle(double next)
 
   if (step_size <= SMALLEST_STEP) step_size = cohort_limit;
   minss = maxss = step_size;
+#if (ADAPT_COH_LIMIT == 1)
+  CycleStart = env[0];
+#endif
+
+#if ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+  ParkDormant(next - env[0]);                                                       // Set dormant cohorts aside
+#endif
 
   // Do as many integration steps as possible with adaptable stepsize and end with an optional rest step
   PrepareCycle();
@@ -465,6 +1386,12 @@ void CohortCycle(double next)
       maxss = max(maxss, step_size);
     }
   ForcedCohortEnd = cohort_end;
+#if (POPULATION_NR > 0)
+  ReleasePopulations();                                                             // Populations to own memory
+#endif
+#if ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+  WakeDormant();                                                                    // Return dormant cohorts
+#endif
 
   if (EBTDEBUG(2))
     {
@@ -479,6 +1406,9 @@ void CohortCycle(double next)
   for (i = 0; i < POPULATION_NR; i++)                                               // Create empty state labels
     strcpy(statelabels[i], "");                                                     // AvdM, moved here from FileState()
 
+#if (ADAPT_COH_LIMIT == 1)
+  MeasureBirths();                                                                  // Birth rates during cycle
+#endif
   InsertBcohorts();                                                                 // Insert boundary cohorts
 
   SievePop();                                                                       // Delete all cohorts that are too small
@@ -517,6 +1447,8 @@ void CohortCycle(double next)
 
 #if (DYNAMIC_COHORTS == 1)
   next_cohort_end = max_time;
+#elif (ADAPT_COH_LIMIT == 1)
+  AdaptCohortLimit();                                                               // Adapt cohort limit and set next end
 #else
   if (fabs(next_cohort_end - env[0]) < SMALLEST_STEP)
     next_cohort_end += cohort_limit;
@@ -524,6 +1456,10 @@ void CohortCycle(double next)
     next_cohort_end = env[0] + cohort_limit;
 #endif // DYNAMIC_COHORTS
 
+  MemTrim();                                                                        // Return idle pooled memory
+
+  if (checkpoint_int > 0.0) Checkpoint(0);                                          // Periodic checkpoint of the run
+
   return;
 }
 
@@ -597,6 +1533,14 @@ EXTERN_C int CycleInit()
 
   if (step_size <= SMALLEST_STEP) step_size = cohort_limit;
   minss = maxss = step_size;
+#if (ADAPT_COH_LIMIT == 1)
+  CycleStart = env[0];
+#endif
+
+#if ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+  ParkDormant(next_cohort_end - env[0]);                                            // Set dormant cohorts aside
+  if (error_code & FATAL_ERROR) return error_code;
+#endif
 
   // Do as many integration steps as possible with adaptable stepsize and end with an optional rest step
   PrepareCycle();
@@ -619,7 +1563,16 @@ EXTERN_C int CycleStep()
 #endif
   error_code = 0;
 
-  if ((env[0] >= max_time) || ForcedRunEnd) return END_OF_COHORT;
+  if ((env[0] >= max_time) || ForcedRunEnd)
+    {
+#if (POPULATION_NR > 0)
+      ReleasePopulations();
+#endif
+#if ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+      WakeDormant();
+#endif
+      return END_OF_COHORT;
+    }
 
   /*
   if ((!((next_cohort_end-env[0]) < SMALLEST_STEP)) && (!cohort_end))
@@ -639,6 +1592,12 @@ EXTERN_C int CycleStep()
     }
 
   ForcedCohortEnd = cohort_end;
+#if (POPULATION_NR > 0)
+  ReleasePopulations();                                                             // Populations to own memory
+#endif
+#if ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+  WakeDormant();                                                                    // Return dormant cohorts
+#endif
 
   ret_val = END_OF_COHORT;                                                          //AvdM
 
@@ -655,6 +1614,9 @@ EXTERN_C int CycleStep()
   for (i = 0; i < POPULATION_NR; i++)                                               // Create empty state labels
     strcpy(statelabels[i], "");                                                     // AvdM, moved here from FileState()
 
+#if (ADAPT_COH_LIMIT == 1)
+  MeasureBirths();                                                                  // Birth rates during cycle
+#endif
   InsertBcohorts();                                                                 // Insert boundary cohorts
 
   if (error_code & FATAL_ERROR) return (ret_val | error_code);
@@ -697,6 +1659,8 @@ EXTERN_C int CycleStep()
 
 #if (DYNAMIC_COHORTS == 1)
   next_cohort_end = max_time;
+#elif (ADAPT_COH_LIMIT == 1)
+  AdaptCohortLimit();                                                               // Adapt cohort limit and set next end
 #else
   if (fabs(next_cohort_end - env[0]) < SMALLEST_STEP)
     next_cohort_end += cohort_limit;
@@ -704,6 +1668,10 @@ EXTERN_C int CycleStep()
     next_cohort_end = env[0] + cohort_limit;
 #endif // DYNAMIC_COHORTS
 
+  MemTrim();                                                                        // Return idle pooled memory
+
+  if (checkpoint_int > 0.0) Checkpoint(0);                                          // Periodic checkpoint of the run
+
   ret_val |= error_code;
 
   return ret_val;                                                                   //AvdM
@@ -27,8 +27,23 @@ EXTERN int		InsCohort(cohort, cohortID, int);
 #else
 EXTERN   int		InsCohort(cohort, int);
 #endif
+EXTERN   void		SortCohorts(int);
 EXTERN_C void		TransBcohorts(void);
+#if defined(MODULE)
+EXTERN_C int		CycleInit(void);
+EXTERN_C int		CycleStep(void);
+#endif
 EXTERN   void		SievePop(void);
+EXTERN   int		ExchangeCycleState(double *, int);
+#if (POPULATION_NR > 0)
+EXTERN   void		AliasPopulations(double *);
+EXTERN   void		ReleasePopulations(void);
+#endif
+#if ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+EXTERN   void		WakeDormant(void);
+EXTERN   void		ShowDormant(void);
+EXTERN   void		HideDormant(void);
+#endif
 
 
 
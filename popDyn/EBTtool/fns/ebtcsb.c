@@ -0,0 +1,307 @@
+/***
+   NAME
+     ebtcsb.c
+   PURPOSE
+     Command line tool to inspect and extract the complete state output of
+     the Escalator Boxcar Train (CSB and ESF files) with the routines in
+     ebtcsbread.c, without loading the file as a whole. It is run as
+
+       ebtcsb [options] <file>
+
+     and writes tab-separated values to standard output (see usage() below).
+     Populations and columns are numbered from 0, as in the program, column
+     0 being the number of individuals in the cohort.
+   NOTES
+     The tool does not depend on the problem-specific file and is compiled
+     once, from the EBTtool directory, with
+
+       gcc -O2 -Ifns -o ebtcsb fns/ebtcsb.c fns/ebtcsbread.c
+
+     Examples:
+
+       ebtcsb EBTstd.csb			list times and cohort numbers
+       ebtcsb -e -t 100:200 EBTstd.csb		environment from T=100 to 200
+       ebtcsb -p 0 -c 0,1 EBTstd.csb		numbers and first i-state
+       ebtcsb -p 0 -H 1 -b 50 EBTstd.csb	size distributions
+   HISTORY
+     Oct 17, 2026 : Created.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#include "ebtcsbread.h"
+
+#define LIST		0			/* Output modes             */
+#define INFO		1
+#define ENVIRON		2
+#define COHORTS		3
+#define HISTOGRAM	4
+
+#define MAXCOLUMNS	256
+
+
+/*==========================================================================*/
+
+static void usage(char *progname)
+
+{
+  fprintf(stderr, "\nUsage: %s [options] <CSB or ESF file>\n\n", progname);
+  fprintf(stderr, "    -l\n");
+  fprintf(stderr, "        List the times of the states and the numbers of cohorts (default)\n\n");
+  fprintf(stderr, "    -i\n");
+  fprintf(stderr, "        Show the format, the dimensions and the parameters of the file\n\n");
+  fprintf(stderr, "    -e\n");
+  fprintf(stderr, "        Write the environment variables of every state\n\n");
+  fprintf(stderr, "    -p <n>\n");
+  fprintf(stderr, "        Write the cohorts of population n, one row per cohort\n\n");
+  fprintf(stderr, "    -c <i,j,...>\n");
+  fprintf(stderr, "        Only write the columns i, j, ... of the cohorts (default all)\n\n");
+  fprintf(stderr, "    -t <t0:t1>\n");
+  fprintf(stderr, "        Only use the states with t0 <= time <= t1, either may be omitted\n\n");
+  fprintf(stderr, "    -H <i>\n");
+  fprintf(stderr, "        Write the histogram of column i of population n, weighted with the numbers\n\n");
+  fprintf(stderr, "    -b <n>\n");
+  fprintf(stderr, "        Use n bins in the histogram (default 20)\n\n");
+  fprintf(stderr, "    -r <lo:hi>\n");
+  fprintf(stderr, "        Range of the histogram (default the range of the values)\n\n");
+  fprintf(stderr, "    -u\n");
+  fprintf(stderr, "        Count the cohorts in the histogram instead of the individuals\n\n");
+  fprintf(stderr, "    -? | --help \n");
+  fprintf(stderr, "        Show this message\n");
+  fprintf(stderr, "\n");
+  exit(1);
+
+  return;
+}
+
+
+
+/*==========================================================================*/
+
+static int	Range(const char *arg, double *lo, double *hi)
+
+  /*
+   * Range - Reads a range "lo:hi" from arg, of which either value may be
+   *	     omitted. Returns 0 on a syntax error.
+   */
+
+{
+  char			*end;
+
+  if (*arg != ':')
+    {
+      *lo = strtod(arg, &end);
+      if ((end == arg) || (*end != ':')) return 0;
+      arg = end;
+    }
+  arg++;
+  if (*arg)
+    {
+      *hi = strtod(arg, &end);
+      if ((end == arg) || *end) return 0;
+    }
+
+  return 1;
+}
+
+
+
+/*==========================================================================*/
+
+int		main(int argc, char **argv)
+
+{
+  csbfile		*f;
+  const double		*par, *val;
+  double		t0 = -DBL_MAX, t1 = DBL_MAX, lo = DBL_MAX, hi = -DBL_MAX;
+  double		*edges, *counts, *tmp;
+  char			*fname = NULL, *lst, *end;
+  int			mode = LIST, pop = -1, hcol = -1, bins = 20, weight = 0, range = 0;
+  int			cols[MAXCOLUMNS], colnr = 0;
+  int			s, s0, p, i, j, n;
+
+  for (i=1; i<argc; i++)
+    {
+      if (!strcmp(argv[i], "-?") || !strcmp(argv[i], "--help")) usage(argv[0]);
+      else if (!strcmp(argv[i], "-l")) mode = LIST;
+      else if (!strcmp(argv[i], "-i")) mode = INFO;
+      else if (!strcmp(argv[i], "-e")) mode = ENVIRON;
+      else if (!strcmp(argv[i], "-u")) weight = -1;
+      else if ((argv[i][0] == '-') && argv[i][1] && !argv[i][2] && strchr("pctHbr", argv[i][1]))
+	{
+	  if (++i == argc) usage(argv[0]);
+	  switch (argv[i-1][1])
+	    {
+	    case 'p':
+	      pop = atoi(argv[i]);
+	      if (mode != HISTOGRAM) mode = COHORTS;
+	      break;
+	    case 'c':
+	      for (lst=argv[i]; *lst && (colnr < MAXCOLUMNS); lst=end)
+		{
+		  cols[colnr++] = (int)strtol(lst, &end, 10);
+		  if (end == lst) usage(argv[0]);
+		  if (*end == ',') end++;
+		}
+	      break;
+	    case 't':
+	      if (!Range(argv[i], &t0, &t1)) usage(argv[0]);
+	      break;
+	    case 'H':
+	      hcol = atoi(argv[i]);
+	      mode = HISTOGRAM;
+	      break;
+	    case 'b':
+	      bins = atoi(argv[i]);
+	      if (bins <= 0) usage(argv[0]);
+	      break;
+	    case 'r':
+	      if (!Range(argv[i], &lo, &hi)) usage(argv[0]);
+	      range = 1;
+	      break;
+	    }
+	}
+      else if ((argv[i][0] == '-') || fname) usage(argv[0]);
+      else fname = argv[i];
+    }
+  if (!fname) usage(argv[0]);
+
+  f = CsbOpen(fname);
+  if (!f)
+    {
+      fprintf(stderr, "\nUnable to read %s as a CSB or ESF file!\n\n", fname);
+      exit(1);
+    }
+  if (((mode == COHORTS) || (mode == HISTOGRAM)) && ((pop < 0) || (pop >= CsbPopulations(f))))
+    {
+      fprintf(stderr, "\nSpecify a population between 0 and %d with -p!\n\n", CsbPopulations(f) - 1);
+      exit(1);
+    }
+  if (!colnr)
+    for (colnr=0; colnr<CsbColumns(f) && (colnr < MAXCOLUMNS); colnr++) cols[colnr] = colnr;
+  for (j=0; j<colnr; j++)
+    if ((cols[j] < 0) || (cols[j] >= CsbColumns(f)))
+      {
+	fprintf(stderr, "\nColumn %d not between 0 and %d!\n\n", cols[j], CsbColumns(f) - 1);
+	exit(1);
+      }
+  if ((mode == HISTOGRAM) && ((hcol < 0) || (hcol >= CsbColumns(f))))
+    {
+      fprintf(stderr, "\nHistogram column %d not between 0 and %d!\n\n", hcol, CsbColumns(f) - 1);
+      exit(1);
+    }
+
+  s0 = CsbFind(f, t0);
+  switch (mode)
+    {
+    case INFO:
+      printf("Format\t%s\n", CsbVersion(f) == 2 ? "CSB indexed" : (CsbVersion(f) ? "CSB original" : "ESF"));
+      printf("States\t%d\n", CsbStates(f));
+      if (CsbStates(f))
+	printf("Times\t%.10G\t%.10G\n", CsbTime(f, 0), CsbTime(f, CsbStates(f) - 1));
+      printf("Environment\t%d\n", CsbEnvironDim(f));
+      printf("Populations\t%d\n", CsbPopulations(f));
+      printf("Columns\t%d\n", CsbColumns(f));
+      n = CsbParameters(f, &par);
+      printf("Parameters\t%d\n", n);
+      for (i=0; i<n; i++) printf("%d\t%.10G\n", i, par[i]);
+      break;
+    case LIST:
+      printf("State\tTime");
+      for (p=0; p<CsbPopulations(f); p++) printf("\tCohorts %d", p);
+      printf("\n");
+      for (s=s0; (s<CsbStates(f)) && (CsbTime(f, s) <= t1); s++)
+	{
+	  printf("%d\t%.10G", s, CsbTime(f, s));
+	  for (p=0; p<CsbPopulations(f); p++) printf("\t%d", CsbCohorts(f, s, p));
+	  printf("\n");
+	}
+      break;
+    case ENVIRON:
+      for (s=s0; (s<CsbStates(f)) && (CsbTime(f, s) <= t1); s++)
+	{
+	  val = CsbEnviron(f, s);
+	  for (i=0; val && (i<CsbEnvironDim(f)); i++)
+	    printf("%s%.10G", i ? "\t" : "", val[i]);
+	  printf("\n");
+	}
+      break;
+    case COHORTS:
+      printf("Time\tCohort");
+      for (j=0; j<colnr; j++) printf("\tColumn %d", cols[j]);
+      printf("\n");
+      for (s=s0; (s<CsbStates(f)) && (CsbTime(f, s) <= t1); s++)
+	{
+	  /*
+	   * Without a mapping CsbColumn() reuses its buffer, hence the
+	   * columns are copied before they are written.
+	   */
+	  n = CsbCohorts(f, s, pop);
+	  if (n <= 0) continue;
+	  tmp = (double *)malloc((size_t)n*colnr*sizeof(double));
+	  if (!tmp) exit(1);
+	  for (j=0; j<colnr; j++)
+	    {
+	      val = CsbColumn(f, s, pop, cols[j]);
+	      if (val) (void)memcpy((void *)(tmp + j*n), (const void *)val, n*sizeof(double));
+	      else n = 0;
+	    }
+	  for (i=0; i<n; i++)
+	    {
+	      printf("%.10G\t%d", CsbTime(f, s), i);
+	      for (j=0; j<colnr; j++) printf("\t%.10G", tmp[j*n + i]);
+	      printf("\n");
+	    }
+	  free(tmp);
+	}
+      break;
+    case HISTOGRAM:
+      if (!range || (lo == DBL_MAX) || (hi == -DBL_MAX))
+	{					/* Range of the values      */
+	  double	vlo = DBL_MAX, vhi = -DBL_MAX;
+
+	  for (s=s0; (s<CsbStates(f)) && (CsbTime(f, s) <= t1); s++)
+	    {
+	      n	  = CsbCohorts(f, s, pop);
+	      val = CsbColumn(f, s, pop, hcol);
+	      for (i=0; val && (i<n); i++)
+		{
+		  if (val[i] < vlo) vlo = val[i];
+		  if (val[i] > vhi) vhi = val[i];
+		}
+	    }
+	  if (lo == DBL_MAX) lo = vlo;
+	  if (hi == -DBL_MAX) hi = vhi;
+	}
+      if (hi <= lo) hi = lo + 1.0;
+      edges  = (double *)malloc((bins + 1)*sizeof(double));
+      counts = (double *)malloc(bins*sizeof(double));
+      if (!edges || !counts) exit(1);
+      for (i=0; i<=bins; i++) edges[i] = lo + i*(hi - lo)/bins;
+      edges[bins] = hi + (hi - lo)*DBL_EPSILON;		/* Include hi	    */
+
+      printf("Time");
+      for (i=0; i<bins; i++) printf("\t%.6G", lo + (i + 0.5)*(hi - lo)/bins);
+      printf("\n");
+      for (s=s0; (s<CsbStates(f)) && (CsbTime(f, s) <= t1); s++)
+	{
+	  (void)memset((void *)counts, 0, bins*sizeof(double));
+	  if (CsbHistogram(f, s, pop, hcol, weight, edges, bins, counts) < 0) continue;
+	  printf("%.10G", CsbTime(f, s));
+	  for (i=0; i<bins; i++) printf("\t%.10G", counts[i]);
+	  printf("\n");
+	}
+      free(edges);
+      free(counts);
+      break;
+    }
+  CsbClose(f);
+
+  return 0;
+}
+
+
+/*==========================================================================*/
@@ -4,6 +4,28 @@
    PURPOSE
      Define some structs used both in ebtutils.c and in ebtcsbfile (in the ebttool)
    NOTES
+     The original CSB file (CSB_MAGIC_KEY) starts with the magic key, the
+     number of parameters and their values, followed by the states. Every
+     state consists of an Envdim header with the environment and for every
+     population a Popdim header, its state label and the cohort values,
+     written column by column.
+
+     The indexed CSB file (CSB_MAGIC_KEY2) is laid out for memory mapping:
+     all blocks start at a multiple of CSB_ALIGN bytes from the start of
+     the file. It consists of
+
+       Csbhead			File header
+       double[parameter_nr]	Parameter values (padded)
+       State ...		Csbstate header, environment (padded) and
+				for every population a Csbpop header, the
+				state label (padded) and the columns of the
+				cohort values (column_stride bytes apart)
+       Csbindex[states]		Time and file offset of every state
+       Csbtail			Offset and length of the index
+
+     The index and tail are written when the file is closed and removed
+     again when states are appended. A file without index, e.g. of a run
+     that crashed, can be read by following the state sizes.
 
    HISTORY
      AMdR - Oct 07, 2016 : Revised.
@@ -15,6 +37,7 @@
 
 #if defined(_MSC_VER) && (_MSC_VER <= 1600)
    typedef __int32 uint32_t;
+   typedef unsigned __int64 uint64_t;
 #else
    #include <stdint.h>
 #endif
@@ -36,6 +59,57 @@ typedef struct popdim {
                        } Popdim;
 
 
+#define CSB_MAGIC_KEY2          20261018        /* Indexed CSB file         */
+#define CSB_INDEX_KEY           20261019        /* Tail of the index        */
+#define CSB_ALIGN               64              /* Alignment of all blocks  */
+#define CSB_PADDED(n)           ((((uint64_t)(n)+CSB_ALIGN-1)/CSB_ALIGN)*CSB_ALIGN)
+
+typedef struct csbhead {                        /* CSB_ALIGN bytes          */
+                        uint32_t        magic;
+                        uint32_t        version;
+                        uint32_t        parameter_nr;
+                        uint32_t        environ_dim;
+                        uint32_t        population_nr;
+                        uint32_t        columns;
+                        uint64_t        data_offset;    /* First state      */
+                        uint64_t        reserved[4];
+                       } Csbhead;
+
+typedef struct csbstate {                       /* CSB_ALIGN bytes          */
+                        double          timeval;
+                        uint64_t        state_size;     /* Including header */
+                        uint32_t        environ_dim;
+                        uint32_t        population_nr;
+                        uint64_t        env_offset;     /* From state start */
+                        uint64_t        reserved[4];
+                       } Csbstate;
+
+typedef struct csbpop {                         /* CSB_ALIGN bytes          */
+                        double          timeval;
+                        uint64_t        pop_size;       /* Including header */
+                        uint32_t        population;
+                        uint32_t        cohorts;
+                        uint32_t        columns;
+                        uint32_t        label_size;     /* Including padding*/
+                        uint64_t        data_offset;    /* From header start*/
+                        uint64_t        column_stride;  /* Bytes per column */
+                        uint64_t        reserved[2];
+                       } Csbpop;
+
+typedef struct csbindex {
+                        double          timeval;
+                        uint64_t        offset;         /* Of the Csbstate  */
+                       } Csbindex;
+
+typedef struct csbtail {                        /* CSB_ALIGN bytes          */
+                        uint32_t        magic;          /* CSB_INDEX_KEY    */
+                        uint32_t        entry_size;
+                        uint64_t        index_offset;
+                        uint64_t        states;
+                        uint64_t        reserved[5];
+                       } Csbtail;
+
+
 
 /*===========================================================================*/
 #endif /* EBTCSBDEFS_H */
@@ -0,0 +1,247 @@
+/***
+   NAME
+     ebtcsbmex.c
+   PURPOSE
+     MATLAB gateway to the routines in ebtcsbread.c that read the complete
+     state output of the Escalator Boxcar Train (CSB and ESF files). Only
+     the requested columns of the requested states are read, such that
+     large files do not have to be loaded as a whole. From MATLAB it is
+     called as
+
+       info = ebtcsb(file)
+       S    = ebtcsb(file, 'columns', pop, cols, [t0 t1])
+       [H, t] = ebtcsb(file, 'hist', pop, col, edges, [t0 t1])
+
+     info is a structure with the fields format (1 or 2 for a CSB file in
+     the original or indexed format, 0 for an ESF file), time (the times of
+     the states), cohorts (the numbers of cohorts of every population in
+     every state), par (the parameters), environ_dim and columns.
+     S is a struct array with the fields time, env and data, one element
+     for every state with t0 <= time <= t1 (all states if omitted). data is
+     a matrix with a row per cohort and the columns cols (default all) of
+     population pop. H is a matrix with a row per state and the histogram
+     of column col of population pop over the bins [edges(b), edges(b+1)),
+     weighted with the numbers of individuals (column 1). t has the times
+     of the rows of H.
+     Populations and columns are numbered from 1, column 1 being the number
+     of individuals in the cohort and the i-states and i-constants
+     following in the order of the program.
+   NOTES
+     The gateway does not depend on the problem-specific file and is
+     compiled once, from the EBTtool directory, with
+
+       mex -Ifns fns/ebtcsbmex.c fns/ebtcsbread.c -output ebtcsb
+   HISTORY
+     Oct 17, 2026 : Created.
+***/
+
+#include <string.h>
+
+#include "ebtcsbread.h"
+
+#include "mex.h"
+
+
+/*==========================================================================*/
+/*
+ * Start of function implementations.
+ */
+/*==========================================================================*/
+
+static void	  TimeRange(const mxArray *arg, double *t0, double *t1)
+
+  /*
+   * TimeRange - Reads the optional time range [t0 t1].
+   */
+
+{
+  const double		*pr;
+
+  *t0 = -mxGetInf();
+  *t1 = mxGetInf();
+  if (!arg || mxIsEmpty(arg)) return;
+  if (!mxIsDouble(arg) || (mxGetNumberOfElements(arg) != 2))
+    mexErrMsgIdAndTxt("EBT:usage", "The time range should be [t0 t1]!");
+  pr  = mxGetPr(arg);
+  *t0 = pr[0];
+  *t1 = pr[1];
+
+  return;
+}
+
+
+
+/*==========================================================================*/
+
+static mxArray	  *Info(csbfile *f)
+
+  /*
+   * Info - Returns the structure with the dimensions and the times of the
+   *	    states of the file.
+   */
+
+{
+  static const char	*fields[] = {"format", "time", "cohorts", "par", "environ_dim", "columns"};
+  const double		*par;
+  mxArray		*info, *mat;
+  double		*pr;
+  int			s, p, n;
+
+  info = mxCreateStructMatrix(1, 1, 6, fields);
+  mxSetField(info, 0, "format", mxCreateDoubleScalar((double)CsbVersion(f)));
+
+  n   = CsbStates(f);
+  mat = mxCreateDoubleMatrix((mwSize)n, 1, mxREAL);
+  pr  = mxGetPr(mat);
+  for (s=0; s<n; s++) pr[s] = CsbTime(f, s);
+  mxSetField(info, 0, "time", mat);
+
+  mat = mxCreateDoubleMatrix((mwSize)n, (mwSize)CsbPopulations(f), mxREAL);
+  pr  = mxGetPr(mat);
+  for (p=0; p<CsbPopulations(f); p++)
+    for (s=0; s<n; s++) *pr++ = (double)CsbCohorts(f, s, p);
+  mxSetField(info, 0, "cohorts", mat);
+
+  n   = CsbParameters(f, &par);
+  mat = mxCreateDoubleMatrix((mwSize)n, 1, mxREAL);
+  if (n) (void)memcpy(mxGetPr(mat), par, n*sizeof(double));
+  mxSetField(info, 0, "par", mat);
+  mxSetField(info, 0, "environ_dim", mxCreateDoubleScalar((double)CsbEnvironDim(f)));
+  mxSetField(info, 0, "columns", mxCreateDoubleScalar((double)CsbColumns(f)));
+
+  return info;
+}
+
+
+
+/*==========================================================================*/
+
+void	  mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+
+  /*
+   * mexFunction - Entry point of the gateway, see the description at the
+   *		   top of this file.
+   */
+
+{
+  static const char	*fields[] = {"time", "env", "data"};
+  char			*fname, mode[16];
+  csbfile		*f;
+  mxArray		*mat;
+  const double		*val, *cpr;
+  double		*pr, t0, t1;
+  int			pop = 0, col, colnr, *cols = NULL, s, s0, s1, bins, i, j, n;
+
+  if ((nrhs < 1) || !mxIsChar(prhs[0]))
+    mexErrMsgIdAndTxt("EBT:usage", "Usage: info = %s(file), S = %s(file, 'columns', pop, cols, [t0 t1])"
+		      " or [H, t] = %s(file, 'hist', pop, col, edges, [t0 t1])",
+		      mexFunctionName(), mexFunctionName(), mexFunctionName());
+  *mode = '\0';
+  if ((nrhs > 1) && (!mxIsChar(prhs[1]) || mxGetString(prhs[1], mode, sizeof(mode)) ||
+		     (strcmp(mode, "columns") && strcmp(mode, "hist"))))
+    mexErrMsgIdAndTxt("EBT:usage", "The second argument should be 'columns' or 'hist'!");
+  if (*mode && ((nrhs < 3) || !mxIsNumeric(prhs[2]) || mxIsEmpty(prhs[2])))
+    mexErrMsgIdAndTxt("EBT:usage", "No population specified!");
+  if (*mode && (nrhs > 3) && !mxIsDouble(prhs[3]))
+    mexErrMsgIdAndTxt("EBT:usage", "The columns should be a double vector!");
+  i = strcmp(mode, "hist") ? 4 : 5;		/* Index of the time range  */
+  TimeRange((*mode && (nrhs > i)) ? prhs[i] : NULL, &t0, &t1);
+
+  fname = mxArrayToString(prhs[0]);
+  f	= CsbOpen(fname);
+  if (!f) mexErrMsgIdAndTxt("EBT:file", "Unable to read %s as a CSB or ESF file!", fname);
+  mxFree(fname);
+
+  if (!*mode)
+    {
+      plhs[0] = Info(f);
+      CsbClose(f);
+      return;
+    }
+
+  n   = CsbPopulations(f);
+  pop = (int)mxGetScalar(prhs[2]) - 1;
+  if ((pop < 0) || (pop >= n))
+    {
+      CsbClose(f);
+      mexErrMsgIdAndTxt("EBT:usage", "Population should be between 1 and %d!", n);
+    }
+
+  if (!strcmp(mode, "columns"))
+    {
+      colnr = CsbColumns(f);
+      if ((nrhs > 3) && !mxIsEmpty(prhs[3])) colnr = (int)mxGetNumberOfElements(prhs[3]);
+      cols = (int *)mxMalloc((colnr + 1)*sizeof(int));
+      for (j=0; j<colnr; j++)
+	{
+	  cols[j] = ((nrhs > 3) && !mxIsEmpty(prhs[3])) ? (int)mxGetPr(prhs[3])[j] - 1 : j;
+	  if ((cols[j] < 0) || (cols[j] >= (n = CsbColumns(f))))
+	    {
+	      CsbClose(f);
+	      mexErrMsgIdAndTxt("EBT:usage", "Columns should be between 1 and %d!", n);
+	    }
+	}
+
+      s0 = CsbFind(f, t0);
+      for (s1=s0; (s1<CsbStates(f)) && (CsbTime(f, s1) <= t1); s1++);
+      plhs[0] = mxCreateStructMatrix(1, (mwSize)(s1 - s0), 3, fields);
+      for (s=s0; s<s1; s++)
+	{
+	  mxSetField(plhs[0], (mwIndex)(s - s0), "time", mxCreateDoubleScalar(CsbTime(f, s)));
+	  mat = mxCreateDoubleMatrix(1, (mwSize)CsbEnvironDim(f), mxREAL);
+	  val = CsbEnviron(f, s);
+	  if (val) (void)memcpy(mxGetPr(mat), val, CsbEnvironDim(f)*sizeof(double));
+	  mxSetField(plhs[0], (mwIndex)(s - s0), "env", mat);
+
+	  n   = CsbCohorts(f, s, pop);
+	  if (n < 0) n = 0;
+	  mat = mxCreateDoubleMatrix((mwSize)n, (mwSize)colnr, mxREAL);
+	  pr  = mxGetPr(mat);
+	  for (j=0; j<colnr; j++)		/* Columns are contiguous   */
+	    {
+	      val = CsbColumn(f, s, pop, cols[j]);
+	      if (val && n) (void)memcpy(pr + j*n, val, n*sizeof(double));
+	    }
+	  mxSetField(plhs[0], (mwIndex)(s - s0), "data", mat);
+	}
+      mxFree(cols);
+    }
+  else
+    {
+      if ((nrhs < 5) || !mxIsDouble(prhs[4]) || (mxGetNumberOfElements(prhs[4]) < 2))
+	{
+	  CsbClose(f);
+	  mexErrMsgIdAndTxt("EBT:usage", "Specify the column and at least 2 bin edges!");
+	}
+      col  = mxIsEmpty(prhs[3]) ? -1 : (int)mxGetScalar(prhs[3]) - 1;
+      n	   = CsbColumns(f);
+      if ((col < 0) || (col >= n))
+	{
+	  CsbClose(f);
+	  mexErrMsgIdAndTxt("EBT:usage", "Column should be between 1 and %d!", n);
+	}
+      cpr  = mxGetPr(prhs[4]);
+      bins = (int)mxGetNumberOfElements(prhs[4]) - 1;
+
+      s0 = CsbFind(f, t0);
+      for (s1=s0; (s1<CsbStates(f)) && (CsbTime(f, s1) <= t1); s1++);
+      plhs[0] = mxCreateDoubleMatrix((mwSize)(s1 - s0), (mwSize)bins, mxREAL);
+      if (nlhs > 1) plhs[1] = mxCreateDoubleMatrix((mwSize)(s1 - s0), 1, mxREAL);
+      pr = (double *)mxCalloc((size_t)bins, sizeof(double));
+      for (s=s0; s<s1; s++)
+	{
+	  (void)memset(pr, 0, bins*sizeof(double));
+	  (void)CsbHistogram(f, s, pop, col, 0, cpr, bins, pr);
+	  for (i=0; i<bins; i++)		/* Row s of the matrix	    */
+	    mxGetPr(plhs[0])[i*(s1 - s0) + (s - s0)] = pr[i];
+	  if (nlhs > 1) mxGetPr(plhs[1])[s - s0] = CsbTime(f, s);
+	}
+      mxFree(pr);
+    }
+  CsbClose(f);
+
+  return;
+}
+
+
+/*==========================================================================*/
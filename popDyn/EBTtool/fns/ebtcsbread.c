@@ -0,0 +1,783 @@
+/***
+   NAME
+     ebtcsbread.c
+   PURPOSE
+     This file contains the routines that read the complete state output
+     of the Escalator Boxcar Train back: the CSB file, in its original and
+     its indexed format (see ebtcsbdefs.h), and the ESF file. They give
+     random access to the states and to single columns of the cohort
+     values of a population, such that states do not have to be loaded as
+     a whole. They are used by the command line tool in ebtcsb.c and the
+     MATLAB gateway in ebtcsbmex.c.
+   NOTES
+     The routines do not depend on the problem-specific file: all
+     dimensions are taken from the file itself. A CSB file is mapped into
+     memory if possible, in which case CsbColumn() and CsbEnviron() return
+     pointers into the mapping, which stay valid until CsbClose(). Otherwise
+     the values are read into a buffer that is reused by the next call.
+
+     The states of an indexed CSB file are found through the index at its
+     end, or by following their sizes if the file has no index (e.g. if
+     the run crashed). The states of an original CSB file are found by
+     following their headers. The values of a population without cohorts
+     are returned as written: a single cohort with zeros in the original
+     format and no cohorts in the indexed format. The cohorts are in the
+     order of the file, which is the reverse of the order in the program.
+
+     An ESF file is read as a single state. Its boundary cohorts are
+     included in the populations.
+   HISTORY
+     Oct 17, 2026 : Created.
+***/
+
+#if !defined(_WIN32)
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE		200112L		/* fseeko() and fileno()    */
+#endif
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS	64		/* Files larger than 2 GB   */
+#endif
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ebtcsbdefs.h"
+#include "ebtcsbread.h"
+
+#if defined(_WIN32)
+#define CsbSeek(fp, pos)	_fseeki64((fp), (__int64)(pos), SEEK_SET)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define CsbSeek(fp, pos)	fseeko((fp), (off_t)(pos), SEEK_SET)
+#ifndef HAS_MMAP
+#define HAS_MMAP		1		/* Map the file into memory */
+#endif
+#endif
+
+#define CSB_MAGIC_KEY		20030509	/* Original CSB file        */
+#define CSB_GROW		256		/* States added at a time   */
+
+
+
+/*==========================================================================*/
+/*
+ * The opened file with the positions of its states. The arrays per
+ * population have popnr elements for every state.
+ */
+
+struct csbfile
+{
+  FILE			*fp;
+  char			*base;			/* Mapping or ESF image     */
+  uint64_t		size;
+  int			mapped;
+  int			version;		/* 1, 2 or 0 for ESF        */
+  int			parnr, envdim, popnr, columns;
+  double		*par;
+  int			states, maxstates;
+  double		*times;
+  uint64_t		*statepos;		/* Start of every state     */
+  uint64_t		*envpos;
+  char			*loaded;		/* Population data known    */
+  int			*cohorts;
+  uint64_t		*datapos, *stride;	/* Columns of a population  */
+  uint64_t		*lblpos;
+  int			*lbllen;
+  double		*buf;			/* Values if not mapped     */
+  size_t		bufmax;
+  char			*lbl;
+  size_t		lblmax;
+};
+
+
+
+/*==========================================================================*/
+
+static int	CsbRead(csbfile *f, uint64_t pos, void *dst, size_t n)
+
+  /*
+   * CsbRead - Copies n bytes at position pos of the file into dst. Returns
+   *	       0 if they are not in the file.
+   */
+
+{
+  if ((pos > f->size) || (n > f->size - pos)) return 0;
+  if (f->base)
+    {
+      (void)memcpy(dst, f->base + pos, n);
+      return 1;
+    }
+  if (CsbSeek(f->fp, pos)) return 0;
+
+  return (fread(dst, 1, n, f->fp) == n);
+}
+
+
+
+static const void	*CsbView(csbfile *f, uint64_t pos, size_t n, void **buf, size_t *bufmax)
+
+  /*
+   * CsbView - Returns a pointer to n bytes at position pos of the file,
+   *	       either in the mapping or read into the buffer buf.
+   */
+
+{
+  void			*tmp;
+
+  if ((pos > f->size) || (n > f->size - pos)) return NULL;
+  if (f->base) return (const void *)(f->base + pos);
+  if (n > *bufmax)
+    {
+      tmp = realloc(*buf, n);
+      if (!tmp) return NULL;
+      *buf    = tmp;
+      *bufmax = n;
+    }
+  if (!n) return *buf;
+
+  return (CsbRead(f, pos, *buf, n) ? *buf : NULL);
+}
+
+
+
+/*==========================================================================*/
+
+static int	CsbAddState(csbfile *f, double t, uint64_t pos)
+
+  /*
+   * CsbAddState - Adds a state at time t that starts at position pos to
+   *		   the list of states. Returns its number or -1 on memory
+   *		   allocation failure.
+   */
+
+{
+  int			m, p, ok = 1;
+  void			*tmp;
+
+  if (f->states == f->maxstates)
+    {
+      m	 = f->maxstates + CSB_GROW;
+      p	 = (f->popnr > 0) ? f->popnr : 1;
+#define CSB_RESIZE(a, n)	if (ok) { tmp = realloc((void *)(a), (size_t)(n)*sizeof(*(a))); \
+				  if (tmp) (a) = tmp; else ok = 0; }
+      CSB_RESIZE(f->times, m);
+      CSB_RESIZE(f->statepos, m);
+      CSB_RESIZE(f->envpos, m);
+      CSB_RESIZE(f->loaded, m);
+      CSB_RESIZE(f->cohorts, m*p);
+      CSB_RESIZE(f->datapos, m*p);
+      CSB_RESIZE(f->stride, m*p);
+      CSB_RESIZE(f->lblpos, m*p);
+      CSB_RESIZE(f->lbllen, m*p);
+#undef CSB_RESIZE
+      if (!ok) return -1;
+      f->maxstates = m;
+    }
+  f->times[f->states]	 = t;
+  f->statepos[f->states] = pos;
+  f->envpos[f->states]	 = 0;
+  f->loaded[f->states]	 = 0;
+
+  return f->states++;
+}
+
+
+
+/*==========================================================================*/
+
+static uint64_t	CsbScanV1(csbfile *f, uint64_t pos)
+
+  /*
+   * CsbScanV1 - Reads the headers of the state at position pos of an
+   *		 original CSB file. Returns the position of the next state,
+   *		 or 0 if the state is incomplete.
+   */
+
+{
+  Envdim		cenv;
+  Popdim		cpop;
+  uint64_t		p, data, hdrsize;
+  int			i = 0, s, last = 0;
+
+  if (!CsbRead(f, pos, (void *)&cenv, sizeof(Envdim))) return 0;
+  if ((cenv.columns < 0) || (cenv.data_offset <= 0)) return 0;
+  if (f->states == 0) f->envdim = cenv.columns;
+  else if (cenv.columns != f->envdim) return 0;
+
+  p	  = pos + ((uint64_t)cenv.data_offset + cenv.columns)*sizeof(double);
+  hdrsize = (sizeof(Popdim)/sizeof(double) + 1)*sizeof(double);
+  if (f->states == 0)				/* Count the populations    */
+    {
+      f->popnr = 0;
+      for (data=p; !last; f->popnr++)
+	{
+	  if (!CsbRead(f, data, (void *)&cpop, sizeof(Popdim))) return 0;
+	  if ((cpop.cohorts < 0) || (cpop.columns <= 0) || (cpop.data_offset <= 0)) return 0;
+	  last	     = cpop.lastpopdim;
+	  f->columns = cpop.columns;
+	  data	    += ((uint64_t)cpop.data_offset + (uint64_t)cpop.cohorts*cpop.columns)*sizeof(double);
+	}
+      last = 0;
+    }
+
+  s = CsbAddState(f, cenv.timeval, pos);
+  if (s < 0) return 0;
+  f->envpos[s] = pos + (uint64_t)cenv.data_offset*sizeof(double);
+
+  for (i=0; (i<f->popnr) && !last; i++)
+    {
+      if (!CsbRead(f, p, (void *)&cpop, sizeof(Popdim)) || (cpop.columns != f->columns) ||
+	  (cpop.cohorts < 0) || ((uint64_t)cpop.data_offset*sizeof(double) < hdrsize))
+	break;
+      last	= cpop.lastpopdim;
+      data	= p + (uint64_t)cpop.data_offset*sizeof(double);
+      f->cohorts[s*f->popnr+i] = cpop.cohorts;
+      f->datapos[s*f->popnr+i] = data;
+      f->stride[s*f->popnr+i]  = (uint64_t)cpop.cohorts*sizeof(double);
+      f->lblpos[s*f->popnr+i]  = p + hdrsize;
+      f->lbllen[s*f->popnr+i]  = (int)(data - p - hdrsize);
+      p = data + (uint64_t)cpop.cohorts*cpop.columns*sizeof(double);
+    }
+  if ((i < f->popnr) || (p > f->size))
+    {
+      f->states--;				/* Incomplete state         */
+      return 0;
+    }
+  f->loaded[s] = 1;
+
+  return p;
+}
+
+
+
+static int	CsbLoadV2(csbfile *f, int s)
+
+  /*
+   * CsbLoadV2 - Reads the population headers of state s of an indexed CSB
+   *		 file. Returns 0 if the state is invalid.
+   */
+
+{
+  Csbstate		cst;
+  Csbpop		cpp;
+  uint64_t		p;
+  int			i;
+
+  if (f->loaded[s]) return 1;
+  if (!CsbRead(f, f->statepos[s], (void *)&cst, sizeof(Csbstate))) return 0;
+  if ((cst.environ_dim != (uint32_t)f->envdim) || (cst.population_nr != (uint32_t)f->popnr)) return 0;
+
+  f->envpos[s] = f->statepos[s] + cst.env_offset;
+  p = f->statepos[s] + sizeof(Csbstate) + CSB_PADDED(cst.environ_dim*sizeof(double));
+  for (i=0; i<f->popnr; i++)
+    {
+      if (!CsbRead(f, p, (void *)&cpp, sizeof(Csbpop)) || (cpp.columns != (uint32_t)f->columns)) return 0;
+      f->cohorts[s*f->popnr+i] = (int)cpp.cohorts;
+      f->datapos[s*f->popnr+i] = p + cpp.data_offset;
+      f->stride[s*f->popnr+i]  = cpp.column_stride;
+      f->lblpos[s*f->popnr+i]  = p + sizeof(Csbpop);
+      f->lbllen[s*f->popnr+i]  = (int)cpp.label_size;
+      p += cpp.pop_size;
+    }
+  if (p > f->statepos[s] + cst.state_size) return 0;
+  f->loaded[s] = 1;
+
+  return 1;
+}
+
+
+
+/*==========================================================================*/
+
+static int	CsbOpenV1(csbfile *f)
+
+{
+  int			parnr;
+  uint64_t		pos;
+
+  if (!CsbRead(f, sizeof(uint32_t), (void *)&parnr, sizeof(int)) || (parnr < 0)) return 0;
+  f->parnr = parnr;
+  f->par   = (double *)calloc((size_t)(parnr + 1), sizeof(double));
+  if (!f->par || !CsbRead(f, 2*sizeof(uint32_t), (void *)f->par, parnr*sizeof(double))) return 0;
+
+  for (pos=2*sizeof(uint32_t)+parnr*sizeof(double); pos<f->size; )
+    if (!(pos = CsbScanV1(f, pos))) break;
+
+  return 1;
+}
+
+
+
+static int	CsbOpenV2(csbfile *f)
+
+{
+  Csbhead		head;
+  Csbstate		cst;
+  Csbtail		tail;
+  Csbindex		entry;
+  uint64_t		pos, end = f->size, k;
+
+  if (!CsbRead(f, 0, (void *)&head, sizeof(Csbhead))) return 0;
+  f->parnr   = head.parameter_nr;
+  f->envdim  = head.environ_dim;
+  f->popnr   = head.population_nr;
+  f->columns = head.columns;
+  f->par     = (double *)calloc((size_t)(f->parnr + 1), sizeof(double));
+  if (!f->par || !CsbRead(f, sizeof(Csbhead), (void *)f->par, f->parnr*sizeof(double))) return 0;
+
+  if ((f->size >= head.data_offset + sizeof(Csbtail)) &&
+      CsbRead(f, f->size - sizeof(Csbtail), (void *)&tail, sizeof(Csbtail)) &&
+      (tail.magic == CSB_INDEX_KEY) && (tail.entry_size == sizeof(Csbindex)) &&
+      (tail.index_offset + tail.states*sizeof(Csbindex) <= f->size - sizeof(Csbtail)))
+    {						/* Times from the index     */
+      for (k=0; k<tail.states; k++)
+	{
+	  if (!CsbRead(f, tail.index_offset + k*sizeof(Csbindex), (void *)&entry, sizeof(Csbindex))) break;
+	  if (CsbAddState(f, entry.timeval, entry.offset) < 0) return 0;
+	}
+      return 1;
+    }
+						/* Or follow the state sizes*/
+  for (pos=head.data_offset; pos+sizeof(Csbstate)<=end; pos+=cst.state_size)
+    {
+      if (!CsbRead(f, pos, (void *)&cst, sizeof(Csbstate))) break;
+      if ((cst.state_size < sizeof(Csbstate)) || (pos+cst.state_size > end)) break;
+      if (CsbAddState(f, cst.timeval, pos) < 0) return 0;
+    }
+
+  return 1;
+}
+
+
+
+static int	CsbOpenESF(csbfile *f)
+
+  /*
+   * CsbOpenESF - Reads the ESF file as a single state. The values are
+   *		  stored in an image with the environment followed by the
+   *		  columns of every population.
+   */
+
+{
+  char			*text, *line, *next, *end;
+  double		*image = NULL, *vals = NULL, val, *tmp;
+  int			nvals = 0, maxvals = 0, n, row, blank = 1, block = -1, cols, i, j;
+  int			*rows = NULL, *first = NULL, bad = 0;
+  uint64_t		pos;
+
+  text = (char *)malloc((size_t)f->size + 1);
+  if (!text || !CsbRead(f, 0, (void *)text, (size_t)f->size))
+    {
+      free(text);
+      return 0;
+    }
+  text[f->size] = '\0';
+  f->columns = 0;
+
+  for (line=text; line && *line; line=next)	/* Read all values in order */
+    {
+      next = strchr(line, '\n');
+      if (next) *next++ = '\0';
+      for (n=0; ; n++)
+	{
+	  val = strtod(line, &end);
+	  if (end == line) break;
+	  line = end;
+	  if (nvals == maxvals)
+	    {
+	      maxvals += 4096;
+	      tmp = (double *)realloc((void *)vals, maxvals*sizeof(double));
+	      if (!tmp)
+		{
+		  bad = 1;
+		  break;
+		}
+	      vals = tmp;
+	    }
+	  vals[nvals++] = val;
+	}
+      if (!n)
+	{
+	  blank = 1;
+	  continue;
+	}
+      if (blank)				/* New block of lines       */
+	{
+	  block++;
+	  rows	= (int *)realloc((void *)rows, (block+1)*sizeof(int));
+	  first = (int *)realloc((void *)first, (block+1)*sizeof(int));
+	  if (!rows || !first)
+	    {
+	      bad = 1;
+	      break;
+	    }
+	  rows[block]  = 0;
+	  first[block] = nvals - n;
+	  if (block == 0) f->envdim = n;
+	  else if (block == 1) f->columns = n;
+	  blank = 0;
+	}
+      if (bad || ((block > 0) && (n != f->columns)))
+	{
+	  bad = 1;
+	  break;
+	}
+      rows[block]++;
+    }
+  free(text);
+  if ((block < 0) || bad)
+    {
+      free(vals); free(rows); free(first);
+      return 0;
+    }
+
+  f->popnr = block;				/* Transpose the populations*/
+  f->par   = (double *)calloc(1, sizeof(double));
+  image	   = (double *)malloc((nvals + 1)*sizeof(double));
+  if (!f->par || !image || (CsbAddState(f, vals[0], 0) < 0))
+    {
+      free(vals); free(rows); free(first); free(image);
+      return 0;
+    }
+  (void)memcpy((void *)image, (void *)vals, f->envdim*sizeof(double));
+  pos = f->envdim;
+  for (i=0; i<f->popnr; i++)
+    {
+      cols = f->columns;
+      for (j=0; j<cols; j++)
+	for (row=0; row<rows[i+1]; row++)
+	  image[pos + j*rows[i+1] + row] = vals[first[i+1] + row*cols + j];
+      f->cohorts[i] = rows[i+1];
+      f->datapos[i] = pos*sizeof(double);
+      f->stride[i]  = rows[i+1]*sizeof(double);
+      f->lblpos[i]  = 0;
+      f->lbllen[i]  = 0;
+      pos += (uint64_t)cols*rows[i+1];
+    }
+  f->envpos[0] = 0;
+  f->loaded[0] = 1;
+#if HAS_MMAP
+  if (f->mapped) (void)munmap((void *)f->base, (size_t)f->size);
+#endif
+  f->mapped    = 0;				/* Image replaces the file  */
+  f->base      = (char *)image;
+  f->size      = pos*sizeof(double);
+  free(vals); free(rows); free(first);
+
+  return 1;
+}
+
+
+
+/*==========================================================================*/
+
+csbfile		*CsbOpen(const char *filename)
+
+  /*
+   * CsbOpen - Opens the CSB or ESF file "filename" and determines the
+   *	       times and positions of its states. Returns NULL if the file
+   *	       can not be read.
+   */
+
+{
+  csbfile		*f;
+  uint32_t		magic = 0;
+  int			ok;
+#if !defined(_WIN32)
+  struct stat		st;
+#endif
+
+  f = (csbfile *)calloc(1, sizeof(csbfile));
+  if (!f) return NULL;
+  f->fp = fopen(filename, "rb");
+  if (!f->fp)
+    {
+      free(f);
+      return NULL;
+    }
+#if defined(_WIN32)
+  if (!_fseeki64(f->fp, 0, SEEK_END)) f->size = (uint64_t)_ftelli64(f->fp);
+#else
+  if (!fstat(fileno(f->fp), &st)) f->size = (uint64_t)st.st_size;
+#endif
+#if HAS_MMAP
+  if (f->size && (f->size == (uint64_t)(size_t)f->size))
+    {
+      f->base = (char *)mmap(NULL, (size_t)f->size, PROT_READ, MAP_SHARED, fileno(f->fp), 0);
+      if (f->base == (char *)MAP_FAILED) f->base = NULL;
+      else f->mapped = 1;
+    }
+#endif
+
+  (void)CsbRead(f, 0, (void *)&magic, sizeof(uint32_t));
+  if (magic == CSB_MAGIC_KEY)
+    {
+      f->version = 1;
+      ok = CsbOpenV1(f);
+    }
+  else if (magic == CSB_MAGIC_KEY2)
+    {
+      f->version = 2;
+      ok = CsbOpenV2(f);
+    }
+  else
+    {
+      f->version = 0;
+      ok = CsbOpenESF(f);
+    }
+  if (!ok)
+    {
+      CsbClose(f);
+      return NULL;
+    }
+
+  return f;
+}
+
+
+
+void		CsbClose(csbfile *f)
+
+  /*
+   * CsbClose - Closes the file and releases all memory.
+   */
+
+{
+  if (!f) return;
+#if HAS_MMAP
+  if (f->mapped) (void)munmap((void *)f->base, (size_t)f->size);
+  else
+#endif
+  if (!f->version) free(f->base);
+  if (f->fp) (void)fclose(f->fp);
+  free(f->par);
+  free(f->times); free(f->statepos); free(f->envpos); free(f->loaded);
+  free(f->cohorts); free(f->datapos); free(f->stride); free(f->lblpos); free(f->lbllen);
+  free(f->buf);
+  free(f->lbl);
+  free(f);
+
+  return;
+}
+
+
+
+/*==========================================================================*/
+
+static int	CsbValid(csbfile *f, int s, int p)
+
+  /*
+   * CsbValid - Checks the numbers of state s and population p (if p >= 0)
+   *		and reads the population headers of the state if necessary.
+   */
+
+{
+  if (!f || (s < 0) || (s >= f->states) || (p >= f->popnr)) return 0;
+  if ((f->version == 2) && !CsbLoadV2(f, s)) return 0;
+
+  return 1;
+}
+
+
+
+int		CsbVersion(const csbfile *f)	{ return f->version; }
+int		CsbStates(const csbfile *f)	{ return f->states; }
+int		CsbPopulations(const csbfile *f){ return f->popnr; }
+int		CsbColumns(const csbfile *f)	{ return f->columns; }
+int		CsbEnvironDim(const csbfile *f)	{ return f->envdim; }
+
+
+
+int		CsbParameters(const csbfile *f, const double **par)
+
+  /*
+   * CsbParameters - Sets par to the parameter values of the run and returns
+   *		     their number.
+   */
+
+{
+  if (par) *par = f->par;
+
+  return f->parnr;
+}
+
+
+
+double		CsbTime(const csbfile *f, int s)
+
+{
+  if ((s < 0) || (s >= f->states)) return 0.0;
+
+  return f->times[s];
+}
+
+
+
+int		CsbFind(const csbfile *f, double t)
+
+  /*
+   * CsbFind - Returns the first state at or after time t, or the number of
+   *	       states if there is none. The times are assumed to be
+   *	       increasing, as they are in a single run.
+   */
+
+{
+  int			lo = 0, hi = f->states, mid;
+
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo)/2;
+      if (f->times[mid] < t) lo = mid + 1;
+      else hi = mid;
+    }
+
+  return lo;
+}
+
+
+
+int		CsbCohorts(const csbfile *f, int s, int p)
+
+  /*
+   * CsbCohorts - Returns the number of cohorts of population p in state s,
+   *		  or -1 if the state is invalid.
+   */
+
+{
+  if (!CsbValid((csbfile *)f, s, p) || (p < 0)) return -1;
+
+  return f->cohorts[s*f->popnr + p];
+}
+
+
+
+const char	*CsbLabel(csbfile *f, int s, int p)
+
+  /*
+   * CsbLabel - Returns the label of population p in state s, as stored by
+   *		the program. The string is valid until the next call.
+   */
+
+{
+  const char		*lbl;
+  size_t		n;
+  void			*tmp;
+
+  if (!CsbValid(f, s, p) || (p < 0)) return NULL;
+  n = (size_t)f->lbllen[s*f->popnr + p];
+  if (n + 1 > f->lblmax)
+    {
+      tmp = realloc((void *)f->lbl, n + 1);
+      if (!tmp) return NULL;
+      f->lbl	= (char *)tmp;
+      f->lblmax = n + 1;
+    }
+  f->lbl[0] = '\0';
+  if (n)
+    {
+      lbl = (const char *)CsbView(f, f->lblpos[s*f->popnr + p], n, (void **)&f->lbl, &f->lblmax);
+      if (!lbl) return NULL;
+      if (lbl != f->lbl) (void)memcpy((void *)f->lbl, lbl, n);
+      f->lbl[n] = '\0';
+    }
+
+  return f->lbl;
+}
+
+
+
+const double	*CsbEnviron(csbfile *f, int s)
+
+  /*
+   * CsbEnviron - Returns the environment variables of state s.
+   */
+
+{
+  if (!CsbValid(f, s, -1)) return NULL;
+
+  return (const double *)CsbView(f, f->envpos[s], f->envdim*sizeof(double),
+				 (void **)&f->buf, &f->bufmax);
+}
+
+
+
+const double	*CsbColumn(csbfile *f, int s, int p, int c)
+
+  /*
+   * CsbColumn - Returns the values of column c of all cohorts of population
+   *		 p in state s. Only this column is read from the file.
+   */
+
+{
+  int			k;
+
+  if (!CsbValid(f, s, p) || (p < 0) || (c < 0) || (c >= f->columns)) return NULL;
+  k = s*f->popnr + p;
+
+  return (const double *)CsbView(f, f->datapos[k] + (uint64_t)c*f->stride[k],
+				 f->cohorts[k]*sizeof(double), (void **)&f->buf, &f->bufmax);
+}
+
+
+
+int		CsbHistogram(csbfile *f, int s, int p, int c, int w,
+			     const double *edges, int bins, double *counts)
+
+  /*
+   * CsbHistogram - Adds the values of column w (or 1 if w < 0) of the
+   *		    cohorts of population p in state s to the bins of column
+   *		    c, bin b covering [edges[b], edges[b+1]). Returns the
+   *		    number of cohorts or -1 on error.
+   */
+
+{
+  const double		*val, *wgt = NULL;
+  double		*copy = NULL;
+  int			i, n, lo, hi, mid;
+
+  n = CsbCohorts(f, s, p);
+  if ((n < 0) || (bins <= 0)) return -1;
+  if (w >= 0)
+    {						/* Keep the weights if read */
+      wgt = CsbColumn(f, s, p, w);
+      if (!wgt) return -1;
+      if (!f->base)
+	{
+	  copy = (double *)malloc((n + 1)*sizeof(double));
+	  if (!copy) return -1;
+	  (void)memcpy((void *)copy, (const void *)wgt, n*sizeof(double));
+	  wgt = copy;
+	}
+    }
+  val = CsbColumn(f, s, p, c);
+  if (!val)
+    {
+      free(copy);
+      return -1;
+    }
+
+  for (i=0; i<n; i++)
+    {
+      if (!(val[i] >= edges[0]) || !(val[i] < edges[bins])) continue;
+      lo = 0;
+      hi = bins;
+      while (hi - lo > 1)
+	{
+	  mid = lo + (hi - lo)/2;
+	  if (val[i] < edges[mid]) hi = mid;
+	  else lo = mid;
+	}
+      counts[lo] += (wgt ? wgt[i] : 1.0);
+    }
+  free(copy);
+
+  return n;
+}
+
+
+/*==========================================================================*/
@@ -0,0 +1,45 @@
+/***
+   NAME
+     ebtcsbread.h
+   PURPOSE
+     Interface header file to the routines in ebtcsbread.c that read the
+     CSB and ESF files of the Escalator Boxcar Train
+   NOTES
+     The header does not depend on the problem-specific file, such that
+     the reader can be compiled once for all models.
+   HISTORY
+     Oct 17, 2026 : Created.
+***/
+
+#ifndef EBTCSBREAD_H
+#define EBTCSBREAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct csbfile csbfile;			/* Opened CSB or ESF file   */
+
+extern csbfile		*CsbOpen(const char *filename);
+extern void		CsbClose(csbfile *f);
+extern int		CsbVersion(const csbfile *f);
+extern int		CsbStates(const csbfile *f);
+extern int		CsbPopulations(const csbfile *f);
+extern int		CsbColumns(const csbfile *f);
+extern int		CsbEnvironDim(const csbfile *f);
+extern int		CsbParameters(const csbfile *f, const double **par);
+extern double		CsbTime(const csbfile *f, int s);
+extern int		CsbFind(const csbfile *f, double t);
+extern int		CsbCohorts(const csbfile *f, int s, int p);
+extern const char	*CsbLabel(csbfile *f, int s, int p);
+extern const double	*CsbEnviron(csbfile *f, int s);
+extern const double	*CsbColumn(csbfile *f, int s, int p, int c);
+extern int		CsbHistogram(csbfile *f, int s, int p, int c, int w,
+				     const double *edges, int bins, double *counts);
+
+#ifdef __cplusplus
+}
+#endif
+
+/*==========================================================================*/
+#endif /* EBTCSBREAD_H */
@@ -0,0 +1,160 @@
+/***
+  NAME
+    ebtdual.h
+  PURPOSE
+    This file defines the forward-mode dual number type Dual<N> that is used
+    to compute exact derivatives of the routines in a program definition
+    file by automatic differentiation (see ebtad.cpp). A dual number holds a
+    value and its derivatives with respect to N independent directions. All
+    arithmetic operators and the functions from math.h that are used in the
+    program definition files are overloaded, such that derivatives are
+    propagated by the chain rule. Comparisons only consider the value, such
+    that the control flow equals the one of the double precision code.
+  NOTES
+    This is a C++ header file. Dual<N> is trivially copyable and default
+    constructible, such that (variable length) arrays of it can be used in
+    the same way as arrays of doubles.
+  HISTORY
+    Oct 17, 2026 : Created.
+***/
+
+#ifndef EBTDUAL_H
+#define EBTDUAL_H
+
+#include <math.h>
+
+template <int N>
+struct Dual
+{
+  double		v;				// Value
+  double		d[N];				// Directional derivatives
+
+  Dual() = default;
+  Dual(double a) : v(a) { for (int i = 0; i < N; i++) d[i] = 0.0; }
+
+  explicit operator double() const { return v; }
+
+  Dual &operator+=(const Dual &b) { v += b.v; for (int i = 0; i < N; i++) d[i] += b.d[i]; return *this; }
+  Dual &operator-=(const Dual &b) { v -= b.v; for (int i = 0; i < N; i++) d[i] -= b.d[i]; return *this; }
+  Dual &operator*=(const Dual &b) { return (*this = *this * b); }
+  Dual &operator/=(const Dual &b) { return (*this = *this / b); }
+
+  // Result of applying a function with value f and derivative df to a
+  friend Dual chain(const Dual &a, double f, double df)
+  {
+    Dual	r;
+
+    r.v = f;
+    for (int i = 0; i < N; i++) r.d[i] = df*a.d[i];
+    return r;
+  }
+
+  friend Dual operator+(const Dual &a) { return a; }
+  friend Dual operator-(const Dual &a) { return chain(a, -a.v, -1.0); }
+
+  friend Dual operator+(const Dual &a, const Dual &b)
+  {
+    Dual	r;
+
+    r.v = a.v + b.v;
+    for (int i = 0; i < N; i++) r.d[i] = a.d[i] + b.d[i];
+    return r;
+  }
+  friend Dual operator-(const Dual &a, const Dual &b)
+  {
+    Dual	r;
+
+    r.v = a.v - b.v;
+    for (int i = 0; i < N; i++) r.d[i] = a.d[i] - b.d[i];
+    return r;
+  }
+  friend Dual operator*(const Dual &a, const Dual &b)
+  {
+    Dual	r;
+
+    r.v = a.v*b.v;
+    for (int i = 0; i < N; i++) r.d[i] = a.d[i]*b.v + a.v*b.d[i];
+    return r;
+  }
+  friend Dual operator/(const Dual &a, const Dual &b)
+  {
+    Dual	r;
+
+    r.v = a.v/b.v;
+    for (int i = 0; i < N; i++) r.d[i] = (a.d[i] - r.v*b.d[i])/b.v;
+    return r;
+  }
+
+  friend Dual operator+(const Dual &a, double b) { Dual r = a; r.v += b; return r; }
+  friend Dual operator+(double a, const Dual &b) { Dual r = b; r.v += a; return r; }
+  friend Dual operator-(const Dual &a, double b) { Dual r = a; r.v -= b; return r; }
+  friend Dual operator-(double a, const Dual &b) { return chain(b, a - b.v, -1.0); }
+  friend Dual operator*(const Dual &a, double b) { return chain(a, a.v*b, b); }
+  friend Dual operator*(double a, const Dual &b) { return chain(b, a*b.v, a); }
+  friend Dual operator/(const Dual &a, double b) { return chain(a, a.v/b, 1.0/b); }
+  friend Dual operator/(double a, const Dual &b) { return chain(b, a/b.v, -a/(b.v*b.v)); }
+
+  friend bool operator< (const Dual &a, const Dual &b) { return a.v <  b.v; }
+  friend bool operator<=(const Dual &a, const Dual &b) { return a.v <= b.v; }
+  friend bool operator> (const Dual &a, const Dual &b) { return a.v >  b.v; }
+  friend bool operator>=(const Dual &a, const Dual &b) { return a.v >= b.v; }
+  friend bool operator==(const Dual &a, const Dual &b) { return a.v == b.v; }
+  friend bool operator!=(const Dual &a, const Dual &b) { return a.v != b.v; }
+  friend bool operator< (const Dual &a, double b) { return a.v <  b; }
+  friend bool operator<=(const Dual &a, double b) { return a.v <= b; }
+  friend bool operator> (const Dual &a, double b) { return a.v >  b; }
+  friend bool operator>=(const Dual &a, double b) { return a.v >= b; }
+  friend bool operator==(const Dual &a, double b) { return a.v == b; }
+  friend bool operator!=(const Dual &a, double b) { return a.v != b; }
+  friend bool operator< (double a, const Dual &b) { return a <  b.v; }
+  friend bool operator<=(double a, const Dual &b) { return a <= b.v; }
+  friend bool operator> (double a, const Dual &b) { return a >  b.v; }
+  friend bool operator>=(double a, const Dual &b) { return a >= b.v; }
+  friend bool operator==(double a, const Dual &b) { return a == b.v; }
+  friend bool operator!=(double a, const Dual &b) { return a != b.v; }
+  friend bool operator!(const Dual &a) { return a.v == 0.0; }
+
+  /*
+   * Functions from math.h
+   */
+  friend Dual fabs (const Dual &a) { return chain(a, fabs(a.v), (a.v < 0.0) ? -1.0 : 1.0); }
+  friend Dual sqrt (const Dual &a) { double f = sqrt(a.v); return chain(a, f, 0.5/f); }
+  friend Dual cbrt (const Dual &a) { double f = cbrt(a.v); return chain(a, f, f/(3.0*a.v)); }
+  friend Dual exp  (const Dual &a) { double f = exp(a.v);  return chain(a, f, f); }
+  friend Dual log  (const Dual &a) { return chain(a, log(a.v), 1.0/a.v); }
+  friend Dual log10(const Dual &a) { return chain(a, log10(a.v), 1.0/(a.v*M_LN10)); }
+  friend Dual sin  (const Dual &a) { return chain(a, sin(a.v), cos(a.v)); }
+  friend Dual cos  (const Dual &a) { return chain(a, cos(a.v), -sin(a.v)); }
+  friend Dual tan  (const Dual &a) { double f = tan(a.v);  return chain(a, f, 1.0 + f*f); }
+  friend Dual atan (const Dual &a) { return chain(a, atan(a.v), 1.0/(1.0 + a.v*a.v)); }
+  friend Dual tanh (const Dual &a) { double f = tanh(a.v); return chain(a, f, 1.0 - f*f); }
+  friend Dual floor(const Dual &a) { return chain(a, floor(a.v), 0.0); }
+  friend Dual ceil (const Dual &a) { return chain(a, ceil(a.v), 0.0); }
+
+  friend Dual pow(const Dual &a, double b)
+  {
+    if (b == 0.0) return Dual(1.0);
+    return chain(a, pow(a.v, b), b*pow(a.v, b - 1.0));
+  }
+  friend Dual pow(double a, const Dual &b)
+  {
+    double	f = pow(a, b.v);
+
+    return chain(b, f, (a > 0.0) ? f*log(a) : 0.0);
+  }
+  friend Dual pow(const Dual &a, const Dual &b)
+  {
+    Dual	r;
+    double	f = pow(a.v, b.v);
+    double	da = (a.v != 0.0) ? b.v*f/a.v : 0.0;
+    double	db = (a.v > 0.0) ? f*log(a.v) : 0.0;
+
+    r.v = f;
+    for (int i = 0; i < N; i++) r.d[i] = da*a.d[i] + db*b.d[i];
+    return r;
+  }
+  friend Dual fmax(const Dual &a, const Dual &b) { return (a.v >= b.v) ? a : b; }
+  friend Dual fmin(const Dual &a, const Dual &b) { return (a.v <= b.v) ? a : b; }
+};
+
+#endif // EBTDUAL_H
@@ -25,6 +25,13 @@
 /* Bas Kooijman 2020/04/02 */
 #include "ebttint.h"
 
+#if (PLUGIN == 1)
+#include <dlfcn.h>
+#endif
+#if (ENSEMBLE == 1)
+#include <pthread.h>
+#endif
+
 /*==========================================================================*/
 /*
  * Defining all constants that are local to this specific file.
@@ -46,11 +53,14 @@
 #define EATL "Error during input of absolute tolerances from the CVF file!"
 #define EBIF "Error during input of bifurcation control variables from the CVF file!"
 #define ECL  "Error during input of cohort time limit from CVF file!"
+#define ECLB "Error during input of cohort time limit bounds from CVF file!"
 #define ECSO "Error during reading of state output interval from CVF file!"
 #define ECVF "Unexpected end/error while reading CVF file!"
 #define EENV "Unexpected end/error while reading environment from ISF file!"
 #define EISF "Unexpected end/error while reading populations from ISF file!"
+#define EISO "Unable to open the ISF file of the ensemble member!"
 #define EIZ  "Error during input of zero comparison value from CVF file!"
+#define EMAX "Error during input of the maximum cohort numbers from the CVF file!"
 #define EMIN "Error during input of the cohort minima from the CVF file!"
 #define EMT  "Error during input of maximum integration time from CVF file!"
 #define EOUT "Error during reading of output time interval from CVF file!"
@@ -60,8 +70,14 @@
 #define ISF  "Unable to open ISF file! Expecting initialization in UserInit()!"
 #define MAFC "Memory allocation failure for cohort variables!"
 #define MAFI "Memory allocation failure for cohort constants!"
+#define MAFS "Memory allocation failure for the input kept for later runs!"
 #define NEA  "Not enough arguments : Usage '<program name> <run name>'"
 #define OUT  "Failure in opening OUT file for writing!"
+#define BOF  "Failure in opening BOF file for writing!"
+#define PLIB "Unable to load the shared library with the problem-specific routines!"
+#define PRTN "Problem-specific routine missing from the shared library!"
+#define PSIG "Dimensions or settings of the shared library do not match those of the program!"
+#define PTL  "Name of the shared library with the problem-specific routines too long!"
 #define RETS "Relative accuracy required too small. Use accuracy > 1.0E-12!"
 #define WNEV "Incomplete environment specification encountered in ISF file! Expecting initialization in UserInit()!"
 
@@ -275,6 +291,98 @@ static int	ScanLineInt(FILE *infile, char *descr, int *value, int var_nr)
 
 
 
+/*==========================================================================*/
+#if (PLUGIN == 1)
+
+EBTSTATE ebt_routines	ModelRoutines;		/* Problem-specific routines*/
+
+#define LoadRoutine(lib, r)	(*(void **)&(ModelRoutines.r##Fn) = dlsym(lib, #r))
+
+static void	  LoadModel(char *inputname)
+
+  /*
+   * LoadModel - Routine loads the shared library with the problem-specific
+   *		 routines, by default the file with the name of the input
+   *		 files and extension .so, checks its dimensions and settings
+   *		 against those of the program and looks up its routines.
+   */
+
+{
+  static const int	signature[EBT_SIGNATURE_NR] = EBT_MODEL_SIGNATURE;
+  const int		*sig;
+  char			name[MAXFILENAMELEN];
+  void			*lib;
+  int			len;
+
+  if (*pluginname)				/* Prefix "./" if not on    */
+    len = snprintf(name, MAXFILENAMELEN, "%s%s",
+		   (strchr(pluginname, '/') ? "" : "./"), pluginname);
+  else						/* the library path         */
+    len = snprintf(name, MAXFILENAMELEN, "%s%s%s",
+		   (strchr(inputname, '/') ? "" : "./"), inputname, "so");
+  if ((len < 0) || (len >= MAXFILENAMELEN)) ErrorAbort(PTL);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+  (void)strcpy(pluginname, name);
+
+  lib = pluginlib = dlopen(pluginname, RTLD_NOW | RTLD_LOCAL);
+  if (!lib) ErrorAbort(PLIB);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+  sig = (const int *)dlsym(lib, "EbtModelSignature");
+  if (!sig || memcmp(sig, signature, sizeof(signature))) ErrorAbort(PSIG);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+
+  (void)LoadRoutine(lib, UserInit);
+  (void)LoadRoutine(lib, SetBpointNo);
+  (void)LoadRoutine(lib, SetBpoints);
+  (void)LoadRoutine(lib, Gradient);
+  (void)LoadRoutine(lib, EventLocation);
+  (void)LoadRoutine(lib, Jacobian);
+  (void)LoadRoutine(lib, ForceCohortEnd);
+  (void)LoadRoutine(lib, InstantDynamics);
+  (void)LoadRoutine(lib, DefineOutput);
+  (void)LoadRoutine(lib, DormantCohort);
+  (void)LoadRoutine(lib, ADJacobian);
+
+  if (!(ModelRoutines.UserInitFn && ModelRoutines.SetBpointNoFn &&
+	ModelRoutines.SetBpointsFn && ModelRoutines.GradientFn &&
+	ModelRoutines.EventLocationFn && ModelRoutines.ForceCohortEndFn &&
+	ModelRoutines.InstantDynamicsFn && ModelRoutines.DefineOutputFn) ||
+      ((JACOBIAN == 1) && !ModelRoutines.JacobianFn) ||
+      ((JACOBIAN == 2) && !ModelRoutines.ADJacobianFn) ||
+      ((DORMANT_COHORTS == 1) && !ModelRoutines.DormantCohortFn))
+    ErrorAbort(PRTN);
+
+  return;
+}
+
+
+
+/*==========================================================================*/
+
+void	  UnloadModel(void)
+
+  /*
+   * UnloadModel - Routine unloads the shared library with the problem-
+   *		   specific routines loaded by LoadModel().
+   */
+
+{
+  if (pluginlib) (void)dlclose(pluginlib);
+  pluginlib = NULL;
+  (void)memset(&ModelRoutines, 0, sizeof(ModelRoutines));
+
+  return;
+}
+
+#endif // (PLUGIN == 1)
+
+
 /*==========================================================================*/
 
 static void	  InitVars()
@@ -290,6 +398,11 @@ static void	  InitVars()
   usernotes = NULL;
 
   for(i=0; i<ENVIRON_DIM; i++) env[i] = 0.0;	/* Create zero environment   */
+  for(i=0; i<FORCING_NR; i++)			/* No forcing tables	     */
+    {
+      forcing_table[i] = NULL;
+      forcing_knots[i] = 0;
+    }
 
   initState = NULL;
   currentState = NULL;
@@ -314,6 +427,12 @@ static void	  InitVars()
     }
 #endif // (POPULATION_NR > 0)
 
+  for(i=0; i<OUTPUT_VAR_NR; i++)		/* Default output labels     */
+    (void)sprintf(outputlabels[i], "Output %d", i+1);
+#if (BIFURCATION == 1)
+  (void)strcpy(outputlabels[OUTPUT_VAR_NR], "Bifurcation parameter");
+#endif // (BIFURCATION == 1)
+
   return;
 }
 
@@ -347,6 +466,25 @@ static void	  ReadCvf(FILE *infile)
 #ifdef MODULE
   if (error_code & FATAL_ERROR) return;
 #endif
+#if (ADAPT_COH_LIMIT == 1)
+  read_no=ScanLineDouble(infile, description.min_coh_limit, &min_coh_limit, 1);
+  if(read_no != 1) ErrorAbort(ECLB);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+  read_no=ScanLineDouble(infile, description.max_coh_limit, &max_coh_limit, 1);
+  if((read_no != 1) || (min_coh_limit < SMALLEST_STEP) ||
+     (max_coh_limit < min_coh_limit)) ErrorAbort(ECLB);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+  read_no=ScanLineDouble(infile, description.target_cohorts, &target_cohorts, 1);
+  if(read_no != 1) ErrorAbort(ECLB);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+  cohort_limit = min(max(cohort_limit, min_coh_limit), max_coh_limit);
+#endif // (ADAPT_COH_LIMIT == 1)
   read_no=ScanLineDouble(infile, description.identical_zero, &identical_zero, 1);
   if(read_no != 1) ErrorAbort(EIZ);
 #ifdef MODULE
@@ -405,6 +543,15 @@ static void	  ReadCvf(FILE *infile)
       for(j=1; j<COHORT_SIZE; j++) 
 	  tol_zero[i] = (tol_zero[i] ||
 			 ((rel_tols[i][j]<=0.0) && (abs_tols[i][j]<=0.0)));
+
+#if (COHORT_BUDGET == 1)
+  read_no=ScanLineDouble(infile, description.max_cohorts, tmp, POPULATION_NR);
+  if(read_no != POPULATION_NR) ErrorAbort(EMAX);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+  for(i=0; i<POPULATION_NR; i++) max_cohorts[i] = (int)floor(tmp[i] + 0.5);
+#endif // (COHORT_BUDGET == 1)
 #endif // (POPULATION_NR > 0)
 
 #if PARAMETER_NR
@@ -593,24 +740,22 @@ static void	  ReadInputPop(FILE *infile)
 #endif
 		}
 #endif
-	      if (CohortNo[i])
-		  CohortNo[i] = InsCohort(val_tmp,
-#if (I_CONST_DIM > 0)
-					  val_tmp+COHORT_SIZE,
-#endif
-					  i);
-	      else
-		{
-		  for (j=0; j<COHORT_SIZE; j++)
-		      pop[i][CohortNo[i]][j] = val_tmp[j]; 
+						/* Append the cohort, the   */
+						/* population is sorted     */
+						/* once it has been read    */
+	      for (j=0; j<COHORT_SIZE; j++)
+		  pop[i][CohortNo[i]][j] = val_tmp[j]; 
 #if (I_CONST_DIM > 0)
-		  for (j=0; j<I_CONST_DIM; j++)
-		      popIDcard[i][CohortNo[i]][j] = val_tmp[j+COHORT_SIZE]; 
+	      for (j=0; j<I_CONST_DIM; j++)
+		  popIDcard[i][CohortNo[i]][j] = val_tmp[j+COHORT_SIZE]; 
 #endif
-		  CohortNo[i]++;
-		}
+	      CohortNo[i]++;
 	    }
 	}
+      SortCohorts(i);
+#ifdef MODULE
+      if (error_code & FATAL_ERROR) return;
+#endif
       if(ferror(infile) || (feof(infile) && !CohortNo[POPULATION_NR-1]))
 	  Warning(EISF);			/* On read error exit	    */
 #ifdef MODULE
@@ -633,38 +778,313 @@ static void	  ReadInputPop(FILE *infile)
 
 
 /*==========================================================================*/
+#if (ENSEMBLE == 1)
+/*
+ * The values read from the CVF and ISF files by the first member with
+ * keep_input set are kept in Setup, from which the later members with
+ * keep_input set take them instead of reading the files again (see
+ * ServeRuns() in ebtmain.c). Setup is shared by all threads and allocated
+ * with calloc(), such that it outlives the contexts of the runs.
+ */
 
-void	  Initialize(int argc, char **argv)
+typedef struct ebt_setup
+{
+  struct dscrptn	description;
+  double		accuracy, cohort_limit, identical_zero, equal2zero;
+  double		max_time, delt_out, state_out;
+#if (ADAPT_COH_LIMIT == 1)
+  double		min_coh_limit, max_coh_limit, target_cohorts;
+#endif
+#if (POPULATION_NR > 0)
+  cohort		abs_tols[POPULATION_NR], rel_tols[POPULATION_NR];
+  int			tol_zero[POPULATION_NR];
+#if (COHORT_BUDGET == 1)
+  int			max_cohorts[POPULATION_NR];
+#endif
+  int			cohort_nr[POPULATION_NR];
+  double		*cohorts[POPULATION_NR];/* Cohorts as in ISF file   */
+#endif // (POPULATION_NR > 0)
+#if PARAMETER_NR
+  double		parameter[PARAMETER_NR];
+#endif
+#if (BIFURCATION == 1)
+  int			BifParIndex, BifParLogStep;
+  double		BifParStep, BifParLastVal, BifOutput, BifStateOutput;
+#endif
+  double		env[ENVIRON_DIM];
+} ebt_setup;
+
+static ebt_setup	*Setup = NULL;
+static pthread_mutex_t	SetupLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+#if (POPULATION_NR > 0)
+
+static void	  SetCohorts(int popnr, const double *data, int cohnr)
 
   /* 
-   * Initialize - Routine initializes the global variables, reads the 
-   *		  constants from the .cvf file and the initial state from
-   *		  the .isf file and takes care of the output at start up.
+   * SetCohorts - Routine replaces the cohorts of population "popnr" by
+   *		  the "cohnr" cohorts in "data", which holds the values of
+   *		  every cohort in the order of a line of the .isf file.
    */
 
 {
-  char			filename[MAXFILENAMELEN], *ch;
-  FILE			*isf, *cvf;
+  register int		i, j;
+  int			first;
 
-  InitVars();
-  if (argc < 2) ErrorAbort(NEA);
-#ifdef MODULE
-  if (error_code & FATAL_ERROR) return;
+  CohortNo[popnr] = 0;
+  if (cohnr > 0)
+    {
+      first = AddCohorts(pop, popnr, cohnr);
+      if (first < 0) return;
+      for (i=0; i<cohnr; i++, data+=(COHORT_SIZE+I_CONST_DIM))
+	{
+	  for (j=0; j<COHORT_SIZE; j++)
+	    pop[popnr][first+i][j] = data[j];
+#if (I_CONST_DIM > 0)
+	  for (j=0; j<I_CONST_DIM; j++)
+	    popIDcard[popnr][first+i][j] = data[COHORT_SIZE+j];
 #endif
+	}
+    }
+  SortCohorts(popnr);
+  cohort_no[popnr] = CohortNo[popnr];
 
-  ch=strcpy(progname, argv[0]);			/* Store name of  program   */
+  return;
+}
+
+#endif // (POPULATION_NR > 0)
+
+
+
+static void	  SaveSetup(void)
+
+  /* 
+   * SaveSetup - Routine keeps the values just read from the CVF and ISF
+   *		 files in Setup, unless another run has done so already.
+   */
+
+{
+  ebt_setup		*setup;
+#if (POPULATION_NR > 0)
+  register int		i, j, k;
+  double		*data;
+#endif
+
+  (void)pthread_mutex_lock(&SetupLock);
+  if (Setup)
+    {
+      (void)pthread_mutex_unlock(&SetupLock);
+      return;
+    }
+  setup = (ebt_setup *)calloc(1, sizeof(ebt_setup));
+  if (!setup)
+    {
+      (void)pthread_mutex_unlock(&SetupLock);
+      Warning(MAFS);
+      return;
+    }
+
+  setup->description	= description;
+  setup->accuracy	= accuracy;
+  setup->cohort_limit	= cohort_limit;
+  setup->identical_zero = identical_zero;
+  setup->equal2zero	= equal2zero;
+  setup->max_time	= max_time;
+  setup->delt_out	= delt_out;
+  setup->state_out	= state_out;
+#if (ADAPT_COH_LIMIT == 1)
+  setup->min_coh_limit	= min_coh_limit;
+  setup->max_coh_limit	= max_coh_limit;
+  setup->target_cohorts = target_cohorts;
+#endif
+#if (POPULATION_NR > 0)
+  (void)memcpy(setup->abs_tols, abs_tols, sizeof(abs_tols));
+  (void)memcpy(setup->rel_tols, rel_tols, sizeof(rel_tols));
+  (void)memcpy(setup->tol_zero, tol_zero, sizeof(tol_zero));
+#if (COHORT_BUDGET == 1)
+  (void)memcpy(setup->max_cohorts, max_cohorts, sizeof(max_cohorts));
+#endif
+  for (i=0; i<POPULATION_NR; i++)
+    {
+      setup->cohort_nr[i] = CohortNo[i];
+      if (!CohortNo[i]) continue;
+      data = (double *)malloc((size_t)CohortNo[i]*(COHORT_SIZE+I_CONST_DIM)*sizeof(double));
+      if (!data)
+	{
+	  for (k=0; k<i; k++) free(setup->cohorts[k]);
+	  free(setup);
+	  (void)pthread_mutex_unlock(&SetupLock);
+	  Warning(MAFS);
+	  return;
+	}
+      setup->cohorts[i] = data;
+      for (j=0; j<CohortNo[i]; j++, data+=(COHORT_SIZE+I_CONST_DIM))
+	{
+	  (void)memcpy(data, pop[i][j], COHORT_SIZE*sizeof(double));
+#if (I_CONST_DIM > 0)
+	  (void)memcpy(data+COHORT_SIZE, popIDcard[i][j], I_CONST_DIM*sizeof(double));
+#endif
+	}
+    }
+#endif // (POPULATION_NR > 0)
+#if PARAMETER_NR
+  (void)memcpy(setup->parameter, parameter, sizeof(parameter));
+#endif
+#if (BIFURCATION == 1)
+  setup->BifParIndex	= BifParIndex;
+  setup->BifParLogStep	= BifParLogStep;
+  setup->BifParStep	= BifParStep;
+  setup->BifParLastVal	= BifParLastVal;
+  setup->BifOutput	= BifOutput;
+  setup->BifStateOutput = BifStateOutput;
+#endif
+  (void)memcpy(setup->env, env, sizeof(env));
+
+  Setup = setup;
+  (void)pthread_mutex_unlock(&SetupLock);
+
+  return;
+}
+
+
+
+static int	RestoreSetup(void)
+
+  /* 
+   * RestoreSetup - Routine sets the values read from the CVF and ISF files
+   *		    to those kept in Setup. Returns 0 if none are kept.
+   */
+
+{
+  ebt_setup		*setup;
+#if (POPULATION_NR > 0)
+  register int		i;
+#endif
+
+  (void)pthread_mutex_lock(&SetupLock);
+  setup = Setup;
+  (void)pthread_mutex_unlock(&SetupLock);
+  if (!setup) return 0;
+
+  description	 = setup->description;
+  accuracy	 = setup->accuracy;
+  cohort_limit	 = setup->cohort_limit;
+  identical_zero = setup->identical_zero;
+  equal2zero	 = setup->equal2zero;
+  max_time	 = setup->max_time;
+  delt_out	 = setup->delt_out;
+  state_out	 = setup->state_out;
+#if (ADAPT_COH_LIMIT == 1)
+  min_coh_limit	 = setup->min_coh_limit;
+  max_coh_limit	 = setup->max_coh_limit;
+  target_cohorts = setup->target_cohorts;
+#endif
+#if (POPULATION_NR > 0)
+  (void)memcpy(abs_tols, setup->abs_tols, sizeof(abs_tols));
+  (void)memcpy(rel_tols, setup->rel_tols, sizeof(rel_tols));
+  (void)memcpy(tol_zero, setup->tol_zero, sizeof(tol_zero));
+#if (COHORT_BUDGET == 1)
+  (void)memcpy(max_cohorts, setup->max_cohorts, sizeof(max_cohorts));
+#endif
+  for (i=0; i<POPULATION_NR; i++)
+    {
+      SetCohorts(i, setup->cohorts[i], setup->cohort_nr[i]);
+      if (error_code & FATAL_ERROR) return 1;
+    }
+#endif // (POPULATION_NR > 0)
+#if PARAMETER_NR
+  (void)memcpy(parameter, setup->parameter, sizeof(parameter));
+#endif
+#if (BIFURCATION == 1)
+  BifParIndex	 = setup->BifParIndex;
+  BifParLogStep	 = setup->BifParLogStep;
+  BifParStep	 = setup->BifParStep;
+  BifParLastVal	 = setup->BifParLastVal;
+  BifOutput	 = setup->BifOutput;
+  BifStateOutput = setup->BifStateOutput;
+#endif
+  (void)memcpy(env, setup->env, sizeof(env));
+
+  return 1;
+}
+
+
+
+static void	  MemberInput(void)
+
+  /* 
+   * MemberInput - Routine replaces the parameter values, the initial
+   *		   environment and the initial cohorts read from the input
+   *		   files by those of the ensemble member, if it has any,
+   *		   and passes its forcing tables to Forcing(). A resumed
+   *		   run keeps the state of the ESF file.
+   */
+
+{
+  register int		i;
+
+  if (!ens_member) return;
+
+#if PARAMETER_NR
+  if (ens_member->parameter)			/* Parameters of the member */
+    for (i=0; (i<ens_member->parameter_nr) && (i<PARAMETER_NR); i++)
+      if (!ismissing(ens_member->parameter[i]))
+	parameter[i] = ens_member->parameter[i];
+#endif
+
+  for (i=0; i<FORCING_NR; i++)			/* Forcing tables	    */
+    if (ens_member->forcing[i] && (ens_member->knots[i] > 0))
+      {
+	forcing_table[i] = ens_member->forcing[i];
+	forcing_knots[i] = ens_member->knots[i];
+      }
+
+  if (Resume) return;				/* Keep state of ESF file   */
+
+  if (ens_member->environ)			/* Initial environment	    */
+    for (i=0; i<ENVIRON_DIM; i++) env[i] = ens_member->environ[i];
+
+#if (POPULATION_NR > 0)
+  for (i=0; i<POPULATION_NR; i++)		/* Initial cohorts	    */
+    if (ens_member->cohorts[i])
+      {
+	SetCohorts(i, ens_member->cohorts[i], ens_member->cohort_nr[i]);
+	if (error_code & FATAL_ERROR) return;
+      }
+#endif
+
+  return;
+}
+
+#endif // (ENSEMBLE == 1)
+
+
+
+/*==========================================================================*/
+
+static void	  ReadInput(char *inputname)
+
+  /* 
+   * ReadInput - Routine reads the constants from the .cvf file and the
+   *		 initial state from the .isf file, or from the .esf file
+   *		 when resuming. A member of an ensemble with its own ISF
+   *		 file reads the initial state from that file instead.
+   */
+
+{
+  char			filename[MAXFILENAMELEN];
+  FILE			*isf, *cvf;
 
-  ch=strcpy(runname, argv[1]);			/* Store name of the run    */
-  while((*ch!='\0')) ch++;
-  *ch='.'; ch++; *ch='\0';
 						/* Open CVF file with	    */
 						/* lower case extension	    */
-  ch=strcpy(filename, runname); ch=strcat(filename, "cvf");
+  (void)strcpy(filename, inputname); (void)strcat(filename, "cvf");
   cvf=fopen(filename, "r");
 
   if(!cvf)					/* On error try upper casee */
     {
-      ch=strcpy(filename, runname); ch=strcat(filename, "CVF");
+      (void)strcpy(filename, inputname); (void)strcat(filename, "CVF");
       cvf=fopen(filename, "r");
       if(!cvf) ErrorAbort(CVF);			/* On repeated error exit   */
 #ifdef MODULE
@@ -677,30 +1097,41 @@ void	  Initialize(int argc, char **argv)
 #endif
 						/* Open ISF file with	    */
 						/* lower case extension	    */
-  ch=strcpy(filename, runname);			/* or ESF file if resuming  */
-  if (Resume) ch=strcat(filename, "esf");
-  else ch=strcat(filename, "isf");
+  if (Resume) (void)strcpy(filename, runname);	/* or ESF file if resuming  */
+  else (void)strcpy(filename, inputname);
+  if (Resume) (void)strcat(filename, "esf");
+  else (void)strcat(filename, "isf");
   isf=fopen(filename, "r");
   if(!isf)					/* On error try upper case  */
     {
-      ch=strcpy(filename, runname);
-      if (Resume) ch=strcat(filename, "ESF");
-      else ch=strcat(filename, "ISF");
+      if (Resume) (void)strcpy(filename, runname);
+      else (void)strcpy(filename, inputname);
+      if (Resume) (void)strcat(filename, "ESF");
+      else (void)strcat(filename, "ISF");
       isf=fopen(filename, "r");
     }
   if (Resume && !isf)				/* ESF not found: restart   */
-    {
-      Warning(FISF);
-      ch=strcpy(filename, runname);
-      ch=strcat(filename, "isf");
+    {						/* unless a checkpoint is   */
+      if (checkpoint_int <= 0.0) Warning(FISF);	/* restored later           */
+      (void)strcpy(filename, inputname);
+      (void)strcat(filename, "isf");
       isf=fopen(filename, "r");
       if(!isf)					/* On error try upper case  */
 	{
-	  ch=strcpy(filename, runname);
-	  ch=strcat(filename, "ISF");
+	  (void)strcpy(filename, inputname);
+	  (void)strcat(filename, "ISF");
 	  isf=fopen(filename, "r");
 	}
     }
+#if (ENSEMBLE == 1)
+  if (ens_member && ens_member->isf && !(Resume && isf))
+    {						/* ISF file of the member   */
+      if (isf) (void)fclose(isf);
+      isf=fopen(ens_member->isf, "r");
+      if(!isf) ErrorAbort(EISO);
+      if (error_code & FATAL_ERROR) return;
+    }
+#endif
   if(isf)					/* Read initial state	    */
     {						/* of environment	    */
       if(ReadInputEnv(isf) != ENVIRON_DIM) Warning(WNEV);
@@ -720,18 +1151,103 @@ void	  Initialize(int argc, char **argv)
 #ifndef MODULE					/* Expect initial state in  */
   else Warning(ISF);				/* UserInit()               */
 #endif
-						/* Open OUT file with	    */
-						/* lower case extension	    */
-  ch=strcpy(filename, runname); ch=strcat(filename, "out");
-  resfil=fopen(filename, "a");
-  if(!resfil)					/* On error try upper case  */
+
+  return;
+}
+
+
+
+/*==========================================================================*/
+
+void	  Initialize(int argc, char **argv)
+
+  /* 
+   * Initialize - Routine initializes the global variables, reads the 
+   *		  constants from the .cvf file and the initial state from
+   *		  the .isf file and takes care of the output at start up.
+   *		  A member of an ensemble reads the files of the ensemble
+   *		  input, with its own parameter values and ISF file, or
+   *		  reuses the values read by an earlier member.
+   */
+
+{
+  char			filename[MAXFILENAMELEN], *ch;
+  char			inputname[MAXFILENAMELEN];
+#if (ENSEMBLE == 1)
+  int			keep;
+#endif
+
+  InitVars();
+  if (argc < 2) ErrorAbort(NEA);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+
+  ch=strcpy(progname, argv[0]);			/* Store name of  program   */
+
+  ch=strcpy(runname, argv[1]);			/* Store name of the run    */
+  while((*ch!='\0')) ch++;
+  *ch='.'; ch++; *ch='\0';
+
+  ch=strcpy(inputname, runname);		/* Name of the input files  */
+#if (ENSEMBLE == 1)
+  if (ens_member)
     {
-      ch=strcpy(filename, runname); ch=strcat(filename, "OUT");
-      resfil=fopen(filename, "a");
-      if(!resfil) ErrorAbort(OUT);		/* On repeated error exit   */
+      ch=strcpy(inputname, ens_input); ch=strcat(inputname, ".");
+    }
+#endif
+#if (PLUGIN == 1)
+  LoadModel(inputname);				/* Problem-specific routines*/
 #ifdef MODULE
-      if (error_code & FATAL_ERROR) return;
+  if (error_code & FATAL_ERROR) return;
+#endif
+#endif
+#if (ENSEMBLE == 1)
+  keep = (ens_member && ens_member->keep_input && !ens_member->isf && !Resume);
+  if (!keep || !RestoreSetup())			/* No input of earlier run  */
+    ReadInput(inputname);
+#else
+  ReadInput(inputname);				/* Read CVF and ISF file    */
 #endif
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return;
+#endif
+#if (ENSEMBLE == 1)
+  if (keep) SaveSetup();
+  MemberInput();				/* Input of the member	    */
+  if (error_code & FATAL_ERROR) return;
+#endif
+  bofnew = 0;
+  if (BinaryOut && !NoFiles)			/* Open BOF file with	    */
+    {						/* lower case extension	    */
+      ch=strcpy(filename, runname); ch=strcat(filename, "bof");
+      resfil=fopen(filename, "ab");
+      if(!resfil)				/* On error try upper case  */
+	{
+	  ch=strcpy(filename, runname); ch=strcat(filename, "BOF");
+	  resfil=fopen(filename, "ab");
+	  if(!resfil) ErrorAbort(BOF);		/* On repeated error exit   */
+#ifdef MODULE
+	  if (error_code & FATAL_ERROR) return;
+#endif
+	}
+      (void)setvbuf(resfil, NULL, _IOFBF, BOF_BUFFER);
+      (void)fseek(resfil, 0L, SEEK_END);	/* Header not written yet   */
+      bofnew = (ftell(resfil) == 0L);
+    }
+  else						/* Open OUT file with	    */
+    {						/* lower case extension	    */
+      ch=strcpy(filename, runname); ch=strcat(filename, "out");
+      resfil=(NoFiles ? NULL : fopen(filename, "a"));
+      if(!resfil && !NoFiles)			/* On error try upper case  */
+	{
+	  ch=strcpy(filename, runname); ch=strcat(filename, "OUT");
+	  resfil=fopen(filename, "a");
+	  if(!resfil) ErrorAbort(OUT);		/* On repeated error exit   */
+#ifdef MODULE
+	  if (error_code & FATAL_ERROR) return;
+#endif
+	}
     }
 
   if (debug_level)				/* Open DBG file with	  */
@@ -748,28 +1264,30 @@ void	  Initialize(int argc, char **argv)
   else dbgfil = NULL;
 
   csbnew = 0;
+  csbversion = CSB_VERSION;
 #if (POPULATION_NR > 0)
   struct stat           st;
 
-  if (!csbfil)
+  if (!csbfil && !NoFiles)
     {						/* Open CSB file	    */
       (void)strcpy(filename, runname); (void)strcat(filename, "csb");
       if ((stat(filename, &st) != 0) || (st.st_size == 0))
 	{
-	  csbfil=fopen(filename, "wb");		// New CSB file
+	  csbfil=fopen(filename, "w+b");	// New CSB file
 	  if (csbfil) csbnew = 1;
 	}
-      else csbfil=fopen(filename, "ab");
+      else csbfil=fopen(filename, "a+b");
       if(!csbfil)				/* On error try upper case  */
 	{
 	  (void)strcpy(filename, runname); (void)strcat(filename, "CSB");
 	  if ((stat(filename, &st) != 0) || (st.st_size == 0))
 	    {
-	      csbfil=fopen(filename, "wb");	// New CSB file
+	      csbfil=fopen(filename, "w+b");	// New CSB file
 	      if (csbfil) csbnew = 1;
 	    }
-	  else csbfil=fopen(filename, "ab");
+	  else csbfil=fopen(filename, "a+b");
 	}
+      if(csbfil && !csbnew) AppendStateFile(csbfil);
       if(csbfil) return;
     }
 #endif // (POPULATION_NR > 0)
@@ -22,6 +22,9 @@
 #define EXTERN	extern
 #endif
 EXTERN void	Initialize(int, char **);
+#if (PLUGIN == 1)
+EXTERN void	UnloadModel(void);
+#endif
 
 
 
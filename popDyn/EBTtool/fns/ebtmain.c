@@ -23,13 +23,37 @@
 /* Bas Kooijman 2020/04/02 */
 #include "ebttint.h"
 
+#if (REENTRANT == 1)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#if (ENSEMBLE == 1)
+#include <signal.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
 
 /*==========================================================================*/
 /*
  * The error messages that occur in the routines in the present file.
  */
 
+#define EENS "Unable to open ENS file with the runs of the ensemble!"
+#define ESNP "Unable to read the CKP file with the snapshot to branch from!"
+#define MAFE "Memory allocation failure for the runs of the ensemble!"
+#define OPT  "Invalid command line option or missing option argument!"
 #define SGE  "Error in installing the signal handlers!"
+#define SCTX "Unable to create the context of the run!"
+#define SIDX "Invalid parameter, population or forcing table index in request!"
+#define SMAF "Memory allocation failure for the request!"
+#define SOCK "Unable to listen on the Unix socket for serving runs!"
+#define SUNK "Unknown request!"
+#define SVAL "Invalid values or wrong number of values in request!"
+
+#define ENSMSG_MAX	128			/* Length of ENS file errors*/
 
 /*==========================================================================*/
 /*
@@ -252,13 +276,50 @@ static void usage(char *progname)
   fprintf(stderr, "\nUsage of %s command line options: \n\n", progname);
   fprintf(stderr, "    -r | --resume\n");
   fprintf(stderr, "        Resume previously interrupted integration\n\n");
+  fprintf(stderr, "    -c <s> | --checkpoint <s> \n");
+  fprintf(stderr, "        Write a binary checkpoint (CKP file) every s seconds, used by -r to resume\n\n");
+  fprintf(stderr, "    -b <s> | --binary <s> \n");
+  fprintf(stderr, "        Write the output in binary format to the BOF file, flushed every s seconds\n\n");
+  fprintf(stderr, "    -w <file> | --warm <file> \n");
+#if (ENSEMBLE == 1)
+  fprintf(stderr, "        Start every run from the snapshot in the CKP file of another run, each in its own process\n\n");
+#else
+  fprintf(stderr, "        Start from the snapshot in the CKP file of another run\n\n");
+#endif
   fprintf(stderr, "    -d <0|1|2|3|4> | --debug <0|1|2|3|4> \n");
   fprintf(stderr, "        Select debug information level 0, 1, 2, 3 or 4 ");
   fprintf(stderr, "(written to DBG file)\n\n");
+  fprintf(stderr, "    -t <n> | --threads <n> \n");
+#if (ENSEMBLE == 1)
+  fprintf(stderr, "        Carry out n runs of the ensemble at a time (0: all processors)\n\n");
+  fprintf(stderr, "    -s | --serve \n");
+  fprintf(stderr, "        Serve runs requested on standard input instead of running the ENS file\n\n");
+  fprintf(stderr, "    -u <path> | --socket <path> \n");
+  fprintf(stderr, "        Serve runs requested on connections to the Unix socket at path\n\n");
+#else
+  fprintf(stderr, "        Use n threads in the parallel loops (0: all processors)\n\n");
+#endif
+#if (SOLVER_REGISTRY == 1)
+  fprintf(stderr, "    -m <method> | --method <method> \n");
+  fprintf(stderr, "        Integrate with RK2, RK4, RKF45, RKCK, DOPRI5, DOPRI8, ");
+  fprintf(stderr, "RADAU5, CVODE or CVBDF\n\n");
+#endif
+#if (PLUGIN == 1)
+  fprintf(stderr, "    -p <file> | --plugin <file> \n");
+  fprintf(stderr, "        Load the problem-specific routines from the shared library file\n\n");
+#endif
+#ifdef MODULE
+  fprintf(stderr, "    -n | --nofiles \n");
+  fprintf(stderr, "        Write no output files\n\n");
+#endif
   fprintf(stderr, "    -? | --help \n");
   fprintf(stderr, "        Show this message\n");
   fprintf(stderr, "\n");
+#if (!defined(MODULE) || (ENSEMBLE == 1))
   exit(0);
+#else
+  ErrorAbort(OPT);				// Never exit the host program
+#endif
   return;
 }
 
@@ -284,7 +345,16 @@ EXTERN_C int		StartUp(int argc, char **argv)
   int			ret_val = 0;
 #endif
   Resume 	= 0;
+  NoFiles	= 0;
+  checkpoint_int = 0.0;
+  BinaryOut	= 0;
+  flush_int	= 0.0;
+  *warmname	= '\0';
+#if (PLUGIN == 1)
+  *pluginname	= '\0';
+#endif
   debug_level 	= 0;
+  thread_nr	= 0;
   environ_dim	= ENVIRON_DIM;
   population_nr	= POPULATION_NR;
   i_state_dim	= I_STATE_DIM;
@@ -306,7 +376,7 @@ EXTERN_C int		StartUp(int argc, char **argv)
 #ifndef MODULE
   feclearexcept(FE_ALL_EXCEPT);
 #if defined(__APPLE__)
-  static 	fenv_t fenv;
+  static EBTSTATE	fenv_t fenv;
   unsigned int 	new_excepts;  // previous masks
 
   new_excepts = (FE_DIVBYZERO | FE_INVALID | FE_OVERFLOW) & FE_ALL_EXCEPT,
@@ -332,9 +402,23 @@ EXTERN_C int		StartUp(int argc, char **argv)
    *
    *	-r   | --resume	 	: Resume previously interrupted integration
    *
+   *	-c s | --checkpoint s	: Wall-clock seconds between checkpoints
+   *
+   *	-b s | --binary s	: Binary output, flushed every s seconds
+   *
+   *	-w s | --warm s		: CKP file with the snapshot to start from
+   *
    *	-d n | --debug n 	: Level of debug information, stored in the
    *			   	  DBG file
    *
+   *	-t n | --threads n	: Number of threads in the parallel loops
+   *
+   *	-m s | --method s	: Integration method (SOLVER_REGISTRY only)
+   *
+   *	-p s | --plugin s	: Library with the model (PLUGIN only)
+   *
+   *	-n   | --nofiles	: Write no output files (MODULE only)
+   *
    *	-?   | --help		: Print usage message
    */
   argpnt1 = argv;
@@ -346,6 +430,12 @@ EXTERN_C int		StartUp(int argc, char **argv)
 	{
 	  Resume = 1;
 	}
+#ifdef MODULE
+      else if (!strcmp(*argpnt1, "-n") || !strcmp(*argpnt1, "--nofiles"))
+	{
+	  NoFiles = 1;
+	}
+#endif
       else if (!strcmp(*argpnt1, "-?") || !strcmp(*argpnt1, "--help"))
 	{
 	  usage(argv[0]);
@@ -357,6 +447,7 @@ EXTERN_C int		StartUp(int argc, char **argv)
 	    {
 	      fprintf(stderr, "\nNo debug level specified!\n");
 	      usage(argv[0]);
+	      break;
 	    }
 	  switch (atoi(*argpnt1))
 	    {
@@ -374,6 +465,111 @@ EXTERN_C int		StartUp(int argc, char **argv)
 	      break;
 	    }
 	}
+      else if (!strcmp(*argpnt1, "-c") ||!strcmp(*argpnt1, "--checkpoint"))
+	{
+	  argpnt1++;
+	  if (!*argpnt1)
+	    {
+	      fprintf(stderr, "\nNo checkpoint interval specified!\n");
+	      usage(argv[0]);
+	      break;
+	    }
+	  if ((!isdigit(**argpnt1)) || (atof(*argpnt1) <= 0.0))
+	    {
+	      fprintf(stderr, "\nWrong checkpoint interval: %s\n", *argpnt1);
+	      usage(argv[0]);
+	    }
+	  checkpoint_int = atof(*argpnt1);
+	}
+      else if (!strcmp(*argpnt1, "-b") ||!strcmp(*argpnt1, "--binary"))
+	{
+	  argpnt1++;
+	  if (!*argpnt1)
+	    {
+	      fprintf(stderr, "\nNo flush interval specified!\n");
+	      usage(argv[0]);
+	      break;
+	    }
+	  if ((!isdigit(**argpnt1)) || (atof(*argpnt1) < 0.0))
+	    {
+	      fprintf(stderr, "\nWrong flush interval: %s\n", *argpnt1);
+	      usage(argv[0]);
+	    }
+	  BinaryOut = 1;
+	  flush_int = atof(*argpnt1);
+	}
+      else if (!strcmp(*argpnt1, "-w") ||!strcmp(*argpnt1, "--warm"))
+	{
+	  argpnt1++;
+	  if (!*argpnt1)
+	    {
+	      fprintf(stderr, "\nNo snapshot file specified!\n");
+	      usage(argv[0]);
+	      break;
+	    }
+	  (void)strcpy(warmname, *argpnt1);
+	}
+      else if (!strcmp(*argpnt1, "-t") ||!strcmp(*argpnt1, "--threads"))
+	{
+	  argpnt1++;
+	  if (!*argpnt1)
+	    {
+	      fprintf(stderr, "\nNo number of threads specified!\n");
+	      usage(argv[0]);
+	      break;
+	    }
+	  if ((!isdigit(**argpnt1)) || (atoi(*argpnt1) < 0))
+	    {
+	      fprintf(stderr, "\nWrong number of threads: %s\n", *argpnt1);
+	      usage(argv[0]);
+	    }
+	  thread_nr = atoi(*argpnt1);
+	}
+#if (SOLVER_REGISTRY == 1)
+      else if (!strcmp(*argpnt1, "-m") ||!strcmp(*argpnt1, "--method"))
+	{
+	  argpnt1++;
+	  if (!*argpnt1)
+	    {
+	      fprintf(stderr, "\nNo integration method specified!\n");
+	      usage(argv[0]);
+	      break;
+	    }
+	  switch (SelectMethod(*argpnt1))
+	    {
+	    case 1:
+	      break;
+	    case -1:
+	      fprintf(stderr, "\nIntegration method %s can not handle the events or forced cohort ends of the problem!\n",
+		      *argpnt1);
+	      usage(argv[0]);
+	      break;
+	    default:
+	      fprintf(stderr, "\nWrong integration method: %s\n", *argpnt1);
+	      usage(argv[0]);
+	      break;
+	    }
+	}
+#endif // (SOLVER_REGISTRY == 1)
+#if (PLUGIN == 1)
+      else if (!strcmp(*argpnt1, "-p") ||!strcmp(*argpnt1, "--plugin"))
+	{
+	  argpnt1++;
+	  if (!*argpnt1)
+	    {
+	      fprintf(stderr, "\nNo shared library specified!\n");
+	      usage(argv[0]);
+	      break;
+	    }
+	  if (strlen(*argpnt1) + 2 >= MAXFILENAMELEN)
+	    {
+	      fprintf(stderr, "\nName of the shared library too long!\n");
+	      usage(argv[0]);
+	      break;
+	    }
+	  (void)strcpy(pluginname, *argpnt1);
+	}
+#endif // (PLUGIN == 1)
       else if ((!strncmp(*argpnt1, "--", 2)))
 	{
 	  fprintf(stderr, "\nUnknown command line option: %s\n", *argpnt1);
@@ -392,6 +588,9 @@ EXTERN_C int		StartUp(int argc, char **argv)
 	}
       argpnt1++;
     }
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return error_code;
+#endif
   // Initialization of the environment, population and output devices
   Initialize(my_argc, my_argv);
 #ifdef MODULE
@@ -422,6 +621,14 @@ EXTERN_C int		StartUp(int argc, char **argv)
 	  (floor((env[0]-identical_zero)/state_out)+1)*state_out;
   else next_state_output = 0.0;
 
+  if (Resume && (checkpoint_int > 0.0))		/* Exact state of checkpoint*/
+    (void)RestoreCheckpoint();
+  else if (!Resume)				/* or snapshot of other run */
+    (void)WarmStart();
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return error_code;
+#endif
+
 #if (BIFURCATION == 1)
   double		oldBifParVal;
 
@@ -489,12 +696,14 @@ EXTERN_C int		StartUp(int argc, char **argv)
     }
 #endif // (POPULATION_NR > 0)
 
-  if (!Resume) WriteReport(my_argc, my_argv);	/* Write report file        */
+  if (!Resume && !NoFiles)			/* Write report file        */
+    WriteReport(my_argc, my_argv);
 
 #ifndef MODULE
 
   while (!((env[0] >= max_time) || ForcedRunEnd))
     CohortCycle(next_cohort_end);
+  if (checkpoint_int > 0.0) Checkpoint(1);	/* Final checkpoint         */
 						/* Program shut down        */
   ShutDown(0);					/* procedure                */
 
@@ -506,4 +715,1019 @@ EXTERN_C int		StartUp(int argc, char **argv)
 
 
 
+/*==========================================================================*/
+#if (REENTRANT == 1)
+/*
+ * With REENTRANT equal to 1 the state of a run is thread-local. A context
+ * owns a thread, on which the jobs posted to it are executed one after the
+ * other, such that several runs can proceed concurrently in one process.
+ * All engine routines of a run, including StartUp(), CycleStep(), ShutDown()
+ * and the exp_*() functions, should be called from jobs posted to its
+ * context. The problem-specific routines are called on the same thread and
+ * reach the state of their run through the usual global variables. Global
+ * variables defined in the problem-specific file itself should be declared
+ * EBTSTATE to be kept per run as well.
+ */
+
+struct ebt_context
+{
+  pthread_t		tid;			/* Thread of the run	    */
+  pthread_mutex_t	lock;
+  pthread_cond_t	wake;			/* Signals a job or quit    */
+  pthread_cond_t	done;			/* Signals a finished job   */
+  int			(*job)(void *);		/* Pending job		    */
+  void			*arg;
+  int			busy;			/* Job pending or running   */
+  int			result;			/* Return value of last job */
+  int			quit;
+};
+
+
+
+static void	*ContextHost(void *data)
+
+  /*
+   * ContextHost - Routine executed by the thread of a context. Runs the
+   *		   posted jobs until the context is destroyed and then
+   *		   returns the memory of the run to the system.
+   */
+
+{
+  ebt_context		*ctx = (ebt_context *)data;
+  int			(*job)(void *);
+  void			*arg;
+  int			result;
+
+  (void)pthread_mutex_lock(&(ctx->lock));
+  for (;;)
+    {
+      while (!ctx->busy && !ctx->quit)
+	(void)pthread_cond_wait(&(ctx->wake), &(ctx->lock));
+      if (!ctx->busy) break;
+
+      job = ctx->job;
+      arg = ctx->arg;
+      (void)pthread_mutex_unlock(&(ctx->lock));
+      result = job(arg);
+      (void)pthread_mutex_lock(&(ctx->lock));
+
+      ctx->result = result;
+      ctx->busy	  = 0;
+      (void)pthread_cond_broadcast(&(ctx->done));
+    }
+  (void)pthread_mutex_unlock(&(ctx->lock));
+
+  MemFreeAll();
+
+  return NULL;
+}
+
+
+
+EXTERN_C ebt_context	*EbtCreate(void)
+
+  /*
+   * EbtCreate - Creates a context with its own thread and thread-local
+   *		 state. Returns NULL if the thread can not be started.
+   */
+
+{
+  ebt_context		*ctx;
+
+  ctx = (ebt_context *)calloc(1, sizeof(ebt_context));
+  if (!ctx) return NULL;
+
+  (void)pthread_mutex_init(&(ctx->lock), NULL);
+  (void)pthread_cond_init(&(ctx->wake), NULL);
+  (void)pthread_cond_init(&(ctx->done), NULL);
+  if (pthread_create(&(ctx->tid), NULL, ContextHost, (void *)ctx))
+    {
+      (void)pthread_cond_destroy(&(ctx->done));
+      (void)pthread_cond_destroy(&(ctx->wake));
+      (void)pthread_mutex_destroy(&(ctx->lock));
+      free(ctx);
+      return NULL;
+    }
+
+  return ctx;
+}
+
+
+
+EXTERN_C int		EbtPost(ebt_context *ctx, int (*job)(void *), void *arg)
+
+  /*
+   * EbtPost - Posts a job to the thread of a context and returns without
+   *	       waiting for it. A job that is still pending or running is
+   *	       awaited first. Returns 0 on success and -1 otherwise.
+   */
+
+{
+  if (!ctx || !job) return -1;
+
+  (void)pthread_mutex_lock(&(ctx->lock));
+  while (ctx->busy) (void)pthread_cond_wait(&(ctx->done), &(ctx->lock));
+  if (ctx->quit)
+    {
+      (void)pthread_mutex_unlock(&(ctx->lock));
+      return -1;
+    }
+  ctx->job  = job;
+  ctx->arg  = arg;
+  ctx->busy = 1;
+  (void)pthread_cond_signal(&(ctx->wake));
+  (void)pthread_mutex_unlock(&(ctx->lock));
+
+  return 0;
+}
+
+
+
+EXTERN_C int		EbtWait(ebt_context *ctx)
+
+  /*
+   * EbtWait - Waits until the last job posted to a context has finished
+   *	       and returns its return value.
+   */
+
+{
+  int			result;
+
+  if (!ctx) return -1;
+
+  (void)pthread_mutex_lock(&(ctx->lock));
+  while (ctx->busy) (void)pthread_cond_wait(&(ctx->done), &(ctx->lock));
+  result = ctx->result;
+  (void)pthread_mutex_unlock(&(ctx->lock));
+
+  return result;
+}
+
+
+
+EXTERN_C int		EbtRun(ebt_context *ctx, int (*job)(void *), void *arg)
+
+  /*
+   * EbtRun - Executes a job on the thread of a context and returns its
+   *	      return value.
+   */
+
+{
+  if (EbtPost(ctx, job, arg)) return -1;
+
+  return EbtWait(ctx);
+}
+
+
+
+EXTERN_C void		EbtDestroy(ebt_context *ctx)
+
+  /*
+   * EbtDestroy - Waits for the last job of a context, stops its thread and
+   *		  releases all memory of the run. Output files should be
+   *		  closed beforehand by a job calling ShutDown().
+   */
+
+{
+  if (!ctx) return;
+
+  (void)pthread_mutex_lock(&(ctx->lock));
+  while (ctx->busy) (void)pthread_cond_wait(&(ctx->done), &(ctx->lock));
+  ctx->quit = 1;
+  (void)pthread_cond_signal(&(ctx->wake));
+  (void)pthread_mutex_unlock(&(ctx->lock));
+
+  (void)pthread_join(ctx->tid, NULL);
+  (void)pthread_cond_destroy(&(ctx->done));
+  (void)pthread_cond_destroy(&(ctx->wake));
+  (void)pthread_mutex_destroy(&(ctx->lock));
+  free(ctx);
+
+  return;
+}
+
+#endif // (REENTRANT == 1)
+
+
+/*==========================================================================*/
+#if (ENSEMBLE == 1)
+/*
+ * An ensemble consists of runs of the same model that differ in their
+ * parameter values and initial state. EbtEnsemble() carries them out
+ * concurrently on a pool of threads, which claim the next run as soon as
+ * they finish the previous one, such that runs of unequal duration keep
+ * all threads busy. Every run is carried out in a new context, hence with
+ * a fresh state, and writes its output to the files named after the run.
+ * EbtBranch() instead starts all runs from the same snapshot, e.g. the
+ * final checkpoint of a burn-in run, in separate processes.
+ */
+
+typedef struct ensemble
+{
+  int			argc;			/* Command line of the runs */
+  char			**argv;
+  ebt_member		*members;
+  int			member_nr;
+  int			next;			/* Next run to carry out    */
+  int			failed;			/* Number of failed runs    */
+  pthread_mutex_t	lock;
+} ensemble;
+
+typedef struct ensemble_run
+{
+  ensemble		*ens;
+  ebt_member		*member;
+} ensemble_run;
+
+
+
+static int	EnsembleRun(void *data)
+
+  /*
+   * EnsembleRun - Job that carries out a single run of an ensemble in its
+   *		   context and returns its error code.
+   */
+
+{
+  ensemble_run		*run = (ensemble_run *)data;
+  char			**argv;
+  int			i, ret;
+
+  argv = (char **)Myalloc(NULL, (size_t)(run->ens->argc + 1), sizeof(char *));
+  if (!argv) return FATAL_ERROR;
+  for (i=0; i<run->ens->argc; i++) argv[i] = run->ens->argv[i];
+  argv[1] = (char *)run->member->name;
+
+  ens_input  = run->ens->argv[1];
+  ens_member = run->member;
+  ret = StartUp(run->ens->argc, argv);
+  Myfree(argv);
+
+  if (ret & FATAL_ERROR)
+    {
+      if (resfil) (void)fclose(resfil);
+      if (csbfil) (void)fclose(csbfil);
+    }
+  else
+    {
+      while (!((ret = CycleInit()) & (END_OF_COHORT | FATAL_ERROR)))
+	{
+	  ret = CycleStep();
+	  if (ret & FATAL_ERROR) break;
+	}
+      ret = (ret & FATAL_ERROR) | ShutDown(0);
+    }
+  if (dbgfil) (void)fclose(dbgfil);
+
+  if (ret & FATAL_ERROR)
+    {
+      (void)fprintf(stderr, "\nRUN %-s: ERROR at T = %.2f:\n", run->member->name, env[0]);
+      (void)fprintf(stderr, "** %-70s **\n\n", error_msg);
+    }
+
+  return ret;
+}
+
+
+
+static void	*EnsembleWorker(void *data)
+
+  /*
+   * EnsembleWorker - Routine executed by the threads of an ensemble. Claims
+   *		      runs until none are left and carries out each of them
+   *		      in a new context.
+   */
+
+{
+  ensemble		*ens = (ensemble *)data;
+  ensemble_run		run;
+  ebt_context		*ctx;
+  int			k;
+
+  run.ens = ens;
+  for (;;)
+    {
+      (void)pthread_mutex_lock(&(ens->lock));
+      k = ens->next++;
+      (void)pthread_mutex_unlock(&(ens->lock));
+      if (k >= ens->member_nr) break;
+
+      run.member = ens->members + k;
+      ctx	 = EbtCreate();
+      if (ctx)
+	{
+	  run.member->result = EbtRun(ctx, EnsembleRun, (void *)&run);
+	  EbtDestroy(ctx);
+	}
+      else run.member->result = FATAL_ERROR;
+
+      if (run.member->result & FATAL_ERROR)
+	{
+	  (void)pthread_mutex_lock(&(ens->lock));
+	  ens->failed++;
+	  (void)pthread_mutex_unlock(&(ens->lock));
+	}
+    }
+
+  return NULL;
+}
+
+
+
+EXTERN_C int		EbtEnsemble(int argc, char **argv, ebt_member *members, int member_nr, int thread_nr)
+
+  /*
+   * EbtEnsemble - Carries out the runs of an ensemble with thread_nr
+   *		   threads (0: all processors). argv[1] is the run name of
+   *		   the CVF and ISF files shared by all runs and argv[0] and
+   *		   the remaining arguments are passed to StartUp(). The
+   *		   return code of every run is stored in its result field.
+   *		   Returns the number of failed runs.
+   */
+
+{
+  ensemble		ens;
+  pthread_t		*tids;
+  int			i, started = 0;
+  long			cpus;
+
+  if ((argc < 2) || !members || (member_nr <= 0)) return 0;
+
+  if (thread_nr <= 0)
+    {
+      cpus	= sysconf(_SC_NPROCESSORS_ONLN);
+      thread_nr = (cpus > 0) ? (int)cpus : 1;
+    }
+  thread_nr = imin(thread_nr, member_nr);
+
+  ens.argc	= argc;
+  ens.argv	= argv;
+  ens.members	= members;
+  ens.member_nr = member_nr;
+  ens.next	= 0;
+  ens.failed	= 0;
+  (void)pthread_mutex_init(&(ens.lock), NULL);
+
+  tids = (pthread_t *)calloc((size_t)thread_nr, sizeof(pthread_t));
+  if (tids)
+    for (started=0; started<thread_nr; started++)
+      if (pthread_create(tids + started, NULL, EnsembleWorker, (void *)&ens)) break;
+  if (!started) (void)EnsembleWorker((void *)&ens);
+  for (i=0; i<started; i++) (void)pthread_join(tids[i], NULL);
+
+  free(tids);
+  (void)pthread_mutex_destroy(&(ens.lock));
+
+  return ens.failed;
+}
+
+
+
+EXTERN_C int		EbtBranch(int argc, char **argv, const char *snapshot, ebt_member *members, int member_nr, int proc_nr)
+
+  /*
+   * EbtBranch - Carries out the runs of an ensemble as branches that all
+   *		 start from the snapshot in the CKP file "snapshot", with
+   *		 at most proc_nr processes at a time (0: all processors).
+   *		 The file is read once and every run is carried out in a
+   *		 child process, which shares the image copy-on-write with
+   *		 the others. The parameters and forcing tables of every run
+   *		 apply from the time of the snapshot on. Arguments, result
+   *		 and return value as for EbtEnsemble().
+   */
+
+{
+  ensemble		ens;
+  ensemble_run		run;
+  ebt_context		*ctx;
+  double		*image;
+  long			len = 0L, cpus;
+  pid_t			pid, *pids;
+  int			i, k, status, running = 0;
+
+  if ((argc < 2) || !members || (member_nr <= 0)) return 0;
+
+  image = LoadSnapshot(snapshot, &len);
+  pids	= (pid_t *)calloc((size_t)member_nr, sizeof(pid_t));
+  if (!image || !pids)
+    {
+      free(image);
+      free(pids);
+      for (i=0; i<member_nr; i++) members[i].result = FATAL_ERROR;
+      (void)fprintf(stderr, "\nENSEMBLE %-s: ERROR:\n", argv[1]);
+      (void)fprintf(stderr, "** %-70s **\n\n", image ? MAFE : ESNP);
+      return member_nr;
+    }
+  if (proc_nr <= 0)
+    {
+      cpus    = sysconf(_SC_NPROCESSORS_ONLN);
+      proc_nr = (cpus > 0) ? (int)cpus : 1;
+    }
+
+  (void)memset((void *)&ens, 0, sizeof(ensemble));
+  ens.argc	= argc;
+  ens.argv	= argv;
+  ens.members	= members;
+  ens.member_nr = member_nr;
+  run.ens	= &ens;
+
+  for (k=0; (k<member_nr) || running; )
+    {
+      if ((k < member_nr) && (running < proc_nr))
+	{					/* Start the next branch    */
+	  members[k].snapshot	  = image;
+	  members[k].snapshot_len = len;
+	  (void)fflush(stdout);
+	  (void)fflush(stderr);
+	  pids[k] = fork();
+	  if (pids[k] == 0)
+	    {
+	      run.member = members + k;
+	      run.member->result = FATAL_ERROR;
+	      ctx = EbtCreate();
+	      if (ctx)
+		{
+		  run.member->result = EbtRun(ctx, EnsembleRun, (void *)&run);
+		  EbtDestroy(ctx);
+		}
+	      (void)fflush(stdout);
+	      (void)fflush(stderr);
+	      _exit(run.member->result & 0xff);	/* Return codes fit a byte  */
+	    }
+	  if (pids[k] > 0) running++;
+	  else
+	    {
+	      members[k].result = FATAL_ERROR;
+	      ens.failed++;
+	    }
+	  k++;
+	  continue;
+	}
+
+      pid = waitpid(-1, &status, 0);		/* Collect finished branch  */
+      if (pid < 0)
+	{
+	  if (errno == EINTR) continue;
+	  break;
+	}
+      for (i=0; (i<k) && (pids[i] != pid); i++);
+      if (i == k) continue;
+      running--;
+      pids[i] = 0;
+      members[i].result = WIFEXITED(status) ? WEXITSTATUS(status) : FATAL_ERROR;
+      if (members[i].result & FATAL_ERROR) ens.failed++;
+    }
+
+  for (i=0; i<member_nr; i++) members[i].snapshot = NULL;
+  free(pids);
+  free(image);
+
+  return ens.failed;
+}
+
+
+
+static int	ReadEnsemble(const char *input, ebt_member **members, char *msg)
+
+  /*
+   * ReadEnsemble - Reads the runs of an ensemble from the ENS file. Every
+   *		    line specifies the run name, the ISF file (- for the
+   *		    shared one) and the values of the leading parameters.
+   *		    Lines starting with # or % are comments. Returns the
+   *		    number of runs, or -1 on failure with the error message
+   *		    in "msg" (of at least ENSMSG_MAX characters).
+   */
+
+{
+  char			filename[MAXFILENAMELEN], line[4096];
+  char			*name, *isf, *tok, *end, *copy;
+  double		*par;
+  int			member_nr = 0, line_nr = 0, n;
+  FILE			*ens;
+
+  (void)strcpy(filename, input); (void)strcat(filename, ".ens");
+  ens = fopen(filename, "r");
+  if (!ens)
+    {
+      (void)strcpy(filename, input); (void)strcat(filename, ".ENS");
+      ens = fopen(filename, "r");
+      if (!ens)
+	{
+	  (void)strcpy(msg, EENS);
+	  return -1;
+	}
+    }
+
+  *members = NULL;
+  while (fgets(line, sizeof(line), ens))
+    {
+      line_nr++;
+      name = strtok(line, " \t\r\n");
+      if (!name || (*name == '#') || (*name == '%')) continue;
+      isf  = strtok(NULL, " \t\r\n");
+
+      if (isf && !strcmp(isf, "-")) isf = NULL;
+      *members = (ebt_member *)Myalloc((void *)*members, (size_t)(member_nr + 1), sizeof(ebt_member));
+      par      = (double *)Myalloc(NULL, (size_t)imax(PARAMETER_NR, 1), sizeof(double));
+      copy     = (char *)Myalloc(NULL, strlen(name) + (isf ? strlen(isf) : 0) + 2, sizeof(char));
+      if (!(*members) || !par || !copy)
+	{
+	  (void)fclose(ens);
+	  (void)strcpy(msg, MAFE);
+	  return -1;
+	}
+      (*members)[member_nr].name = strcpy(copy, name);
+      if (isf) (*members)[member_nr].isf = strcpy(copy + strlen(name) + 1, isf);
+
+      for (n=0; (n<PARAMETER_NR) && (tok = strtok(NULL, " \t\r\n")); n++)
+	{
+	  par[n] = strtod(tok, &end);
+	  if ((end == tok) || *end)
+	    {
+	      (void)fclose(ens);
+	      (void)snprintf(msg, ENSMSG_MAX,
+			     "Parameter %d on line %d of ENS file is not a number: %.20s",
+			     n, line_nr, tok);
+	      return -1;
+	    }
+	}
+      (*members)[member_nr].parameter	 = par;
+      (*members)[member_nr].parameter_nr = n;
+      member_nr++;
+    }
+  (void)fclose(ens);
+
+  return member_nr;
+}
+
+
+
+/*==========================================================================*/
+/*
+ * In server mode the driver stays resident and carries out the runs that
+ * are requested on standard input or on the connections to a Unix socket,
+ * one after the other. A request consists of the lines
+ *
+ *	par <index> <value> ...		: Values of the parameters starting
+ *					  with number index
+ *	env <value> ...			: Initial environment, all ENVIRON_DIM
+ *					  values as in the ISF file
+ *	cohort <pop> <value> ...	: Initial cohort of population pop, all
+ *					  values as in the ISF file
+ *	forcing <k> <t> <value> ...	: Time and value of the knots of forcing
+ *					  table k, see Forcing() in ebtutils.c
+ *	run [name]			: Carry out the run and reset request
+ *	quit				: End the session
+ *
+ * The CVF and ISF files are only read by the first run, later runs reuse
+ * their values (see keep_input in ebtinit.c). The cohorts requested for a
+ * population replace those of the ISF file. The runs write no files, but
+ * respond with a line "out <values>" for every output, followed by
+ * "done <name> <code>" or "error <name> <message>" at the end. Invalid
+ * request lines are answered by "error - <message>" and ignored.
+ */
+
+typedef struct serve_run
+{
+  ensemble_run		run;
+  FILE			*out;			/* Stream of the responses  */
+} serve_run;
+
+
+
+static void	ServeOutput(int what, void *data)
+
+  /*
+   * ServeOutput - Routine sends the output of a served run to its client.
+   *		   It is called by FileOut() (see OutputHook in ebtmain.h).
+   */
+
+{
+  serve_run		*srv = (serve_run *)data;
+  double		*out;
+  int			i, n;
+
+  if (what != NORMAL_OUT) return;
+
+  out = exp_output();
+  n   = exp_output_var_nr() + 1;
+  (void)fputs("out", srv->out);
+  for (i=0; i<n; i++) (void)fprintf(srv->out, " %.17g", out[i]);
+  (void)fputc('\n', srv->out);
+
+  return;
+}
+
+
+
+static int	ServeRun(void *data)
+
+  /*
+   * ServeRun - Job that carries out a served run in its context, while
+   *		streaming its output, and responds with its outcome.
+   */
+
+{
+  serve_run		*srv = (serve_run *)data;
+  char			*ch;
+  int			ret;
+
+  OutputHook	= ServeOutput;
+  OutputHookArg = data;
+  ret = EnsembleRun((void *)&(srv->run));
+
+  if (ret & FATAL_ERROR)
+    {
+      if ((ch = strchr(error_msg, '\n'))) *ch = '\0';
+      (void)fprintf(srv->out, "error %s %s\n", srv->run.member->name, error_msg);
+    }
+  else (void)fprintf(srv->out, "done %s %d\n", srv->run.member->name, ret);
+  (void)fflush(srv->out);
+
+  return ret;
+}
+
+
+
+static int	ServeValues(double **vals, int *val_max)
+
+  /*
+   * ServeValues - Routine reads the remaining values of a request line into
+   *		   the buffer "vals", which is enlarged as needed. Returns
+   *		   the number of values, -1 if one of them is not a number
+   *		   and -2 on memory allocation failure.
+   */
+
+{
+  char			*tok, *end;
+  double		*grown;
+  int			n = 0;
+
+  while ((tok = strtok(NULL, " \t\r\n")))
+    {
+      if (n == *val_max)			/* Keep the old buffer on   */
+	{					/* allocation failure       */
+	  grown = (double *)Myalloc((void *)*vals, (size_t)(2*(*val_max) + 16), sizeof(double));
+	  if (!grown) return -2;
+	  *vals	   = grown;
+	  *val_max = 2*(*val_max) + 16;
+	}
+      (*vals)[n] = strtod(tok, &end);
+      if (*end) return -1;
+      n++;
+    }
+
+  return n;
+}
+
+
+
+static int	ServeIndex(int limit)
+
+  /*
+   * ServeIndex - Routine reads the index that follows the keyword of a
+   *		  request line. Returns -1 unless it lies in [0, limit).
+   */
+
+{
+  char			*tok, *end;
+  long			k;
+
+  tok = strtok(NULL, " \t\r\n");
+  if (!tok) return -1;
+  k = strtol(tok, &end, 10);
+  if (*end || (k < 0) || (k >= limit)) return -1;
+
+  return (int)k;
+}
+
+
+
+static int	ServeRuns(int argc, char **argv, FILE *in, FILE *out)
+
+  /*
+   * ServeRuns - Routine carries out the runs requested on the stream "in"
+   *		 and sends the responses to the stream "out", until the
+   *		 request quit or the end of the stream. Every run is carried
+   *		 out in a new context with the command line argc and argv.
+   *		 Returns the number of failed runs.
+   */
+
+{
+  ensemble		ens;
+  serve_run		srv;
+  ebt_member		member;
+  ebt_context		*ctx;
+  char			*line = NULL, *key, name[MAXFILENAMELEN];
+  const char		*err;
+  size_t		line_max = 0;
+  double		*vals = NULL, *par = NULL, environ[ENVIRON_DIM];
+  double		*forcing[FORCING_NR], *grown;
+  int			i, k, n, val_max = 0, failed = 0;
+#if (POPULATION_NR > 0)
+  double		*cohorts[POPULATION_NR];
+  int			cohort_max[POPULATION_NR];
+#endif
+
+  (void)memset((void *)&ens, 0, sizeof(ensemble));
+  ens.argc	= argc;
+  ens.argv	= argv;
+  ens.members	= &member;
+  ens.member_nr = 1;
+  srv.run.ens	= &ens;
+  srv.run.member= &member;
+  srv.out	= out;
+
+  par = (double *)Myalloc(NULL, (size_t)imax(PARAMETER_NR, 1), sizeof(double));
+  if (!par) return 0;
+  for (k=0; k<FORCING_NR; k++) forcing[k] = NULL;
+#if (POPULATION_NR > 0)
+  for (k=0; k<POPULATION_NR; k++)
+    {
+      cohorts[k]    = NULL;
+      cohort_max[k] = 0;
+    }
+#endif
+
+  for (;;)					/* Serve the requested runs */
+    {
+      (void)memset((void *)&member, 0, sizeof(ebt_member));
+      for (i=0; i<PARAMETER_NR; i++) par[i] = MISSING_VALUE;
+      member.parameter	  = par;
+      member.parameter_nr = PARAMETER_NR;
+      member.keep_input	  = 1;
+						/* Read the request	    */
+      while ((n = (int)getline(&line, &line_max, in)) > 0)
+	{
+	  key = strtok(line, " \t\r\n");
+	  if (!key || (*key == '#') || (*key == '%')) continue;
+	  if (!strcmp(key, "run") || !strcmp(key, "quit")) break;
+
+	  err = NULL;
+	  if (!strcmp(key, "par"))
+	    {
+	      k = ServeIndex(PARAMETER_NR);
+	      n = ServeValues(&vals, &val_max);
+	      if (k < 0) err = SIDX;
+	      else if ((n < 1) || (k + n > PARAMETER_NR)) err = ((n == -2) ? SMAF : SVAL);
+	      else for (i=0; i<n; i++) par[k+i] = vals[i];
+	    }
+	  else if (!strcmp(key, "env"))
+	    {
+	      n = ServeValues(&vals, &val_max);
+	      if (n != ENVIRON_DIM) err = ((n == -2) ? SMAF : SVAL);
+	      else
+		{
+		  for (i=0; i<n; i++) environ[i] = vals[i];
+		  member.environ = environ;
+		}
+	    }
+	  else if (!strcmp(key, "cohort"))
+	    {
+#if (POPULATION_NR > 0)
+	      k = ServeIndex(POPULATION_NR);
+	      n = ServeValues(&vals, &val_max);
+	      if (k < 0) err = SIDX;
+	      else if (n != (COHORT_SIZE+I_CONST_DIM)) err = ((n == -2) ? SMAF : SVAL);
+	      else
+		{
+		  grown = cohorts[k];
+		  if (member.cohort_nr[k] == cohort_max[k])
+		    {
+		      grown = (double *)Myalloc((void *)cohorts[k],
+						(size_t)(2*cohort_max[k] + 16)*(COHORT_SIZE+I_CONST_DIM),
+						sizeof(double));
+		      if (grown)
+			{
+			  cohorts[k]	= grown;
+			  cohort_max[k] = 2*cohort_max[k] + 16;
+			}
+		    }
+		  if (!grown) err = SMAF;
+		  else
+		    {
+		      for (i=0; i<n; i++) cohorts[k][member.cohort_nr[k]*n + i] = vals[i];
+		      member.cohorts[k] = cohorts[k];
+		      member.cohort_nr[k]++;
+		    }
+		}
+#else
+	      err = SIDX;
+#endif // (POPULATION_NR > 0)
+	    }
+	  else if (!strcmp(key, "forcing"))
+	    {
+	      k = ServeIndex(FORCING_NR);
+	      n = ServeValues(&vals, &val_max);
+	      if (k < 0) err = SIDX;
+	      else if ((n < 2) || (n % 2)) err = ((n == -2) ? SMAF : SVAL);
+	      else
+		{
+		  for (i=2; i<n; i+=2)		/* Times should increase    */
+		    if (!(vals[i] > vals[i-2])) break;
+		  if (i < n) err = SVAL;
+		  else
+		    {
+		      grown = (double *)Myalloc((void *)forcing[k], (size_t)n, sizeof(double));
+		      if (!grown) err = SMAF;
+		      else
+			{
+			  forcing[k]	    = grown;
+			  member.forcing[k] = forcing[k];
+			  member.knots[k]   = n/2;
+			  for (i=0; i<n; i++) forcing[k][i] = vals[i];
+			}
+		    }
+		}
+	    }
+	  else err = SUNK;
+
+	  if (err)
+	    {
+	      (void)fprintf(out, "error - %s\n", err);
+	      (void)fflush(out);
+	    }
+	}
+      if ((n <= 0) || strcmp(key, "run")) break;
+
+      key = strtok(NULL, " \t\r\n");		/* Carry out the run	    */
+      (void)strncpy(name, (key ? key : "serve"), MAXFILENAMELEN - 2);
+      name[MAXFILENAMELEN - 2] = '\0';
+      member.name = name;
+
+      ctx = EbtCreate();
+      if (ctx)
+	{
+	  member.result = EbtRun(ctx, ServeRun, (void *)&srv);
+	  EbtDestroy(ctx);
+	}
+      else
+	{
+	  member.result = FATAL_ERROR;
+	  (void)fprintf(out, "error %s %s\n", name, SCTX);
+	  (void)fflush(out);
+	}
+      if (member.result & FATAL_ERROR) failed++;
+    }
+
+  free(line);
+  Myfree(vals);
+  Myfree(par);
+  for (k=0; k<FORCING_NR; k++) Myfree(forcing[k]);
+#if (POPULATION_NR > 0)
+  for (k=0; k<POPULATION_NR; k++) Myfree(cohorts[k]);
+#endif
+
+  return failed;
+}
+
+
+
+static int	ServeSocket(const char *path, int argc, char **argv)
+
+  /*
+   * ServeSocket - Routine listens on the Unix socket at "path" and serves
+   *		   the runs requested on its connections, one connection
+   *		   after the other. Returns -1 if the socket can not be set
+   *		   up and otherwise only when accepting connections fails.
+   */
+
+{
+  struct sockaddr_un	addr;
+  FILE			*in, *out;
+  int			fd, conn;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+  (void)memset((void *)&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  (void)strcpy(addr.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  (void)unlink(path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 8))
+    {
+      (void)close(fd);
+      return -1;
+    }
+  (void)signal(SIGPIPE, SIG_IGN);		/* Survive lost clients     */
+
+  for (;;)
+    {
+      conn = accept(fd, NULL, NULL);
+      if (conn < 0)
+	{
+	  if (errno == EINTR) continue;
+	  break;
+	}
+      in  = fdopen(conn, "r");
+      out = (in ? fdopen(dup(conn), "w") : NULL);
+      if (in && out) (void)ServeRuns(argc, argv, in, out);
+      if (out) (void)fclose(out);
+      if (in) (void)fclose(in);
+      else (void)close(conn);
+    }
+  (void)close(fd);
+  (void)unlink(path);
+
+  return 0;
+}
+
+
+
+int			main(int argc, char **argv)
+
+  /*
+   * main - Ensemble driver. Carries out the runs listed in the ENS file
+   *	    with the run name given on the command line. The option -t
+   *	    sets the number of runs carried out at a time, the remaining
+   *	    options are passed on to every run. With the option -w the
+   *	    runs branch off from the snapshot in a CKP file, each in its
+   *	    own process. With the option -s or -u it serves the runs
+   *	    requested on standard input or on a Unix socket instead.
+   */
+
+{
+  char			**my_argv, *input = NULL, *socket_path = NULL, *warm = NULL;
+  char			msg[ENSMSG_MAX];
+  ebt_member		*members = NULL;
+  int			i, my_argc = 0, member_nr, failed, threads = 0, serve = 0;
+
+  my_argv = (char **)Myalloc(NULL, (size_t)(argc + 2), sizeof(char *));
+  if (!my_argv)
+    {
+      (void)fprintf(stderr, "\n** %-70s **\n\n", MAFE);
+      return 1;
+    }
+  my_argv[my_argc++] = argv[0];
+  my_argv[my_argc++] = NULL;
+  for (i=1; i<argc; i++)
+    {
+      if (!strcmp(argv[i], "-?") || !strcmp(argv[i], "--help")) usage(argv[0]);
+      else if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "--threads"))
+	{
+	  if ((++i == argc) || !isdigit(*argv[i])) usage(argv[0]);
+	  threads = atoi(argv[i]);
+	}
+      else if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--serve")) serve = 1;
+      else if (!strcmp(argv[i], "-u") || !strcmp(argv[i], "--socket"))
+	{
+	  if (++i == argc) usage(argv[0]);
+	  socket_path = argv[i];
+	}
+      else if (!strcmp(argv[i], "-w") || !strcmp(argv[i], "--warm"))
+	{
+	  if (++i == argc) usage(argv[0]);
+	  warm = argv[i];
+	}
+      else if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "--debug") ||
+	       !strcmp(argv[i], "-c") || !strcmp(argv[i], "--checkpoint") ||
+	       !strcmp(argv[i], "-b") || !strcmp(argv[i], "--binary") ||
+	       !strcmp(argv[i], "-m") || !strcmp(argv[i], "--method") ||
+	       !strcmp(argv[i], "-p") || !strcmp(argv[i], "--plugin"))
+	{
+	  my_argv[my_argc++] = argv[i++];
+	  if (i == argc) usage(argv[0]);
+	  my_argv[my_argc++] = argv[i];
+	}
+      else if (*argv[i] == '-') my_argv[my_argc++] = argv[i];
+      else if (!input) input = argv[i];
+      else usage(argv[0]);
+    }
+  if (!input) usage(argv[0]);
+  my_argv[1] = input;
+
+  if (serve || socket_path)			/* Server mode		    */
+    {
+      my_argv[my_argc++] = (char *)"-n";
+      if (!socket_path) failed = ServeRuns(my_argc, my_argv, stdin, stdout);
+      else if ((failed = ServeSocket(socket_path, my_argc, my_argv)) < 0)
+	{
+	  (void)fprintf(stderr, "\nSERVER %-s: ERROR:\n", input);
+	  (void)fprintf(stderr, "** %-70s **\n\n", SOCK);
+	}
+      return (failed < 0);
+    }
+
+  member_nr = ReadEnsemble(input, &members, msg);
+  if (member_nr < 0)
+    {
+      (void)fprintf(stderr, "\nENSEMBLE %-s: ERROR:\n", input);
+      (void)fprintf(stderr, "** %-70s **\n\n", msg);
+      return 1;
+    }
+
+  if (warm)					/* Branches of a snapshot   */
+    failed = EbtBranch(my_argc, my_argv, warm, members, member_nr, threads);
+  else
+    failed = EbtEnsemble(my_argc, my_argv, members, member_nr, threads);
+
+  (void)fprintf(stderr, "\n\nENSEMBLE %-s COMPLETED: %d runs, %d failed\n\n", input, member_nr, failed);
+
+  return (failed > 0);
+}
+
+#endif // (ENSEMBLE == 1)
+
+
 /*==========================================================================*/
@@ -17,7 +17,9 @@
 /*
  * Definitions of global variables exported to the linker. All the global 
  * variables are defined in the ebtmain.h file and exported to the other 
- * modules. This facilitates location of their definitions.
+ * modules. This facilitates location of their definitions. With REENTRANT
+ * equal to 1 every thread has its own instance of them (see EBTSTATE in
+ * escbox.h).
  */
 
 #ifndef EXPORTING
@@ -25,12 +27,12 @@
 #endif
 #ifdef 	EBTMAIN_C
 #  undef  EXTERN
-#  define EXTERN
+#  define EXTERN	EBTSTATE
 #else
 #  undef  EXPORTING
 #  define EXPORTING
 #  undef  EXTERN
-#  define EXTERN	extern
+#  define EXTERN	extern EBTSTATE
 #endif
 
 EXTERN int	environ_dim;		/* Environment dimension    */
@@ -42,11 +44,16 @@ EXTERN int      error_code;             /* Warning/(fatal) error    */
 
 #ifdef 	EBTMAIN_C
 // Static variables restricted to ebtmain.c only
-static int	output_var_nr;			/* Output variable number   */
+static EBTSTATE int output_var_nr;		/* Output variable number   */
 #endif
 
 #ifdef MODULE
 EXTERN	 char error_msg[1024];	/* Error message, for tool  */
+EXTERN_C int StartUp(int argc, char **argv);
+// Called by FileOut() and FileState() with NORMAL_OUT or STATE_OUT, also
+// for the intermediate output produced by the integration methods
+EXTERN	 void (*OutputHook)(int what, void *arg);
+EXTERN	 void *OutputHookArg;
 EXTERN_C char* exp_error_msg(void);
 EXTERN_C int exp_environ_dim(void);
 EXTERN_C int exp_population_nr(void);
@@ -69,6 +76,47 @@ EXTERN_C double* exp_popIDcard(void);
 // to protect the value of output_var_nr from changes by the user
 EXTERN_C int exp_output_var_nr(void);
 
+#if (REENTRANT == 1)
+// The handle of a run with its own thread, see EbtCreate() in ebtmain.c
+typedef struct ebt_context ebt_context;
+
+EXTERN_C ebt_context *EbtCreate(void);
+EXTERN_C int EbtPost(ebt_context *ctx, int (*job)(void *), void *arg);
+EXTERN_C int EbtWait(ebt_context *ctx);
+EXTERN_C int EbtRun(ebt_context *ctx, int (*job)(void *), void *arg);
+EXTERN_C void EbtDestroy(ebt_context *ctx);
+#endif // (REENTRANT == 1)
+
+#if (ENSEMBLE == 1)
+// A run of an ensemble, see EbtEnsemble() in ebtmain.c
+typedef struct ebt_member
+{
+  const char	*name;			/* Run name of the output   */
+  const char	*isf;			/* ISF file or NULL         */
+  const double	*parameter;		/* Leading parameter values */
+  int		parameter_nr;		/* that replace CVF values  */
+  const double	*environ;		/* Initial environment or   */
+					/* NULL                     */
+#if (POPULATION_NR > 0)
+  const double	*cohorts[POPULATION_NR];/* Initial cohorts replacing*/
+  int		cohort_nr[POPULATION_NR];/* those of the ISF file    */
+#endif
+  const double	*forcing[FORCING_NR];	/* Forcing tables with time */
+  int		knots[FORCING_NR];	/* and value of every knot  */
+  int		keep_input;		/* Reuse CVF and ISF data   */
+					/* read by an earlier run   */
+  const double	*snapshot;		/* Image of a CKP file to   */
+  long		snapshot_len;		/* start from and its length*/
+  int		result;			/* Return code of the run   */
+} ebt_member;
+
+EXTERN_C int EbtEnsemble(int argc, char **argv, ebt_member *members, int member_nr, int thread_nr);
+EXTERN_C int EbtBranch(int argc, char **argv, const char *snapshot, ebt_member *members, int member_nr, int proc_nr);
+
+EXTERN const char	*ens_input;		/* Run name of the input    */
+EXTERN ebt_member	*ens_member;		/* Member run by the thread */
+#endif // (ENSEMBLE == 1)
+
 
 EXTERN double	*initState;			/* Pointer to initial       */
 						/* system state             */
@@ -78,6 +126,8 @@ EXTERN double	*currentDers[MAXDERS];		/* Pointers to computed     */
 						/* derivatives              */
 EXTERN double	env[ENVIRON_DIM];		/* Becomes vector of        */
 						/* environmental values     */
+EXTERN const double *forcing_table[FORCING_NR];	/* Forcing tables of the run*/
+EXTERN int	forcing_knots[FORCING_NR];	/* and their knot numbers   */
 #if (POPULATION_NR > 0)
 EXTERN population pop[POPULATION_NR];		/* Array of pointers to the */
 						/* population data          */
@@ -103,6 +153,11 @@ EXTERN int	bpoint_no[POPULATION_NR];       /* Copy of BpointNo vector  */
 #endif // (POPULATION_NR > 0)
 
 EXTERN double	cohort_limit;                   /* Time limit new cohorts   */
+#if (ADAPT_COH_LIMIT == 1)
+EXTERN double	min_coh_limit, max_coh_limit;	/* Bounds on cohort limit   */
+EXTERN double	target_cohorts;			/* Target number of cohorts */
+						/* (<= 0: no target)        */
+#endif
 
 EXTERN double	max_time;                       /* Maximum integration time */
 
@@ -135,6 +190,11 @@ EXTERN FILE	*extrema;
 
 EXTERN int	csbnew;				/* Flag new state file      */
 
+EXTERN int	csbversion;			/* Format of the state file */
+
+EXTERN int	bofnew;				/* Flag new binary output   */
+						/* file                     */
+
 EXTERN FILE	*dbgfil;			/* Pointer debug report file*/
 
 EXTERN double	accuracy;                       /* Accuracy of the          */
@@ -153,6 +213,10 @@ EXTERN int	tol_zero[POPULATION_NR];        /* Flag indicating one of   */
 EXTERN int	pop_extinct[POPULATION_NR];     /* Flag indicating whether  */
 						/* population extinction has*/
 						/* been signalled already   */
+#if (COHORT_BUDGET == 1)
+EXTERN int	max_cohorts[POPULATION_NR];	/* Maximum number of cohorts*/
+						/* (<= 0: no maximum)       */
+#endif
 #endif // (POPULATION_NR > 0)
 
 #if PARAMETER_NR
@@ -181,21 +245,39 @@ EXTERN char	progname[MAXFILENAMELEN];       /* Name of the program      */
 
 EXTERN char	runname[MAXFILENAMELEN];        /* Name of the current run  */
 
+EXTERN char	warmname[MAXFILENAMELEN];	/* CKP file to start from   */
+
+#if (PLUGIN == 1)
+EXTERN char	pluginname[MAXFILENAMELEN];	/* Library with the problem-*/
+						/* specific routines        */
+EXTERN void	*pluginlib;			/* Handle of the library    */
+#endif
+
 EXTERN char	**usernotes;			/* User defined notes       */
 						/* State labels in CSB file */
 #if (POPULATION_NR > 0)
 EXTERN char     statelabels[POPULATION_NR][DESCRIP_MAX];
 #endif // (POPULATION_NR > 0)
+						/* Output labels in BOF file*/
+EXTERN char     outputlabels[OUTPUT_VAR_NR+1][DESCRIP_MAX];
 
 EXTERN struct dscrptn {				/* The structure with       */
 		char accuracy[DESCRIP_MAX];	/* descriptions of the      */
 		char cohort_limit[DESCRIP_MAX];	/* quantities that are      */
+#if (ADAPT_COH_LIMIT == 1)
+		char min_coh_limit[DESCRIP_MAX];
+		char max_coh_limit[DESCRIP_MAX];
+		char target_cohorts[DESCRIP_MAX];
+#endif
 		char identical_zero[DESCRIP_MAX]; /* read from .CVF file    */
 		char max_time[DESCRIP_MAX];
 		char delt_out[DESCRIP_MAX];
 		char state_out[DESCRIP_MAX];
 		char abs_tols[COHORT_SIZE][DESCRIP_MAX];
 		char rel_tols[COHORT_SIZE][DESCRIP_MAX];
+#if (COHORT_BUDGET == 1)
+		char max_cohorts[DESCRIP_MAX];
+#endif
 #if PARAMETER_NR
 		char parameter[PARAMETER_NR][DESCRIP_MAX];
 #endif
@@ -211,8 +293,22 @@ EXTERN struct dscrptn {				/* The structure with       */
 
 EXTERN int	Resume;				/* Flag for resuming run    */
 
+EXTERN int	NoFiles;			/* Flag for writing no      */
+						/* output files (MODULE)    */
+
+EXTERN double	checkpoint_int;			/* Wall-clock seconds       */
+						/* between checkpoints      */
+
+EXTERN int	BinaryOut;			/* Flag for binary output   */
+						/* (BOF file)               */
+EXTERN double	flush_int;			/* Wall-clock seconds       */
+						/* between flushes of BOF   */
+
 EXTERN int	debug_level;			/* Level of debug info      */
 
+EXTERN int	thread_nr;			/* Number of threads in the */
+						/* parallel loops (0: all)  */
+
 #if (POPULATION_NR > 0)
 EXTERN long	DataMemAllocated[POPULATION_NR];/* Total number of doubles  */
 						/* currently allocated      */
@@ -0,0 +1,387 @@
+/***
+   NAME
+     ebtmex.c
+   PURPOSE
+     MATLAB gateway to the Escalator Boxcar Train. The routines StartUp(),
+     CycleInit(), CycleStep() and ShutDown() of a MODULE build are called
+     inside the MATLAB process, and the output and the complete population
+     states are returned as arrays instead of being written to the OUT and
+     CSB files. From MATLAB the run is started with
+
+       [out, states] = EBTstd('EBTstd', options...)
+
+     where the first argument is the name of the run, of which the CVF and
+     ISF file are read, and the remaining ones are command line options
+     (see usage() in ebtmain.c). out is an (n, 1+OUTPUT_VAR_NR) array with
+     the rows of the OUT file. The optional states is a struct array with
+     the fields time, env and pop, one element for every state output of
+     the CSB file. pop is a cell array with for every population a matrix
+     with a row per cohort, with the number, the i-states and the
+     i-constants in its columns, in the order of the CSB file.
+   NOTES
+     The gateway is compiled with the other files of the program and the
+     problem-specific file, from the EBTtool directory:
+
+       mex -DMODULE -DREENTRANT=1 -DPROBLEMFILE="<deb/EBTstd.h>" -I. -Ifns
+           -IOdesolvers fns/ebtmex.c fns/ebtmain.c fns/ebtinit.c
+           fns/ebttint.c fns/ebtcohrt.c fns/ebtutils.c fns/ebtstop.c
+           deb/EBTstd.c -lpthread -output EBTstd
+
+     No output files are written (option -n is always passed). Every call
+     runs on a new context (see EbtCreate() in ebtmain.c), such that it
+     starts from a clean state and all its memory is returned afterwards.
+     The static variables of the engine and the integration methods keep
+     their values between calls of a MEX file that stays loaded, which is
+     why REENTRANT has to be 1. REENTRANT needs POSIX threads (see
+     HAS_PTHREADS in ebttune.h), so the gateway can not be built on Windows.
+     The results are collected by FileOut() and FileState() through
+     OutputHook, such that also the intermediate output of the integration
+     methods is included, in buffers that are sized from the output
+     intervals in the CVF file. They are copied into the MATLAB arrays at the
+     end, as the MATLAB API can only be used from its own thread.
+   HISTORY
+     Oct 17, 2026 : Created.
+***/
+
+#define EBTLIB					/* File grouping	    */
+
+#include "escbox.h"				/* Include general header   */
+#include "ebtmain.h"
+#include "ebtcohrt.h"
+#include "ebtutils.h"
+#include "ebtstop.h"
+
+#include "mex.h"
+
+#ifndef MODULE
+#error The MATLAB gateway requires a MODULE build, compile with -DMODULE!
+#endif
+#if (REENTRANT != 1)
+#error The MATLAB gateway requires a fresh context for every call, compile with -DREENTRANT=1!
+#endif
+
+
+/*==========================================================================*/
+/*
+ * Defining all constants and types that are local to this specific file.
+ */
+
+#define MAFO "Memory allocation failure for the output of the run!"
+
+#define MEX_ARGS	64			/* Maximum number of options*/
+#define STATE_COLUMNS	(COHORT_SIZE+I_CONST_DIM)
+
+typedef struct mex_state			/* State output of the run  */
+{
+  double		time;
+  double		env[ENVIRON_DIM];
+  int			cohorts[POPULATION_NR+1];
+  double		*data;			/* Cohort matrices	    */
+} mex_state;
+
+typedef struct mex_run
+{
+  int			argc;
+  char			**argv;
+  int			states;			/* Collect state output	    */
+  int			nomem;			/* Buffers could not grow   */
+
+  double		*out;			/* Rows of the output	    */
+  long			out_nr, out_max;
+  int			out_cols;
+
+  mex_state		*state;
+  long			state_nr, state_max;
+
+  int			result;
+  char			msg[1024];		/* Error message	    */
+  char			warning[1024];		/* Last warning		    */
+} mex_run;
+
+
+/*==========================================================================*/
+/*
+ * Start of function implementations.
+ */
+/*==========================================================================*/
+
+static void	  Collect(int what, void *data)
+
+  /*
+   * Collect - Routine stores the output or the complete state of the run.
+   *	       It is called by FileOut() and FileState() (see OutputHook in
+   *	       ebtmain.h). The buffers are sized from the CVF file at the
+   *	       first call and grow if more output is produced.
+   */
+
+{
+  mex_run		*run = (mex_run *)data;
+  register int		i, j, k;
+  long			n;
+  void			*pnt;
+  double		*dst;
+  mex_state		*st;
+
+  if (run->nomem) return;
+
+  if (what == NORMAL_OUT)
+    {
+      if (run->out_nr == run->out_max)
+	{
+	  if (run->out) n = 2*run->out_max;
+	  else n = (long)floor((max_time - env[0])/delt_out) + 2;
+	  run->out_cols = exp_output_var_nr() + 1;
+	  pnt = realloc(run->out, (size_t)(n*run->out_cols)*sizeof(double));
+	  if (!pnt)
+	    {
+	      run->nomem = 1;
+	      return;
+	    }
+	  run->out = (double *)pnt; run->out_max = n;
+	}
+      (void)memcpy(run->out + run->out_nr*run->out_cols, exp_output(),
+		   (size_t)run->out_cols*sizeof(double));
+      run->out_nr++;
+    }
+
+#if (POPULATION_NR > 0)
+  if ((what == STATE_OUT) && run->states)
+    {
+      if (run->state_nr == run->state_max)
+	{
+	  if (run->state) n = 2*run->state_max;
+	  else n = (long)floor((max_time - env[0])/state_out) + 2;
+	  pnt = realloc(run->state, (size_t)n*sizeof(mex_state));
+	  if (!pnt)
+	    {
+	      run->nomem = 1;
+	      return;
+	    }
+	  run->state = (mex_state *)pnt; run->state_max = n;
+	}
+      st = run->state + run->state_nr;
+      st->time = env[0];
+      (void)memcpy(st->env, env, ENVIRON_DIM*sizeof(double));
+
+      for (i=0, n=0; i<POPULATION_NR; i++)
+	n += (st->cohorts[i] = CohortNo[i])*STATE_COLUMNS;
+      st->data = dst = (double *)malloc((size_t)imax((int)n, 1)*sizeof(double));
+      if (!dst)
+	{
+	  run->nomem = 1;
+	  return;
+	}
+      run->state_nr++;
+
+      for (i=0; i<POPULATION_NR; i++)		/* Column-major, like CSB   */
+	{
+	  for (k=0; k<COHORT_SIZE; k++)
+	    for (j=CohortNo[i]-1; j>=0; j--) *dst++ = pop[i][j][k];
+#if (I_CONST_DIM > 0)
+	  for (k=0; k<I_CONST_DIM; k++)
+	    for (j=CohortNo[i]-1; j>=0; j--) *dst++ = popIDcard[i][j][k];
+#endif
+	}
+    }
+#endif // (POPULATION_NR > 0)
+
+  return;
+}
+
+
+
+/*==========================================================================*/
+
+static int	  MexRun(void *data)
+
+  /*
+   * MexRun - Routine carries out the run from start up to shut down and
+   *	      collects its output. Returns the error code of the run.
+   */
+
+{
+  mex_run		*run = (mex_run *)data;
+  int			ret;
+
+  OutputHook	= Collect;
+  OutputHookArg = (void *)run;
+
+  ret = StartUp(run->argc, run->argv);
+  if (ret & WARNING) (void)strcpy(run->warning, error_msg);
+
+  while (!(ret & FATAL_ERROR) && !run->nomem)	/* Cohort cycles	    */
+    {
+      ret = CycleInit();
+      if (ret & WARNING) (void)strcpy(run->warning, error_msg);
+      if (ret & (END_OF_COHORT | FATAL_ERROR)) break;
+
+      ret = CycleStep();
+      if (ret & WARNING) (void)strcpy(run->warning, error_msg);
+    }
+  if (run->nomem && !(ret & FATAL_ERROR))
+    {
+      (void)strcpy(error_msg, MAFO);
+      ret = FATAL_ERROR;
+    }
+
+  if (ret & FATAL_ERROR) (void)strcpy(run->msg, error_msg);
+  else
+    {
+      ret = ShutDown(0);
+      if (ret & FATAL_ERROR) (void)strcpy(run->msg, error_msg);
+    }
+  if (dbgfil) (void)fclose(dbgfil);
+  dbgfil = NULL;
+
+  OutputHook	= NULL;
+  OutputHookArg = NULL;
+
+  run->result = ret;
+
+  return ret;
+}
+
+
+
+/*==========================================================================*/
+
+static char	  *MexString(const char *str)
+
+  /*
+   * MexString - Routine returns a copy of a string in MATLAB memory.
+   */
+
+{
+  char			*copy;
+
+  copy = (char *)mxMalloc(strlen(str) + 1);
+  (void)strcpy(copy, str);
+
+  return copy;
+}
+
+
+
+/*==========================================================================*/
+
+static void	  MexRelease(mex_run *run)
+
+  /*
+   * MexRelease - Routine frees the arguments and result buffers of a run.
+   */
+
+{
+  register int		i;
+
+  for (i=0; i<run->argc; i++) mxFree(run->argv[i]);
+  for (i=0; i<run->state_nr; i++) free(run->state[i].data);
+  free(run->state);
+  free(run->out);
+
+  return;
+}
+
+
+
+/*==========================================================================*/
+
+void	  mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+
+  /*
+   * mexFunction - Entry point of the gateway, see the description at the
+   *		   top of this file.
+   */
+
+{
+  static const char	*fields[] = {"time", "env", "pop"};
+  char			*argv[MEX_ARGS+3], buf[64];
+  mex_run		run;
+  mxArray		*cell, *mat;
+  double		*pr;
+  long			n;
+  register int		i, j, k;
+  double		*data;
+  ebt_context		*ctx;
+
+  if ((nrhs < 1) || !mxIsChar(prhs[0]))
+    mexErrMsgIdAndTxt("EBT:usage", "Usage: [out, states] = %s(runname, options...)", mexFunctionName());
+  if (nrhs > MEX_ARGS)
+    mexErrMsgIdAndTxt("EBT:usage", "Too many command line options!");
+  if (nlhs > 2)
+    mexErrMsgIdAndTxt("EBT:usage", "Too many output arguments!");
+
+  (void)memset(&run, 0, sizeof(mex_run));
+  run.argv   = argv;
+  run.states = (nlhs > 1);
+
+  argv[run.argc++] = mxArrayToString(prhs[0]);	/* Program and run name	    */
+  argv[run.argc++] = mxArrayToString(prhs[0]);
+  argv[run.argc++] = MexString("-n");		/* No output files	    */
+  for (i=1; i<nrhs; i++)			/* Options, also numerical  */
+    {
+      if (mxIsChar(prhs[i])) argv[run.argc++] = mxArrayToString(prhs[i]);
+      else if (mxIsNumeric(prhs[i]) && (mxGetNumberOfElements(prhs[i]) == 1))
+	{
+	  (void)sprintf(buf, "%.17g", mxGetScalar(prhs[i]));
+	  argv[run.argc++] = MexString(buf);
+	}
+      else
+	{
+	  MexRelease(&run);
+	  mexErrMsgIdAndTxt("EBT:usage", "Option %d is not a string or a scalar!", i);
+	}
+    }
+  argv[run.argc] = NULL;
+
+  ctx = EbtCreate();
+  if (!ctx || (EbtRun(ctx, MexRun, &run) < 0))
+    {
+      if (ctx) EbtDestroy(ctx);
+      MexRelease(&run);
+      mexErrMsgIdAndTxt("EBT:context", "Unable to start the thread of the run!");
+    }
+  EbtDestroy(ctx);
+
+  if (run.result & FATAL_ERROR)
+    {
+      MexRelease(&run);
+      mexErrMsgIdAndTxt("EBT:run", "%s", run.msg);
+    }
+  if (*run.warning) mexWarnMsgIdAndTxt("EBT:run", "%s", run.warning);
+
+  plhs[0] = mxCreateDoubleMatrix((mwSize)run.out_nr, (mwSize)run.out_cols, mxREAL);
+  pr	  = mxGetPr(plhs[0]);
+  for (j=0; j<run.out_cols; j++)		/* Rows to columns	    */
+    for (n=0; n<run.out_nr; n++) *pr++ = run.out[n*run.out_cols+j];
+
+  if (nlhs > 1)
+    {
+      plhs[1] = mxCreateStructMatrix(1, (mwSize)run.state_nr, 3, fields);
+      for (n=0; n<run.state_nr; n++)
+	{
+	  mxSetField(plhs[1], (mwIndex)n, "time", mxCreateDoubleScalar(run.state[n].time));
+	  mat = mxCreateDoubleMatrix(1, ENVIRON_DIM, mxREAL);
+	  (void)memcpy(mxGetPr(mat), run.state[n].env, ENVIRON_DIM*sizeof(double));
+	  mxSetField(plhs[1], (mwIndex)n, "env", mat);
+
+	  cell = mxCreateCellMatrix(1, POPULATION_NR);
+	  data = run.state[n].data;
+	  for (i=0; i<POPULATION_NR; i++)
+	    {
+	      k	  = run.state[n].cohorts[i];
+	      mat = mxCreateDoubleMatrix((mwSize)k, STATE_COLUMNS, mxREAL);
+	      (void)memcpy(mxGetPr(mat), data, (size_t)(k*STATE_COLUMNS)*sizeof(double));
+	      data += k*STATE_COLUMNS;
+	      mxSetCell(cell, i, mat);
+	    }
+	  mxSetField(plhs[1], (mwIndex)n, "pop", cell);
+	}
+    }
+
+  MexRelease(&run);
+
+  return;
+}
+
+
+/*==========================================================================*/
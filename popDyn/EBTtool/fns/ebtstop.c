@@ -4,8 +4,19 @@
    PURPOSE
      This file contains the ShutDown() routine and the routine
      WriteRepport() to generate a report of the run statistics. 
+     It also contains the routines Checkpoint() and RestoreCheckpoint()
+     that write and read the binary checkpoint (CKP) file of the run, and
+     WarmStart() that starts a run from the checkpoint of another run.
    NOTES
-     
+     The CKP file holds the complete state of the run at the end of a
+     cohort cycle, including the state that the integration method and
+     the cohort administration carry over to the next cycle, in full
+     binary precision. A run resumed from it (-r together with -c)
+     hence continues exactly as the interrupted run would have done.
+     Control variables and parameters are read from the CVF file as
+     usual; static variables in the problem-specific file are not saved.
+     Other runs can start from the CKP file as a snapshot (-w <file>),
+     e.g. to branch off scenarios after a common burn-in.
    HISTORY
      AMdR - Jul 20, 1995 : Created.
      AMdR - Feb 11, 2018 : Revised last.
@@ -15,14 +26,23 @@
 #define	EBTLIB					/* and file grouping        */
 
 #include "escbox.h"				/* Include general header   */
+#include "ebtinit.h"
 #include "ebtmain.h"
 #include "ebtstop.h"
 #include "ebtutils.h"
+#include "ebtcohrt.h"
 
 
 /* Bas Kooijman 2020/04/02 */
 #include "ebttint.h"
 
+#include <time.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 /*==========================================================================*/
 /*
  * The error messages that occur in the routines in the present file.
@@ -31,6 +51,28 @@
 #define ESF  "Unable to open ESF file for storing end state of populations!"
 #define REP  "Unable to open REP file for generating report file of the run!"
 #define MARN "Memory allocation failure in storing user defined report notes!"
+#define FCKP "No matching CKP file for resuming; Using ESF/ISF file instead!"
+#define MACK "Memory allocation failure in writing the CKP file!"
+#define MSNP "The snapshot to start from does not match the program!"
+#define OSNP "Unable to read the CKP file with the snapshot to start from!"
+#define WCKP "Unable to write the CKP file with the checkpoint of the run!"
+
+
+
+/*==========================================================================*/
+/*
+ * The layout of the CKP file. All values are stored as doubles: a header of
+ * CKP_HEADER values, the number of cohorts in every population, the state
+ * of the run, the cohort administration and the integration method, and
+ * finally the cohorts and their i-constants of every population.
+ */
+
+#define CKP_MAGIC_KEY	20261017.0
+#define CKP_HEADER	12			/* Magic key, dimensions,   */
+						/* block sizes and offsets  */
+						/* of the OUT and CSB file  */
+
+static EBTSTATE time_t	CkpLast = 0;		/* Time of last checkpoint  */
 
 
 
@@ -56,7 +98,11 @@ EXTERN_C int	ShutDown(int exitcode)
   FILE                  *esf;
 
   if (resfil) (void)fclose(resfil);		/* Close result file        */
+#if (POPULATION_NR > 0)
+  if (csbfil) WriteStateIndex(csbfil);		/* Index of the states      */
+#endif
   if (csbfil) (void)fclose(csbfil);		/* Close binary state file  */
+  resfil = csbfil = NULL;
 
 #if ((BIFURCATION == 1) && (MEASUREBIFSTATS == 1))
   if (averages)  (void)fclose(averages);	// Close bifurcation output
@@ -69,8 +115,8 @@ EXTERN_C int	ShutDown(int exitcode)
 						/* lower case extension     */
   (void)strcpy(filename, runname);
   (void)strcat(filename, "esf");
-  esf=fopen(filename, "w");
-  if(!esf)                                      /* On error try upper case  */
+  esf=(NoFiles ? NULL : fopen(filename, "w"));
+  if(!esf && !NoFiles)                          /* On error try upper case  */
     {
       (void)strcpy(filename, runname); (void)strcat(filename, "ESF");
       esf=fopen(filename, "w");
@@ -80,8 +126,18 @@ EXTERN_C int	ShutDown(int exitcode)
 #endif
     }
 
-  WriteStateToFile(esf, NULL);			/* Write state to .esf file */
-  (void)fclose(esf);                            /* Close end state file     */
+#if ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+  WakeDormant();				/* Return dormant cohorts   */
+#endif
+  if (esf)
+    {
+      WriteStateToFile(esf, NULL);		/* Write state to .esf file */
+      (void)fclose(esf);			/* Close end state file     */
+    }
+  if (EBTDEBUG(1)) MemReport(dbgfil);		/* Memory high-water marks  */
+#if (PLUGIN == 1)
+  UnloadModel();				/* Close the model library  */
+#endif
 
 #ifndef MODULE
   (void)strcpy(filename, runname);
@@ -89,6 +145,10 @@ EXTERN_C int	ShutDown(int exitcode)
   (void)fprintf(stderr, "\n\nRUN %-s COMPLETED at T = %.2f:\n", filename, env[0]);
   (void)fprintf(stderr, "** %-70s **\n\n", 
 	  "Program terminated. Normal closure of output files succeeded.");
+#if (AUTO_SWITCH == 1)
+  (void)fprintf(stderr, "Integration method switched %d times, final method %s\n\n",
+		MethodSwitches(), MethodName());
+#endif
 
   (void)fflush(stdout); 
   (void)fflush(stderr);
@@ -109,6 +169,411 @@ EXTERN_C int	ShutDown(int exitcode)
 
 
 
+/*==========================================================================*/
+
+static int	ExchangeRunState(double *data, int load)
+
+  /*
+   * ExchangeRunState - Copies the environment and the global state of the
+   *		        run at the end of a cohort cycle to data[] (load = 0),
+   *		        or loads it from there (load = 1). Returns the number
+   *		        of values.
+   */
+
+{
+  register int		i;
+  int			n = 0;
+
+  for (i=0; i<ENVIRON_DIM; i++) ExchangeVar(data, n, load, env[i]);
+  ExchangeVar(data, n, load, step_size);
+  ExchangeVar(data, n, load, next_cohort_end);
+  ExchangeVar(data, n, load, next_output);
+  ExchangeVar(data, n, load, next_state_output);
+  ExchangeVar(data, n, load, cohort_end);
+  ExchangeVar(data, n, load, ForcedCohortEnd);
+  ExchangeVar(data, n, load, ForcedRunEnd);
+  ExchangeVar(data, n, load, LocatedEvent);
+#if (POPULATION_NR > 0)
+  for (i=0; i<POPULATION_NR; i++) ExchangeVar(data, n, load, pop_extinct[i]);
+#endif
+
+  return n;
+}
+
+
+
+static long	FileEnd(FILE *fp)
+
+  /*
+   * FileEnd - Returns the size of the output file pointed to by fp, or -1
+   *	       if there is no such file.
+   */
+
+{
+  if (!fp) return -1L;
+  (void)fflush(fp);
+  if (fseek(fp, 0L, SEEK_END)) return -1L;
+
+  return ftell(fp);
+}
+
+
+
+void	TruncateFile(FILE *fp, double size)
+
+  /*
+   * TruncateFile - Discards the output written to the file pointed to by
+   *		    fp beyond its first size bytes, e.g. after a checkpoint.
+   */
+
+{
+  long			end = FileEnd(fp);
+
+  if ((size < 0.0) || (end <= (long)size)) return;
+#if defined(_WIN32)
+  (void)_chsize(_fileno(fp), (long)size);
+#else
+  (void)ftruncate(fileno(fp), (off_t)size);
+#endif
+  (void)fseek(fp, 0L, SEEK_END);
+
+  return;
+}
+
+
+
+/*==========================================================================*/
+
+void	Checkpoint(int final)
+
+  /*
+   * Checkpoint - Writes the complete state of the run to the CKP file, if
+   *		  at least checkpoint_int seconds have elapsed since the last
+   *		  checkpoint or if final is non-zero. Is called at the end of
+   *		  a cohort cycle only. The file is written under a temporary
+   *		  name first, such that an interrupted write leaves the
+   *		  previous checkpoint intact.
+   */
+
+{
+  register int		i;
+  char			filename[MAXFILENAMELEN], tmpname[MAXFILENAMELEN];
+  double		hdr[CKP_HEADER+POPULATION_NR+1], *data = NULL;
+  int			run_n, cycle_n, solver_n, writeOK;
+  time_t		now;
+  FILE			*ckp;
+
+  if (NoFiles || (checkpoint_int <= 0.0)) return;
+
+  now = time(NULL);
+  if (!CkpLast) CkpLast = now;
+  if ((!final) && (difftime(now, CkpLast) < checkpoint_int)) return;
+  CkpLast = now;
+
+  run_n    = ExchangeRunState(NULL, 0);
+  cycle_n  = ExchangeCycleState(NULL, 0);
+  solver_n = ExchangeSolver(NULL, 0);
+  data = (double *)Myalloc((void *)NULL, (size_t)(run_n+cycle_n+solver_n+1), sizeof(double));
+  if (!data)
+    {
+      Warning(MACK);
+      return;
+    }
+  (void)ExchangeRunState(data, 0);
+  (void)ExchangeCycleState(data+run_n, 0);
+  (void)ExchangeSolver(data+run_n+cycle_n, 0);
+
+  hdr[0]  = CKP_MAGIC_KEY;
+  hdr[1]  = ENVIRON_DIM;
+  hdr[2]  = POPULATION_NR;
+  hdr[3]  = I_STATE_DIM;
+  hdr[4]  = I_CONST_DIM;
+#if (SOLVER_REGISTRY == 1)
+  hdr[5]  = 0.0;
+#elif defined(TIME_METHOD)
+  hdr[5]  = TIME_METHOD;
+#else
+  hdr[5]  = RKCK;
+#endif
+  hdr[6]  = run_n;
+  hdr[7]  = cycle_n;
+  hdr[8]  = solver_n;
+  hdr[9]  = (double)FileEnd(resfil);
+  hdr[10] = (double)FileEnd(csbfil);
+  hdr[11] = env[0];
+#if (POPULATION_NR > 0)
+  for (i=0; i<POPULATION_NR; i++) hdr[CKP_HEADER+i] = CohortNo[i];
+#endif
+
+  (void)strcpy(filename, runname); (void)strcat(filename, "ckp");
+  (void)strcpy(tmpname, filename); (void)strcat(tmpname, ".tmp");
+  ckp = fopen(tmpname, "wb");
+  writeOK = (ckp != NULL);
+  if (writeOK)
+    writeOK = (fwrite((void *)hdr, sizeof(double), CKP_HEADER+POPULATION_NR, ckp) == (CKP_HEADER+POPULATION_NR));
+  if (writeOK)
+    writeOK = (fwrite((void *)data, sizeof(double), run_n+cycle_n+solver_n, ckp) == (size_t)(run_n+cycle_n+solver_n));
+#if (POPULATION_NR > 0)
+  for (i=0; (i<POPULATION_NR) && writeOK; i++)
+    {
+      if (!CohortNo[i]) continue;
+      writeOK = (fwrite((void *)pop[i], sizeof(double), CohortNo[i]*COHORT_SIZE, ckp) ==
+		 (size_t)(CohortNo[i]*COHORT_SIZE));
+#if (I_CONST_DIM > 0)
+      if (writeOK)
+	writeOK = (fwrite((void *)popIDcard[i], sizeof(double), CohortNo[i]*I_CONST_DIM, ckp) ==
+		   (size_t)(CohortNo[i]*I_CONST_DIM));
+#endif
+    }
+#endif // (POPULATION_NR > 0)
+  if (ckp && fclose(ckp)) writeOK = 0;
+  Myfree(data);
+
+#if defined(_WIN32)
+  if (writeOK) (void)remove(filename);		/* rename() does not replace*/
+#endif
+  if (writeOK) writeOK = !rename(tmpname, filename);
+  if (!writeOK)
+    {
+      (void)remove(tmpname);
+      Warning(WCKP);
+      return;
+    }
+
+  if (EBTDEBUG(1))
+    {
+      (void)fprintf(dbgfil, "Checkpoint written at T = %.4f\n", env[0]);
+      (void)fflush(dbgfil);
+    }
+
+  return;
+}
+
+
+
+/*==========================================================================*/
+
+double	*LoadSnapshot(const char *filename, long *len)
+
+  /*
+   * LoadSnapshot - Reads the CKP file "filename" into memory. Returns the
+   *		    image of the file and its number of doubles in len, or
+   *		    NULL if the file can not be read. The image is allocated
+   *		    with malloc(), such that it can be shared by the runs of
+   *		    an ensemble, and should be released with free().
+   */
+
+{
+  double		*image;
+  long			size;
+  FILE			*ckp;
+
+  ckp = fopen(filename, "rb");
+  if (!ckp) return NULL;
+
+  size = (fseek(ckp, 0L, SEEK_END) ? -1L : ftell(ckp));
+  if ((size <= 0L) || (size % sizeof(double)) || fseek(ckp, 0L, SEEK_SET))
+    {
+      (void)fclose(ckp);
+      return NULL;
+    }
+  image = (double *)malloc((size_t)size);
+  if (image && (fread((void *)image, 1, (size_t)size, ckp) != (size_t)size))
+    {
+      free(image);
+      image = NULL;
+    }
+  (void)fclose(ckp);
+  *len = size/sizeof(double);
+
+  return image;
+}
+
+
+
+/*==========================================================================*/
+
+int	RestoreSnapshot(const double *image, long len)
+
+  /*
+   * RestoreSnapshot - Restores the state of the run from the image of a
+   *		       CKP file with len doubles. Returns 1 on success and
+   *		       0, without changing any state, if the image does not
+   *		       match the program.
+   */
+
+{
+  register int		i;
+  CONST double		*data;
+  double		size;
+  int			run_n, cycle_n, solver_n, matchOK;
+
+  run_n    = ExchangeRunState(NULL, 0);
+  cycle_n  = ExchangeCycleState(NULL, 0);
+  solver_n = ExchangeSolver(NULL, 0);
+						/* Check the image before   */
+  matchOK = (len >= (CKP_HEADER+POPULATION_NR));/* changing any state       */
+  matchOK = matchOK && (image[0] == CKP_MAGIC_KEY) && (image[1] == ENVIRON_DIM) && (image[2] == POPULATION_NR) &&
+    (image[3] == I_STATE_DIM) && (image[4] == I_CONST_DIM) &&
+    (image[6] == run_n) && (image[7] == cycle_n) && (image[8] == solver_n);
+#if (SOLVER_REGISTRY == 1)
+  matchOK = matchOK && (image[5] == 0.0);
+#elif defined(TIME_METHOD)
+  matchOK = matchOK && (image[5] == TIME_METHOD);
+#else
+  matchOK = matchOK && (image[5] == RKCK);
+#endif
+  if (!matchOK) return 0;
+
+  size = CKP_HEADER+POPULATION_NR+run_n+cycle_n+solver_n;
+  for (i=0; i<POPULATION_NR; i++) size += image[CKP_HEADER+i]*(COHORT_SIZE+I_CONST_DIM);
+  if (size != (double)len) return 0;
+
+  data = image+CKP_HEADER+POPULATION_NR;
+  (void)ExchangeRunState((double *)data, 1);
+  (void)ExchangeCycleState((double *)(data+run_n), 1);
+  (void)ExchangeSolver((double *)(data+run_n+cycle_n), 1);
+  data += run_n+cycle_n+solver_n;
+
+#if (POPULATION_NR > 0)
+  for (i=0; i<POPULATION_NR; i++)
+    {
+      CohortNo[i] = cohort_no[i] = 0;
+      if (!image[CKP_HEADER+i]) continue;
+      (void)AddCohorts(pop, i, (int)image[CKP_HEADER+i]);
+#ifdef MODULE
+      if (error_code & FATAL_ERROR) return 0;
+#endif
+      (void)memcpy((DEF_TYPE *)pop[i], (DEF_TYPE *)data, CohortNo[i]*COHORT_SIZE*sizeof(double));
+      data += CohortNo[i]*COHORT_SIZE;
+#if (I_CONST_DIM > 0)
+      (void)memcpy((DEF_TYPE *)popIDcard[i], (DEF_TYPE *)data, CohortNo[i]*I_CONST_DIM*sizeof(double));
+      data += CohortNo[i]*I_CONST_DIM;
+#endif
+    }
+#endif // (POPULATION_NR > 0)
+
+  return 1;
+}
+
+
+
+/*==========================================================================*/
+
+int	RestoreCheckpoint(void)
+
+  /*
+   * RestoreCheckpoint - Restores the state of the run from the CKP file
+   *			 when resuming, after the ESF file has been read by
+   *			 Initialize(), and truncates the OUT and CSB file to
+   *			 their size at the checkpoint. Returns 1 on success
+   *			 and 0 if the ESF file state has to be used instead.
+   */
+
+{
+  char			filename[MAXFILENAMELEN];
+  double		*image;
+  long			len = 0L;
+
+  CkpLast = time(NULL);
+
+  (void)strcpy(filename, runname); (void)strcat(filename, "ckp");
+  image = LoadSnapshot(filename, &len);
+  if (!(image && RestoreSnapshot(image, len)))
+    {
+      free(image);
+#ifdef MODULE
+      if (error_code & FATAL_ERROR) return 0;
+#endif
+      Warning(FCKP);
+      return 0;
+    }
+
+  TruncateFile(resfil, image[9]);
+  TruncateFile(csbfil, image[10]);
+  if (csbfil && (image[10] == 0.0))		/* CSB header not written yet*/
+    {
+      csbnew	 = 1;
+      csbversion = CSB_VERSION;
+    }
+  if (resfil && BinaryOut && (image[9] == 0.0)) bofnew = 1;
+  free(image);
+
+  if (EBTDEBUG(1))
+    {
+      (void)fprintf(dbgfil, "Checkpoint restored at T = %.4f\n", env[0]);
+      (void)fflush(dbgfil);
+    }
+
+  return 1;
+}
+
+
+
+/*==========================================================================*/
+
+int	WarmStart(void)
+
+  /*
+   * WarmStart - Starts the run from the snapshot of another run: the CKP
+   *		 file given with -w, or the snapshot shared by the branches
+   *		 of an ensemble (see EbtBranch() in ebtmain.c). The state of
+   *		 the run is replaced by that of the snapshot, while the
+   *		 parameters and forcing tables of the run itself take effect
+   *		 from the time of the snapshot on. Output starts at that
+   *		 time. Returns 1 if a snapshot has been restored.
+   */
+
+{
+  CONST double		*snapshot = NULL;
+  double		*image = NULL;
+  long			len = 0L;
+  int			restored;
+
+#if (ENSEMBLE == 1)
+  if (ens_member && ens_member->snapshot)
+    {
+      snapshot = ens_member->snapshot;
+      len      = ens_member->snapshot_len;
+    }
+#endif
+  if (!snapshot && *warmname) snapshot = image = LoadSnapshot(warmname, &len);
+  if (!snapshot)
+    {
+      if (*warmname) ErrorAbort(OSNP);
+      return 0;
+    }
+
+  restored = RestoreSnapshot(snapshot, len);
+  free(image);
+#ifdef MODULE
+  if (error_code & FATAL_ERROR) return 0;
+#endif
+  if (!restored)
+    {
+      ErrorAbort(MSNP);
+      return 0;
+    }
+  CkpLast = time(NULL);
+						/* Output from now on at    */
+  next_output =					/* the intervals of the run */
+      (floor((env[0]-identical_zero)/delt_out)+1)*delt_out;
+  if (state_out > 0.0)
+      next_state_output =
+	  (floor((env[0]-identical_zero)/state_out)+1)*state_out;
+  else next_state_output = 0.0;
+
+  if (EBTDEBUG(1))
+    {
+      (void)fprintf(dbgfil, "Warm start from snapshot at T = %.4f\n", env[0]);
+      (void)fflush(dbgfil);
+    }
+
+  return 1;
+}
+
+
+
 /*==========================================================================*/
 
 void ReportNote(const char *fmt, ...)
@@ -116,7 +581,7 @@ void ReportNote(const char *fmt, ...)
 {
   va_list		argpnt;
   register int		i;
-  static int		lines = 0, count = 0;
+  static EBTSTATE int	lines = 0, count = 0;
   
   if ((!usernotes) || (count >= (lines-1)))
     {
@@ -182,6 +647,9 @@ void	  WriteReport(int argc, char **argv)
   (void)fprintf(rep, "\n%2s%-s\n", " ", "PROGRAM, RUN AND ARGUMENTS");
   (void)fprintf(rep, "%4sProgram   : %-s\n", " ", progname);
   (void)fprintf(rep, "%4sRun       : %-s\n", " ", filename);
+#if (PLUGIN == 1)
+  (void)fprintf(rep, "%4sModel     : %-s\n", " ", pluginname);
+#endif
   (void)fprintf(rep, "%4sArguments : ", " ");
   for (i=2; i<argc; i++) (void)fprintf(rep, " %-s", argv[i]);
   (void)fprintf(rep, "\n");
@@ -200,7 +668,9 @@ void	  WriteReport(int argc, char **argv)
   (void)fprintf(rep, "\n%2s%-s\n", " ", "USED VALUES FOR CONTROL VARIABLES");
   (void)fprintf(rep, "%4s%-65s%5s%-s\n", " ", 
 		"Time integration method", "  :  ",
-#if    (TIME_METHOD ==  RK2)
+#if    (SOLVER_REGISTRY == 1)
+		MethodName());
+#elif  (TIME_METHOD ==  RK2)
                 "RK2");
 #elif  (TIME_METHOD ==  RK4)
                 "RK4");
@@ -214,6 +684,10 @@ void	  WriteReport(int argc, char **argv)
                 "DOPRI8");
 #elif  (TIME_METHOD ==  RADAU5)
                 "RADAU5");
+#elif  (TIME_METHOD ==  CVODE)
+                "CVODE (ADAMS)");
+#elif  (TIME_METHOD ==  CVBDF)
+                "CVODE (BDF)");
 #else
 		"RKCK");
 #endif
@@ -221,6 +695,14 @@ void	  WriteReport(int argc, char **argv)
 		description.accuracy, "  :  ", accuracy);
   (void)fprintf(rep, "%4s%-65s%5s%-10.4G\n", " ", 
 		description.cohort_limit, "  :  ", cohort_limit);
+#if (ADAPT_COH_LIMIT == 1)
+  (void)fprintf(rep, "%4s%-65s%5s%-10.4G\n", " ", 
+		description.min_coh_limit, "  :  ", min_coh_limit);
+  (void)fprintf(rep, "%4s%-65s%5s%-10.4G\n", " ", 
+		description.max_coh_limit, "  :  ", max_coh_limit);
+  (void)fprintf(rep, "%4s%-65s%5s%-10.4G\n", " ", 
+		description.target_cohorts, "  :  ", target_cohorts);
+#endif // (ADAPT_COH_LIMIT == 1)
   (void)fprintf(rep, "%4s%-65s%5s%-10.4G\n", " ", 
 		description.identical_zero, "  :  ", identical_zero);
 
@@ -260,6 +742,14 @@ void	  WriteReport(int argc, char **argv)
 	  (void)fprintf(rep, "%-7.4G", abs_tols[i][i_state(j)]);
       (void)fprintf(rep, "\n");
     }
+
+#if (COHORT_BUDGET == 1)
+  (void)fprintf(rep, "%4s%-65s%5s", " ",
+		description.max_cohorts, "  :  ");
+  for(i=0; i<POPULATION_NR; i++)
+      (void)fprintf(rep, "%-7d", max_cohorts[i]);
+  (void)fprintf(rep, "\n");
+#endif // (COHORT_BUDGET == 1)
 #endif // (POPULATION_NR > 0)
   
 #if PARAMETER_NR
@@ -22,6 +22,12 @@
 #define EXTERN	extern
 #endif
 EXTERN   void	WriteReport(int, char **);
+EXTERN   void	Checkpoint(int);
+EXTERN   int	RestoreCheckpoint(void);
+EXTERN   void	TruncateFile(FILE *, double);
+EXTERN   double	*LoadSnapshot(const char *, long *);
+EXTERN   int	RestoreSnapshot(const double *, long);
+EXTERN   int	WarmStart(void);
 
 #ifndef MODULE
 EXTERN_C void	ShutDown(int);
@@ -9,10 +9,23 @@
      routines: PrepareCycle() and IntegrationStep(). These are called by
      NewCohort() to integrate all the variables during the time interval
      between cohort closures. Cohort cycles end at regularly spaced points in
-     time or when forced by the ForceCohortEnd() routine (DOPRI5, DOPRI8 and
-     RADAU5 methods only).
+     time or when forced by the ForceCohortEnd() routine (DOPRI5, DOPRI8,
+     RADAU5, CVODE and CVBDF methods only).
    NOTES
-     
+     With SOLVER_REGISTRY equal to 1 all methods are linked into the
+     program and the method is selected at run time (-m <method>). The
+     present file is then compiled once as usual, which yields the
+     dispatching PrepareCycle() and IntegrationStep(), and once for every
+     method with -DINTEGRATOR=<method>, e.g.
+
+       gcc -DPROBLEMFILE=... -DINTEGRATOR=DOPRI5 -o ebtdopri5.o -c ebttint.c
+
+     for RK2, RK4, RKF45, RKCK, DOPRI5, DOPRI8, RADAU5, CVODE and CVBDF.
+     The methods keep their state in file-static variables and can hence
+     not share a single object file.
+     With AUTO_SWITCH equal to 1 the program switches from DOPRI5 to RADAU5
+     when DOPRI5 detects stiffness and back when RADAU5 finds the problem
+     non-stiff again, at the start of the next cohort cycle.
    HISTORY
      AMdR - Nov 08, 1998 : Created.
      AMdR - Jan 08, 2014 : Revised last.
@@ -29,6 +42,364 @@
 /* Bas Kooijman 2020/04/02 */
 #include "ebttint.h"
 
+#if ((SOLVER_REGISTRY == 1) && !defined(INTEGRATOR))
+#define EBTREGISTRY				/* Dispatch to all methods  */
+#endif
+
+#if ((COHORT_LAYOUT == SOA) && !defined(EBTREGISTRY))
+/*==========================================================================*/
+/*
+ * With COHORT_LAYOUT equal to SOA the routine Gradient() in the problem
+ * file receives the i-states of the internal and boundary cohorts of every
+ * population as contiguous columns (see COHORT_VAR and BPOINT_VAR in
+ * escbox.h). The integration methods and the cohort administration keep
+ * the cohort records. SoAGradient() transposes the state to columns before
+ * and the derivatives back to records after the call to Gradient(), and is
+ * called by the integration methods instead of Gradient().
+ */
+
+#define SOAF "Memory allocation failure in structure-of-arrays Gradient()!"
+
+#if (POPULATION_NR > 0)
+static EBTSTATE long		SoAAllocated = 0L;
+static EBTSTATE double		*SoAstate = NULL, *SoAgrad = NULL;
+static EBTSTATE population	SoApop[POPULATION_NR],     SoAofs[POPULATION_NR];
+static EBTSTATE population	SoApopgrad[POPULATION_NR], SoAofsgrad[POPULATION_NR];
+static EBTSTATE population	SoAbpoints[POPULATION_NR];
+
+
+
+static void	ToColumns(double *RESTRICT col, CONST double *RESTRICT rec, int n)
+
+  /*
+   * ToColumns - Copies n cohort records rec[] to the COHORT_SIZE columns
+   *		 of length n in col[].
+   */
+
+{
+  register int			i, k;
+
+  for (i=0; i<n; i++)
+    for (k=0; k<COHORT_SIZE; k++) col[k*n+i] = rec[i*COHORT_SIZE+k];
+
+  return;
+}
+
+
+
+static void	ToRecords(double *RESTRICT rec, CONST double *RESTRICT col, int n)
+
+  /*
+   * ToRecords - Copies the COHORT_SIZE columns of length n in col[] to the
+   *		 n cohort records in rec[].
+   */
+
+{
+  register int			i, k;
+
+  for (i=0; i<n; i++)
+    for (k=0; k<COHORT_SIZE; k++) rec[i*COHORT_SIZE+k] = col[k*n+i];
+
+  return;
+}
+#endif // (POPULATION_NR > 0)
+
+
+
+static void	SoAGradient(double *env, population *pop, population *ofs,
+			    double *envgrad, population *popgrad,
+			    population *ofsgrad, population *bpoints)
+
+{
+#if (POPULATION_NR > 0)
+  register int			p;
+  long				len, org;
+
+  len = 0L;
+  for (p=0; p<POPULATION_NR; p++)
+    len += (cohort_no[p] + 2*bpoint_no[p])*COHORT_SIZE;
+  if (!(len < SoAAllocated))
+    {
+      SoAAllocated = MemBlocks(len);
+      SoAstate = (double *)Myalloc((void *)SoAstate, (size_t)SoAAllocated,
+				   sizeof(double));
+      SoAgrad  = (double *)Myalloc((void *)SoAgrad, (size_t)SoAAllocated,
+				   sizeof(double));
+      if (!(SoAstate && SoAgrad)) ErrorAbort(SOAF);
+    }
+  (void)memset((DEF_TYPE *)SoAgrad, 0, (size_t)(len*sizeof(double)));
+
+  org = 0L;
+  for (p=0; p<POPULATION_NR; p++)
+    {
+      SoApop[p]     = (population)(SoAstate+org);
+      SoApopgrad[p] = (population)(SoAgrad+org);
+      ToColumns(SoAstate+org, pop[p][0], cohort_no[p]);
+      org += cohort_no[p]*COHORT_SIZE;
+
+      SoAofs[p]     = (population)(SoAstate+org);
+      SoAofsgrad[p] = (population)(SoAgrad+org);
+      ToColumns(SoAstate+org, ofs[p][0], bpoint_no[p]);
+      org += bpoint_no[p]*COHORT_SIZE;
+
+      SoAbpoints[p] = (population)(SoAstate+org);
+      ToColumns(SoAstate+org, bpoints[p][0], bpoint_no[p]);
+      org += bpoint_no[p]*COHORT_SIZE;
+    }
+
+  Gradient(env, SoApop, SoAofs, envgrad, SoApopgrad, SoAofsgrad, SoAbpoints);
+
+  for (p=0; p<POPULATION_NR; p++)
+    {
+      ToRecords(popgrad[p][0], (double *)SoApopgrad[p], cohort_no[p]);
+      ToRecords(ofsgrad[p][0], (double *)SoAofsgrad[p], bpoint_no[p]);
+    }
+#else
+  Gradient(env, pop, ofs, envgrad, popgrad, ofsgrad, bpoints);
+#endif // (POPULATION_NR > 0)
+
+  return;
+}
+
+#undef  Gradient
+#define Gradient	SoAGradient
+#endif // ((COHORT_LAYOUT == SOA) && !defined(EBTREGISTRY))
+
+#if defined(EBTREGISTRY)
+/*==========================================================================*/
+/*
+ * The integrator registry. Every method is compiled into its own object
+ * file (see NOTES above). PrepareCycle() and IntegrationStep() dispatch to
+ * the method selected by SelectMethod(), which by default is TIME_METHOD.
+ */
+
+typedef struct
+{
+  CONST char			*name;		/* Name on command line     */
+  CONST char			*label;		/* Name in report file      */
+  int				events;		/* Locates events and ends  */
+						/* cohort cycles when forced*/
+  void				(*prepare)(void);
+  double			(*step)(double, double, int);
+  int				(*exchange)(double *, int);
+} integrator;
+
+extern void	RK2PrepareCycle(void);
+extern double	RK2IntegrationStep(double, double, int);
+extern void	RK4PrepareCycle(void);
+extern double	RK4IntegrationStep(double, double, int);
+extern void	RKF45PrepareCycle(void);
+extern double	RKF45IntegrationStep(double, double, int);
+extern void	RKCKPrepareCycle(void);
+extern double	RKCKIntegrationStep(double, double, int);
+extern void	DOPRI5PrepareCycle(void);
+extern double	DOPRI5IntegrationStep(double, double, int);
+extern int	DOPRI5ExchangeSolver(double *, int);
+extern void	DOPRI8PrepareCycle(void);
+extern double	DOPRI8IntegrationStep(double, double, int);
+extern int	DOPRI8ExchangeSolver(double *, int);
+extern void	RADAU5PrepareCycle(void);
+extern double	RADAU5IntegrationStep(double, double, int);
+extern int	RADAU5ExchangeSolver(double *, int);
+extern void	CVODEPrepareCycle(void);
+extern double	CVODEIntegrationStep(double, double, int);
+extern int	CVODEExchangeSolver(double *, int);
+extern void	CVBDFPrepareCycle(void);
+extern double	CVBDFIntegrationStep(double, double, int);
+extern int	CVBDFExchangeSolver(double *, int);
+#if ((AUTO_SWITCH == 1) && (EVENT_NR > 0))
+extern void	DOPRI5ExchangeEvents(double *, int *, int);
+extern void	RADAU5ExchangeEvents(double *, int *, int);
+#endif
+
+/*
+ * The entries are ordered by their key values RK2, ..., CVBDF
+ */
+static integrator	methods[] =
+{
+  {"RK2",    "RK2",           0, RK2PrepareCycle,    RK2IntegrationStep,    NULL},
+  {"RK4",    "RK4",           0, RK4PrepareCycle,    RK4IntegrationStep,    NULL},
+  {"RKF45",  "RKF45",         0, RKF45PrepareCycle,  RKF45IntegrationStep,  NULL},
+  {"RKCK",   "RKCK",          0, RKCKPrepareCycle,   RKCKIntegrationStep,   NULL},
+  {"DOPRI5", "DOPRI5",        1, DOPRI5PrepareCycle, DOPRI5IntegrationStep, DOPRI5ExchangeSolver},
+  {"DOPRI8", "DOPRI8",        1, DOPRI8PrepareCycle, DOPRI8IntegrationStep, DOPRI8ExchangeSolver},
+  {"RADAU5", "RADAU5",        1, RADAU5PrepareCycle, RADAU5IntegrationStep, RADAU5ExchangeSolver},
+  {"CVODE",  "CVODE (ADAMS)", 1, CVODEPrepareCycle,  CVODEIntegrationStep,  CVODEExchangeSolver},
+  {"CVBDF",  "CVODE (BDF)",   1, CVBDFPrepareCycle,  CVBDFIntegrationStep,  CVBDFExchangeSolver}
+};
+
+static EBTSTATE int	method = TIME_METHOD - RK2;
+#if (AUTO_SWITCH == 1)
+static EBTSTATE int	next_method = -1, switch_no = 0;
+#endif
+
+
+
+int	SelectMethod(CONST char *name)
+
+  /*
+   * SelectMethod - Selects the integration method with the given name for
+   *		    all subsequent cohort cycles. Returns 1 on success, 0 if
+   *		    the method is unknown and -1 if the method can not locate
+   *		    the events or end the cohort cycles that the problem
+   *		    requires.
+   */
+
+{
+  register int			i;
+
+  for (i=0; i<(int)(sizeof(methods)/sizeof(integrator)); i++)
+    if (!strcmp(name, methods[i].name)) break;
+  if (i == (int)(sizeof(methods)/sizeof(integrator))) return 0;
+
+#if ((EVENT_NR > 0) || (DYNAMIC_COHORTS == 1))
+  if (!methods[i].events) return -1;
+#endif
+
+  method = i;
+
+  return 1;
+}
+
+
+
+CONST char	*MethodName(void)
+
+{
+  return methods[method].label;
+}
+
+
+
+#if (AUTO_SWITCH == 1)
+void	NoteStiffness(int stiff)
+
+  /*
+   * NoteStiffness - Called by DOPRI5 when the problem becomes stiff
+   *		     (stiff = 1) and by RADAU5 when it becomes non-stiff
+   *		     (stiff = 0). The other method takes over at the start of
+   *		     the next cohort cycle.
+   */
+
+{
+  if (stiff && (method == (DOPRI5 - RK2)))
+    next_method = RADAU5 - RK2;
+  else if ((!stiff) && (method == (RADAU5 - RK2)))
+    next_method = DOPRI5 - RK2;
+
+  return;
+}
+
+
+
+static void	SwitchMethod(void)
+
+  /*
+   * SwitchMethod - Switches to the method requested by NoteStiffness(). The
+   *		    methods restart from the cohort state in every cycle, but
+   *		    the state of the event location is handed over, such that
+   *		    an event located at the end of the previous cycle is not
+   *		    located once more.
+   */
+
+{
+#if (EVENT_NR > 0)
+  double			ELvalue[EVENT_NR];
+  int				loc[EVENT_NR];
+
+  if (method == (DOPRI5 - RK2))
+    {
+      DOPRI5ExchangeEvents(ELvalue, loc, 0);
+      RADAU5ExchangeEvents(ELvalue, loc, 1);
+    }
+  else
+    {
+      RADAU5ExchangeEvents(ELvalue, loc, 0);
+      DOPRI5ExchangeEvents(ELvalue, loc, 1);
+    }
+#endif // (EVENT_NR > 0)
+
+  if (EBTDEBUG(1))
+    {
+      (void)fprintf(dbgfil, "Switching from %s to %s at T = %.4f\n",
+		    methods[method].name, methods[next_method].name, env[0]);
+      fflush(dbgfil);
+    }
+  method      = next_method;
+  next_method = -1;
+  switch_no++;
+
+  return;
+}
+
+
+
+int	MethodSwitches(void)
+
+  /*
+   * MethodSwitches - Returns the number of switches between DOPRI5 and
+   *		      RADAU5 so far.
+   */
+
+{
+  return switch_no;
+}
+#endif // (AUTO_SWITCH == 1)
+
+
+
+void	PrepareCycle()
+
+{
+#if (AUTO_SWITCH == 1)
+  if (next_method >= 0) SwitchMethod();
+#endif
+  (*methods[method].prepare)();
+
+  return;
+}
+
+
+
+double	IntegrationStep(double del_tim, double del_max, int recurs)
+
+{
+  return (*methods[method].step)(del_tim, del_max, recurs);
+}
+
+
+
+int	ExchangeSolver(double *data, int load)
+
+  /*
+   * ExchangeSolver - Copies the selected method and the state of all
+   *		      methods to data[] (load = 0) or loads them from there
+   *		      (load = 1), as every method may be selected in a later
+   *		      cohort cycle. Returns the number of values.
+   */
+
+{
+  register int			i;
+  int				n = 0;
+#if (AUTO_SWITCH == 1)
+  int				next = next_method;
+#else
+  int				next = -1;
+#endif
+
+  ExchangeVar(data, n, load, method);
+  ExchangeVar(data, n, load, next);
+#if (AUTO_SWITCH == 1)
+  next_method = next;
+#endif
+  for (i=0; i<(int)(sizeof(methods)/sizeof(integrator)); i++)
+    if (methods[i].exchange) n += (*methods[i].exchange)(data ? data+n : NULL, load);
+
+  return n;
+}
+
+#else
+
 /*==========================================================================*/
 /*
  * Including the file with the selected time integration method
@@ -37,6 +408,53 @@
 #ifndef TIME_METHOD
 #define TIME_METHOD	RKCK
 #endif /* TIME_METHOD */
+
+#if defined(INTEGRATOR)
+/*
+ * Registry member: the method INTEGRATOR exports its routines under names
+ * prefixed with the method name.
+ */
+#undef  TIME_METHOD
+#define TIME_METHOD	INTEGRATOR
+#if    (INTEGRATOR ==  RK2)
+#define PrepareCycle	RK2PrepareCycle
+#define IntegrationStep	RK2IntegrationStep
+#elif  (INTEGRATOR ==  RK4)
+#define PrepareCycle	RK4PrepareCycle
+#define IntegrationStep	RK4IntegrationStep
+#elif  (INTEGRATOR ==  RKF45)
+#define PrepareCycle	RKF45PrepareCycle
+#define IntegrationStep	RKF45IntegrationStep
+#elif  (INTEGRATOR ==  RKCK)
+#define PrepareCycle	RKCKPrepareCycle
+#define IntegrationStep	RKCKIntegrationStep
+#elif  (INTEGRATOR ==  DOPRI5)
+#define PrepareCycle	DOPRI5PrepareCycle
+#define IntegrationStep	DOPRI5IntegrationStep
+#define ExchangeSolver	DOPRI5ExchangeSolver
+#define ExchangeEvents	DOPRI5ExchangeEvents
+#elif  (INTEGRATOR ==  DOPRI8)
+#define PrepareCycle	DOPRI8PrepareCycle
+#define IntegrationStep	DOPRI8IntegrationStep
+#define ExchangeSolver	DOPRI8ExchangeSolver
+#elif  (INTEGRATOR ==  RADAU5)
+#define PrepareCycle	RADAU5PrepareCycle
+#define IntegrationStep	RADAU5IntegrationStep
+#define ExchangeSolver	RADAU5ExchangeSolver
+#define ExchangeEvents	RADAU5ExchangeEvents
+#elif  (INTEGRATOR ==  CVODE)
+#define PrepareCycle	CVODEPrepareCycle
+#define IntegrationStep	CVODEIntegrationStep
+#define ExchangeSolver	CVODEExchangeSolver
+#elif  (INTEGRATOR ==  CVBDF)
+#define PrepareCycle	CVBDFPrepareCycle
+#define IntegrationStep	CVBDFIntegrationStep
+#define ExchangeSolver	CVBDFExchangeSolver
+#else
+#error Unknown integration method INTEGRATOR!
+#endif
+#endif // defined(INTEGRATOR)
+
 #if    (TIME_METHOD ==  RK2)
 #include "ebtrk2.c"
 #elif  (TIME_METHOD ==  RK4)
@@ -59,6 +477,22 @@
 #error Internal EBT error: TIME_METHOD not specified!
 #endif
 
+#if ((TIME_METHOD <= RKCK) && !defined(INTEGRATOR))
+/*==========================================================================*/
+
+int	ExchangeSolver(double *data, int load)
+
+  /*
+   * ExchangeSolver - The Runge-Kutta methods start every cohort cycle
+   *		      afresh and have no state to store in a checkpoint.
+   */
+
+{
+  return 0;
+}
+#endif
+#endif // defined(EBTREGISTRY)
+
 
 
 /*==============================================================================*/
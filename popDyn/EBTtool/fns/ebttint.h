@@ -23,6 +23,15 @@
 
 EXTERN void	PrepareCycle(void);
 EXTERN double	IntegrationStep(double, double, int);
+EXTERN int	ExchangeSolver(double *, int);
+#if (SOLVER_REGISTRY == 1)
+EXTERN int	SelectMethod(CONST char *);
+EXTERN CONST char *MethodName(void);
+#endif
+#if (AUTO_SWITCH == 1)
+EXTERN void	NoteStiffness(int);
+EXTERN int	MethodSwitches(void);
+#endif
 
 
 /*===========================================================================*/
@@ -19,13 +19,16 @@
 //#include  "fenv.h"
 //#endif
 
-const int END_OF_COHORT = 0x01;		// 1
-const int NORMAL_OUT = 0x02;		// 2
-const int STATE_OUT = 0x04;		// 4
-const int WARNING = 0x08;		// 8
-const int NON_FATAL_ERROR = 0x10;	// 16
-const int FATAL_ERROR = 0x20;		// 32
-const int LIB_NOT_LOADED = 0x40;        // 64
-const int FPE_ERROR = 0x80;		// 128
+enum
+{
+  END_OF_COHORT = 0x01,		// 1
+  NORMAL_OUT = 0x02,		// 2
+  STATE_OUT = 0x04,		// 4
+  WARNING = 0x08,		// 8
+  NON_FATAL_ERROR = 0x10,	// 16
+  FATAL_ERROR = 0x20,		// 32
+  LIB_NOT_LOADED = 0x40,	// 64
+  FPE_ERROR = 0x80		// 128
+};
 
 #endif // EBTTOOLDEFS_H 
@@ -60,15 +60,102 @@
 #endif
 
 /*
- * HAS_MALLINFO determines whether the mallinfo structure is available
- * on this system.
+ * HAS_HUGEPAGES determines whether large memory blocks can be backed by
+ * transparent huge pages using madvise(MADV_HUGEPAGE) on this system.
  *
  * Default: no, unless Linux is the operating system
  *
  */
-#ifndef HAS_MALLINFO
-#define HAS_MALLINFO	0
+#ifndef HAS_HUGEPAGES
+#define HAS_HUGEPAGES	0
 #endif
+
+/*
+ * HAS_PTHREADS determines whether POSIX threads are available on this
+ * system. If not, ParallelFor() and ParallelSum() run on a single thread.
+ *
+ * Default: yes, if Linux or macOS is the operating system, otherwise no.
+ *
+ */
+#ifndef HAS_PTHREADS
+#if defined(__linux__) || defined(__APPLE__)
+#define HAS_PTHREADS		1
+#else
+#define HAS_PTHREADS		0
+#endif
+#endif
+
+/*
+ * HAS_DLOPEN determines whether shared libraries can be loaded at run time
+ * with dlopen() and resolve symbols of the program that loads them, as
+ * required by PLUGIN.
+ *
+ * Default: yes, if Linux or macOS is the operating system, otherwise no.
+ *
+ */
+#ifndef HAS_DLOPEN
+#if defined(__linux__) || defined(__APPLE__)
+#define HAS_DLOPEN		1
+#else
+#define HAS_DLOPEN		0
+#endif
+#endif
+
+/*
+ * RESTRICT expands to the restrict qualifier of C99, which tells the
+ * compiler that pointers do not alias, if the compiler supports it.
+ *
+ * Default: yes, if using gcc or MSVC, otherwise no.
+ *
+ */
+#ifndef RESTRICT
+#if defined(__GNUC__)
+#define RESTRICT		__restrict__
+#elif defined(_MSC_VER)
+#define RESTRICT		__restrict
+#else
+#define RESTRICT
+#endif
+#endif
+
+/*
+ * THREAD_LOCAL expands to the storage class specifier that gives every
+ * thread its own instance of a variable, if the compiler supports it.
+ * It is left undefined otherwise, and REENTRANT builds then stop with
+ * an error.
+ *
+ * Default: yes, if using gcc, MSVC or a C11/C++11 compiler, otherwise no.
+ *
+ */
+#ifndef THREAD_LOCAL
+#if defined(__cplusplus) && (__cplusplus >= 201103L)
+#define THREAD_LOCAL		thread_local
+#elif defined(__GNUC__)
+#define THREAD_LOCAL		__thread
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL		__declspec(thread)
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+#define THREAD_LOCAL		_Thread_local
+#endif
+#endif
+
+/*
+ * SIMD_DISPATCH is a function attribute that makes the compiler generate
+ * AVX-512, AVX2 and generic versions of the numerical kernels of the
+ * integration methods, the fastest of which is selected at run time.
+ * Define it as empty to only generate the generic version.
+ *
+ * Default: yes, if using gcc (>= 6) on x86-64 Linux, otherwise no.
+ *
+ */
+#ifndef SIMD_DISPATCH
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && \
+    defined(__x86_64__) && defined(__linux__)
+#define SIMD_DISPATCH		__attribute__((target_clones("avx512f", "avx2", "default"), \
+				       optimize("O3", "fp-contract=off")))
+#endif
+#endif
+
 /*
  * To avoid name mangling of exported function when compiling with a C++ 
  * compiler:
@@ -89,8 +176,8 @@
 #undef  HAS_SIGNALS
 #define HAS_SIGNALS		1
 typedef 			void (*sighandler)(int);     
-#undef  HAS_MALLINFO
-#define HAS_MALLINFO		1
+#undef  HAS_HUGEPAGES
+#define HAS_HUGEPAGES		1
 /*
  * The following settings are supposed to be valid for MS Windows systems
  */
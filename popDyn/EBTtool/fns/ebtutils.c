@@ -6,7 +6,23 @@
      all low level routines that are processing memory allocation
      requests and issuing error and warning messages. The routines are
      called from a number of different modules.
+
+     The file furthermore contains the routines ParallelFor() and
+     ParallelSum(), which distribute the iterations of a loop over the
+     threads of a persistent pool.
    NOTES
+     With the command line option -b FileOut() writes the output in binary
+     format to the BOF file instead of the OUT file, see WriteBinOutput().
+
+     FileState() writes the indexed CSB format (see ebtcsbdefs.h), unless
+     CSB_VERSION is 1 or the states are appended to a CSB file in the
+     original format.
+
+     The iterations of ParallelFor() and ParallelSum() are divided in blocks
+     of fixed size, which only depends on the number of iterations. The
+     partial sums of the blocks in ParallelSum() are added in the order of
+     the blocks, such that the result does not depend on the number of
+     threads.
 
    HISTORY
      AMdR - Jul 19, 1995 : Created.
@@ -19,6 +35,7 @@
 #include "ebtmain.h"
 #include "ebtstop.h"
 #include "ebtutils.h"
+#include "ebtcohrt.h"
 
 /* Bas Kooijman 2020/04/02 */
 #include "ebttint.h"
@@ -30,13 +47,27 @@
 #define EBTDEBUG(a)	0
 #endif
 
-#if (HAS_MALLINFO && EBTDEBUG(5))
+#include <time.h>
+
+#if defined(_WIN32)
 #include "malloc.h"
-#endif /* HAS_MALLINFO */
+#endif
+
+#if (MEM_HUGE_PAGES && HAS_HUGEPAGES)
+#include <sys/mman.h>
+#endif
+
+#if HAS_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif /* HAS_PTHREADS */
 
 // Magic key of the type of CSB file written
 const uint32_t		CSB_MAGIC_KEY = 20030509;
 
+// Magic key of the binary output (BOF) file, unlike those of the CSB and CKP files
+const uint32_t		BOF_MAGIC_KEY = 20261020;
+
 
 
 /*==========================================================================*/
@@ -44,11 +75,14 @@ const uint32_t		CSB_MAGIC_KEY = 20030509;
  * The error messages that occur in the routines in the present file.
  */
 
+#define EBOF "Error writing to BOF file. Further output will be disabled!"
 #define ECSB "Error writing to CSB file. Further state output will be disabled!"
 #define IPAC "Invalid population number in request to add cohorts: AddCohorts()!"
 #define ICAC "Invalid cohort number in request to add cohorts: AddCohorts()!"
 #define MAFC "Memory allocation failure for cohort variables!"
 #define MAFI "Memory allocation failure for cohort constants!"
+#define MAFP "Memory allocation failure for partial sums of parallel loop!"
+#define TCPF "Failed to create all threads for parallel loops!"
 
 
 
@@ -255,63 +289,303 @@ void	  Warning(CONST char *mes)
 
 
 /*==========================================================================*/
-#if (HAS_MALLINFO && EBTDEBUG(5))
-#define SKIP_CALLS	10
-static long unsigned	call_nr = 0L;
-struct mallinfo		malloc_info;
-#endif /* HAS_MALLINFO */
+/*
+ * Memory blocks are 64-byte aligned and preceded by a header of MEM_ALIGN
+ * bytes. Their capacities are taken from the geometric series 64, 96, 128,
+ * 192, 256, ... bytes, such that buffers that grow in steps reallocate only
+ * a logarithmic number of times. Freed blocks are kept in a pool per
+ * capacity class and reused by later requests. MemTrim(), called once per
+ * cohort cycle, returns blocks to the system that have not been reused for
+ * MEM_IDLE_CYCLES cycles. The allocator is not thread-safe and should only
+ * be called from the thread of the run. With REENTRANT equal to 1 every
+ * thread has its own pool, which MemFreeAll() releases at the end.
+ */
 
-void	*Myalloc(void *pnt, size_t count, size_t eltsize)
+#define MEM_CLASSES	96			/* Number of capacity classes*/
+
+typedef struct memblock
+{
+  struct memblock	*next;			/* Next block in the list   */
+  struct memblock	*prev;			/* Previous block in use    */
+  size_t		size;			/* Bytes requested	    */
+  int			klass;			/* Capacity class	    */
+  int			idle;			/* Cycles spent in the pool */
+} memblock;
+
+#define MemHeader(p)	((memblock *)((char *)(p) - MEM_ALIGN))
+#define MemData(h)	((void *)((char *)(h) + MEM_ALIGN))
+#define MemCapacity(k)	(((size_t)(((k)%2) ? 96 : 64)) << ((k)/2))
+
+static EBTSTATE memblock		*MemPool[MEM_CLASSES];	/* Free blocks per class    */
+static EBTSTATE memblock		*MemUsed = NULL;	/* Blocks in use	    */
+static EBTSTATE size_t	MemInUse   = 0;		/* Bytes in blocks in use   */
+static EBTSTATE size_t	MemPooled  = 0;		/* Bytes in pooled blocks   */
+static EBTSTATE size_t	MemPeakUse = 0;		/* High-water mark of use   */
+static EBTSTATE size_t	MemPeakSys = 0;		/* High-water mark of total */
+static EBTSTATE long unsigned	MemSysCalls = 0L;	/* Allocations from system  */
+static EBTSTATE long unsigned	MemPoolHits = 0L;	/* Allocations from pool    */
+
+
+
+static int	MemClass(size_t size)
 
   /*
-   * Myalloc - Replacement routine for the 'calloc()' and 'realloc()'
-   *	       functions.  Allocates or reallocates memory and sets it to 0.
-   *	       Implemented to watch memory use.
+   * MemClass - Returns the smallest capacity class that can hold a block
+   *		of the given size in bytes.
+   */
+
+{
+  register int		k = 0;
+
+  while ((k < MEM_CLASSES) && (MemCapacity(k) < size)) k++;
+
+  return k;
+}
+
+
+
+static memblock	*MemGet(int k)
+
+  /*
+   * MemGet - Returns a block of capacity class k, taken from the pool if
+   *	      possible and otherwise allocated from the system.
    */
 
 {
-  size_t		size;
-  void			*value;
+  size_t		bytes = MemCapacity(k) + MEM_ALIGN;
+  memblock		*head = NULL;
 
-#if (HAS_MALLINFO && EBTDEBUG(5))
-  call_nr++;
-  if (!(call_nr%SKIP_CALLS))
+  if (MemPool[k])
     {
-      malloc_info = mallinfo();
-      (void)fprintf(stderr, "Myalloc #%12ld  in:", call_nr);
-      (void)fprintf(stderr, "\tBlocks free: %8d  total: %8d",
-		    malloc_info.fordblks,
-		    malloc_info.uordblks);
-      (void)fprintf(stderr, "\tChunks free: %8d  Arena: %8d  \n",
-		    malloc_info.ordblks,
-		    malloc_info.arena);
+      head	 = MemPool[k];
+      MemPool[k] = head->next;
+      MemPooled -= MemCapacity(k);
+      MemPoolHits++;
     }
-#endif /* HAS_MALLINFO */
+  else
+    {
+#if (MEM_HUGE_PAGES && HAS_HUGEPAGES)
+      if (bytes >= MEM_HUGE_SIZE)
+	{
+	  if (posix_memalign((void **)&head, (size_t)MEM_HUGE_SIZE, bytes)) head = NULL;
+	  if (head) (void)madvise((void *)head, bytes, MADV_HUGEPAGE);
+	}
+      else
+#endif
+#if defined(_WIN32)
+	head = (memblock *)_aligned_malloc(bytes, MEM_ALIGN);
+#else
+	if (posix_memalign((void **)&head, MEM_ALIGN, bytes)) head = NULL;
+#endif
+      if (!head) return NULL;
+      head->klass = k;
+      MemSysCalls++;
+    }
+  head->prev = NULL;
+  head->next = MemUsed;
+  if (MemUsed) MemUsed->prev = head;
+  MemUsed    = head;
+  MemInUse  += MemCapacity(k);
+  if (MemInUse > MemPeakUse) MemPeakUse = MemInUse;
+  if ((MemInUse + MemPooled) > MemPeakSys) MemPeakSys = MemInUse + MemPooled;
+
+  return head;
+}
+
+
+
+static void	MemRelease(memblock *head)
+
+  /*
+   * MemRelease - Returns a block to the system.
+   */
+
+{
+#if defined(_WIN32)
+  _aligned_free((DEF_TYPE *)head);
+#else
+  free((DEF_TYPE *)head);
+#endif
+
+  return;
+}
+
+
+
+void	*Myalloc(void *pnt, size_t count, size_t eltsize)
+
+  /*
+   * Myalloc - Replacement routine for the 'calloc()' and 'realloc()'
+   *	       functions.  Allocates or reallocates memory and sets the
+   *	       memory beyond the old contents to 0. A reallocated block
+   *	       that still fits in its capacity class is not moved.
+   */
+
+{
+  size_t		size, keep = 0;
+  int			k;
+  memblock		*head, *old = NULL;
 
   size	= count * eltsize;
+  k	= MemClass(size);
+  if (k == MEM_CLASSES) return NULL;
+
   if (pnt)					/* Reallocation call        */
-      value = (void *)realloc((DEF_TYPE *)pnt, (SIZE_TYPE)size);
-  else						/* Allocation call	    */
     {
-      value = (void *)malloc((SIZE_TYPE)size);
-      if (value != NULL) (void)memset((DEF_TYPE *)value, 0, size);
+      old  = MemHeader(pnt);
+      keep = (old->size < size) ? old->size : size;
+      if (old->klass == k)
+	{
+	  if (size > keep) (void)memset((char *)pnt + keep, 0, size - keep);
+	  old->size = size;
+	  return pnt;
+	}
+    }
+
+  head = MemGet(k);
+  if (!head) return NULL;
+  head->size = size;
+  if (keep) (void)memcpy(MemData(head), pnt, keep);
+  (void)memset((char *)MemData(head) + keep, 0, size - keep);
+  if (old) Myfree(pnt);
+
+  return MemData(head);
+}
+
+
+
+void	Myfree(void *pnt)
+
+  /*
+   * Myfree - Returns a block allocated by Myalloc() to the pool.
+   */
+
+{
+  memblock		*head;
+
+  if (!pnt) return;
+
+  head	     = MemHeader(pnt);
+  if (head->prev) head->prev->next = head->next;
+  else MemUsed = head->next;
+  if (head->next) head->next->prev = head->prev;
+  head->idle = 0;
+  head->next = MemPool[head->klass];
+  MemPool[head->klass] = head;
+  MemInUse  -= MemCapacity(head->klass);
+  MemPooled += MemCapacity(head->klass);
+
+  return;
+}
+
+
+
+void	MemFreeAll(void)
+
+  /*
+   * MemFreeAll - Returns all blocks, in use or pooled, to the system. Any
+   *		  memory allocated by Myalloc() is invalid afterwards.
+   */
+
+{
+  register int		k;
+  memblock		*head;
+
+  while ((head = MemUsed))
+    {
+      MemUsed = head->next;
+      MemRelease(head);
+    }
+  for (k = 0; k < MEM_CLASSES; k++)
+    while ((head = MemPool[k]))
+      {
+	MemPool[k] = head->next;
+	MemRelease(head);
+      }
+  MemInUse = MemPooled = 0;
+
+  return;
+}
+
+
+
+long	MemBlocks(long req)
+
+  /*
+   * MemBlocks - Returns the number of elements to allocate for a buffer
+   *		 that should hold more than req elements. The result grows
+   *		 geometrically with req and is at least MEM_BLOCK_SIZE.
+   */
+
+{
+  long			n = MEM_BLOCK_SIZE;
+
+  while (!(req < n))
+    {
+      if (n & (n - 1))				/* 3*2^k -> 4*2^k	    */
+	n = (n/3)*4;
+      else					/* 2^k -> 3*2^(k-1)	    */
+	n = (n/2)*3;
+    }
+
+  return n;
+}
+
+
+
+void	MemTrim(void)
+
+  /*
+   * MemTrim - Routine is called once per cohort cycle and returns pooled
+   *	       blocks to the system that have not been reused for
+   *	       MEM_IDLE_CYCLES cycles.
+   */
+
+{
+  register int		k;
+  memblock		**link, *head;
+
+  for (k = 0; k < MEM_CLASSES; k++)
+    {
+      link = MemPool + k;
+      while ((head = *link))
+	{
+	  if (++(head->idle) > MEM_IDLE_CYCLES)
+	    {
+	      *link	 = head->next;
+	      MemPooled -= MemCapacity(k);
+	      MemRelease(head);
+	    }
+	  else
+	    link = &(head->next);
+	}
     }
 
-#if (HAS_MALLINFO && EBTDEBUG(5))
-  if (!(call_nr%SKIP_CALLS))
+  if (EBTDEBUG(5))
     {
-      malloc_info = mallinfo();
-      (void)fprintf(stderr, "Myalloc #%12ld out:", call_nr);
-      (void)fprintf(stderr, "\tBlocks free: %8d  total: %8d",
-		    malloc_info.fordblks,
-		    malloc_info.uordblks);
-      (void)fprintf(stderr, "\tChunks free: %8d  Arena: %8d  \n",
-		    malloc_info.ordblks,
-		    malloc_info.arena);
+      (void)fprintf(dbgfil, "Memory: T = %15.8f   in use: %12lu  pooled: %12lu  peak use: %12lu  peak total: %12lu\n",
+		    env[0], (long unsigned)MemInUse, (long unsigned)MemPooled,
+		    (long unsigned)MemPeakUse, (long unsigned)MemPeakSys);
     }
-#endif /* HAS_MALLINFO */
 
-  return value;
+  return;
+}
+
+
+
+void	MemReport(FILE *fp)
+
+  /*
+   * MemReport - Writes the high-water marks of the memory use to file.
+   */
+
+{
+  (void)fprintf(fp, "Memory high-water mark in use : %12lu bytes\n", (long unsigned)MemPeakUse);
+  (void)fprintf(fp, "Memory high-water mark total  : %12lu bytes\n", (long unsigned)MemPeakSys);
+  (void)fprintf(fp, "System allocations            : %12lu\n", MemSysCalls);
+  (void)fprintf(fp, "Allocations served from pool  : %12lu\n", MemPoolHits);
+
+  return;
 }
 
 
@@ -520,9 +794,300 @@ static void	  WriteBinStateToFile(FILE *fp)
 }
 
 
+
+
+/*==========================================================================*/
+
+static void	  WriteColStateToFile(FILE *fp)
+
+/*
+ * WriteColStateToFile - Routine writes the entire state of the populations
+ *			 and the environment to the indexed CSB file pointed
+ *			 to by fp (see ebtcsbdefs.h). The state is composed
+ *			 in memory, with the cohort values transposed into
+ *			 aligned columns, and written at once.
+ */
+
+{
+  register int		i, j, k;
+  uint64_t		size, envsize, lblsize[POPULATION_NR], stride[POPULATION_NR];
+  char			*buf, *blk;
+  Csbstate		*cst;
+  Csbpop		*cpp;
+  double		*col;
+  int			writeOK;
+
+  envsize = CSB_PADDED(ENVIRON_DIM*sizeof(double));
+  size	  = sizeof(Csbstate) + envsize;
+  for (i=0; i<POPULATION_NR; i++)
+    {
+      lblsize[i] = CSB_PADDED(strlen(statelabels[i])+1);
+      stride[i]	 = CSB_PADDED(CohortNo[i]*sizeof(double));
+      size	+= sizeof(Csbpop) + lblsize[i] + (COHORT_SIZE+I_CONST_DIM)*stride[i];
+    }
+
+  buf = (char *)Myalloc(NULL, (size_t)size, sizeof(char));
+  if (!buf)
+    {
+      writeOK = 0;
+    }
+  else
+    {
+      cst		= (Csbstate *)buf;
+      cst->timeval	= env[0];
+      cst->state_size	= size;
+      cst->environ_dim	= ENVIRON_DIM;
+      cst->population_nr= POPULATION_NR;
+      cst->env_offset	= sizeof(Csbstate);
+      (void)memcpy(buf + sizeof(Csbstate), (void *)env, ENVIRON_DIM*sizeof(double));
+
+      blk = buf + sizeof(Csbstate) + envsize;
+      for (i=0; i<POPULATION_NR; i++)
+	{
+	  cpp		   = (Csbpop *)blk;
+	  cpp->timeval	   = env[0];
+	  cpp->population  = i;
+	  cpp->cohorts	   = CohortNo[i];
+	  cpp->columns	   = COHORT_SIZE+I_CONST_DIM;
+	  cpp->label_size  = lblsize[i];
+	  cpp->data_offset = sizeof(Csbpop) + lblsize[i];
+	  cpp->column_stride = stride[i];
+	  cpp->pop_size	   = cpp->data_offset + (COHORT_SIZE+I_CONST_DIM)*stride[i];
+	  (void)strcpy(blk + sizeof(Csbpop), statelabels[i]);
+						/* Cohorts in the order of  */
+	  col = (double *)(blk + cpp->data_offset);/* the original CSB file */
+	  for (k=0; k<COHORT_SIZE; k++, col=(double *)((char *)col + stride[i]))
+	    for (j=0; j<CohortNo[i]; j++) col[j] = pop[i][CohortNo[i]-1-j][k];
+#if (I_CONST_DIM > 0)
+	  for (k=0; k<I_CONST_DIM; k++, col=(double *)((char *)col + stride[i]))
+	    for (j=0; j<CohortNo[i]; j++) col[j] = popIDcard[i][CohortNo[i]-1-j][k];
+#endif
+	  blk += cpp->pop_size;
+	}
+
+      writeOK = (fwrite((void *)buf, 1, (size_t)size, fp) == (size_t)size);
+      Myfree(buf);
+    }
+
+  (void)fflush(fp);				/* Flush the file buffer    */
+
+  if (!writeOK)
+    {
+      Warning(ECSB);
+      (void)fclose(fp);
+      csbfil = NULL;
+    }
+
+  return;
+}
+
+
+
+
+/*==========================================================================*/
+
+void	  AppendStateFile(FILE *fp)
+
+/*
+ * AppendStateFile - Routine prepares the existing CSB file pointed to by
+ *		     fp for appending states. The states are appended in
+ *		     the format of the file and the index at the end of an
+ *		     indexed CSB file is removed, to be written anew when
+ *		     the file is closed.
+ */
+
+{
+  uint32_t		magic = 0;
+  Csbtail		tail;
+  long			end;
+
+  (void)fflush(fp);
+  if (fseek(fp, 0L, SEEK_SET) || (fread((void *)&magic, sizeof(uint32_t), 1, fp) != 1)) magic = 0;
+  if (magic == CSB_MAGIC_KEY) csbversion = 1;
+  else if (magic == CSB_MAGIC_KEY2) csbversion = 2;
+
+  if ((csbversion == 2) && !fseek(fp, 0L, SEEK_END))
+    {
+      end = ftell(fp);
+      if ((end >= (long)(sizeof(Csbhead)+sizeof(Csbtail))) &&
+	  !fseek(fp, end-(long)sizeof(Csbtail), SEEK_SET) &&
+	  (fread((void *)&tail, sizeof(Csbtail), 1, fp) == 1) &&
+	  (tail.magic == CSB_INDEX_KEY) && (tail.index_offset < (uint64_t)end))
+	TruncateFile(fp, (double)tail.index_offset);
+    }
+  (void)fseek(fp, 0L, SEEK_END);
+
+  return;
+}
+
+
+
+
+/*==========================================================================*/
+
+void	  WriteStateIndex(FILE *fp)
+
+/*
+ * WriteStateIndex - Routine writes the index with the time and the offset
+ *		     of every state at the end of the indexed CSB file
+ *		     pointed to by fp, when the file is closed. The states
+ *		     are found by following their sizes from the start of
+ *		     the file, such that states appended by earlier runs
+ *		     and resumed runs are all included. An incomplete state
+ *		     at the end of the file is discarded.
+ */
+
+{
+  Csbhead		head;
+  Csbstate		cst;
+  Csbindex		*index = NULL, pad[CSB_ALIGN/sizeof(Csbindex)];
+  Csbtail		tail;
+  uint64_t		pos, end;
+  size_t		n = 0, nmax = 0, k;
+  int			writeOK = 1;
+
+  if (csbversion != 2) return;
+
+  (void)fflush(fp);
+  if (fseek(fp, 0L, SEEK_END)) return;
+  end = (uint64_t)ftell(fp);
+  if (fseek(fp, 0L, SEEK_SET) || (fread((void *)&head, sizeof(Csbhead), 1, fp) != 1) ||
+      (head.magic != CSB_MAGIC_KEY2))
+    return;
+
+  for (pos=head.data_offset; pos+sizeof(Csbstate)<=end; pos+=cst.state_size)
+    {
+      if (fseek(fp, (long)pos, SEEK_SET) || (fread((void *)&cst, sizeof(Csbstate), 1, fp) != 1)) break;
+      if ((cst.state_size < sizeof(Csbstate)) || (pos+cst.state_size > end)) break;
+      if (n == nmax)
+	{
+	  nmax  = ((2*nmax > MEM_BLOCK_SIZE) ? 2*nmax : MEM_BLOCK_SIZE);
+	  index = (Csbindex *)Myalloc((void *)index, nmax, sizeof(Csbindex));
+	  if (!index) return;
+	}
+      index[n].timeval = cst.timeval;
+      index[n].offset  = pos;
+      n++;
+    }
+  if (pos < end) TruncateFile(fp, (double)pos);
+  (void)fseek(fp, 0L, SEEK_END);
+
+  (void)memset((void *)&tail, 0, sizeof(Csbtail));
+  tail.magic	    = CSB_INDEX_KEY;
+  tail.entry_size   = sizeof(Csbindex);
+  tail.index_offset = pos;
+  tail.states	    = n;
+  if (n) writeOK = (fwrite((void *)index, sizeof(Csbindex), n, fp) == n);
+  k = (CSB_ALIGN/sizeof(Csbindex)) - (n % (CSB_ALIGN/sizeof(Csbindex)));
+  if (writeOK && (k < (CSB_ALIGN/sizeof(Csbindex))))	/* Pad to alignment */
+    {
+      (void)memset((void *)pad, 0, sizeof(pad));
+      writeOK = (fwrite((void *)pad, sizeof(Csbindex), k, fp) == k);
+    }
+  if (writeOK) writeOK = (fwrite((void *)&tail, sizeof(Csbtail), 1, fp) == 1);
+  (void)fflush(fp);
+  Myfree(index);
+
+  if (!writeOK) Warning(ECSB);
+
+  return;
+}
+
+
 #endif // (POPULATION_NR > 0)
 
 
+/*==========================================================================*/
+
+static EBTSTATE time_t	FlushLast = 0;		/* Time of last BOF flush   */
+
+static void	  WriteBinOutput(FILE *fp)
+
+/*
+ * WriteBinOutput - Routine writes the current output in binary format to
+ *		    the BOF file pointed to by fp. The file starts with a
+ *		    header, written before the first output, that contains:
+ *
+ *		    uint32_t	BOF_MAGIC_KEY
+ *		    uint32_t	Number of columns (time plus output variables)
+ *		    uint32_t	PARAMETER_NR
+ *		    uint32_t	DESCRIP_MAX
+ *		    double	Output time interval
+ *		    double	Parameter values
+ *		    char	Run name		(DESCRIP_MAX bytes)
+ *		    char	Column labels		(DESCRIP_MAX bytes each)
+ *
+ *		    Every output is a row of doubles with the time and the
+ *		    output variables. The file is written through a large
+ *		    buffer, which is flushed every flush_int seconds.
+ */
+
+{
+  register int		i;
+  uint32_t		hdr[4];
+  char			label[DESCRIP_MAX];
+  double		row[OUTPUT_VAR_NR+2];
+  int			columns, writeOK = 1;
+  time_t		now;
+
+  columns = exp_output_var_nr()+1;
+  if (bofnew)
+    { // New BOF file: Write header with run name and column labels
+      hdr[0] = BOF_MAGIC_KEY;
+      hdr[1] = columns;
+      hdr[2] = PARAMETER_NR;
+      hdr[3] = DESCRIP_MAX;
+      row[0] = delt_out;
+      writeOK = (fwrite((void *)hdr, sizeof(uint32_t), 4, fp) == 4);
+      if (writeOK)
+	writeOK = (fwrite((void *)row, sizeof(double), 1, fp) == 1);
+#if PARAMETER_NR
+      if (writeOK)
+	writeOK = (fwrite((void *)parameter, sizeof(double), PARAMETER_NR, fp) == PARAMETER_NR);
+#endif
+      (void)memset((void *)label, 0, DESCRIP_MAX);
+      (void)snprintf(label, DESCRIP_MAX, "%.*s", DESCRIP_MAX-1, runname);
+      if (strlen(label) && (label[strlen(label)-1] == '.')) label[strlen(label)-1] = '\0';
+      if (writeOK)
+	writeOK = (fwrite((void *)label, 1, DESCRIP_MAX, fp) == DESCRIP_MAX);
+      (void)memset((void *)label, 0, DESCRIP_MAX);
+      (void)strcpy(label, "Time");
+      if (writeOK)
+	writeOK = (fwrite((void *)label, 1, DESCRIP_MAX, fp) == DESCRIP_MAX);
+      for (i=0; (i<columns-1) && writeOK; i++)
+	{
+	  (void)memset((void *)label, 0, DESCRIP_MAX);
+	  (void)snprintf(label, DESCRIP_MAX, "%.*s", DESCRIP_MAX-1, outputlabels[i]);
+	  writeOK = (fwrite((void *)label, 1, DESCRIP_MAX, fp) == DESCRIP_MAX);
+	}
+      bofnew = 0;
+    }
+
+  row[0] = env[0];
+  for (i=0; i<columns-1; i++) row[i+1] = output[i];
+  if (writeOK)
+    writeOK = (fwrite((void *)row, sizeof(double), columns, fp) == (size_t)columns);
+
+  now = time(NULL);
+  if (writeOK && (difftime(now, FlushLast) >= flush_int))
+    {
+      writeOK = (fflush(fp) == 0);		/* Flush the file buffer    */
+      FlushLast = now;
+    }
+
+  if (!writeOK)
+    {
+      Warning(EBOF);
+      (void)fclose(fp);
+      resfil = NULL;
+    }
+
+  return;
+}
+
+
+
+
 /*==========================================================================*/
 
 void	  FileOut()
@@ -537,6 +1102,9 @@ void	  FileOut()
   register int		i;
 
   for(i=0; i<OUTPUT_VAR_NR; i++) output[i]=0.0;
+#if ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+  ShowDormant();				/* Include dormant cohorts  */
+#endif
 #if (POPULATION_NR > 0)
   for(i=0; i<POPULATION_NR; i++) cohort_no[i] = CohortNo[i];
 #endif // (POPULATION_NR > 0)
@@ -552,16 +1120,26 @@ void	  FileOut()
   output[OUTPUT_VAR_NR] = parameter[BifParIndex];
 #endif // (BIFURCATION == 1)
 
-  (void)fprintf(resfil, "%.2f", env[0]);
-  for(i=0; i<exp_output_var_nr(); i++)
+  if (resfil && BinaryOut) WriteBinOutput(resfil);
+  else if (resfil)
     {
-      (void)fprintf(resfil, "\t");
-      PrettyPrint(resfil, output[i]);
+      (void)fprintf(resfil, "%.2f", env[0]);
+      for(i=0; i<exp_output_var_nr(); i++)
+	{
+	  (void)fprintf(resfil, "\t");
+	  PrettyPrint(resfil, output[i]);
+	}
+      (void)fprintf(resfil, "\n"); (void)fflush(resfil);
     }
-  (void)fprintf(resfil, "\n"); (void)fflush(resfil);
 
   for(i=exp_output_var_nr(); i>0; i--) output[i] = output[i-1];
   output[0] = env[0];
+#ifdef MODULE
+  if (OutputHook) OutputHook(NORMAL_OUT, OutputHookArg);
+#endif
+#if ((POPULATION_NR > 0) && (DORMANT_COHORTS == 1))
+  HideDormant();
+#endif
 
   return;
 }
@@ -580,11 +1158,40 @@ void	  FileState()
    */
 
 {
+  register int		i;
   uint32_t		tmpint32;
   int			tmpint;
   int			writeOK = 1;
+  Csbhead		head;
+  double		pad[CSB_ALIGN/sizeof(double)];
 
-  if (csbfil && csbnew)
+#if (DORMANT_COHORTS == 1)
+  ShowDormant();				/* Include dormant cohorts  */
+#endif
+  if (csbfil && csbnew && (csbversion == 2))
+    { // New indexed CSB file: Write header and parameters
+      (void)memset((void *)&head, 0, sizeof(Csbhead));
+      head.magic	 = CSB_MAGIC_KEY2;
+      head.version	 = 2;
+      head.parameter_nr	 = PARAMETER_NR;
+      head.environ_dim	 = ENVIRON_DIM;
+      head.population_nr = POPULATION_NR;
+      head.columns	 = COHORT_SIZE+I_CONST_DIM;
+      head.data_offset	 = sizeof(Csbhead) + CSB_PADDED(PARAMETER_NR*sizeof(double));
+      writeOK = (fwrite((void *)&head, sizeof(Csbhead), 1, csbfil) == 1);
+      (void)memset((void *)pad, 0, CSB_ALIGN);
+      for (i=0; (i<PARAMETER_NR) && writeOK; i++)
+	{
+	  pad[i % (CSB_ALIGN/sizeof(double))] = parameter[i];
+	  if ((i == PARAMETER_NR-1) || !((i+1) % (CSB_ALIGN/sizeof(double))))
+	    {
+	      writeOK = (fwrite((void *)pad, 1, CSB_ALIGN, csbfil) == CSB_ALIGN);
+	      (void)memset((void *)pad, 0, CSB_ALIGN);
+	    }
+	}
+      csbnew = 0;
+    }
+  else if (csbfil && csbnew)
     { // New CSB file: Write magic key and parameters
       tmpint32 = CSB_MAGIC_KEY;
       writeOK = (fwrite((void *)(&tmpint32), 1, sizeof(uint32_t), csbfil) == sizeof(uint32_t));
@@ -602,7 +1209,15 @@ void	  FileState()
       (void)fclose(csbfil);
       csbfil = NULL;
     }
-  if (csbfil) WriteBinStateToFile(csbfil);	/* Append state to .csb file*/
+  if (csbfil && (csbversion == 2))		/* Append state to .csb file*/
+    WriteColStateToFile(csbfil);
+  else if (csbfil) WriteBinStateToFile(csbfil);
+#ifdef MODULE
+  if (OutputHook) OutputHook(STATE_OUT, OutputHookArg);
+#endif
+#if (DORMANT_COHORTS == 1)
+  HideDormant();
+#endif
 
   return;
 }
@@ -665,19 +1280,90 @@ int	AddCohorts(population *pop, int popnr, int cohnr)
 
 
 
+/*==========================================================================*/
+
+int	ForcingKnots(int k)
+
+  /*
+   * ForcingKnots - Routine returns the number of knots in forcing table
+   *		    "k" given to the current run, or 0 if it has none. The
+   *		    problem-specific routines only use Forcing() in the
+   *		    former case and their own forcing otherwise.
+   */
+
+{
+  if ((k < 0) || (k >= FORCING_NR) || !forcing_table[k]) return 0;
+
+  return forcing_knots[k];
+}
+
+
+
+double	Forcing(int k, double t)
+
+  /*
+   * Forcing - Routine returns the value of forcing table "k" at time "t",
+   *	       interpolating linearly between the knots as the splines
+   *	       written by get_EBT.m. The table holds the time and value of
+   *	       every knot in order of increasing time.
+   */
+
+{
+  register int		i, n;
+  const double		*tab;
+
+  n = ForcingKnots(k);
+  if (!n) return 0.0;
+  tab = forcing_table[k];
+  if (n == 1) return tab[1];
+
+  for (i=n-2; i>0; i--)
+    if (t - tab[2*i] >= 0) break;
+
+  return tab[2*i+1] + (t - tab[2*i])*(tab[2*i+3] - tab[2*i+1])/(tab[2*i+2] - tab[2*i]);
+}
+
+
+
+double	ForcingMax(int k, double t0, double t1)
+
+  /*
+   * ForcingMax - Routine returns the largest value of forcing table "k"
+   *		  between the times "t0" and "t1". With the linear
+   *		  interpolation of Forcing() it is found at one of the two
+   *		  times or at a knot in between.
+   */
+
+{
+  register int		i, n;
+  const double		*tab;
+  double		val, tmp;
+
+  val = Forcing(k, t0);
+  tmp = Forcing(k, t1);
+  if (tmp > val) val = tmp;
+
+  n   = ForcingKnots(k);
+  tab = forcing_table[k];
+  for (i=0; i<n; i++)
+    if ((tab[2*i] > t0) && (tab[2*i] < t1) && (tab[2*i+1] > val)) val = tab[2*i+1];
+
+  return val;
+}
+
+
+
+
 /*==========================================================================*/
 #if (POPULATION_NR > 0)
 void LabelState(int popnr, const char *fmt, ...)
 
 {
   va_list		argpnt;
-  char			tmpbuf[1024];
 
   va_start(argpnt, fmt);
-  vsprintf(tmpbuf, fmt, argpnt);
+  (void)vsnprintf(statelabels[popnr], DESCRIP_MAX, fmt, argpnt);
   va_end(argpnt);
-  strncpy(statelabels[popnr], tmpbuf, (DESCRIP_MAX-1)*sizeof(char));
-  statelabels[popnr][DESCRIP_MAX-1] = '\0';
 
   return;
 } /* LabelState */
@@ -685,11 +1371,36 @@ void LabelState(int popnr, const char *fmt, ...)
 #endif
 
 
+
+/*==========================================================================*/
+
+void LabelOutput(int varnr, const char *fmt, ...)
+
+  /*
+   * LabelOutput - Routine sets the label of output variable "varnr" (the
+   *		   index in the output array of DefineOutput()) that is
+   *		   written to the header of the BOF file. Can be called by
+   *		   the user in the routine UserInit().
+   */
+
+{
+  va_list		argpnt;
+
+  if ((varnr < 0) || (varnr >= OUTPUT_VAR_NR)) return;
+
+  va_start(argpnt, fmt);
+  (void)vsnprintf(outputlabels[varnr], DESCRIP_MAX, fmt, argpnt);
+  va_end(argpnt);
+
+  return;
+} /* LabelOutput */
+
+
 /*==========================================================================*/
 #if (BIFURCATION == 1)
 
-static double		next_bif_output;
-static int		DoBifOutput = 0;
+static EBTSTATE double	next_bif_output;
+static EBTSTATE int	DoBifOutput = 0;
 
 #if (MEASUREBIFSTATS == 1)
 #include "ebtbifstats.c"
@@ -698,7 +1409,7 @@ static int		DoBifOutput = 0;
 void	SetBifOutputTimes(double *env)
 
 {
-  static int			first = 1;
+  static EBTSTATE int		first = 1;
 
   // At start no (state) output
   if (first)
@@ -753,4 +1464,332 @@ void	SetBifOutputTimes(double *env)
 
 
 
+/*==========================================================================*/
+/*
+ * The thread pool of the parallel loops. The threads are created on the
+ * first call to ParallelFor() or ParallelSum() with more than one block
+ * and wait for the next loop in between, first spinning for a short while,
+ * such that dispatching the loops of the successive stages of an
+ * integration step costs little, and then blocking. With REENTRANT equal
+ * to 1 the threads of the pool can not reach the state of the run, such
+ * that the loops are executed by the thread of the run itself.
+ */
+
+#if (REENTRANT == 1)
+#define PAR_POOL	0
+#else
+#define PAR_POOL	HAS_PTHREADS
+#endif
+#define PAR_MAXTHREADS	64			/* Maximum number of threads*/
+#define PAR_SPIN	20000			/* Spin count before waiting*/
+
+static EBTSTATE int	par_threads = 0;	/* Threads, including main  */
+#if PAR_POOL
+static EBTSTATE int	par_spin = PAR_SPIN;	/* Spin count before waiting*/
+#endif
+static EBTSTATE int	par_nblk, par_blksize, par_n, par_m;
+static EBTSTATE void	(*par_for)(int, int, void *);
+static EBTSTATE void	(*par_sum)(int, int, void *, double *);
+static EBTSTATE void	*par_arg;
+static EBTSTATE double	*par_part = NULL;
+static EBTSTATE long	par_partsize = 0L;
+
+#if PAR_POOL
+static pthread_mutex_t	par_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	par_wake  = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	par_done  = PTHREAD_COND_INITIALIZER;
+static EBTSTATE volatile long	par_gen	  = 0L;		/* Number of the loop	    */
+static EBTSTATE volatile int	par_next;		/* Next block to process    */
+static EBTSTATE volatile int	par_busy;		/* Threads still busy	    */
+#endif
+
+
+
+static void	ParallelBlock(int b)
+
+  /*
+   * ParallelBlock - Processes block b of the current loop.
+   */
+
+{
+  int			lo, hi, j;
+  double		*part;
+
+  lo = b*par_blksize;
+  hi = (par_n - lo < par_blksize) ? par_n : lo + par_blksize;
+
+  if (par_sum)
+    {
+      part = par_part + b*par_m;
+      for (j=0; j<par_m; j++) part[j] = 0.0;
+      (*par_sum)(lo, hi, par_arg, part);
+    }
+  else
+    (*par_for)(lo, hi, par_arg);
+
+  return;
+}
+
+
+
+#if PAR_POOL
+static void	ParallelRun(void)
+
+  /*
+   * ParallelRun - Processes blocks of the current loop until none are
+   *		   left.
+   */
+
+{
+  int			b;
+
+  while ((b = __atomic_fetch_add(&par_next, 1, __ATOMIC_ACQ_REL)) < par_nblk)
+    ParallelBlock(b);
+
+  return;
+}
+
+
+
+static void	*ParallelWorker(void *arg)
+
+  /*
+   * ParallelWorker - The routine executed by the threads of the pool.
+   */
+
+{
+  long			gen = 0L;
+  int			k;
+
+  for (;;)
+    {
+      for (k=0; (k<par_spin) &&
+	     (__atomic_load_n(&par_gen, __ATOMIC_ACQUIRE) == gen); k++);
+      if (__atomic_load_n(&par_gen, __ATOMIC_ACQUIRE) == gen)
+	{
+	  (void)pthread_mutex_lock(&par_mutex);
+	  while (__atomic_load_n(&par_gen, __ATOMIC_ACQUIRE) == gen)
+	    (void)pthread_cond_wait(&par_wake, &par_mutex);
+	  (void)pthread_mutex_unlock(&par_mutex);
+	}
+      gen = __atomic_load_n(&par_gen, __ATOMIC_ACQUIRE);
+
+      ParallelRun();
+
+      if (__atomic_sub_fetch(&par_busy, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+	  (void)pthread_mutex_lock(&par_mutex);
+	  (void)pthread_cond_signal(&par_done);
+	  (void)pthread_mutex_unlock(&par_mutex);
+	}
+    }
+
+  return arg;
+}
+#endif // PAR_POOL
+
+
+
+int	ParallelThreads(void)
+
+  /*
+   * ParallelThreads - Returns the number of threads used in the parallel
+   *		       loops, creating the pool if necessary. The number is
+   *		       set with the command line option -t; by default all
+   *		       processors are used.
+   */
+
+{
+#if PAR_POOL
+  pthread_t		tid;
+  sigset_t		all, old;
+  int			i;
+  long			cpus;
+#endif
+
+  if (par_threads) return par_threads;
+
+  par_threads = 1;
+#if PAR_POOL
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus < 1) cpus = 1;
+  par_threads = (thread_nr > 0) ? thread_nr : (int)cpus;
+  par_threads = imin(par_threads, PAR_MAXTHREADS);
+  // Spinning threads would take the processors of the busy ones
+  if (par_threads > cpus) par_spin = 0;
+
+  // The threads of the pool should not receive the asynchronous signals
+  (void)sigfillset(&all);
+  (void)sigdelset(&all, SIGFPE);
+  (void)sigdelset(&all, SIGSEGV);
+  (void)sigdelset(&all, SIGBUS);
+  (void)sigdelset(&all, SIGILL);
+  (void)pthread_sigmask(SIG_BLOCK, &all, &old);
+  for (i=1; i<par_threads; i++)
+    {
+      if (pthread_create(&tid, NULL, ParallelWorker, NULL))
+	{
+	  Warning(TCPF);
+	  par_threads = i;
+	  break;
+	}
+      (void)pthread_detach(tid);
+    }
+  (void)pthread_sigmask(SIG_SETMASK, &old, NULL);
+#endif
+
+  if (EBTDEBUG(1))
+    (void)fprintf(dbgfil, "Number of threads in parallel loops: %d\n",
+		  par_threads);
+
+  return par_threads;
+}
+
+
+
+static void	ParallelLoop(int n, int blksize)
+
+  /*
+   * ParallelLoop - Executes the loop set up by ParallelForBlocks() or
+   *		    ParallelSumBlocks(), in parallel if it consists of more
+   *		    than one block.
+   */
+
+{
+  int			b;
+#if PAR_POOL
+  int			k;
+#endif
+
+  par_n	      = n;
+  par_blksize = blksize;
+  par_nblk    = (n + blksize - 1)/blksize;
+
+  if (par_sum && (par_nblk*par_m > par_partsize))
+    {
+      par_partsize = MemBlocks(par_nblk*par_m);
+      par_part = (double *)Myalloc((void *)par_part, (size_t)par_partsize,
+				   sizeof(double));
+      if (!par_part) ErrorAbort(MAFP);
+    }
+
+#if PAR_POOL
+  if ((par_nblk > 1) && (ParallelThreads() > 1))
+    {
+      __atomic_store_n(&par_next, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&par_busy, par_threads - 1, __ATOMIC_RELAXED);
+      (void)pthread_mutex_lock(&par_mutex);
+      __atomic_add_fetch(&par_gen, 1, __ATOMIC_ACQ_REL);
+      (void)pthread_cond_broadcast(&par_wake);
+      (void)pthread_mutex_unlock(&par_mutex);
+
+      ParallelRun();
+
+      for (k=0; (k<par_spin) && __atomic_load_n(&par_busy, __ATOMIC_ACQUIRE); k++);
+      if (__atomic_load_n(&par_busy, __ATOMIC_ACQUIRE))
+	{
+	  (void)pthread_mutex_lock(&par_mutex);
+	  while (__atomic_load_n(&par_busy, __ATOMIC_ACQUIRE))
+	    (void)pthread_cond_wait(&par_done, &par_mutex);
+	  (void)pthread_mutex_unlock(&par_mutex);
+	}
+      return;
+    }
+#endif
+
+  for (b=0; b<par_nblk; b++) ParallelBlock(b);
+
+  return;
+}
+
+
+
+void	ParallelForBlocks(int n, int blksize, void (*body)(int, int, void *),
+			  void *arg)
+
+  /*
+   * ParallelForBlocks - Calls body(lo, hi, arg) for consecutive blocks
+   *		         [lo, hi) of blksize iterations that together cover
+   *		         the iterations 0 to n. The blocks are processed in
+   *		         parallel and in arbitrary order.
+   */
+
+{
+  if (n <= 0) return;
+
+  par_for = body;
+  par_sum = NULL;
+  par_arg = arg;
+  ParallelLoop(n, imax(blksize, 1));
+
+  return;
+}
+
+
+
+void	ParallelSumBlocks(int n, int blksize, int m,
+			  void (*body)(int, int, void *, double *), void *arg,
+			  double *sums)
+
+  /*
+   * ParallelSumBlocks - Calls body(lo, hi, arg, part) for consecutive
+   *		         blocks [lo, hi) of blksize iterations that together
+   *		         cover the iterations 0 to n. The routine body() should
+   *		         add the contributions of the iterations to the m
+   *		         partial sums part[], which are zeroed beforehand. The
+   *		         partial sums of the blocks are added in the order of
+   *		         the blocks and returned in sums[].
+   */
+
+{
+  int			b, j;
+
+  for (j=0; j<m; j++) sums[j] = 0.0;
+  if ((n <= 0) || (m <= 0)) return;
+
+  par_for = NULL;
+  par_sum = body;
+  par_arg = arg;
+  par_m	  = m;
+  ParallelLoop(n, imax(blksize, 1));
+
+  for (b=0; b<par_nblk; b++)
+    for (j=0; j<m; j++) sums[j] += par_part[b*m+j];
+
+  return;
+}
+
+
+
+void	ParallelFor(int n, void (*body)(int, int, void *), void *arg)
+
+  /*
+   * ParallelFor - Parallel loop over n cohorts, in blocks of PAR_BLOCK
+   *		   cohorts (see ParallelForBlocks()).
+   */
+
+{
+  ParallelForBlocks(n, PAR_BLOCK, body, arg);
+
+  return;
+}
+
+
+
+void	ParallelSum(int n, int m, void (*body)(int, int, void *, double *),
+		    void *arg, double *sums)
+
+  /*
+   * ParallelSum - Parallel computation of m sums over n cohorts, in blocks
+   *		   of PAR_BLOCK cohorts (see ParallelSumBlocks()).
+   */
+
+{
+  ParallelSumBlocks(n, PAR_BLOCK, m, body, arg, sums);
+
+  return;
+}
+
+
+
 /*=============================================================================*/
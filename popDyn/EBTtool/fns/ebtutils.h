@@ -39,11 +39,29 @@ EXTERN void                       Warning(const char *);
 EXTERN void                       FileOut(void);
 EXTERN void                       FileState(void);
 EXTERN void                       *Myalloc(void *, size_t, size_t);
+EXTERN void                       Myfree(void *);
+EXTERN long                       MemBlocks(long);
+EXTERN void                       MemTrim(void);
+EXTERN void                       MemFreeAll(void);
+EXTERN void                       MemReport(FILE *);
 EXTERN void                       PrettyPrint(FILE *fp, double output);
 EXTERN void                       WriteStateToFile(FILE *fp, double *data);
 EXTERN void                       kill_shmem(void);
 EXTERN int                        init_shmem(void);
 EXTERN void                       ReportNote(const char *, ...);
+#if (POPULATION_NR > 0)
+EXTERN int                        AddCohorts(population *, int, int);
+EXTERN void                       AppendStateFile(FILE *);
+EXTERN void                       WriteStateIndex(FILE *);
+#endif
+EXTERN int                        ForcingKnots(int);
+EXTERN double                     Forcing(int, double);
+EXTERN double                     ForcingMax(int, double, double);
+EXTERN int                        ParallelThreads(void);
+EXTERN void                       ParallelFor(int, void (*)(int, int, void *), void *);
+EXTERN void                       ParallelSum(int, int, void (*)(int, int, void *, double *), void *, double *);
+EXTERN void                       ParallelForBlocks(int, int, void (*)(int, int, void *), void *);
+EXTERN void                       ParallelSumBlocks(int, int, int, void (*)(int, int, void *, double *), void *, double *);
 #if (BIFURCATION == 1)
 EXTERN void                       SetBifOutputTimes(double *);
 #if (MEASUREBIFSTATS == 1)
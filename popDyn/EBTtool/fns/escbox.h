@@ -32,6 +32,9 @@
 #define CVODE                     98110808
 #define CVBDF                     98110809
 
+#define AOS                       0                                                 // Key values to indicate the cohort layouts in Gradient()
+#define SOA                       1
+
 #define MAXDERS                   20                                                // Max. stages in ODE solver
 
 #if defined(PROBLEMFILE)                                                            // If program header file is defined, include it. 
@@ -86,7 +89,102 @@
 #define CHECK_EXTINCTION          2                                                 // 0: Ignore all tests; 1: Ignore run ending; 2: Test and end run
 #endif
 
+#ifndef JACOBIAN
+#define JACOBIAN                  0                                                 // 1: Problem file defines Jacobian(); 2: Automatic differentiation (ebtad.cpp)
+#endif
+#if (JACOBIAN > 0)
+#undef  BLOCK_JACOBIAN
+#define BLOCK_JACOBIAN            1
+#endif
+
+#ifndef BLOCK_JACOBIAN                                                              // 0: Dense Jacobian; 1: Cohort-block structured Jacobian (RADAU5, CVBDF)
+#define BLOCK_JACOBIAN            ((TIME_METHOD == CVBDF) ? 1 : 0)                  // By default only for CVBDF. Evaluated where tested, such that every
+#endif                                                                              // registry member gets its own value (see INTEGRATOR in ebttint.c)
+
+#ifndef AUTO_SWITCH
+#define AUTO_SWITCH               0                                                 // 1: Switch between DOPRI5 and RADAU5 when stiffness changes
+#endif
+#if (AUTO_SWITCH == 1)
+#undef  SOLVER_REGISTRY
+#define SOLVER_REGISTRY           1
+#endif
+
+#ifndef SOLVER_REGISTRY
+#define SOLVER_REGISTRY           0                                                 // 1: Link all integration methods and select one at run time
+#endif
+
+#ifndef COHORT_LAYOUT
+#define COHORT_LAYOUT             AOS                                               // AOS: Cohort records; SOA: I-state columns in Gradient()
+#endif
+
+#ifndef DORMANT_COHORTS
+#define DORMANT_COHORTS           0                                                 // 1: Skip cohorts declared dormant by DormantCohort()
+#endif
+
+#ifndef COHORT_BUDGET
+#define COHORT_BUDGET             0                                                 // 1: CVF file specifies maximum cohort numbers, kept by SievePop()
+#endif
+
+#ifndef ADAPT_COH_LIMIT
+#define ADAPT_COH_LIMIT           0                                                 // 1: Adapt the cohort limit within bounds given in the CVF file
+#endif
+#if ((ADAPT_COH_LIMIT == 1) && ((POPULATION_NR == 0) || (BIFURCATION == 1) || (DYNAMIC_COHORTS == 1)))
+#error ADAPT_COH_LIMIT requires populations and can not be combined with BIFURCATION or DYNAMIC_COHORTS
+#endif
+
+#ifndef CSB_VERSION
+#define CSB_VERSION               2                                                 // 1: Original CSB format; 2: Indexed format with aligned columns, see ebtcsbdefs.h
+#endif
+
+#ifndef MEM_HUGE_PAGES
+#define MEM_HUGE_PAGES            0                                                 // 1: Back large cohort and solver buffers by transparent huge pages
+#endif
+
+#ifndef PLUGIN
+#define PLUGIN                    0                                                 // 1: Load the problem-specific routines at run time, see LoadModel() in ebtinit.c
+#endif
+
+#ifndef ENSEMBLE
+#define ENSEMBLE                  0                                                 // 1: Build the ensemble driver and server, see EbtEnsemble() in ebtmain.c
+#endif
+#if (ENSEMBLE == 1)                                                                 // The runs of an ensemble use the reentrant library interface
+#ifndef MODULE
+#define MODULE
+#include "ebttooldefs.h"
+#endif
+#undef  REENTRANT
+#define REENTRANT                 1
+#endif
+
+#ifndef REENTRANT
+#define REENTRANT                 0                                                 // 1: Keep the state of a run per thread, see EbtCreate() in ebtmain.c
+#endif
+
+#ifndef PAR_BLOCK
+#define PAR_BLOCK                 256                                               // Cohorts per block in ParallelFor() and ParallelSum()
+#endif
+
+#ifndef FORCING_NR
+#define FORCING_NR                4                                                 // Number of forcing tables a run can be given, see Forcing() in ebtutils.c
+#endif
+
 #include "ebttune.h"
+
+#if (REENTRANT == 1)                                                                // Storage class of the state of a run
+#define EBTSTATE                  THREAD_LOCAL
+#if !defined(THREAD_LOCAL)
+#error REENTRANT requires thread-local storage, define THREAD_LOCAL for this compiler
+#endif
+#if !HAS_PTHREADS
+#error REENTRANT requires POSIX threads
+#endif
+#else
+#define EBTSTATE
+#endif
+#if ((PLUGIN == 1) && !HAS_DLOPEN)
+#error PLUGIN requires dlopen()
+#endif
+
 #include "ctype.h"
 #include "math.h"
 #include "stdio.h"
@@ -150,7 +248,14 @@
 
 #define REPORTNOTE_MAX            4096                                              // The maximum length of a ReportNote             
 
-#define MEM_BLOCK_SIZE            256                                               // Number of doubles in allocated memory block   
+#define BOF_BUFFER                (1L << 16)                                        // Size in bytes of the write buffer of the BOF file
+
+#define MEM_BLOCK_SIZE            256                                               // Minimum number of doubles in allocated memory block
+#define MEM_ALIGN                 64                                                // Alignment in bytes of allocated memory blocks
+#define MEM_HUGE_SIZE             (1L << 21)                                        // Minimum size in bytes of huge page blocks
+#ifndef MEM_IDLE_CYCLES
+#define MEM_IDLE_CYCLES           16                                                // Cohort cycles that freed memory is kept pooled
+#endif
 #define SMALLEST_STEP             1.0E-12                                           // The minimum step size allowed in integration   
 #define DEFAULT_STEP              0.1                                               // Default step size in integration              
 #ifndef LARGEST_STEP
@@ -203,8 +308,23 @@ typedef cohort_ind_pnt            population_index;
 #define CONST                     const
 #define SIZE_TYPE                 size_t
 
-#define MemBlocks(a)              (((a/MEM_BLOCK_SIZE)+1)*MEM_BLOCK_SIZE)
+#define MemExcess(a, b)           (((b) > MEM_BLOCK_SIZE) && (4*(a) < (b)))         // Allocated memory b exceeds 4 times the need a
 #define EBTDEBUG(a)               (dbgfil && (debug_level >= (a)))
+#define ExchangeVar(d, n, l, v)   { if (d) { if (l) (v) = (d)[n]; else (d)[n] = (double)(v); } (n)++; } // Checkpoint v as d[n]
+
+/*
+ * Access to i-state k of internal cohort i (COHORT_VAR) and boundary cohort i
+ * (BPOINT_VAR) of population p in the routine Gradient(). With COHORT_LAYOUT
+ * equal to SOA Gradient() receives every i-state of a population as a
+ * contiguous column, such that loops over the cohorts can be vectorized.
+ */
+#if (COHORT_LAYOUT == SOA)
+#define COHORT_VAR(pp, p, i, k)   (((double *)((pp)[p]))[(k)*cohort_no[p] + (i)])
+#define BPOINT_VAR(pp, p, i, k)   (((double *)((pp)[p]))[(k)*bpoint_no[p] + (i)])
+#else
+#define COHORT_VAR(pp, p, i, k)   ((pp)[p][i][k])
+#define BPOINT_VAR(pp, p, i, k)   ((pp)[p][i][k])
+#endif
 
 
 /*==================================================================================================================================*/
@@ -217,31 +337,34 @@ typedef cohort_ind_pnt            population_index;
 #define CycleStart                SetBpointNo
 #define CycleEnd                  InstantDynamics
 
-extern double                     cohort_limit;
-extern double                     next_output, next_state_output;
+extern EBTSTATE double            cohort_limit;
+extern EBTSTATE double            next_output, next_state_output;
 #if (POPULATION_NR > 0)
-extern int                        cohort_no[POPULATION_NR];
-extern int                        bpoint_no[POPULATION_NR];
+extern EBTSTATE int               cohort_no[POPULATION_NR];
+extern EBTSTATE int               bpoint_no[POPULATION_NR];
 #endif // (POPULATION_NR > 0)
-extern int                        rk_level;
-extern int                        ForcedCohortEnd;
-extern int                        ForcedRunEnd;
-extern int                        LocatedEvent;
-extern int                        parameter_nr;
+extern EBTSTATE int               rk_level;
+extern EBTSTATE int               ForcedCohortEnd;
+extern EBTSTATE int               ForcedRunEnd;
+extern EBTSTATE int               LocatedEvent;
+extern EBTSTATE int               parameter_nr;
 #if PARAMETER_NR
-extern double                     parameter[PARAMETER_NR];
+extern EBTSTATE double            parameter[PARAMETER_NR];
 #endif
 #if (BIFURCATION == 1)
-extern int                        BifParIndex;
-extern double                     BifOutput;
-extern double                     BifStateOutput;
-extern double                     BifPeriod;
+extern EBTSTATE int               BifParIndex;
+extern EBTSTATE double            BifOutput;
+extern EBTSTATE double            BifStateOutput;
+extern EBTSTATE double            BifPeriod;
 #endif // (BIFURCATION == 1)
 #if ((POPULATION_NR > 0) && (I_CONST_DIM > 0))
-extern popID                      popIDcard[POPULATION_NR];
-extern popID                      ofsIDcard[POPULATION_NR];
+extern EBTSTATE popID             popIDcard[POPULATION_NR];
+extern EBTSTATE popID             ofsIDcard[POPULATION_NR];
 #endif
 extern int                        AddCohorts(population *, int, int);
+extern int                        ForcingKnots(int);
+extern double                     Forcing(int, double);
+extern double                     ForcingMax(int, double, double);
 
 extern int                        imax(int, int);
 extern int                        imin(int, int);
@@ -261,7 +384,10 @@ extern void                       ErrorExit(const int, const char *);
 extern void                       Warning(const char *);
 extern void                       ReportNote(const char *, ...);
 extern void                       LabelState(int, const char *, ...);
+extern void                       LabelOutput(int, const char *, ...);
 extern void                       measureBifstats(double *env, population *pop);
+extern void                       ParallelFor(int, void (*)(int, int, void *), void *);
+extern void                       ParallelSum(int, int, void (*)(int, int, void *, double *), void *, double *);
 #endif // EBTLIB 
 
 
@@ -285,9 +411,65 @@ EXTERN void                       SetBpointNo(double *, population *, int *);
 EXTERN void                       SetBpoints(double *, population *, population *);
 EXTERN void                       Gradient(double *, population *, population *, double *, population *, population *, population *);
 EXTERN void                       EventLocation(double *, population *, population *, population *, double *);
+EXTERN void                       Jacobian(double *, population *, population *, population *, int, int, double *, double *);
 EXTERN int                        ForceCohortEnd(double *, population *, population *, population *);
 EXTERN void                       InstantDynamics(double *, population *, population *);
 EXTERN void                       DefineOutput(double *, population *, double *);
+EXTERN int                        DormantCohort(double *, population *, int, int, double, double *);
+
+#if (defined(EBTLIB) && (JACOBIAN == 2))
+extern void                       ADJacobian(double *, population *, population *, population *, int, int, double *, double *);
+extern void                       ADGradientSensitivity(double *, population *, population *, population *, int, double *, population *, population *);
+#endif
+
+
+
+/*==================================================================================================================================*/
+/*
+ * With PLUGIN equal to 1 the problem-specific program file is compiled into a shared library, which the program loads at run time.
+ * Models with the same dimensions and settings can thus share the compiled program. The library exports these as the array
+ * EbtModelSignature[], which LoadModel() checks against those of the program. The program calls the routines of the library
+ * through the table ModelRoutines.
+ */
+
+#if (PLUGIN == 1)
+#define EBT_SIGNATURE_NR          10
+#define EBT_MODEL_SIGNATURE       {POPULATION_NR, I_STATE_DIM, I_CONST_DIM, ENVIRON_DIM, OUTPUT_VAR_NR, PARAMETER_NR, EVENT_NR,      \
+                                   BIFURCATION, COHORT_LAYOUT, REENTRANT}
+
+#if defined(EBTLIB)
+typedef struct ebt_routines
+{
+  void                            (*UserInitFn)(int, char **, double *, population *);
+  void                            (*SetBpointNoFn)(double *, population *, int *);
+  void                            (*SetBpointsFn)(double *, population *, population *);
+  void                            (*GradientFn)(double *, population *, population *, double *, population *, population *, population *);
+  void                            (*EventLocationFn)(double *, population *, population *, population *, double *);
+  void                            (*JacobianFn)(double *, population *, population *, population *, int, int, double *, double *);
+  int                             (*ForceCohortEndFn)(double *, population *, population *, population *);
+  void                            (*InstantDynamicsFn)(double *, population *, population *);
+  void                            (*DefineOutputFn)(double *, population *, double *);
+  int                             (*DormantCohortFn)(double *, population *, int, int, double, double *);
+  void                            (*ADJacobianFn)(double *, population *, population *, population *, int, int, double *, double *);
+} ebt_routines;
+
+extern EBTSTATE ebt_routines      ModelRoutines;
+
+#define UserInit                  (*ModelRoutines.UserInitFn)
+#define SetBpointNo               (*ModelRoutines.SetBpointNoFn)
+#define SetBpoints                (*ModelRoutines.SetBpointsFn)
+#define Gradient                  (*ModelRoutines.GradientFn)
+#define EventLocation             (*ModelRoutines.EventLocationFn)
+#define Jacobian                  (*ModelRoutines.JacobianFn)
+#define ForceCohortEnd            (*ModelRoutines.ForceCohortEndFn)
+#define InstantDynamics           (*ModelRoutines.InstantDynamicsFn)
+#define DefineOutput              (*ModelRoutines.DefineOutputFn)
+#define DormantCohort             (*ModelRoutines.DormantCohortFn)
+#define ADJacobian                (*ModelRoutines.ADJacobianFn)
+#elif !defined(__cplusplus)
+const int                         EbtModelSignature[EBT_SIGNATURE_NR] = EBT_MODEL_SIGNATURE;
+#endif // defined(EBTLIB)
+#endif // (PLUGIN == 1)
 
 
 /*==================================================================================================================================*/
@@ -0,0 +1,72 @@
+/***
+  NAME
+    EBTvdpol.c
+    van der Pol oscillator with large damping, a stiff problem without populations.
+    The slow phases are stiff, the fast transitions between them are not.
+***/
+
+#include "escbox.h"
+
+#define time env[0]
+#define y1   env[1]
+#define y2   env[2]
+
+#define eps  parameter[0] /* stiff for eps << 1 */
+
+void UserInit(int argc, char **argv, double *env, population *pop)
+{
+  return;
+}
+
+void SetBpointNo(double *env, population *pop, int *no)
+{
+  return;
+}
+
+void SetBpoints(double *env, population *pop, population *bpoints)
+{
+  return;
+}
+
+void Gradient(double *env, population *pop, population *ofs, double *envgrad,
+              population *popgrad, population *ofsgrad, population *bpoints)
+{
+  envgrad[0] = 1.0;
+  envgrad[1] = y2;
+  envgrad[2] = ((1.0 - y1 * y1) * y2 - y1)/ eps;
+
+  return;
+}
+
+void EventLocation(double *env, population *pop, population *ofs, population *bpoints, double *events)
+{
+  return;
+}
+
+void Jacobian(double *env, population *pop, population *ofs, population *bpoints, int p, int i, double *dfdx, double *dedx)
+{
+  return;
+}
+
+int ForceCohortEnd(double *env, population *pop, population *ofs, population *bpoints)
+{
+  return 0;
+}
+
+void InstantDynamics(double *env, population *pop, population *ofs)
+{
+  return;
+}
+
+void DefineOutput(double *env, population *pop, double *output)
+{
+  output[0] = y1;
+  output[1] = y2;
+
+  return;
+}
+
+int DormantCohort(double *env, population *pop, int p, int i, double horizon, double *rates)
+{
+  return 0;
+}
@@ -0,0 +1,16 @@
+/***
+  NAME
+    test/EBTvdpol.h
+
+  PURPOSE
+    header file of the stiff van der Pol test problem, see autoswitch.sh
+***/
+
+#define POPULATION_NR   0
+#define I_STATE_DIM     0
+#define I_CONST_DIM     0
+#define ENVIRON_DIM     3 /* time, y1, y2 */
+#define OUTPUT_VAR_NR   2 /* y1, y2 */
+#define PARAMETER_NR    1
+#define TIME_METHOD     DOPRI5
+#define AUTO_SWITCH     1 /* switch to RADAU5 when the problem becomes stiff */
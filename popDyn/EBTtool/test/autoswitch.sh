@@ -0,0 +1,31 @@
+#!/bin/sh
+# Test of AUTO_SWITCH: the stiff van der Pol problem in EBTvdpol.c has to make
+# DOPRI5 hand over to RADAU5 in a normal run, i.e. without debug output.
+# Run from popDyn/EBTtool: sh test/autoswitch.sh
+
+set -e
+T=$(mktemp -d)
+trap 'rm -rf "$T"' EXIT
+P="-DPROBLEMFILE=<$PWD/test/EBTvdpol.h>"
+
+for f in ebtmain ebtinit ebtcohrt ebtutils ebtstop; do
+  gcc "$P" -o $T/$f.o -c fns/$f.c
+done
+gcc -IOdesolvers/ "$P" -o $T/ebttint.o -c fns/ebttint.c
+for m in RK2 RK4 RKF45 RKCK DOPRI5 DOPRI8 RADAU5 CVODE CVBDF; do
+  gcc -IOdesolvers/ "$P" -DINTEGRATOR=$m -o $T/ebt$m.o -c fns/ebttint.c
+done
+gcc -I. -I./fns "$P" -o $T/EBTvdpol.o -c test/EBTvdpol.c
+gcc -o $T/EBTvdpol.exe $T/*.o -lm -lpthread -ldl
+
+cp test/EBTvdpol.cvf test/EBTvdpol.isf $T/
+(cd $T && ./EBTvdpol.exe EBTvdpol > log.txt 2>&1)
+
+n=$(sed -n 's/^Integration method switched \([0-9]*\) times.*/\1/p' $T/log.txt)
+if [ -n "$n" ] && [ "$n" -gt 0 ]; then
+  echo "PASS: integration method switched $n times"
+else
+  cat $T/log.txt
+  echo "FAIL: no switch between DOPRI5 and RADAU5"
+  exit 1
+fi
@@ -0,0 +1,37 @@
+%% mexrepeat
+% Test of the MATLAB gateway fns/ebtmex.c: a MEX file stays loaded between
+% calls, so a second call of the gateway must not see anything left behind by
+% the first one and has to give identical output. The stiff van der Pol
+% problem in EBTvdpol.c switches between DOPRI5 and RADAU5, which exercises
+% the state of the integration methods as well.
+% Run from popDyn/EBTtool: run test/mexrepeat
+
+if ispc; error('mexrepeat: the gateway needs POSIX threads, which are not available on Windows'); end
+WD = pwd;
+T = tempname; mkdir(T);
+cleanup = onCleanup(@() rmdir(T, 's'));
+
+flags = {'-DMODULE', '-DREENTRANT=1', ['-DPROBLEMFILE="<', WD, '/test/EBTvdpol.h>"'], '-I.', '-Ifns', '-IOdesolvers'};
+obj = '.o';
+
+objs = {};
+for m = {'RK2', 'RK4', 'RKF45', 'RKCK', 'DOPRI5', 'DOPRI8', 'RADAU5', 'CVODE', 'CVBDF'}
+  mex('-c', flags{:}, ['-DINTEGRATOR=', m{1}], 'fns/ebttint.c', '-outdir', T);
+  movefile(fullfile(T, ['ebttint', obj]), fullfile(T, ['ebt', m{1}, obj]));
+  objs = [objs, {fullfile(T, ['ebt', m{1}, obj])}];
+end
+mex(flags{:}, 'fns/ebtmex.c', 'fns/ebtmain.c', 'fns/ebtinit.c', 'fns/ebttint.c', 'fns/ebtcohrt.c', ...
+    'fns/ebtutils.c', 'fns/ebtstop.c', 'test/EBTvdpol.c', objs{:}, '-lpthread', '-outdir', T, '-output', 'EBTvdpol');
+
+copyfile('test/EBTvdpol.cvf', T); copyfile('test/EBTvdpol.isf', T);
+cd(T);
+out1 = EBTvdpol('EBTvdpol');
+out2 = EBTvdpol('EBTvdpol');
+clear EBTvdpol
+cd(WD);
+
+if ~isempty(out1) && isequal(out1, out2)
+  fprintf('PASS: %d identical output rows in two calls of the gateway\n', size(out1, 1));
+else
+  error('FAIL: the second call of the gateway gives different output');
+end
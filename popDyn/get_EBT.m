@@ -39,6 +39,8 @@ function tXNL23W = get_EBT(model, par, tT, tJX, x_0, V_X, t_max, numPar)
 % * V_X: scalar with volume of reactor
 % * t_max: scalar with time to be simulated
 % * numPar: structure with numerical parameter settings  
+%   optional field MEX: if 1, run EBTtool in-process as MEX function (default 0)
+%   optional field BOF: if 1, EBTtool writes its output in binary format to EBTmod.bof (default 0)
 %
 % Output:
 %
@@ -51,6 +53,10 @@ function tXNL23W = get_EBT(model, par, tT, tJX, x_0, V_X, t_max, numPar)
 % * uses deb/EBTmod.c, which is written in C directly
 % * runs EBTmod.exe in Window's PowerShell, which writes EBTmod.out
 % * reads EBTmod.out for output
+% * with numPar.MEX = 1: compiles EBTmod.mex with fns/ebtmex.c and calls it instead, which
+%   returns the output as array without writing or reading output files;
+%   not on Windows, as the gateway needs POSIX threads (see EBTtool/fns/ebtmex.c)
+% * with numPar.BOF = 1: reads EBTmod.bof with <read_EBT_bof.html *read_EBT_bof*> instead of EBTmod.out
 
   % unpack par and compute compound pars
   vars_pull(par); vars_pull(parscomp_st(par));  
@@ -268,7 +274,8 @@ function tXNL23W = get_EBT(model, par, tT, tJX, x_0, V_X, t_max, numPar)
       
 %% EBTmod.h: header file 
 
-  if strcmp(numPar.TIME_METHOD, 'DOPRI5') || strcmp(numPar.TIME_METHOD, 'DOPRI8') || strcmp(numPar.TIME_METHOD, 'RADAU5')
+  if strcmp(numPar.TIME_METHOD, 'DOPRI5') || strcmp(numPar.TIME_METHOD, 'DOPRI8') || strcmp(numPar.TIME_METHOD, 'RADAU5') ...
+     || strcmp(numPar.TIME_METHOD, 'CVODE') || strcmp(numPar.TIME_METHOD, 'CVBDF')
     switch model
       case {'std','stf','sbp','abp'} % b,p
         n_events = 2;
@@ -304,6 +311,15 @@ function tXNL23W = get_EBT(model, par, tT, tJX, x_0, V_X, t_max, numPar)
   fprintf(oid, '#define TIME_METHOD     %s /* we need events */\n', numPar.TIME_METHOD);
   fprintf(oid, '#define EVENT_NR        %d /* birth, weaning, puberty */\n', n_events);
   fprintf(oid, '#define DYNAMIC_COHORTS 0\n');
+  fprintf(oid, '#define DORMANT_COHORTS 1 /* embryos are set aside during cohort cycles */\n');
+  if strcmp(numPar.TIME_METHOD, 'CVBDF') % not for RADAU5: with the block Jacobian it stops with too small steps on std
+    fprintf(oid, '#define BLOCK_JACOBIAN  1 /* cohorts only interact via food */\n');
+    if strcmp(model, 'std')
+      fprintf(oid, '#define JACOBIAN        1 /* deb/EBTstd.c defines Jacobian() */\n');
+    else
+      fprintf(oid, '#define JACOBIAN        2 /* Jacobian() by automatic differentiation */\n');
+    end
+  end
   fclose(oid);
   
  %% EBTmod.cvf: control variable file 
@@ -365,11 +381,30 @@ function tXNL23W = get_EBT(model, par, tT, tJX, x_0, V_X, t_max, numPar)
   
 %% Delete existing out-file
   
-  delete('*.out')
+  delete('*.out'); delete('*.bof')
 
 %% EBTmod.exe: compile and run EBTtool
 
   WD = cdEBTtool;  
+  AD = strcmp(numPar.TIME_METHOD, 'CVBDF') && ~strcmp(model, 'std');
+  if isfield(numPar, 'MEX') && numPar.MEX % in-process: no process spawn, no out-file
+    if ispc
+      cd(WD);
+      error('get_EBT:MEX', 'numPar.MEX = 1 is not available on Windows: the MEX gateway needs POSIX threads; use numPar.MEX = 0');
+    end
+    src = {'fns/ebtmex.c', 'fns/ebtmain.c', 'fns/ebtinit.c', 'fns/ebttint.c', 'fns/ebtcohrt.c', ...
+           'fns/ebtutils.c', 'fns/ebtstop.c', ['deb/EBT', model, '.c'], '-lpthread'};
+    flags = {'-DMODULE', '-DREENTRANT=1', ['-DPROBLEMFILE="<', pwd, '/deb/EBT', model, '.h>"'], '-I.', '-Ifns', '-IOdesolvers'};
+    if AD % model with dual numbers, see fns/ebtad.cpp
+      mex('-c', flags{:}, ['-DPROGRAMFILE="<', pwd, '/deb/EBT', model, '.c>"'], 'fns/ebtad.cpp');
+      src = [src, {'ebtad.o', '-lstdc++'}];
+    end
+    clear(['EBT', model]); % unload a previous build
+    mex(flags{:}, src{:}, '-output', ['EBT', model]); 
+    tXNL23W = feval(['EBT', model], ['EBT', model]); % output (n,7)-array
+    cd(WD);
+    return
+  end
   if ismac
     txt = ['!gcc -DPROBLEMFILE="<', pwd, '/deb/EBT', model, '.h>"'];
     TXT = ['!gcc -IOdesolvers/ -DPROBLEMFILE="<', pwd, '/deb/EBT', model, '.h>"'];
@@ -381,6 +416,9 @@ function tXNL23W = get_EBT(model, par, tT, tJX, x_0, V_X, t_max, numPar)
     eval([txt, ' -o ebtutils.o -c fns/ebtutils.c']);
     eval([txt, ' -o ebtstop.o  -c fns/ebtstop.c']);
     eval([TxT, ' -o EBT', model, '.o   -c deb/EBT', model, '.c']);
+    if AD % compile the model a second time with dual numbers: fns/ebtad.cpp
+      eval(['!g++ -I. -I./fns -DPROBLEMFILE="<', pwd, '/deb/EBT', model, '.h>" -DPROGRAMFILE="<', pwd, '/deb/EBT', model, '.c>" -o ebtad.o -c fns/ebtad.cpp']);
+    end
   else
     txt = ['!gcc -DPROBLEMFILE="<', pwd, '\deb\EBT', model, '.h>"'];
     TXT = ['!gcc -IOdesolvers\ -DPROBLEMFILE="<', pwd, '\deb\EBT', model, '.h>"'];
@@ -392,18 +430,31 @@ function tXNL23W = get_EBT(model, par, tT, tJX, x_0, V_X, t_max, numPar)
     eval([txt, ' -o ebtutils.o -c fns\ebtutils.c']);
     eval([txt, ' -o ebtstop.o  -c fns\ebtstop.c']);
     eval([TxT, ' -o EBT', model, '.o   -c deb\EBT', model, '.c']);
+    if AD % compile the model a second time with dual numbers: fns/ebtad.cpp
+      eval(['!g++ -I. -I.\fns -DPROBLEMFILE="<', pwd, '\deb\EBT', model, '.h>" -DPROGRAMFILE="<', pwd, '\deb\EBT', model, '.c>" -o ebtad.o -c fns\ebtad.cpp']);
+    end
+  end
+  if AD
+    eval(['!gcc -o EBT', model, '.exe ebtinit.o ebtmain.o ebtcohrt.o ebttint.o ebtutils.o ebtstop.o EBT', model, '.o ebtad.o -lm -lstdc++']); % link o-files in EBTmod.exe
+  else
+    eval(['!gcc -o EBT', model, '.exe ebtinit.o ebtmain.o ebtcohrt.o ebttint.o ebtutils.o ebtstop.o EBT', model, '.o -lm']); % link o-files in EBTmod.exe
   end
-  eval(['!gcc -o EBT', model, '.exe ebtinit.o ebtmain.o ebtcohrt.o ebttint.o ebtutils.o ebtstop.o EBT', model, '.o -lm']); % link o-files in EBTmod.exe
   %delete('*.o')
+  BOF = isfield(numPar, 'BOF') && numPar.BOF; % binary output, flushed every 10 s
+  opts = ''; if BOF; opts = '-b 10 '; end
   if ismac
-    eval(['!./EBT', model, '.exe EBT', model]); % run EBTtool using input files run.cvf and run.isf
+    eval(['!./EBT', model, '.exe ', opts, 'EBT', model]); % run EBTtool using input files run.cvf and run.isf
   else
-    eval(['!.\EBT', model, '.exe EBT', model]); % run EBTtool using input files run.cvf and run.isf
+    eval(['!.\EBT', model, '.exe ', opts, 'EBT', model]); % run EBTtool using input files run.cvf and run.isf
   end
   cd(WD);
   
 %% EBTmod.out: read output variable file 
 
+  if BOF
+    tXNL23W = read_EBT_bof(['EBT', model, '.bof']); % output (n,7)-array
+    return
+  end
   out = fopen(['EBT', model, '.out'], 'r');
   data = fscanf(out,'%e');
   fclose(out);
@@ -413,7 +464,7 @@ function tXNL23W = get_EBT(model, par, tT, tJX, x_0, V_X, t_max, numPar)
   % read report file run.rep
   % read end state file run.esf
   % read complete state output file run.cso
-  % read complete state binary output file run.csb
+  % read complete state binary output file run.csb (and run.esf) with EBTtool/fns/ebtcsbmex.c, e.g. info = ebtcsb('EBTstd.csb')
 
 end
 
@@ -441,12 +492,16 @@ function write_spline(txt, tY)
   % txt: char-string with txt = "TC" or "JX"
   % tY: (n,2)-array with knots
   %
-  % writes files spline_TC.c or spline_JX.c
+  % writes files spline_TC.c or spline_JX.c, which also define spline_txt_max
+  % that function takes two times and returns the largest interpolated value in between
+  % a forcing table given to a run in server mode (0 for TC, 1 for JX) replaces the knots
   
   fnName = ['spline_', txt]; fileName = [fnName, '.c']; n = size(tY, 1);
+  k = find(strcmp(txt, {'TC', 'JX'})) - 1; % index of the forcing table
   oid = fopen(fileName, 'w+'); % open file for writing, delete existing content
   fprintf(oid, 'double %s(double tt)\n', fnName);
   fprintf(oid, '{\n');
+  fprintf(oid, '  if (ForcingKnots(%d)) return Forcing(%d, tt);\n\n', k, k);
   fprintf(oid, '  int i, n; n = %d;\n', n);
   fprintf(oid, '  double t[n+1], %s[n+1];\n\n', txt);
   for i=1:n
@@ -459,6 +514,22 @@ function write_spline(txt, tY)
   fprintf(oid, '      break;\n');
   fprintf(oid, '  }\n\n');
   fprintf(oid, '  return %s[i] + (tt - t[i]) * (%s[i+1] - %s[i])/ (t[i+1] - t[i]);\n\n', txt, txt, txt);
+  fprintf(oid, '}\n\n');
+  fprintf(oid, 'double %s_max(double t0, double t1)\n', fnName);
+  fprintf(oid, '{\n');
+  fprintf(oid, '  if (ForcingKnots(%d)) return ForcingMax(%d, t0, t1);\n\n', k, k);
+  fprintf(oid, '  int i, n; n = %d;\n', n);
+  fprintf(oid, '  double t[n+1], %s[n+1], val, tmp;\n\n', txt);
+  for i=1:n
+  fprintf(oid, '  t[%d] = %5.4g; %s[%d] = %5.4g;\n', i, tY(i,1), txt, i, tY(i,2));
+  end
+  fprintf(oid, '\n');
+  fprintf(oid, '  val = %s(t0); tmp = %s(t1);\n', fnName, fnName);
+  fprintf(oid, '  if (tmp > val) val = tmp;\n');
+  fprintf(oid, '  for (i = 1; i <= n; i++)\n');
+  fprintf(oid, '    if ((t[i] > t0) && (t[i] < t1) && (%s[i] > val))\n', txt);
+  fprintf(oid, '      val = %s[i];\n\n', txt);
+  fprintf(oid, '  return val;\n');
   fprintf(oid, '}\n');
   fclose(oid);
 end
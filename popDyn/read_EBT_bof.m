@@ -0,0 +1,56 @@
+%% read_EBT_bof
+% reads the binary output file of the Escalator Boxcar Train
+
+%%
+function [tOut, labels, info] = read_EBT_bof(fileName)
+
+% created 2026/10/17
+
+%% Syntax
+% [tOut, labels, info] = <../read_EBT_bof.m *read_EBT_bof*> (fileName)
+
+%% Description
+% reads the BOF file that EBTtool writes in place of the out-file with the option -b, called by get_EBT
+%
+% Input:
+%
+% * fileName: character-string with name of the BOF file, e.g. 'EBTstd.bof'
+%
+% Output:
+%
+% * tOut: (n,m)-array with times and output variables, as in the out-file, but in full precision
+% * labels: (1,m) cell-array with the labels of the columns, the first one being 'Time'
+% * info: structure with fields run (run name), delt_out (output time interval) and par (parameter values)
+
+%% Remarks
+% The file starts with a header of 4 uint32: magic key 20261020, number of columns m, number of parameters and label length;
+% followed by the output time interval and the parameter values (doubles), the run name and the column labels (chars).
+% The rows of m doubles follow the header; an incomplete last row of a running or interrupted run is skipped.
+
+  fid = fopen(fileName, 'r', 'ieee-le');
+  if fid < 0
+    error(['read_EBT_bof: cannot open ', fileName]);
+  end
+  hdr = fread(fid, 4, 'uint32=>double');
+  if length(hdr) < 4 || hdr(1) ~= 20261020
+    fclose(fid);
+    error(['read_EBT_bof: ', fileName, ' is not a BOF file']);
+  end
+  m = hdr(2); n_par = hdr(3); n_lbl = hdr(4);
+
+  info.delt_out = fread(fid, 1, 'double');
+  info.par = fread(fid, n_par, 'double');
+  lbl = fread(fid, n_lbl, 'uint8=>char')';
+  info.run = lbl(1:find([lbl, char(0)] == 0, 1) - 1); % strip trailing NULs
+  labels = cell(1, m);
+  for i = 1:m
+    lbl = fread(fid, n_lbl, 'uint8=>char')';
+    labels{i} = lbl(1:find([lbl, char(0)] == 0, 1) - 1);
+  end
+
+  data = fread(fid, Inf, 'double');
+  fclose(fid);
+  n = floor(length(data)/ m);
+  tOut = reshape(data(1:n * m), m, n)'; % output (n,m)-array
+
+end